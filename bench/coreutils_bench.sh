@@ -0,0 +1,85 @@
+#!/bin/sh
+#
+# Coreutils benchmark: times the in-process text utilities of kzsh against
+# the GNU coreutils binaries on large generated files.
+#
+# Usage: coreutils_bench.sh path/to/kzsh [size-MiB]
+#
+# Each case runs once through `kzsh script` (builtin) and once through
+# `sh -c` (external tool). The outputs of both sides are compared first,
+# and the benchmark fails if they differ.
+
+set -eu
+
+KZSH=${1:?usage: coreutils_bench.sh path/to/kzsh [size-MiB]}
+SIZE_MB=${2:-${COREUTILS_BENCH_MB:-64}}
+
+TMP=$(mktemp -d "${TMPDIR:-/tmp}/kzsh-bench.XXXXXX")
+trap 'rm -rf "$TMP"' EXIT INT TERM
+
+now_ns() {
+    date +%s%N
+}
+
+# ~SIZE_MB of mixed text lines, plus a smaller file for sort
+awk -v mb="$SIZE_MB" 'BEGIN {
+    srand(42);
+    target = mb * 1024 * 1024; n = 0; i = 0;
+    while (n < target) {
+        line = sprintf("%d %s%d lorem ipsum dolor sit amet %x", int(rand() * 1000), \
+                       (i % 7 == 0) ? "needle" : "hay", i, int(rand() * 65536));
+        print line; n += length(line) + 1; i++;
+    }
+}' > "$TMP/big.txt"
+head -n 500000 "$TMP/big.txt" > "$TMP/sortable.txt"
+
+cd "$TMP"
+F=big.txt
+S=sortable.txt
+
+status=0
+printf '%-34s %10s %10s %8s\n' "case" "kzsh ms" "gnu ms" "speedup"
+
+bench() {
+    printf '%s\n' "$1" > "$TMP/case.sh"
+    sh -c "$1" > "$TMP/gnu.out" 2>&1 || true
+    "$KZSH" "$TMP/case.sh" > "$TMP/kzsh.out" 2>&1 || true
+    if ! cmp -s "$TMP/kzsh.out" "$TMP/gnu.out"; then
+        echo "MISMATCH: $1" >&2
+        status=1
+        return
+    fi
+
+    # Output goes to a file, not /dev/null: GNU grep stops at the first
+    # match when it detects /dev/null, which would skew the comparison.
+    t0=$(now_ns); "$KZSH" "$TMP/case.sh" > "$TMP/kzsh.out" || true; t1=$(now_ns)
+    sh -c "$1" > "$TMP/gnu.out" || true; t2=$(now_ns)
+    k=$(( (t1 - t0) / 1000000 ))
+    g=$(( (t2 - t1) / 1000000 ))
+    printf '%-34s %10d %10d %7s\n' "$1" "$k" "$g" \
+        "$(awk -v k="$k" -v g="$g" 'BEGIN { printf "%.2fx", (k > 0 ? g / k : 0) }')"
+}
+
+bench "cat $F"
+bench "cat -n $F"
+bench "head -n 100000 $F"
+bench "tail -n 100000 $F"
+bench "cat $F | tail -n 1000"
+bench "wc $F"
+bench "wc -l $F"
+bench "wc -c $F"
+bench "grep -c needle $F"
+bench "grep needle1234 $F"
+bench "grep -v -c lorem $F"
+bench "grep -c -E '^9[0-9]+ hay' $F"
+bench "fgrep -c ipsum $F"
+bench "sort $S"
+bench "sort -n $S"
+bench "sort -k2 $S"
+bench "sort $S | uniq -c"
+bench "cat $F | tr a-z A-Z"
+bench "seq 1 5000000"
+bench "yes | head -c 100000000"
+bench "cat $F | tee tee.out"
+
+exit $status
@@ -0,0 +1,158 @@
+/*
+ * Globbing benchmark: pathglob (src/pathglob.c) against libc glob() on a
+ * generated tree of empty files, d0..dN/f0..fM with N * M files in all.
+ *
+ * Each pattern is timed with libc glob(), with pathglob and an empty
+ * listing cache, and with pathglob again once the cache is warm. The
+ * ** pattern is compared with its one-level glob() equivalent, serially
+ * and on a thread pool. Fails if the two ever disagree on the match count.
+ *
+ * Usage: glob_bench [files] [directory]
+ *   files:     size of the tree (default 1000000)
+ *   directory: where to build it (default $TMPDIR or /tmp); it is kept
+ *              and reused by later runs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+#include "pathglob.h"
+
+#define REPEAT 3
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* Build the tree unless a previous run finished building it */
+static int make_tree(const char *root, long ndirs, long per_dir) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/.complete", root);
+    if (access(path, F_OK) == 0) return 0;
+    if (mkdir(root, 0755) != 0 && errno != EEXIST) {
+        perror(root);
+        return -1;
+    }
+    printf("creating %ld files under %s\n", ndirs * per_dir, root);
+    fflush(stdout);
+    for (long d = 0; d < ndirs; ++d) {
+        snprintf(path, sizeof(path), "%s/d%ld", root, d);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            perror(path);
+            return -1;
+        }
+        int dfd = open(path, O_RDONLY | O_DIRECTORY);
+        if (dfd < 0) {
+            perror(path);
+            return -1;
+        }
+        for (long f = 0; f < per_dir; ++f) {
+            char name[32];
+            snprintf(name, sizeof(name), "f%ld", f);
+            int fd = openat(dfd, name, O_WRONLY | O_CREAT, 0644);
+            if (fd < 0) {
+                perror(name);
+                close(dfd);
+                return -1;
+            }
+            close(fd);
+        }
+        close(dfd);
+    }
+    snprintf(path, sizeof(path), "%s/.complete", root);
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd >= 0) close(fd);
+    /* listings of directories changed within the last second are not cached */
+    sleep(2);
+    return 0;
+}
+
+static size_t run_libc(const char *pattern, double *ms) {
+    size_t n = 0;
+    *ms = 1e30;
+    for (int i = 0; i < REPEAT; ++i) {
+        glob_t g;
+        double t = now_ms();
+        int r = glob(pattern, 0, NULL, &g);
+        t = now_ms() - t;
+        if (t < *ms) *ms = t;
+        n = r == 0 ? g.gl_pathc : 0;
+        if (r == 0) globfree(&g);
+    }
+    return n;
+}
+
+static size_t run_pathglob(const char *pattern, int cold, double *ms) {
+    size_t n = 0;
+    *ms = 1e30;
+    struct arena a;
+    arena_init(&a, ARENA_DEFAULT_CHUNK);
+    for (int i = 0; i < REPEAT; ++i) {
+        if (cold) pathglob_cache_clear();
+        else pathglob(&a, pattern, &n);    /* make sure it is warm */
+        arena_reset(&a);
+        double t = now_ms();
+        pathglob(&a, pattern, &n);
+        t = now_ms() - t;
+        if (t < *ms) *ms = t;
+        arena_reset(&a);
+    }
+    arena_free(&a);
+    return n;
+}
+
+static int compare(const char *pattern, const char *libc_pattern, int threads) {
+    double libc_ms, cold_ms, warm_ms;
+    pathglob_set_threads(threads);
+    size_t expect = run_libc(libc_pattern, &libc_ms);
+    size_t cold = run_pathglob(pattern, 1, &cold_ms);
+    size_t warm = run_pathglob(pattern, 0, &warm_ms);
+    char label[64];
+    snprintf(label, sizeof(label), "%s%s", pattern, threads > 1 ? " (threads)" : "");
+    printf("%-20s %8zu matches   glob() %9.2f ms   pathglob %9.2f ms   cached %9.2f ms\n",
+           label, expect, libc_ms, cold_ms, warm_ms);
+    if (cold != expect || warm != expect) {
+        fprintf(stderr, "glob_bench: %s: pathglob found %zu/%zu matches, glob() %zu\n",
+                pattern, cold, warm, expect);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long files = argc > 1 ? atol(argv[1]) : 1000000;
+    if (files < 1) files = 1;
+    const char *tmp = getenv("TMPDIR");
+    char root[2048];
+    if (argc > 2) snprintf(root, sizeof(root), "%s", argv[2]);
+    else snprintf(root, sizeof(root), "%s/kzsh-glob-bench-%ld", tmp && *tmp ? tmp : "/tmp", files);
+
+    long ndirs = 1;
+    while ((ndirs + 1) * (ndirs + 1) <= files) ndirs++;
+    long per_dir = (files + ndirs - 1) / ndirs;
+    if (make_tree(root, ndirs, per_dir) != 0) return 2;
+    if (chdir(root) != 0) {
+        perror(root);
+        return 2;
+    }
+
+    long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = nproc > 8 ? 8 : nproc > 1 ? (int)nproc : 2;
+    int failed = 0;
+    failed |= compare("d*/f*7", "d*/f*7", 0);
+    failed |= compare("d1*/f[0-4]*", "d1*/f[0-4]*", 0);
+    failed |= compare("d7/f1??", "d7/f1??", 0);
+    failed |= compare("**/f*77", "*/f*77", 0);
+    failed |= compare("**/f*77", "*/f*77", threads);
+    return failed;
+}
@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Control flow benchmark: times loops, case statements and function calls
+# in kzsh against bash running the same script.
+#
+# Usage: loop_bench.sh path/to/kzsh [path/to/bash]
+#
+# Each case runs once through `kzsh script` and once through `bash script`.
+# The outputs of both sides are compared first, and the benchmark fails if
+# they differ.
+
+set -eu
+
+KZSH=${1:?usage: loop_bench.sh path/to/kzsh [path/to/bash]}
+BASH=${2:-bash}
+
+TMP=$(mktemp -d "${TMPDIR:-/tmp}/kzsh-bench.XXXXXX")
+trap 'rm -rf "$TMP"' EXIT INT TERM
+
+now_ns() {
+    date +%s%N
+}
+
+status=0
+printf '%-72s %9s %9s %8s\n' "case" "kzsh ms" "bash ms" "speedup"
+
+bench() {
+    printf '%s\n' "$1" > "$TMP/case.sh"
+    "$BASH" "$TMP/case.sh" > "$TMP/bash.out" 2>&1 || true
+    "$KZSH" "$TMP/case.sh" > "$TMP/kzsh.out" 2>&1 || true
+    if ! cmp -s "$TMP/kzsh.out" "$TMP/bash.out"; then
+        echo "MISMATCH: $1" >&2
+        status=1
+        return
+    fi
+
+    t0=$(now_ns); "$KZSH" "$TMP/case.sh" > /dev/null || true; t1=$(now_ns)
+    "$BASH" "$TMP/case.sh" > /dev/null || true; t2=$(now_ns)
+    k=$(( (t1 - t0) / 1000000 ))
+    b=$(( (t2 - t1) / 1000000 ))
+    printf '%-72s %9d %9d %7s\n' "$1" "$k" "$b" \
+        "$(awk -v k="$k" -v b="$b" 'BEGIN { printf "%.1fx", (k > 0 ? b / k : 0) }')"
+}
+
+bench 'for i in $(seq 1 1000000); do :; done; echo $i'
+bench 's=0; for i in $(seq 1 200000); do s=$((s + i)); done; echo $s'
+bench 'i=0; while [ $i -lt 200000 ]; do i=$((i + 1)); done; echo $i'
+bench 'n=0; while test $n -ne 200000 && [ -n "$n" ]; do n=$((n + 1)); done; echo $n'
+bench 'n=0; while :; do n=$((n + 1)); case $n in 200000) break;; esac; done; echo $n'
+bench 'c=0; for i in $(seq 1 200000); do case $i in *7) c=$((c + 1));; *) ;; esac; done; echo $c'
+bench 'for i in $(seq 1 300000); do if true; then continue; fi; echo no; done; echo $i'
+bench 'f() { x=$1; }; for i in $(seq 1 200000); do f $i; done; echo $x'
+bench 'for i in $(seq 1 300); do for j in $(seq 1 1000); do :; done; done; echo $i $j'
+
+exit $status
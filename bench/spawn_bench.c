@@ -0,0 +1,63 @@
+/*
+ * Spawn microbenchmark: launches /bin/true repeatedly through the fork and
+ * posix_spawn backends of src/launch.c and reports spawns per second.
+ *
+ * Usage: spawn_bench [iterations] [heap-MiB]
+ *   heap-MiB: touch this much memory first to simulate a large shell RSS
+ *             (fork cost grows with it, spawn cost should not).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+
+extern char **environ;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double run(enum launch_backend backend, const char *path, int iterations) {
+    char *argv[] = { (char *)"true", NULL };
+    struct launch l;
+    launch_init(&l);
+    double start = now();
+    for (int i = 0; i < iterations; ++i) {
+        pid_t pid = launch_with(backend, path, argv, environ, &l);
+        if (pid < 0) {
+            perror("launch");
+            exit(1);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    return iterations / (now() - start);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    size_t heap_mib = argc > 2 ? (size_t)atol(argv[2]) : 256;
+    const char *path = access("/bin/true", X_OK) == 0 ? "/bin/true" : "/usr/bin/true";
+
+    char *heap = NULL;
+    if (heap_mib) {
+        heap = malloc(heap_mib << 20);
+        if (heap) memset(heap, 1, heap_mib << 20);
+    }
+
+    double fork_rate = run(LAUNCH_FORK, path, iterations);
+    double spawn_rate = run(LAUNCH_SPAWN, path, iterations);
+
+    printf("heap %zu MiB, %d iterations\n", heap_mib, iterations);
+    printf("fork+exec    %10.0f spawns/s\n", fork_rate);
+    printf("posix_spawn  %10.0f spawns/s  (%.2fx)\n", spawn_rate, spawn_rate / fork_rate);
+    free(heap);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Startup benchmark: times exec-to-exit of `kzsh -c true`, the cost paid
+ * by every job runner invocation, next to /bin/true as a baseline.
+ *
+ * Usage: startup_bench path/to/kzsh [iterations] [max-us]
+ *   max-us: fail (exit 1) when the median kzsh run is more than this many
+ *           microseconds slower than the median /bin/true run (default 500,
+ *           or $STARTUP_BENCH_MAX_US). Measuring against /bin/true takes the
+ *           machine's own exec cost out of the threshold.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Run argv iterations times; fills samples (microseconds), sorted */
+static void run(char **argv, int iterations, double *samples) {
+    for (int i = 0; i < iterations; ++i) {
+        double start = now_us();
+        pid_t pid;
+        if (posix_spawn(&pid, argv[0], NULL, NULL, argv, environ) != 0) {
+            perror(argv[0]);
+            exit(2);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        samples[i] = now_us() - start;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "startup_bench: %s exited with status %d\n", argv[0], status);
+            exit(2);
+        }
+    }
+    qsort(samples, (size_t)iterations, sizeof(*samples), by_value);
+}
+
+static void report(const char *name, const double *s, int n) {
+    printf("%-16s median %8.0f us   p10 %8.0f us   p90 %8.0f us\n",
+           name, s[n / 2], s[n / 10], s[n * 9 / 10]);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: startup_bench path/to/kzsh [iterations] [max-us]\n");
+        return 2;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : 1000;
+    const char *env_max = getenv("STARTUP_BENCH_MAX_US");
+    double max_us = argc > 3 ? atof(argv[3]) : env_max ? atof(env_max) : 500;
+    if (iterations < 10) iterations = 10;
+
+    double *base = malloc(sizeof(double) * (size_t)iterations);
+    double *kzsh = malloc(sizeof(double) * (size_t)iterations);
+    if (!base || !kzsh) return 2;
+
+    char *true_argv[] = { (char *)(access("/bin/true", X_OK) == 0 ? "/bin/true" : "/usr/bin/true"), NULL };
+    char *kzsh_argv[] = { argv[1], (char *)"-c", (char *)"true", NULL };
+    run(true_argv, iterations, base);
+    run(kzsh_argv, iterations, kzsh);
+
+    printf("%d iterations\n", iterations);
+    report("/bin/true", base, iterations);
+    report("kzsh -c true", kzsh, iterations);
+    double overhead = kzsh[iterations / 2] - base[iterations / 2];
+    printf("overhead over /bin/true: %.0f us (limit %.0f us)\n", overhead, max_us);
+
+    int status = 0;
+    if (overhead > max_us) {
+        fprintf(stderr, "REGRESSION: startup overhead %.0f us exceeds %.0f us\n", overhead, max_us);
+        status = 1;
+    }
+    free(base);
+    free(kzsh);
+    return status;
+}
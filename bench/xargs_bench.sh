@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Parallel spawn benchmark: times the xargs builtin at growing -P against
+# the system xargs run by bash, and reports commands started per second.
+#
+# Usage: xargs_bench.sh path/to/kzsh [path/to/bash]
+#
+# Each case runs once through `kzsh script` and once through `bash script`.
+# Output order depends on scheduling, so both sides are sorted and compared
+# first, and the benchmark fails if they differ.
+
+set -eu
+
+KZSH=${1:?usage: xargs_bench.sh path/to/kzsh [path/to/bash]}
+BASH=${2:-bash}
+N=${XARGS_BENCH_N:-4000}
+
+TMP=$(mktemp -d "${TMPDIR:-/tmp}/kzsh-bench.XXXXXX")
+trap 'rm -rf "$TMP"' EXIT INT TERM
+
+now_ns() {
+    date +%s%N
+}
+
+status=0
+printf '%-52s %9s %9s %8s %10s\n' "case" "kzsh ms" "bash ms" "speedup" "kzsh cmd/s"
+
+bench() {
+    printf '%s\n' "$1" > "$TMP/case.sh"
+    "$BASH" "$TMP/case.sh" 2>&1 | sort > "$TMP/bash.out" || true
+    "$KZSH" "$TMP/case.sh" 2>&1 | sort > "$TMP/kzsh.out" || true
+    if ! cmp -s "$TMP/kzsh.out" "$TMP/bash.out"; then
+        echo "MISMATCH: $1" >&2
+        status=1
+        return
+    fi
+
+    t0=$(now_ns); "$KZSH" "$TMP/case.sh" > /dev/null || true; t1=$(now_ns)
+    "$BASH" "$TMP/case.sh" > /dev/null || true; t2=$(now_ns)
+    k=$(( (t1 - t0) / 1000000 ))
+    b=$(( (t2 - t1) / 1000000 ))
+    printf '%-52s %9d %9d %7s %10s\n' "$1" "$k" "$b" \
+        "$(awk -v k="$k" -v b="$b" 'BEGIN { printf "%.1fx", (k > 0 ? b / k : 0) }')" \
+        "$(awk -v k="$k" -v n="$2" 'BEGIN { printf "%d", (k > 0 ? n * 1000 / k : 0) }')"
+}
+
+cpus=$(nproc 2>/dev/null || echo 1)
+for p in 1 2 4 "$cpus"; do
+    bench "seq 1 $N | xargs -P$p -n1 /bin/true" "$N"
+done
+bench "seq 1 $N | xargs -P$cpus -n1 /bin/echo" "$N"
+bench "seq 1 $N | xargs -P$cpus -n100 /bin/echo" "$((N / 100))"
+bench "seq 1 $N | xargs -P$cpus -I{} /bin/echo x{}y" "$N"
+
+exit $status
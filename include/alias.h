@@ -1,10 +1,35 @@
 #ifndef ALIAS_H
 #define ALIAS_H
-#define ALIAS_MAX 100
-extern int alias_count;
-extern char *names[ALIAS_MAX];
-extern char *values[ALIAS_MAX];
+
+#include <stddef.h>
+#include "parser.h"
+
+/* Alias values are split into shell words once, when they are defined,
+ * using the same lexer as command lines. Words keep their quotes; quote
+ * removal happens when the alias is used, like any other word. */
+struct alias {
+    char *name;
+    char *value;
+    struct word *words;     /* nwords words, views into value */
+    int nwords;
+    int compound;           /* value has operators (| ; && ...): it is run
+                             * as a command line instead of spliced into argv */
+    int trailing_blank;     /* value ends in a blank: the word after the
+                             * alias is checked for alias expansion too */
+};
+
+/* Returns NULL when name is not an alias */
+const struct alias *alias_lookup(const char *name);
+const struct alias *alias_lookup_n(const char *name, size_t len);
+
 void alias_set(const char *name, const char *value);
-void alias_unset(const char *name);
-void alias_show();
+/* Returns 0 if the alias was removed, -1 if it was not defined */
+int alias_unset(const char *name);
+struct out;
+void alias_show(struct out *o);
+void alias_print(struct out *o, const struct alias *al);
+size_t alias_count(void);
+/* Iterate in table order: start with *pos = 0; NULL when done */
+const struct alias *alias_next(size_t *pos);
+
 #endif // ALIAS_H
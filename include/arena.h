@@ -0,0 +1,42 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Bump allocator used for per-line parse/eval storage.
+ * Allocations are never freed individually; the whole arena (or everything
+ * allocated after a mark) is released at once.
+ */
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct arena {
+    struct arena_chunk *head;   /* chunk currently being filled */
+    size_t chunk_size;          /* default size of new chunks */
+};
+
+struct arena_mark {
+    struct arena_chunk *chunk;
+    size_t used;
+};
+
+#define ARENA_DEFAULT_CHUNK 8192
+
+void arena_init(struct arena *a, size_t chunk_size);
+void *arena_alloc(struct arena *a, size_t n);
+void *arena_calloc(struct arena *a, size_t n);
+char *arena_strndup(struct arena *a, const char *s, size_t n);
+
+/* Save / roll back the allocation point (for nested evaluation). */
+struct arena_mark arena_mark(const struct arena *a);
+void arena_release(struct arena *a, struct arena_mark m);
+
+/* Drop everything but keep the first chunk around for reuse. */
+void arena_reset(struct arena *a);
+void arena_free(struct arena *a);
+
+#endif // ARENA_H
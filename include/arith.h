@@ -0,0 +1,10 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+/* Shell arithmetic ($((...)) and integer variables): C integer operators
+ * on long long, including assignments and ++/--, with variables referred
+ * to by name. Returns -1 (after printing a message) on a syntax error,
+ * division by zero or runaway recursion through variable values. */
+int arith_eval(const char *expr, long long *result);
+
+#endif // ARITH_H
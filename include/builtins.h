@@ -1,11 +1,98 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
 
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int (*builtin_fn)(int argc, char **argv);
+
+/* Registry flags */
+#define BUILTIN_SPECIAL 0x01    /* POSIX special builtin */
+#define BUILTIN_NOFORK  0x02    /* leaves shell state alone; may run in-process as a pipeline stage */
+#define BUILTIN_STDIN   0x04    /* reads standard input (when given no file operands) */
+
+struct builtin {
+    const char *name;
+    builtin_fn fn;
+    unsigned flags;
+};
+
+/* O(1) lookup in the registry generated from builtins_list.h.
+ * Returns NULL for unknown names and for reserved, unimplemented ones. */
+const struct builtin *builtin_lookup(const char *name);
+
+/* Iterate over the implemented builtins (in builtins_list.h order). */
+size_t builtin_count(void);
+const struct builtin *builtin_at(size_t index);
+
 int builtin_echo(int argc, char **argv);
 int builtin_true(int argc, char **argv);
 int builtin_false(int argc, char **argv);
+int builtin_exit(int argc, char **argv);
 int builtin_cd(int argc, char **argv);
+int builtin_pwd(int argc, char **argv);
 int builtin_source(int argc, char **argv);
+int builtin_printenv(int argc, char **argv);
+int builtin_env(int argc, char **argv);
+int builtin_unset(int argc, char **argv);
+int builtin_export(int argc, char **argv);
+int builtin_readonly(int argc, char **argv);
+int builtin_declare(int argc, char **argv);
+int builtin_hash(int argc, char **argv);
+int builtin_type(int argc, char **argv);
+int builtin_which(int argc, char **argv);
+int builtin_umask(int argc, char **argv);
+int builtin_whoami(int argc, char **argv);
+int builtin_logname(int argc, char **argv);
+int builtin_clear(int argc, char **argv);
+int builtin_history(int argc, char **argv);
+int builtin_alias(int argc, char **argv);
+int builtin_unalias(int argc, char **argv);
+int builtin_help(int argc, char **argv);
+
+// In-process text utilities (src/coreutils.c)
+int builtin_cat(int argc, char **argv);
+int builtin_head(int argc, char **argv);
+int builtin_tail(int argc, char **argv);
+int builtin_wc(int argc, char **argv);
+int builtin_grep(int argc, char **argv);
+int builtin_egrep(int argc, char **argv);
+int builtin_fgrep(int argc, char **argv);
+int builtin_sort(int argc, char **argv);
+int builtin_uniq(int argc, char **argv);
+int builtin_tr(int argc, char **argv);
+int builtin_seq(int argc, char **argv);
+int builtin_yes(int argc, char **argv);
+int builtin_tee(int argc, char **argv);
+int builtin_sleep(int argc, char **argv);
+
+// Control flow and functions (src/vm.c)
+int builtin_break(int argc, char **argv);
+int builtin_continue(int argc, char **argv);
+int builtin_return(int argc, char **argv);
+int builtin_shift(int argc, char **argv);
+int builtin_local(int argc, char **argv);
+
+// Job control (src/jobs.c)
+int builtin_jobs(int argc, char **argv);
+int builtin_fg(int argc, char **argv);
+int builtin_bg(int argc, char **argv);
+int builtin_wait(int argc, char **argv);
+int builtin_kill(int argc, char **argv);
+
+// Conditional expressions (src/test.c)
+int builtin_test(int argc, char **argv);
+
+// Parallel execution (src/parallel.c)
+int builtin_xargs(int argc, char **argv);
+int builtin_parallel(int argc, char **argv);
 // Add more builtins as needed
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // BUILTINS_H
@@ -2,59 +2,83 @@
 #define BUILTINS_LIST_H
 
 // List of supported builtins (expand as needed)
+//
+// X(name, function, flags): the builtin registry in src/builtins_cpp.cpp is
+// generated from this list at compile time. Names whose function is NULL
+// are reserved but not implemented yet; they still run from $PATH.
 #define BUILTIN_COMMANDS \
-    X(echo) \
-    X(true) \
-    X(false) \
-    X(exit) \
-    X(cd) \
-    X(pwd) \
-    X(ls) \
-    X(cat) \
-    X(chmod) \
-    X(chown) \
-    X(mkdir) \
-    X(rmdir) \
-    X(rm) \
-    X(mv) \
-    X(cp) \
-    X(date) \
-    X(sleep) \
-    X(printenv) \
-    X(set) \
-    X(unset) \
-    X(export) \
-    X(which) \
-    X(type) \
-    X(umask) \
-    X(ln) \
-    X(test) \
-    X(printf) \
-    X(head) \
-    X(tail) \
-    X(wc) \
-    X(grep) \
-    X(fgrep) \
-    X(egrep) \
-    X(find) \
-    X(diff) \
-    X(sort) \
-    X(tr) \
-    X(uniq) \
-    X(xargs) \
-    X(seq) \
-    X(yes) \
-    X(whoami) \
-    X(who) \
-    X(id) \
-    X(logname) \
-    X(groups) \
-    X(tee) \
-    X(stty) \
-    X(clear) \
-    X(history) \
-    X(alias) \
-    X(unalias) \
-    X(help)
+    X("echo",     builtin_echo,     BUILTIN_NOFORK) \
+    X("true",     builtin_true,     BUILTIN_NOFORK) \
+    X("false",    builtin_false,    BUILTIN_NOFORK) \
+    X(":",        builtin_true,     BUILTIN_SPECIAL | BUILTIN_NOFORK) \
+    X("exit",     builtin_exit,     BUILTIN_SPECIAL) \
+    X("cd",       builtin_cd,       0) \
+    X("pwd",      builtin_pwd,      BUILTIN_NOFORK) \
+    X("source",   builtin_source,   BUILTIN_SPECIAL) \
+    X(".",        builtin_source,   BUILTIN_SPECIAL) \
+    X("break",    builtin_break,    BUILTIN_SPECIAL) \
+    X("continue", builtin_continue, BUILTIN_SPECIAL) \
+    X("return",   builtin_return,   BUILTIN_SPECIAL) \
+    X("shift",    builtin_shift,    BUILTIN_SPECIAL) \
+    X("local",    builtin_local,    0) \
+    X("jobs",     builtin_jobs,     0) \
+    X("fg",       builtin_fg,       0) \
+    X("bg",       builtin_bg,       0) \
+    X("wait",     builtin_wait,     0) \
+    X("kill",     builtin_kill,     0) \
+    X("parallel", builtin_parallel, 0) \
+    X("ls",       NULL,             0) \
+    X("cat",      builtin_cat,      BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("chmod",    NULL,             0) \
+    X("chown",    NULL,             0) \
+    X("mkdir",    NULL,             0) \
+    X("rmdir",    NULL,             0) \
+    X("rm",       NULL,             0) \
+    X("mv",       NULL,             0) \
+    X("cp",       NULL,             0) \
+    X("date",     NULL,             0) \
+    X("sleep",    builtin_sleep,    0) \
+    X("printenv", builtin_printenv, BUILTIN_NOFORK) \
+    X("env",      builtin_env,      BUILTIN_NOFORK) \
+    X("set",      NULL,             BUILTIN_SPECIAL) \
+    X("unset",    builtin_unset,    BUILTIN_SPECIAL) \
+    X("export",   builtin_export,   BUILTIN_SPECIAL) \
+    X("readonly", builtin_readonly, BUILTIN_SPECIAL) \
+    X("declare",  builtin_declare,  0) \
+    X("typeset",  builtin_declare,  0) \
+    X("hash",     builtin_hash,     0) \
+    X("which",    builtin_which,    BUILTIN_NOFORK) \
+    X("type",     builtin_type,     BUILTIN_NOFORK) \
+    X("umask",    builtin_umask,    0) \
+    X("ln",       NULL,             0) \
+    X("test",     builtin_test,     BUILTIN_NOFORK) \
+    X("[",        builtin_test,     BUILTIN_NOFORK) \
+    X("printf",   NULL,             0) \
+    X("head",     builtin_head,     BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("tail",     builtin_tail,     BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("wc",       builtin_wc,       BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("grep",     builtin_grep,     BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("fgrep",    builtin_fgrep,    BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("egrep",    builtin_egrep,    BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("find",     NULL,             0) \
+    X("diff",     NULL,             0) \
+    X("sort",     builtin_sort,     BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("tr",       builtin_tr,       BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("uniq",     builtin_uniq,     BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("xargs",    builtin_xargs,    0) \
+    X("seq",      builtin_seq,      BUILTIN_NOFORK) \
+    X("yes",      builtin_yes,      BUILTIN_NOFORK) \
+    X("whoami",   builtin_whoami,   BUILTIN_NOFORK) \
+    X("who",      NULL,             0) \
+    X("id",       NULL,             0) \
+    X("logname",  builtin_logname,  BUILTIN_NOFORK) \
+    X("groups",   NULL,             0) \
+    X("tee",      builtin_tee,      BUILTIN_NOFORK | BUILTIN_STDIN) \
+    X("stty",     NULL,             0) \
+    X("clear",    builtin_clear,    BUILTIN_NOFORK) \
+    X("history",  builtin_history,  0) \
+    X("alias",    builtin_alias,    0) \
+    X("unalias",  builtin_unalias,  0) \
+    X("help",     builtin_help,     BUILTIN_NOFORK)
 
 #endif // BUILTINS_LIST_H
@@ -0,0 +1,25 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+/* Command-path cache (like bash's `hash`): maps command names to the
+ * absolute path found by searching $PATH, so repeated external commands
+ * skip the PATH walk. */
+
+/* Return the path to execute for name, resolving and caching it on first
+ * use. Names containing '/' are returned unchanged. NULL if not found. */
+const char *cmdhash_lookup(const char *name);
+
+/* Look up without resolving: NULL if name is not in the table. */
+const char *cmdhash_peek(const char *name);
+
+/* Resolve $PATH for name without touching the table (malloc'd, or NULL). */
+char *cmdhash_search_path(const char *name);
+
+/* Drop every remembered path (hash -r, or when PATH changes). */
+void cmdhash_clear(void);
+
+/* Print the table in `hash` format. */
+struct out;
+void cmdhash_show(struct out *o);
+
+#endif // CMDHASH_H
@@ -0,0 +1,36 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stddef.h>
+
+/* Tab completion. Candidates come from in-memory indexes: a sorted listing
+ * of every $PATH directory and a small cache of directory listings for
+ * path completion. A listing is rescanned only when its directory's mtime
+ * changes, so after the first scan a completion costs one stat() per
+ * directory involved plus a binary search. */
+
+struct completion_item {
+    const char *name;
+    int dir;                /* a directory: complete with '/', not ' ' */
+};
+
+struct completion {
+    size_t start;           /* candidates replace line[start .. cursor) */
+    size_t prefix_len;      /* what was typed there, unescaped: each name's first bytes */
+    const struct completion_item *items;    /* sorted, no duplicates */
+    size_t n;
+};
+
+/* Complete the word that ends at cursor in line[0 .. cursor). In command
+ * position that is builtins, aliases and $PATH executables; otherwise (or
+ * for a word with a '/') files, matched against the last path component
+ * with backslashes and quotes removed. The results stay valid until the
+ * next call. Returns the number of candidates. */
+size_t complete_line(const char *line, size_t cursor, struct completion *c);
+
+/* The text to insert for a candidate: name with the characters the shell
+ * would interpret escaped by backslashes. Returns the length written (at
+ * most outlen - 1). */
+size_t complete_escape(const char *name, char *out, size_t outlen);
+
+#endif // COMPLETE_H
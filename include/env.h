@@ -1,8 +1,10 @@
 #ifndef ENV_H
 #define ENV_H
 
-void env_export(const char *name, const char *value);
-void env_unset(const char *name);
-void env_show();
+/* The environment is the exported part of the variable table (var.h) */
+
+/* NAME=value for every exported variable */
+struct out;
+void env_show(struct out *o);
 
 #endif // ENV_H
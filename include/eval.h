@@ -0,0 +1,16 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "arena.h"
+#include "parser.h"
+
+/* Exit status of the most recently executed command ($?) */
+extern int eval_last_status;
+
+/* Execute an AST; scratch storage comes from the given arena. */
+int eval_node(struct arena *a, struct node *n);
+
+/* Quote removal: returns a NUL-terminated copy of the word in the arena. */
+char *word_unquote(struct arena *a, const struct word *w);
+
+#endif // EVAL_H
@@ -1,6 +1,48 @@
 #ifndef EXEC_H
 #define EXEC_H
 
+#include <sys/types.h>
+#include "arena.h"
+#include "parser.h"
+
+/* Run a builtin, or an external command in the foreground. */
 int exec_builtin(const char *cmd, int argc, char **argv);
 
+/* Run the PATH binary for argv[0] in the foreground even when a builtin
+ * has that name: the builtin utilities hand over options they don't
+ * implement. Returns its exit status (127 if there is none). */
+int exec_external(char **argv);
+
+/* Start an external command with stdin/stdout redirected to in_fd/out_fd
+ * (-1 keeps the shell's) and then the redirections redirs (NULL for none),
+ * in process group pgid (-1 the shell's, 0 a new one). Returns the pid, or
+ * -1 with *status set to the shell exit status for the failure (1 for a
+ * redirection, 127 not found, 126 not executable). */
+pid_t exec_spawn(struct arena *a, const char *cmd, char **argv, int in_fd, int out_fd,
+                 const struct redir *redirs, pid_t pgid, int *status);
+
+/* Redirections done in the shell itself, for builtins, functions and
+ * compound commands: every fd they replace is kept above 9 until
+ * exec_restore puts it back. */
+struct redir_saved {
+    int fd;
+    int saved;              /* its copy, -1 if fd was closed */
+};
+
+struct redir_undo {
+    struct redir_saved *v;
+    int n;
+};
+
+/* Perform redirs in order. Returns -1 after printing a message; what was
+ * done up to then is in u all the same. Flush stdout first. */
+int exec_redirect(struct arena *a, const struct redir *redirs, struct redir_undo *u);
+
+/* Undo the redirections recorded in u, last first */
+void exec_restore(struct redir_undo *u);
+
+/* Wait for a child and return its shell exit status. */
+int exec_wait(pid_t pid);
+int exec_status(int wait_status);
+
 #endif // EXEC_H
@@ -0,0 +1,49 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "arena.h"
+#include "parser.h"
+
+/* Word expansion at execution time: tilde, parameters ($name, ${...}),
+ * command substitution ($(...) and `...`), arithmetic ($((...))), field
+ * splitting on $IFS and quote removal. Every result lives in the arena. */
+
+struct field_list {
+    char **v;
+    int n, cap;
+};
+
+/* Positional parameters $1 .. $n ($#, $@, $*): the script's arguments,
+ * or a function's while it runs. The strings are not owned. */
+struct param_list {
+    char **v;
+    int n;
+};
+
+extern struct param_list expand_params;
+
+/* $0: the script path, the name following -c's command string, or "kzsh" */
+extern const char *expand_arg0;
+
+/* Record the shell's own pid for $$ (subshells keep the parent's) */
+void expand_init(void);
+
+/* Append the fields of w to out; an unquoted expansion that comes out
+ * empty adds none. Returns -1 after printing a message on an expansion
+ * error (${x?}, bad arithmetic, bad substitution). */
+int expand_word(struct arena *a, const struct word *w, struct field_list *out);
+
+/* Expand w to a single string without field splitting. With assign, w is
+ * NAME=value and ~ is also expanded after the = and each ':' of the value.
+ * Returns NULL after printing a message on an expansion error. */
+char *expand_string(struct arena *a, const struct word *w, int assign);
+
+/* Expand w as a pattern for fnmatch: as expand_string, but quoted
+ * characters come out backslash-escaped so they only match themselves. */
+char *expand_pattern(struct arena *a, const struct word *w);
+
+/* Exit status of the last command substitution, or -1 if none has run
+ * since it was reset; an assignment-only command reports it as $?. */
+extern int expand_subst_status;
+
+#endif // EXPAND_H
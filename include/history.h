@@ -2,7 +2,19 @@
 #define HISTORY_H
 
 void history_add(const char *line);
-void history_show(void);
+struct out;
+void history_show(struct out *o);
+
+/* Load $HISTFILE (default ~/.kzsh_history) and append new entries to it.
+ * Only interactive shells call this; returns -1 if the file is unusable. */
+int history_open(void);
+
+/* Index of the newest entry at or before `from` that contains `query`,
+ * or -1. Backed by a per-block bloom index, for incremental search. */
+int history_search(const char *query, int from);
+
+/* Resize to `size` entries (HISTSIZE); a negative size re-reads $HISTSIZE */
+void history_set_size(int size);
 
 /* Accessors for history (use these instead of exporting internal arrays) */
 int history_count_get(void);
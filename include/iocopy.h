@@ -0,0 +1,28 @@
+#ifndef IOCOPY_H
+#define IOCOPY_H
+
+#include <sys/types.h>
+
+/* Kernel-side data movement between descriptors for builtins that shuffle
+ * bulk data (cat, tee, head, ...). Each call picks the cheapest mechanism
+ * the pair of fds allows: copy_file_range for file->file, splice when
+ * either side is a pipe, sendfile from a regular file, and a plain
+ * read/write loop otherwise. */
+
+/* Copy up to limit bytes (or until EOF when limit < 0) from in to out.
+ * Returns the number of bytes copied, or -1 with errno set. */
+off_t io_copy(int in, int out, off_t limit);
+
+/* Duplicate everything readable from in into each of outs[0..nout-1].
+ * Uses tee(2)+splice when in and the outputs are pipes. */
+off_t io_tee(int in, const int *outs, int nout);
+
+/* Write all of buf, retrying on short writes and EINTR. */
+int io_write_all(int fd, const void *buf, size_t len);
+
+/* Write all of iov[0..n-1] with as few writev calls as it takes; iov is
+ * used up in the process. */
+struct iovec;
+int io_writev_all(int fd, struct iovec *iov, int n);
+
+#endif // IOCOPY_H
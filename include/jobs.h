@@ -0,0 +1,56 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <sys/types.h>
+#include "parser.h"
+
+/* Job control: background and stopped jobs, process groups and the
+ * terminal, and a SIGCHLD handler that only writes to a self-pipe. The
+ * children are reaped at safe points by jobs_reap. */
+
+/* Job control is on (interactive shell on a terminal): every pipeline
+ * gets its own process group, and the foreground one gets the terminal */
+extern int jobs_control;
+
+/* Pid of the most recent background job ($!), 0 if none */
+extern pid_t jobs_last_bg;
+
+/* Turn job control on: take the terminal and ignore the stop signals */
+void jobs_init_interactive(void);
+
+/* In a forked child of the shell: forget the parent's jobs and turn job
+ * control off */
+void jobs_forked(void);
+
+/* Hand the terminal to process group pgid (no-op without job control) */
+void jobs_give_terminal(pid_t pgid);
+
+/* Process group the shell handed the terminal to while it runs a stage
+ * of that pipeline itself, -1 when the terminal is the shell's own.
+ * Children the shell starts meanwhile belong in it, to get Ctrl-C. */
+pid_t jobs_foreground(void);
+
+/* Wait for the foreground processes pids[0..n-1] and store their shell
+ * exit statuses in statuses; entries whose pid is <= 0 are left alone.
+ * pgid is their process group under job control, -1 otherwise. If they
+ * stop they become a job described by src, and the stopped ones read
+ * 128 + the signal. Returns statuses[n - 1]. */
+int jobs_wait_fg(pid_t pgid, const pid_t *pids, int *statuses, int n, const struct node *src);
+
+/* Register a background job made of pids[0..n-1] (see jobs_wait_fg) */
+void jobs_add_bg(pid_t pgid, const pid_t *pids, int n, const struct node *src);
+
+/* Collect children that changed state. Costs one read when none did. */
+void jobs_reap(void);
+
+/* Report jobs that finished or stopped since the last prompt */
+void jobs_notify(void);
+
+/* Take the wait status of pid if the reaper already collected it (a
+ * foreground child reaped while a builtin ran). Returns 1 if it did. */
+int jobs_take_status(pid_t pid, int *status);
+
+/* Before exit: warns and returns 1 the first time there are stopped jobs */
+int jobs_exit_check(void);
+
+#endif // JOBS_H
@@ -0,0 +1,67 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <sys/types.h>
+
+/* External command launch. Child-side fd setup is described up front as a
+ * list of actions so it can be handed to posix_spawn as file actions;
+ * fork() is only used when a launch needs something spawn can't express
+ * (or when the fork backend is selected explicitly). */
+
+enum launch_backend {
+    LAUNCH_SPAWN,   /* posix_spawn (clone(CLONE_VM|CLONE_VFORK) in glibc) */
+    LAUNCH_FORK     /* fork + execve */
+};
+
+enum launch_action_type {
+    LAUNCH_DUP2,    /* dup2(src, fd) */
+    LAUNCH_CLOSE,   /* close(fd) */
+    LAUNCH_OPEN     /* fd = open(path, oflag, mode) */
+};
+
+struct launch_action {
+    enum launch_action_type type;
+    int fd;
+    int src;
+    const char *path;
+    int oflag;
+    mode_t mode;
+};
+
+#define LAUNCH_MAX_ACTIONS 16
+
+struct launch {
+    struct launch_action actions[LAUNCH_MAX_ACTIONS];
+    int nactions;
+    pid_t pgid;             /* -1 inherit, 0 new group led by the child, >0 join */
+    int need_fork;          /* set when setup can't be expressed as spawn actions */
+    int (*setup)(void *);   /* run in the forked child after the actions */
+    void *setup_arg;
+};
+
+/* Backend used by launch_external (LAUNCH_SPAWN unless changed) */
+extern enum launch_backend launch_default_backend;
+
+void launch_init(struct launch *l);
+int launch_dup2(struct launch *l, int src, int fd);
+int launch_close(struct launch *l, int fd);
+int launch_open(struct launch *l, int fd, const char *path, int oflag, mode_t mode);
+
+/* Have the child call fn(arg) after the actions and before exec, exiting
+ * with status 1 if it returns nonzero. Arbitrary code can't be handed to
+ * posix_spawn, so this sets need_fork. */
+void launch_setup(struct launch *l, int (*fn)(void *), void *arg);
+
+/* Start path with argv/envp. Returns the child pid, or -1 with errno set
+ * (exec errors such as ENOENT are reported here for the spawn backend).
+ * Both backends run a file the kernel can't exec through /bin/sh. */
+pid_t launch_external(const char *path, char *const argv[], char *const envp[],
+                      const struct launch *l);
+pid_t launch_with(enum launch_backend backend, const char *path, char *const argv[],
+                  char *const envp[], const struct launch *l);
+
+/* Restore default dispositions for signals the shell handles or ignores
+ * (used in forked children before exec). */
+void launch_reset_signals(void);
+
+#endif // LAUNCH_H
@@ -0,0 +1,15 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include <stddef.h>
+
+/* Interactive line editor (termios, no readline). Shows prompt and reads
+ * one line; *line points to it (NUL-terminated, owned by the editor and
+ * valid until the next call). Returns:
+ *  1 - read a line successfully
+ *  0 - EOF (caller should exit)
+ * -1 - input cancelled (Ctrl-C) -> caller should continue loop and show prompt
+ */
+int lineedit_read(const char *prompt, char **line);
+
+#endif // LINEEDIT_H
@@ -0,0 +1,68 @@
+#ifndef OUT_H
+#define OUT_H
+
+#include <stddef.h>
+#include <string.h>
+
+/* Output buffer for builtins. A builtin fills one for the length of its
+ * run and flushes it at the end, so nothing goes through stdio: no lock
+ * per call and no write per line. When the buffer fills up, it and the
+ * data that did not fit go out in one writev. On a terminal it is also
+ * flushed at the end of each line, so output shows up as it is made. */
+
+#define OUT_BUFSZ (64 * 1024)
+
+struct out {
+    int fd;
+    int err;                /* errno of the first failed write; later ones are dropped */
+    int tty;                /* fd is a terminal: flush after each newline; -1 until
+                             * the first newline asks. A builtin that prints one line
+                             * sets 0 and leaves the flush to out_close. */
+    size_t len;
+    char buf[OUT_BUFSZ];
+};
+
+/* Start buffering for fd, after anything stdio already holds */
+void out_init(struct out *o, int fd);
+
+/* A malloc'd buffer for fd (out_init done), NULL if out of memory */
+struct out *out_open(int fd);
+
+/* Flush and free a buffer from out_open. Returns -1 if any write failed. */
+int out_close(struct out *o);
+
+/* Returns -1 if this or an earlier write failed */
+int out_flush(struct out *o);
+
+/* out_write once the buffer is full, or on a terminal */
+void out_write_slow(struct out *o, const void *p, size_t n);
+
+/* A line ended: flush if fd is a terminal */
+void out_line(struct out *o);
+
+static inline void out_write(struct out *o, const void *p, size_t n) {
+    if (o->len + n > OUT_BUFSZ || o->tty) {
+        out_write_slow(o, p, n);
+        return;
+    }
+    memcpy(o->buf + o->len, p, n);
+    o->len += n;
+}
+
+static inline void out_putc(struct out *o, char c) {
+    if (o->len == OUT_BUFSZ) out_flush(o);
+    o->buf[o->len++] = c;
+    if (c == '\n' && o->tty) out_line(o);
+}
+
+static inline void out_str(struct out *o, const char *s) {
+    out_write(o, s, strlen(s));
+}
+
+/* unsigned to decimal, right-aligned in width (0 = no padding) */
+void out_num(struct out *o, unsigned long long v, int width, char pad);
+
+/* s in single quotes, each ' written as '\'' so the shell reads it back */
+void out_quoted(struct out *o, const char *s);
+
+#endif // OUT_H
@@ -0,0 +1,206 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+#include "arena.h"
+
+/* ---- Lexer ---- */
+
+enum token_type {
+    TOK_EOF,
+    TOK_WORD,
+    TOK_IO_NUMBER,  /* digits directly followed by '<' or '>' */
+    TOK_NEWLINE,
+    TOK_SEMI,       /* ;  */
+    TOK_DSEMI,      /* ;; */
+    TOK_AMP,        /* &  */
+    TOK_PIPE,       /* |  */
+    TOK_AND_IF,     /* && */
+    TOK_OR_IF,      /* || */
+    TOK_LPAREN,     /* (  */
+    TOK_RPAREN,     /* )  */
+    TOK_LESS,       /* <  */
+    TOK_GREAT,      /* >  */
+    TOK_DGREAT,     /* >> */
+    TOK_LESSAND,    /* <& */
+    TOK_GREATAND,   /* >& */
+    TOK_LESSGREAT,  /* <> */
+    TOK_CLOBBER,    /* >| */
+    TOK_DLESS,      /* << */
+    TOK_DLESSDASH,  /* <<- */
+    TOK_TLESS,      /* <<< */
+    TOK_ERROR
+};
+
+/* Word flags, computed by the lexer in the same pass that finds the word
+ * boundaries so later stages can skip work for plain literals. */
+#define WORD_QUOTED  0x01   /* contains quotes or backslashes */
+#define WORD_DOLLAR  0x02   /* contains $ or ` (needs expansion) */
+#define WORD_GLOB    0x04   /* contains unquoted * ? [ */
+#define WORD_TILDE   0x08   /* starts with unquoted ~ */
+#define WORD_ASSIGN  0x10   /* looks like NAME=value */
+
+struct token {
+    enum token_type type;
+    const char *start;      /* view into the source text */
+    size_t len;
+    unsigned flags;         /* WORD_* for TOK_WORD */
+    int line;
+};
+
+struct redir;
+
+struct lexer {
+    const char *src;
+    const char *cur;
+    const char *end;
+    int line;
+    const char *error;      /* set when TOK_ERROR is returned */
+    int incomplete;         /* ran out of input: inside a token, or in a here-doc body */
+    /* here-documents whose bodies start after the next newline */
+    struct redir *heredocs[16];
+    int nheredocs;
+};
+
+void lexer_init(struct lexer *lx, const char *src, size_t len);
+struct token lexer_next(struct lexer *lx);
+/* End of the quoted string, backquote or $ construct starting at p, by the
+ * same rules the lexer used to find word boundaries; NULL if unterminated */
+const char *lexer_skip(const char *p, const char *end);
+
+/* ---- AST ---- */
+
+/* A word is a view into the source (or arena) text, quotes included.
+ * Quote removal and expansion happen at execution time. */
+struct word {
+    const char *text;
+    size_t len;
+    unsigned flags;
+    struct word *next;
+};
+
+enum redir_type {
+    REDIR_IN,       /* <   */
+    REDIR_OUT,      /* >   */
+    REDIR_APPEND,   /* >>  */
+    REDIR_CLOBBER,  /* >|  */
+    REDIR_RDWR,     /* <>  */
+    REDIR_DUPIN,    /* <&  */
+    REDIR_DUPOUT,   /* >&  */
+    REDIR_HEREDOC,  /* << and <<- */
+    REDIR_HERESTR   /* <<< */
+};
+
+struct redir {
+    enum redir_type type;
+    int fd;                 /* explicit IO_NUMBER, or -1 for the default */
+    struct word *target;    /* file name / fd / here-doc delimiter */
+    const char *body;       /* here-doc body (view) */
+    size_t body_len;
+    int strip_tabs;         /* <<- */
+    int quoted_delim;       /* delimiter was quoted: no expansion in body */
+    struct redir *next;
+};
+
+enum node_type {
+    NODE_CMD,       /* simple command */
+    NODE_PIPELINE,
+    NODE_AND,       /* a && b */
+    NODE_OR,        /* a || b */
+    NODE_SEQ,       /* a ; b */
+    NODE_BACKGROUND,/* a & */
+    NODE_IF,        /* if / elif / else */
+    NODE_WHILE,
+    NODE_UNTIL,
+    NODE_FOR,
+    NODE_CASE,
+    NODE_GROUP,     /* { list; } */
+    NODE_SUBSHELL,  /* ( list ) */
+    NODE_FUNCDEF    /* name() compound-command */
+};
+
+/* One arm of a case statement: pattern | pattern) body ;; */
+struct case_item {
+    struct word *patterns;
+    struct node *body;      /* NULL for an empty arm */
+    struct case_item *next;
+};
+
+struct node {
+    enum node_type type;
+    int line;
+    struct redir *redirs;   /* compound commands: redirections after them */
+    union {
+        struct {
+            struct word *assigns;   /* NAME=value prefixes */
+            struct word *words;
+            int nwords;
+            struct redir *redirs;
+        } cmd;
+        struct {
+            struct node **cmds;
+            int ncmds;
+            int bang;               /* leading '!' */
+        } pipe;
+        struct {
+            struct node *left;
+            struct node *right;     /* NULL for NODE_BACKGROUND */
+        } bin;
+        struct {
+            struct node *cond;
+            struct node *body;      /* then-part, or the loop body */
+            struct node *else_part; /* NODE_IF: else, or a nested NODE_IF for elif */
+        } ctl;                      /* NODE_IF, NODE_WHILE, NODE_UNTIL */
+        struct {
+            struct word *var;
+            struct word *words;     /* the list after `in' */
+            int has_in;             /* without `in', the loop runs over "$@" */
+            struct node *body;
+        } loop;                     /* NODE_FOR */
+        struct {
+            struct word *subject;
+            struct case_item *items;
+        } cas;                      /* NODE_CASE */
+        struct {
+            struct node *body;
+        } group;                    /* NODE_GROUP, NODE_SUBSHELL */
+        struct {
+            struct word *name;
+            struct node *body;
+        } func;                     /* NODE_FUNCDEF */
+    } u;
+};
+
+/* ---- Parser ---- */
+
+struct parse_error {
+    const char *msg;        /* NULL when there was no error */
+    int line;
+    int incomplete;         /* input ended inside a construct */
+};
+
+struct parser {
+    struct lexer lx;
+    struct arena *arena;
+    struct token tok;       /* one-token lookahead */
+    int have_tok;
+    struct parse_error err;
+};
+
+void parser_init(struct parser *p, struct arena *a, const char *src, size_t len);
+
+/* Parse the next complete command (everything up to an unquoted newline).
+ * Returns NULL at end of input or on error; check p->err.msg to tell apart.
+ * Blank lines and comments are skipped. */
+struct node *parser_next(struct parser *p);
+
+/* Parse a whole buffer into one node (a NODE_SEQ chain); NULL if empty. */
+struct node *parse_buffer(struct arena *a, const char *src, size_t len, struct parse_error *err);
+
+void parse_error_print(const char *origin, const struct parse_error *err);
+
+/* Deep copy of an AST, word text included, into another arena: for
+ * function bodies, which outlive the command line that defined them. */
+struct node *node_copy(struct arena *a, const struct node *n);
+
+#endif // PARSER_H
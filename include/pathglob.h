@@ -0,0 +1,22 @@
+#ifndef PATHGLOB_H
+#define PATHGLOB_H
+
+#include <stddef.h>
+#include "arena.h"
+
+/* Pathname expansion: * ? [...] within a path component, and ** as a
+ * whole component for any number of directories. A backslash quotes the
+ * next character. Names starting with '.' only match a pattern component
+ * that starts with a literal '.', and . and .. never match. */
+
+/* Sorted (byte order) matches of pattern as a NULL-terminated array in
+ * the arena; NULL with *count 0 when nothing matches. */
+char **pathglob(struct arena *a, const char *pattern, size_t *count);
+
+/* Threads used to walk ** trees; below 2 they are walked serially */
+void pathglob_set_threads(int n);
+
+/* Drop every cached directory listing */
+void pathglob_cache_clear(void);
+
+#endif // PATHGLOB_H
@@ -0,0 +1,33 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <stddef.h>
+
+/* Inputs of the prompt that can change while the shell runs. Whoever
+ * changes one of them calls prompt_invalidate(); everything else is
+ * fetched once. */
+#define PROMPT_CWD  0x01    /* working directory (cd) */
+#define PROMPT_HOME 0x02    /* $HOME, used for ~ abbreviation */
+#define PROMPT_PS1  0x04    /* $PS1 itself */
+#define PROMPT_GIT  0x08    /* git branch/dirty state (\g) */
+#define PROMPT_LAST 0x10    /* exit status and duration of the last command */
+
+void prompt_invalidate(unsigned what);
+
+/* Called after each command line; feeds \? and \c and schedules a new
+ * git check, since the command may have changed the work tree. */
+void prompt_command_done(int status, long long elapsed_ns);
+
+/* Slow segments (\g) are computed by a child process and the prompt is
+ * drawn with the last known value meanwhile. prompt_async_fd() is the fd
+ * to poll for the result, -1 when nothing is pending. When it is readable,
+ * prompt_async_collect() consumes the data without blocking and returns 1
+ * if the rendered prompt changed and should be redrawn. */
+int prompt_async_fd(void);
+int prompt_async_collect(void);
+
+/* Returns the rendered prompt (owned by the cache, valid until the next
+ * call) and stores its length in *len when len is not NULL. */
+const char *prompt_render(size_t *len);
+
+#endif // PROMPT_H
@@ -0,0 +1,18 @@
+#ifndef RCFILE_H
+#define RCFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Run an rc file. The first run records a snapshot of it next to the
+ * other caches (keyed on the file's size, mtime and content hash); later
+ * runs of the unchanged file replay the snapshot instead of parsing it.
+ * Returns -1 if the file does not exist, otherwise the last status. */
+int rcfile_load(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RCFILE_H
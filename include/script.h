@@ -0,0 +1,40 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "parser.h"
+
+/* A script file parsed once into an AST that can be run any number of
+ * times. Words in the AST are views into the mapped file contents. */
+struct program {
+    struct arena arena;     /* owns every node of the program */
+    const char *text;       /* file contents (mmap'd or heap) */
+    size_t len;
+    int mapped;
+    struct node **cmds;     /* top-level complete commands */
+    int ncmds;
+};
+
+/* Load and parse a script. Returns NULL (after printing a message) on error. */
+struct program *program_load(const char *path);
+int program_run(struct program *prog);
+void program_free(struct program *prog);
+
+/* Load, run and free a script: used by `source` and `kzsh file.sh`. */
+int script_run_file(const char *path);
+
+/* Run a command string (`kzsh -c`). Each complete command runs as soon as
+ * it has been parsed; a syntax error stops there with status 2. */
+int script_run_string(const char *text, size_t len);
+
+/* The same for text taken from a file: errors are reported as
+ * "origin: line N", counting from line. */
+int script_run_text(const char *origin, const char *text, size_t len, int line);
+
+/* Run commands read from fd (`kzsh < script`, `producer | kzsh`). Input is
+ * read in large blocks and every complete command in a block runs before
+ * the next read, so commands are not held back until EOF. */
+int script_run_fd(int fd);
+
+#endif // SCRIPT_H
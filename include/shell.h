@@ -1,6 +1,14 @@
 #ifndef SHELL_H
 #define SHELL_H
 
+#include <signal.h>
+
+// Set by the interactive SIGINT handler; long-running builtins poll it
+extern volatile sig_atomic_t got_sigint;
+
+// Set once shell_start runs; a non-interactive shell exits on ${x?msg}
+extern int shell_interactive;
+
 // Start the interactive shell
 void shell_start(const char *version);
 
@@ -3,9 +3,17 @@
 #ifdef __cplusplus
 #include <string>
 void print_banner(const std::string& version);
-bool load_kshrc();
+extern "C" {
 #else
 #include <string.h>
 void print_banner(const char *version);
 #endif
+
+/* Run ~/.kshrc if there is one (replaying its cached snapshot while the
+ * file is unchanged). Returns 1 if an rc file was run. */
+int load_kshrc(void);
+
+#ifdef __cplusplus
+}
+#endif
 #endif // UTILS_H
@@ -0,0 +1,76 @@
+#ifndef VAR_H
+#define VAR_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shell variables. The table owns every variable: the environment kzsh
+ * was started with is imported once by var_init, and children get their
+ * environment from var_envp() rather than from libc's environ. */
+
+#define VAR_EXPORT   0x01   /* passed to children */
+#define VAR_READONLY 0x02
+#define VAR_INTEGER  0x04   /* values are normalised to decimal integers */
+#define VAR_ARRAY    0x08   /* indexed array; see nelems */
+
+struct var {
+    char *str;          /* "NAME=value"; envp entries point at it */
+    size_t name_len;
+    unsigned flags;
+    int set;            /* 0: declared (export X, declare -i X) but no value */
+    int nelems;         /* VAR_ARRAY: elements stored back to back in the
+                         * value, each NUL-terminated, so $NAME and the
+                         * environment see element 0 */
+};
+
+/* Value part of a variable's "NAME=value" string */
+#define VAR_VALUE(v) ((v)->str + (v)->name_len + 1)
+
+void var_init(void);
+
+/* NULL when name is unset */
+const char *var_get(const char *name);
+const struct var *var_lookup(const char *name);
+
+/* Set name to value and add flags to its attributes. Returns -1 (after
+ * printing a message) for an invalid name, a readonly variable or a bad
+ * value for an integer variable. */
+int var_set(const char *name, const char *value, unsigned flags);
+/* Make name an array of the n strings in values. Returns -1 when name is
+ * readonly or memory runs out; nothing is printed. */
+int var_set_array(const char *name, const char *const *values, int n);
+/* Element i of v (element 0 of a scalar); NULL when out of range */
+const char *var_elem(const struct var *v, int i);
+/* Add flags to name's attributes, declaring it without a value if needed */
+int var_set_flags(const char *name, unsigned flags);
+/* Put a variable back the way var_lookup saw it earlier: value NULL
+ * removes it. Attributes are replaced, not added, and readonly is not
+ * checked; used to undo `NAME=value cmd`. */
+void var_restore(const char *name, const char *value, unsigned flags);
+/* Returns -1 (after printing a message) when name is readonly */
+int var_unset(const char *name);
+
+/* NAME=value strings of the exported variables, NULL-terminated. The array
+ * is cached and only rebuilt after an exported variable changed. */
+char **var_envp(void);
+
+/* Print v as the command that recreates it: `cmd NAME='value'`, or with
+ * with_flags `cmd -ix NAME='value'` */
+struct out;
+void var_print(struct out *o, const char *cmd, const struct var *v, int with_flags);
+/* var_print every variable that has all the attributes in mask, by name */
+void var_show(struct out *o, const char *cmd, unsigned mask, int with_flags);
+
+/* Iterate in table order: start with *pos = 0; NULL when done */
+const struct var *var_next(size_t *pos);
+
+int var_valid_name(const char *name, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VAR_H
@@ -0,0 +1,29 @@
+#ifndef VM_H
+#define VM_H
+
+#include "arena.h"
+#include "parser.h"
+
+/* Compound commands (if, while, until, for, case, { } and function
+ * definitions) are compiled to bytecode and run by a small VM. */
+
+struct function;
+
+/* Compile n and run it; scratch storage comes from the arena, as for
+ * eval_node. */
+int vm_eval(struct arena *a, struct node *n);
+
+/* The function called name, or NULL */
+const struct function *vm_function(const char *name);
+
+/* Call fn with argv[1..] as its positional parameters */
+int vm_call(struct arena *a, const struct function *fn, int argc, char **argv);
+
+/* Returns -1 if name is not a function */
+int vm_function_unset(const char *name);
+
+/* Nonzero while break, continue or return is unwinding: lists that are
+ * being walked stop at the next command. */
+extern int vm_unwinding;
+
+#endif // VM_H
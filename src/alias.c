@@ -1,40 +1,201 @@
+/*
+ * Alias store: open-addressing (linear probing) hash table of
+ * name -> struct alias. Removal uses backward-shift deletion so lookups
+ * never have to step over tombstones and stay O(1) however many aliases
+ * come and go.
+ */
+
 #include "../include/alias.h"
+#include "../include/out.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-int alias_count = 0;
-#define ALIAS_MAX 100
-char *names[ALIAS_MAX];
-char *values[ALIAS_MAX];
-void alias_set(const char *name, const char *value) {
-    for (int i = 0; i < alias_count; ++i) {
-        if (strcmp(names[i], name) == 0) {
-            free(values[i]);
-            values[i] = strdup(value);
-            return;
-        }
+#include <stdint.h>
+
+struct alias_slot {
+    struct alias *alias;    /* NULL marks an empty slot */
+    uint32_t hash;
+};
+
+static struct alias_slot *table = NULL;
+static size_t table_cap = 0;    /* always a power of two */
+static size_t table_used = 0;
+
+static uint32_t hash_mem(const char *s, size_t len) {
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct alias_slot *find_slot(const char *name, size_t len, uint32_t h) {
+    size_t mask = table_cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        struct alias_slot *e = &table[i];
+        if (!e->alias) return e;
+        if (e->hash == h && strncmp(e->alias->name, name, len) == 0 && e->alias->name[len] == '\0') return e;
+    }
+}
+
+static int grow(void) {
+    size_t ncap = table_cap ? table_cap * 2 : 32;
+    struct alias_slot *old = table;
+    size_t ocap = table_cap;
+    table = calloc(ncap, sizeof(*table));
+    if (!table) {
+        table = old;
+        return -1;
     }
-    if (alias_count < ALIAS_MAX) {
-        names[alias_count] = strdup(name);
-        values[alias_count++] = strdup(value);
+    table_cap = ncap;
+    for (size_t i = 0; i < ocap; ++i) {
+        if (old[i].alias) {
+            const char *name = old[i].alias->name;
+            *find_slot(name, strlen(name), old[i].hash) = old[i];
+        }
     }
+    free(old);
+    return 0;
 }
-void alias_unset(const char *name) {
-    for (int i = 0; i < alias_count; ++i) {
-        if (strcmp(names[i], name) == 0) {
-            free(names[i]);
-            free(values[i]);
-            for (int j = i; j < alias_count - 1; ++j) {
-                names[j] = names[j+1];
-                values[j] = values[j+1];
+
+/* Split value into words. Anything that is not a plain word (operators,
+ * redirections, newlines) makes the alias compound. */
+static void alias_tokenize(struct alias *al) {
+    struct lexer lx;
+    size_t len = strlen(al->value);
+    int cap = 0;
+    lexer_init(&lx, al->value, len);
+    for (;;) {
+        struct token t = lexer_next(&lx);
+        if (t.type == TOK_EOF) break;
+        if (t.type != TOK_WORD) {
+            al->compound = 1;
+            break;
+        }
+        if (al->nwords == cap) {
+            cap = cap ? cap * 2 : 4;
+            struct word *grown = realloc(al->words, sizeof(*grown) * (size_t)cap);
+            if (!grown) {
+                al->compound = 1;
+                break;
             }
-            --alias_count;
-            return;
+            al->words = grown;
+        }
+        struct word *w = &al->words[al->nwords++];
+        w->text = t.start;
+        w->len = t.len;
+        w->flags = t.flags;
+        w->next = NULL;
+    }
+    for (int i = 0; i + 1 < al->nwords; ++i) al->words[i].next = &al->words[i + 1];
+    al->trailing_blank = len > 0 && (al->value[len - 1] == ' ' || al->value[len - 1] == '\t');
+}
+
+static void alias_free(struct alias *al) {
+    free(al->name);
+    free(al->value);
+    free(al->words);
+    free(al);
+}
+
+const struct alias *alias_lookup_n(const char *name, size_t len) {
+    if (!table_used) return NULL;
+    return find_slot(name, len, hash_mem(name, len))->alias;
+}
+
+const struct alias *alias_lookup(const char *name) {
+    return alias_lookup_n(name, strlen(name));
+}
+
+void alias_set(const char *name, const char *value) {
+    struct alias *al = calloc(1, sizeof(*al));
+    if (!al) return;
+    al->name = strdup(name);
+    al->value = strdup(value);
+    if (!al->name || !al->value) {
+        alias_free(al);
+        return;
+    }
+    alias_tokenize(al);
+
+    size_t len = strlen(name);
+    uint32_t h = hash_mem(name, len);
+    /* keep the load factor at or below 1/2 */
+    if ((table_used + 1) * 2 > table_cap && grow() != 0) {
+        alias_free(al);
+        return;
+    }
+    struct alias_slot *e = find_slot(name, len, h);
+    if (e->alias) {
+        alias_free(e->alias);
+    } else {
+        table_used++;
+    }
+    e->alias = al;
+    e->hash = h;
+}
+
+int alias_unset(const char *name) {
+    if (!table_used) return -1;
+    size_t len = strlen(name);
+    struct alias_slot *e = find_slot(name, len, hash_mem(name, len));
+    if (!e->alias) return -1;
+    alias_free(e->alias);
+    table_used--;
+
+    /* backward-shift: pull later members of the probe run into the hole */
+    size_t mask = table_cap - 1;
+    size_t hole = (size_t)(e - table);
+    for (size_t i = (hole + 1) & mask; table[i].alias; i = (i + 1) & mask) {
+        size_t home = table[i].hash & mask;
+        /* move it unless its home lies cyclically in (hole, i] */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table[hole] = table[i];
+            hole = i;
         }
     }
+    table[hole].alias = NULL;
+    return 0;
+}
+
+/* alias name='value', with embedded quotes written as '\'' so the
+ * output can be fed back to the shell */
+void alias_print(struct out *o, const struct alias *al) {
+    out_str(o, "alias ");
+    out_str(o, al->name);
+    out_putc(o, '=');
+    out_quoted(o, al->value);
+    out_putc(o, '\n');
+}
+
+static int by_name(const void *a, const void *b) {
+    const struct alias *x = *(const struct alias *const *)a;
+    const struct alias *y = *(const struct alias *const *)b;
+    return strcmp(x->name, y->name);
+}
+
+void alias_show(struct out *o) {
+    if (!table_used) return;
+    const struct alias **list = malloc(sizeof(*list) * table_used);
+    if (!list) return;
+    size_t n = 0;
+    for (size_t i = 0; i < table_cap; ++i) {
+        if (table[i].alias) list[n++] = table[i].alias;
+    }
+    qsort(list, n, sizeof(*list), by_name);
+    for (size_t i = 0; i < n; ++i) alias_print(o, list[i]);
+    free(list);
+}
+
+size_t alias_count(void) {
+    return table_used;
 }
-void alias_show() {
-    for (int i = 0; i < alias_count; ++i) {
-        printf("alias %s='%s'\n", names[i], values[i]);
+
+const struct alias *alias_next(size_t *pos) {
+    while (*pos < table_cap) {
+        const struct alias *al = table[(*pos)++].alias;
+        if (al) return al;
     }
+    return NULL;
 }
@@ -0,0 +1,94 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ARENA_ALIGN (sizeof(void *) > sizeof(long double) ? sizeof(void *) : sizeof(long double))
+
+static struct arena_chunk *chunk_new(size_t size) {
+    struct arena_chunk *c = malloc(sizeof(*c) + size);
+    if (!c) {
+        perror("kzsh: arena");
+        abort();
+    }
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+void arena_init(struct arena *a, size_t chunk_size) {
+    a->head = NULL;
+    a->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+}
+
+void *arena_alloc(struct arena *a, size_t n) {
+    struct arena_chunk *c = a->head;
+    size_t off = 0;
+    if (c) {
+        off = (c->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    }
+    if (!c || off + n > c->size) {
+        /* Oversized requests get a chunk of their own */
+        size_t size = n > a->chunk_size ? n : a->chunk_size;
+        struct arena_chunk *nc = chunk_new(size);
+        nc->next = c;
+        a->head = nc;
+        c = nc;
+        off = 0;
+    }
+    c->used = off + n;
+    return c->data + off;
+}
+
+void *arena_calloc(struct arena *a, size_t n) {
+    void *p = arena_alloc(a, n);
+    memset(p, 0, n);
+    return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t n) {
+    char *p = arena_alloc(a, n + 1);
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+struct arena_mark arena_mark(const struct arena *a) {
+    struct arena_mark m;
+    m.chunk = a->head;
+    m.used = a->head ? a->head->used : 0;
+    return m;
+}
+
+void arena_release(struct arena *a, struct arena_mark m) {
+    if (!m.chunk) {
+        arena_reset(a);
+        return;
+    }
+    while (a->head && a->head != m.chunk) {
+        struct arena_chunk *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+    if (a->head) a->head->used = m.used;
+}
+
+void arena_reset(struct arena *a) {
+    /* The oldest chunk is at the tail of the list; keep it. */
+    while (a->head && a->head->next) {
+        struct arena_chunk *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+    if (a->head) a->head->used = 0;
+}
+
+void arena_free(struct arena *a) {
+    while (a->head) {
+        struct arena_chunk *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+}
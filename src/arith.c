@@ -0,0 +1,349 @@
+/*
+ * Arithmetic evaluation: a recursive-descent parser that computes as it
+ * goes, one function per C precedence level. The untaken side of && || ?:
+ * is parsed with evaluation switched off, so it can neither assign nor
+ * divide by zero.
+ *
+ * A variable's value is itself evaluated as an expression (so x=y+1 works
+ * after y=2), with a recursion limit to stop x=x.
+ */
+
+#include "arith.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "var.h"
+
+#define ARITH_MAX_DEPTH 64
+
+struct arith {
+    const char *s;          /* cursor */
+    const char *expr;       /* the whole expression, for messages */
+    const char *err;
+    int noeval;
+};
+
+static int depth = 0;
+
+static long long assign(struct arith *x);
+
+static void fail(struct arith *x, const char *msg) {
+    if (!x->err) x->err = msg;
+}
+
+static void skip_blanks(struct arith *x) {
+    while (*x->s == ' ' || *x->s == '\t' || *x->s == '\n') x->s++;
+}
+
+/* Consume op if it comes next (and is not the start of a longer one
+ * listed in not_followed_by) */
+static int accept(struct arith *x, const char *op, const char *not_followed_by) {
+    skip_blanks(x);
+    size_t n = strlen(op);
+    if (strncmp(x->s, op, n) != 0) return 0;
+    if (not_followed_by && x->s[n] && strchr(not_followed_by, x->s[n])) return 0;
+    x->s += n;
+    return 1;
+}
+
+static int is_name_start(char c) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static int is_name_char(char c) {
+    return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+/* Read a variable name at the cursor into buf; 0 if there is none */
+static size_t read_name(struct arith *x, char *buf, size_t buflen) {
+    skip_blanks(x);
+    const char *p = x->s;
+    if (!is_name_start(*p)) return 0;
+    while (is_name_char(*p)) p++;
+    size_t n = (size_t)(p - x->s);
+    if (n >= buflen) {
+        fail(x, "variable name too long");
+        return 0;
+    }
+    memcpy(buf, x->s, n);
+    buf[n] = '\0';
+    x->s = p;
+    return n;
+}
+
+static long long get_var(struct arith *x, const char *name) {
+    const char *v = var_get(name);
+    if (!v || !*v || x->noeval) return 0;
+    long long r = 0;
+    if (arith_eval(v, &r) != 0) fail(x, "invalid variable value");
+    return r;
+}
+
+static void set_var(struct arith *x, const char *name, long long v) {
+    if (x->noeval || x->err) return;
+    char num[32];
+    snprintf(num, sizeof(num), "%lld", v);
+    if (var_set(name, num, 0) != 0) fail(x, "assignment failed");
+}
+
+static long long number(struct arith *x) {
+    const char *p = x->s;
+    char *end;
+    long long v;
+    /* base#digits, as in 2#1010 or 16#ff */
+    long base = strtol(p, &end, 10);
+    if (*end == '#' && base >= 2 && base <= 36) {
+        p = end + 1;
+        v = strtoll(p, &end, (int)base);
+        if (end == p) fail(x, "invalid number");
+    } else {
+        v = strtoll(p, &end, 0);
+    }
+    if (is_name_char(*end)) fail(x, "invalid number");
+    x->s = end;
+    return v;
+}
+
+static long long primary(struct arith *x) {
+    skip_blanks(x);
+    if (*x->s == '(') {
+        x->s++;
+        long long v = assign(x);
+        if (!accept(x, ")", NULL)) fail(x, "missing `)'");
+        return v;
+    }
+    if (*x->s >= '0' && *x->s <= '9') return number(x);
+    char name[256];
+    if (read_name(x, name, sizeof(name))) {
+        long long v = get_var(x, name);
+        /* postfix ++ / -- */
+        if (accept(x, "++", NULL)) set_var(x, name, v + 1);
+        else if (accept(x, "--", NULL)) set_var(x, name, v - 1);
+        return v;
+    }
+    fail(x, *x->s ? "syntax error: operand expected" : "syntax error: missing operand");
+    return 0;
+}
+
+static long long unary(struct arith *x) {
+    if (accept(x, "++", NULL) || accept(x, "--", NULL)) {
+        int inc = x->s[-1] == '+';
+        char name[256];
+        if (!read_name(x, name, sizeof(name))) {
+            fail(x, "syntax error: variable expected");
+            return 0;
+        }
+        long long v = get_var(x, name) + (inc ? 1 : -1);
+        set_var(x, name, v);
+        return v;
+    }
+    if (accept(x, "+", NULL)) return unary(x);
+    if (accept(x, "-", NULL)) return -unary(x);
+    if (accept(x, "!", "=")) return !unary(x);
+    if (accept(x, "~", NULL)) return ~unary(x);
+    return primary(x);
+}
+
+static long long power(struct arith *x) {
+    long long base = unary(x);
+    if (!accept(x, "**", NULL)) return base;
+    long long e = power(x);     /* right associative */
+    if (x->noeval) return 0;
+    if (e < 0) {
+        fail(x, "exponent less than 0");
+        return 0;
+    }
+    /* square and multiply; unsigned so overflow wraps the way bash's does */
+    unsigned long long r = 1, b = (unsigned long long)base;
+    while (e) {
+        if (e & 1) r *= b;
+        b *= b;
+        e >>= 1;
+    }
+    return (long long)r;
+}
+
+static long long multiplicative(struct arith *x) {
+    long long v = power(x);
+    for (;;) {
+        if (accept(x, "*", "=*")) {
+            v *= power(x);
+        } else if (accept(x, "/", "=") || accept(x, "%", "=")) {
+            int div = x->s[-1] == '/';
+            long long r = power(x);
+            if (x->noeval) continue;
+            if (r == 0) {
+                fail(x, "division by 0");
+                return 0;
+            }
+            /* LLONG_MIN / -1 overflows; the wrapped result is what bash gives */
+            if (r == -1) v = div ? -v : 0;
+            else v = div ? v / r : v % r;
+        } else {
+            return v;
+        }
+    }
+}
+
+static long long additive(struct arith *x) {
+    long long v = multiplicative(x);
+    for (;;) {
+        if (accept(x, "+", "=+")) v += multiplicative(x);
+        else if (accept(x, "-", "=-")) v -= multiplicative(x);
+        else return v;
+    }
+}
+
+static long long shift(struct arith *x) {
+    long long v = additive(x);
+    for (;;) {
+        if (accept(x, "<<", "=")) v = (long long)((unsigned long long)v << (additive(x) & 63));
+        else if (accept(x, ">>", "=")) v >>= additive(x) & 63;
+        else return v;
+    }
+}
+
+static long long relational(struct arith *x) {
+    long long v = shift(x);
+    for (;;) {
+        if (accept(x, "<=", NULL)) v = v <= shift(x);
+        else if (accept(x, ">=", NULL)) v = v >= shift(x);
+        else if (accept(x, "<", "<")) v = v < shift(x);
+        else if (accept(x, ">", ">")) v = v > shift(x);
+        else return v;
+    }
+}
+
+static long long equality(struct arith *x) {
+    long long v = relational(x);
+    for (;;) {
+        if (accept(x, "==", NULL)) v = v == relational(x);
+        else if (accept(x, "!=", NULL)) v = v != relational(x);
+        else return v;
+    }
+}
+
+static long long bit_and(struct arith *x) {
+    long long v = equality(x);
+    while (accept(x, "&", "&=")) v &= equality(x);
+    return v;
+}
+
+static long long bit_xor(struct arith *x) {
+    long long v = bit_and(x);
+    while (accept(x, "^", "=")) v ^= bit_and(x);
+    return v;
+}
+
+static long long bit_or(struct arith *x) {
+    long long v = bit_xor(x);
+    while (accept(x, "|", "|=")) v |= bit_xor(x);
+    return v;
+}
+
+static long long logical_and(struct arith *x) {
+    long long v = bit_or(x);
+    while (accept(x, "&&", NULL)) {
+        int saved = x->noeval;
+        if (!v) x->noeval = 1;
+        long long r = bit_or(x);
+        x->noeval = saved;
+        v = v && r;
+    }
+    return v;
+}
+
+static long long logical_or(struct arith *x) {
+    long long v = logical_and(x);
+    while (accept(x, "||", NULL)) {
+        int saved = x->noeval;
+        if (v) x->noeval = 1;
+        long long r = logical_and(x);
+        x->noeval = saved;
+        v = v || r;
+    }
+    return v;
+}
+
+static long long conditional(struct arith *x) {
+    long long c = logical_or(x);
+    if (!accept(x, "?", NULL)) return c;
+    int saved = x->noeval;
+    if (!c) x->noeval = 1;
+    long long a = assign(x);
+    x->noeval = saved;
+    if (!accept(x, ":", NULL)) {
+        fail(x, "`:' expected for conditional expression");
+        return 0;
+    }
+    if (c) x->noeval = 1;
+    long long b = conditional(x);
+    x->noeval = saved;
+    return c ? a : b;
+}
+
+static long long assign(struct arith *x) {
+    static const char *const ops[] = {
+        "=", "+=", "-=", "*=", "/=", "%=", "<<=", ">>=", "&=", "^=", "|=",
+    };
+    const char *start = x->s;
+    char name[256];
+    if (read_name(x, name, sizeof(name))) {
+        skip_blanks(x);
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+            size_t n = strlen(ops[i]);
+            if (strncmp(x->s, ops[i], n) != 0 || (i == 0 && x->s[1] == '=')) continue;
+            x->s += n;
+            long long r = assign(x);
+            long long v = i == 0 ? r : get_var(x, name);
+            switch (ops[i][0]) {
+                case '+': v += r; break;
+                case '-': v -= r; break;
+                case '*': v *= r; break;
+                case '/':
+                case '%':
+                    if (r == 0) {
+                        if (!x->noeval) fail(x, "division by 0");
+                        return 0;
+                    }
+                    if (r == -1) v = ops[i][0] == '/' ? -v : 0;
+                    else v = ops[i][0] == '/' ? v / r : v % r;
+                    break;
+                case '<': v = (long long)((unsigned long long)v << (r & 63)); break;
+                case '>': v >>= r & 63; break;
+                case '&': v &= r; break;
+                case '^': v ^= r; break;
+                case '|': v |= r; break;
+                default: break;
+            }
+            set_var(x, name, v);
+            return v;
+        }
+        x->s = start;   /* not an assignment: parse it again as an operand */
+    }
+    return conditional(x);
+}
+
+int arith_eval(const char *expr, long long *result) {
+    if (depth >= ARITH_MAX_DEPTH) {
+        fprintf(stderr, "kzsh: %s: expression recursion level exceeded\n", expr);
+        return -1;
+    }
+    struct arith x = { expr, expr, NULL, 0 };
+    depth++;
+    skip_blanks(&x);
+    long long v = *x.s ? assign(&x) : 0;
+    skip_blanks(&x);
+    if (!x.err && *x.s) fail(&x, "syntax error in expression");
+    depth--;
+    if (x.err) {
+        /* nested evaluations of variable values report only once */
+        if (depth == 0 || strcmp(x.err, "invalid variable value") != 0) {
+            fprintf(stderr, "kzsh: %s: %s\n", expr, x.err);
+        }
+        return -1;
+    }
+    *result = v;
+    return 0;
+}
@@ -1,15 +1,45 @@
 #include "shell.h"
+#include "builtins.h"
+#include "script.h"
+#include "cmdhash.h"
+#include "alias.h"
+#include "env.h"
+#include "history.h"
+#include "jobs.h"
+#include "prompt.h"
+#include "kzsh.h"
+#include "out.h"
+#include "var.h"
+#include "vm.h"
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <pwd.h>
+#include <sys/stat.h>
 
 int builtin_echo(int argc, char **argv) {
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    o->tty = 0;
     for (int i = 1; i < argc; ++i) {
-        printf("%s%s", argv[i], (i < argc-1) ? " " : "\n");
+        if (i > 1) out_putc(o, ' ');
+        out_str(o, argv[i]);
     }
-    return 0;
+    out_putc(o, '\n');
+    return out_close(o) != 0;
+}
+
+/* One line of output through an out buffer, for the builtins that print
+ * a single line */
+static int print_line(const char *s) {
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    o->tty = 0;
+    out_str(o, s);
+    out_putc(o, '\n');
+    return out_close(o) != 0;
 }
 
 int builtin_true(int argc, char **argv) {
@@ -20,38 +50,361 @@ int builtin_false(int argc, char **argv) {
     return 1;
 }
 
+int builtin_exit(int argc, char **argv) {
+    if (jobs_exit_check()) return 1;
+    int code = (argc > 1) ? atoi(argv[1]) : 0;
+    exit(code);
+}
+
 int builtin_cd(int argc, char **argv) {
     const char *dir = NULL;
     if (argc < 2) {
-        dir = getenv("HOME");
-        if (!dir) return -1;
+        dir = var_get("HOME");
+        if (!dir) {
+            fprintf(stderr, "cd: HOME not set\n");
+            return 1;
+        }
     } else {
         dir = argv[1];
     }
     if (chdir(dir) != 0) {
         fprintf(stderr, "cd: %s: %s\n", dir, strerror(errno));
-        return -1;
+        return 1;
     }
+    prompt_invalidate(PROMPT_CWD);
     return 0;
 }
 
+int builtin_pwd(int argc, char **argv) {
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        fprintf(stderr, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    return print_line(cwd);
+}
+
 int builtin_source(int argc, char **argv) {
     if (argc < 2) {
         fprintf(stderr, "source: filename required\n");
-        return -1;
+        return 2;
+    }
+    /* Parsed once up front; sourced lines never reach history */
+    return script_run_file(argv[1]);
+}
+
+static const char *alias_value(const char *name) {
+    const struct alias *al = alias_lookup(name);
+    return al ? al->value : NULL;
+}
+
+int builtin_hash(int argc, char **argv) {
+    int status = 0;
+    int i = 1;
+    if (i < argc && strcmp(argv[i], "-r") == 0) {
+        cmdhash_clear();
+        i++;
+    }
+    if (argc == 1) {
+        struct out *o = out_open(STDOUT_FILENO);
+        if (!o) return 1;
+        cmdhash_show(o);
+        return out_close(o) != 0;
+    }
+    for (; i < argc; ++i) {
+        if (strchr(argv[i], '/')) continue;
+        if (builtin_lookup(argv[i])) continue;
+        if (!cmdhash_lookup(argv[i])) {
+            fprintf(stderr, "hash: %s: not found\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int builtin_type(int argc, char **argv) {
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    int status = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *name = argv[i];
+        const char *val = alias_value(name);
+        const char *hashed = NULL, *path = NULL;
+        if (!val && !vm_function(name) && !builtin_lookup(name) &&
+            !(hashed = cmdhash_peek(name)) && !(path = cmdhash_lookup(name))) {
+            /* after what was printed so far */
+            out_flush(o);
+            fprintf(stderr, "type: %s: not found\n", name);
+            status = 1;
+            continue;
+        }
+        out_str(o, name);
+        if (val) {
+            out_str(o, " is aliased to `");
+            out_str(o, val);
+            out_putc(o, '\'');
+        } else if (vm_function(name)) {
+            out_str(o, " is a function");
+        } else if (builtin_lookup(name)) {
+            out_str(o, " is a shell builtin");
+        } else if (hashed) {
+            out_str(o, " is hashed (");
+            out_str(o, hashed);
+            out_putc(o, ')');
+        } else {
+            out_str(o, " is ");
+            out_str(o, path);
+        }
+        out_putc(o, '\n');
     }
-    FILE *f = fopen(argv[1], "r");
-    if (!f) {
-        fprintf(stderr, "source: cannot open %s: %s\n", argv[1], strerror(errno));
-        return -1;
+    if (out_close(o) != 0) status = 1;
+    return status;
+}
+
+int builtin_which(int argc, char **argv) {
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    int status = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *path = cmdhash_lookup(argv[i]);
+        if (path && (path != argv[i] || access(path, X_OK) == 0)) {
+            out_str(o, path);
+            out_putc(o, '\n');
+        } else {
+            status = 1;
+        }
     }
-    char line[512];
-    while (fgets(line, sizeof(line), f)) {
-        // strip newline
-        line[strcspn(line, "\n")] = 0;
-        shell_eval_line(line);
+    if (out_close(o) != 0) status = 1;
+    return status;
+}
+
+/* env_show into an out buffer */
+static int show_env(void) {
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    env_show(o);
+    return out_close(o) != 0;
+}
+
+/* var_show into an out buffer */
+static int show_vars(const char *cmd, unsigned mask, int with_flags) {
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    var_show(o, cmd, mask, with_flags);
+    return out_close(o) != 0;
+}
+
+int builtin_printenv(int argc, char **argv) {
+    if (argc < 2) return show_env();
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    int status = 0;
+    for (int i = 1; i < argc; ++i) {
+        /* only what a child would see: shell-local variables don't count */
+        const struct var *v = var_lookup(argv[i]);
+        if (v && v->set && (v->flags & VAR_EXPORT)) {
+            out_str(o, VAR_VALUE(v));
+            out_putc(o, '\n');
+        } else {
+            status = 1;
+        }
     }
-    fclose(f);
+    if (out_close(o) != 0) status = 1;
+    return status;
+}
+
+int builtin_env(int argc, char **argv) {
+    return show_env();
+}
+
+/* NAME=value sets and adds flags; a bare NAME only adds flags */
+static int set_with_flags(char *arg, unsigned flags) {
+    char *eq = strchr(arg, '=');
+    if (!eq) return var_set_flags(arg, flags);
+    *eq = '\0';
+    int r = var_set(arg, eq + 1, flags);
+    *eq = '=';
+    return r;
+}
+
+int builtin_export(int argc, char **argv) {
+    int i = 1;
+    if (i < argc && strcmp(argv[i], "-p") == 0) i++;
+    if (i == argc) return show_env();
+    int status = 0;
+    for (; i < argc; ++i) {
+        if (set_with_flags(argv[i], VAR_EXPORT) != 0) status = 1;
+    }
+    return status;
+}
+
+int builtin_readonly(int argc, char **argv) {
+    int i = 1;
+    if (i < argc && strcmp(argv[i], "-p") == 0) i++;
+    if (i == argc) return show_vars("readonly", VAR_READONLY, 0);
+    int status = 0;
+    for (; i < argc; ++i) {
+        if (set_with_flags(argv[i], VAR_READONLY) != 0) status = 1;
+    }
+    return status;
+}
+
+/* declare/typeset [-irxp] [NAME[=value]...] */
+int builtin_declare(int argc, char **argv) {
+    unsigned flags = 0;
+    int print = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        for (const char *o = argv[i] + 1; *o; ++o) {
+            switch (*o) {
+                case 'i': flags |= VAR_INTEGER; break;
+                case 'r': flags |= VAR_READONLY; break;
+                case 'x': flags |= VAR_EXPORT; break;
+                case 'p': print = 1; break;
+                default:
+                    fprintf(stderr, "%s: -%c: invalid option\n", argv[0], *o);
+                    return 2;
+            }
+        }
+    }
+    if (i == argc) return show_vars(argv[0], flags, 1);
+    int status = 0;
+    for (; i < argc; ++i) {
+        if (print) {
+            const struct var *v = var_lookup(argv[i]);
+            struct out *o = v ? out_open(STDOUT_FILENO) : NULL;
+            if (o) {
+                var_print(o, argv[0], v, 1);
+                if (out_close(o) != 0) status = 1;
+            } else if (v) {
+                status = 1;
+            } else {
+                fprintf(stderr, "%s: %s: not found\n", argv[0], argv[i]);
+                status = 1;
+            }
+        } else if (set_with_flags(argv[i], flags) != 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* unset [-v | -f] name...: without an option, a name that is not a
+ * variable is taken to be a function */
+int builtin_unset(int argc, char **argv) {
+    int i = 1;
+    char what = 0;
+    if (i < argc && (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "-f") == 0)) what = argv[i++][1];
+    int status = 0;
+    for (; i < argc; ++i) {
+        if (what == 'f' || (!what && !var_lookup(argv[i]) && vm_function(argv[i]))) {
+            vm_function_unset(argv[i]);
+        } else if (var_unset(argv[i]) != 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int builtin_umask(int argc, char **argv) {
+    if (argc < 2) {
+        mode_t m = umask(0);
+        umask(m);
+        char text[8];
+        snprintf(text, sizeof(text), "%04o", (unsigned)m);
+        return print_line(text);
+    }
+    char *end;
+    long m = strtol(argv[1], &end, 8);
+    if (*end || m < 0 || m > 0777) {
+        fprintf(stderr, "umask: %s: invalid mode\n", argv[1]);
+        return 1;
+    }
+    umask((mode_t)m);
+    return 0;
+}
+
+int builtin_whoami(int argc, char **argv) {
+    struct passwd *pw = getpwuid(geteuid());
+    if (!pw) {
+        fprintf(stderr, "whoami: cannot find name for user ID %u\n", (unsigned)geteuid());
+        return 1;
+    }
+    return print_line(pw->pw_name);
+}
+
+int builtin_logname(int argc, char **argv) {
+    const char *name = getlogin();
+    if (!name) name = var_get("LOGNAME");
+    if (!name) {
+        fprintf(stderr, "logname: no login name\n");
+        return 1;
+    }
+    return print_line(name);
+}
+
+int builtin_clear(int argc, char **argv) {
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    out_str(o, "\x1b[H\x1b[2J");
+    return out_close(o) != 0;
+}
+
+int builtin_history(int argc, char **argv) {
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    history_show(o);
+    return out_close(o) != 0;
+}
+
+int builtin_alias(int argc, char **argv) {
+    struct out *o = out_open(STDOUT_FILENO);
+    if (!o) return 1;
+    if (argc < 2) {
+        alias_show(o);
+        return out_close(o) != 0;
+    }
+    /* Legacy form: alias name value */
+    if (argc == 3 && !strchr(argv[1], '=')) {
+        alias_set(argv[1], argv[2]);
+        return out_close(o) != 0;
+    }
+    int status = 0;
+    for (int i = 1; i < argc; ++i) {
+        char *eq = strchr(argv[i], '=');
+        if (eq) {
+            *eq = '\0';
+            alias_set(argv[i], eq + 1);
+            *eq = '=';
+        } else {
+            const struct alias *al = alias_lookup(argv[i]);
+            if (al) {
+                alias_print(o, al);
+            } else {
+                out_flush(o);
+                fprintf(stderr, "alias: %s: not found\n", argv[i]);
+                status = 1;
+            }
+        }
+    }
+    if (out_close(o) != 0) status = 1;
+    return status;
+}
+
+int builtin_unalias(int argc, char **argv) {
+    int status = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (alias_unset(argv[i]) != 0) {
+            fprintf(stderr, "unalias: %s: not found\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int builtin_help(int argc, char **argv) {
+    fflush(stdout);
+    ksh_help();
     return 0;
 }
 
@@ -1,19 +1,13 @@
-#include "version.h"
-
-// Example usage
-void ksh_version() {
-    print_version();
-}
-
 #include <iostream>
+#include "version.h"
 #include "../include/kzsh.h"
-
-extern "C" void print_version();
+#include "../include/builtins.h"
 
 void ksh_help() {
     std::cout << "Kuznix Shell Help: Built-in commands..." << std::endl;
-    std::cout << "  help      Show help" << std::endl;
-    std::cout << "  version   Show version info" << std::endl;
+    for (size_t i = 0; i < builtin_count(); ++i) {
+        std::cout << "  " << builtin_at(i)->name << std::endl;
+    }
 }
 
 void ksh_version() {
@@ -1 +1,101 @@
+// Builtin registry.
+//
+// The table below is generated from the X-macro in builtins_list.h, and a
+// perfect hash over the implemented names is searched for at compile time,
+// so a lookup is one hash, one table probe and one string compare no
+// matter how many builtins there are.
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "builtins.h"
+#include "builtins_list.h"
+
+namespace {
+
+constexpr builtin entries[] = {
+#define X(name, fn, flags) { name, fn, flags },
+    BUILTIN_COMMANDS
+#undef X
+};
+
+constexpr std::size_t kCount = sizeof(entries) / sizeof(entries[0]);
+static_assert(kCount < 255, "builtin slots are stored as uint8_t");
+
+constexpr std::size_t cstrlen(const char *s) {
+    std::size_t n = 0;
+    while (s[n]) ++n;
+    return n;
+}
+
+constexpr std::uint32_t mix(const char *s, std::size_t n, std::uint32_t seed) {
+    std::uint32_t h = 2166136261u ^ seed;
+    for (std::size_t i = 0; i < n; ++i) {
+        h ^= static_cast<unsigned char>(s[i]);
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+// Sparse table (~8 slots per name) so a collision-free seed turns up fast
+constexpr std::size_t table_size() {
+    std::size_t n = 1;
+    while (n < kCount * 8) n <<= 1;
+    return n;
+}
+constexpr std::size_t kSize = table_size();
+
+struct PerfectHash {
+    std::uint32_t seed;
+    std::uint8_t slot[kSize];       // entry index + 1; 0 is empty
+    std::uint8_t order[kCount];     // implemented entries, in list order
+    std::size_t implemented;
+};
+
+constexpr PerfectHash build() {
+    PerfectHash t{};
+    for (std::size_t i = 0; i < kCount; ++i) {
+        if (entries[i].fn) t.order[t.implemented++] = static_cast<std::uint8_t>(i);
+    }
+    for (std::uint32_t seed = 1; seed < 100000; ++seed) {
+        for (std::size_t i = 0; i < kSize; ++i) t.slot[i] = 0;
+        bool ok = true;
+        for (std::size_t i = 0; i < kCount && ok; ++i) {
+            if (!entries[i].fn) continue;
+            std::size_t h = mix(entries[i].name, cstrlen(entries[i].name), seed) & (kSize - 1);
+            if (t.slot[h]) ok = false;
+            else t.slot[h] = static_cast<std::uint8_t>(i + 1);
+        }
+        if (ok) {
+            t.seed = seed;
+            return t;
+        }
+    }
+    t.seed = 0;
+    return t;
+}
+
+constexpr PerfectHash kTable = build();
+static_assert(kTable.seed != 0, "no perfect hash found (duplicate name in builtins_list.h?)");
+
+} // namespace
+
+extern "C" const struct builtin *builtin_lookup(const char *name) {
+    std::size_t n = std::strlen(name);
+    std::uint8_t s = kTable.slot[mix(name, n, kTable.seed) & (kSize - 1)];
+    if (!s) return nullptr;
+    const builtin *b = &entries[s - 1];
+    return std::strcmp(b->name, name) == 0 ? b : nullptr;
+}
+
+extern "C" std::size_t builtin_count(void) {
+    return kTable.implemented;
+}
+
+extern "C" const struct builtin *builtin_at(std::size_t index) {
+    return index < kTable.implemented ? &entries[kTable.order[index]] : nullptr;
+}
@@ -0,0 +1,150 @@
+/*
+ * Open-addressing (linear probing) table of command name -> path.
+ * Entries are only ever removed all at once, so no tombstones are needed.
+ */
+
+#include "cmdhash.h"
+#include "out.h"
+#include "var.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct cmd_entry {
+    char *name;         /* NULL marks an empty slot */
+    char *path;
+    uint32_t hash;
+    unsigned hits;
+};
+
+static struct cmd_entry *table = NULL;
+static size_t table_cap = 0;    /* always a power of two */
+static size_t table_used = 0;
+static char *uncached_path = NULL;  /* last result that was not stored */
+
+static uint32_t hash_str(const char *s) {
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct cmd_entry *find_slot(const char *name, uint32_t h) {
+    size_t mask = table_cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        struct cmd_entry *e = &table[i];
+        if (!e->name) return e;
+        if (e->hash == h && strcmp(e->name, name) == 0) return e;
+    }
+}
+
+static int grow(void) {
+    size_t ncap = table_cap ? table_cap * 2 : 64;
+    struct cmd_entry *old = table;
+    size_t ocap = table_cap;
+    table = calloc(ncap, sizeof(*table));
+    if (!table) {
+        table = old;
+        return -1;
+    }
+    table_cap = ncap;
+    for (size_t i = 0; i < ocap; ++i) {
+        if (old[i].name) *find_slot(old[i].name, old[i].hash) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+static int is_executable(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+char *cmdhash_search_path(const char *name) {
+    const char *path = var_get("PATH");
+    if (!path) path = "/usr/local/bin:/usr/bin:/bin";
+    size_t nlen = strlen(name);
+    char buf[4096];
+    const char *p = path;
+    for (;;) {
+        const char *colon = strchr(p, ':');
+        size_t dlen = colon ? (size_t)(colon - p) : strlen(p);
+        /* An empty PATH element means the current directory */
+        const char *dir = dlen ? p : ".";
+        if (dlen == 0) dlen = 1;
+        if (dlen + nlen + 2 <= sizeof(buf)) {
+            memcpy(buf, dir, dlen);
+            buf[dlen] = '/';
+            memcpy(buf + dlen + 1, name, nlen + 1);
+            if (is_executable(buf)) return strdup(buf);
+        }
+        if (!colon) break;
+        p = colon + 1;
+    }
+    return NULL;
+}
+
+const char *cmdhash_peek(const char *name) {
+    if (!table_used) return NULL;
+    struct cmd_entry *e = find_slot(name, hash_str(name));
+    return e->name ? e->path : NULL;
+}
+
+const char *cmdhash_lookup(const char *name) {
+    if (strchr(name, '/')) return name;
+    uint32_t h = hash_str(name);
+    if (table_cap) {
+        struct cmd_entry *e = find_slot(name, h);
+        if (e->name) {
+            e->hits++;
+            return e->path;
+        }
+    }
+    char *found = cmdhash_search_path(name);
+    if (!found) return NULL;
+    /* Relative PATH entries depend on the cwd; don't remember them */
+    if (found[0] != '/' || ((table_used + 1) * 2 > table_cap && grow() != 0)) {
+        free(uncached_path);
+        uncached_path = found;
+        return found;
+    }
+    struct cmd_entry *e = find_slot(name, h);
+    e->name = strdup(name);
+    e->path = found;
+    e->hash = h;
+    e->hits = 1;
+    table_used++;
+    return found;
+}
+
+void cmdhash_clear(void) {
+    for (size_t i = 0; i < table_cap; ++i) {
+        if (table[i].name) {
+            free(table[i].name);
+            free(table[i].path);
+            table[i].name = NULL;
+        }
+    }
+    table_used = 0;
+}
+
+void cmdhash_show(struct out *o) {
+    if (!table_used) {
+        out_str(o, "hash: hash table empty\n");
+        return;
+    }
+    out_str(o, "hits\tcommand\n");
+    for (size_t i = 0; i < table_cap; ++i) {
+        if (table[i].name) {
+            out_num(o, table[i].hits, 4, ' ');
+            out_putc(o, '\t');
+            out_str(o, table[i].path);
+            out_putc(o, '\n');
+        }
+    }
+}
@@ -0,0 +1,335 @@
+/*
+ * Tab completion indexes.
+ *
+ * A listing is one directory's entries sorted by name, with the names in a
+ * single blob. Prefix queries are a binary search for the first match
+ * followed by a walk over the run of matches. Each listing remembers the
+ * directory's device, inode and mtime; any change there (an entry added,
+ * removed or renamed, or the directory replaced) triggers a rescan on
+ * the next query.
+ *
+ * $PATH gets one listing per directory, holding only executables; it is
+ * rebuilt when $PATH itself changes. Path completion uses a small LRU of
+ * listings, so going back and forth between a few big directories never
+ * rescans them.
+ */
+
+#include "complete.h"
+#include "builtins.h"
+#include "alias.h"
+#include "var.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <limits.h>
+
+#define DIR_CACHE_SLOTS 8
+
+struct entry {
+    uint32_t off;           /* name in the listing's blob */
+    unsigned char dir;
+};
+
+struct listing {
+    char *path;
+    int exec_only;          /* $PATH directory: executables only */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    int scanned;
+    char *names;            /* NUL-separated entry names */
+    size_t names_len, names_cap;
+    struct entry *ents;     /* sorted by name */
+    size_t n, cap;
+    unsigned long used;     /* LRU stamp */
+};
+
+static struct listing dir_cache[DIR_CACHE_SLOTS];
+static unsigned long lru_clock = 0;
+
+static struct listing *path_dirs = NULL;
+static size_t npath_dirs = 0;
+static char *path_value = NULL;     /* $PATH the listings were made for */
+
+static struct completion_item *items = NULL;
+static size_t nitems = 0, items_cap = 0;
+
+/* ---- listings ---- */
+
+static void listing_reset(struct listing *l) {
+    free(l->path);
+    free(l->names);
+    free(l->ents);
+    memset(l, 0, sizeof(*l));
+}
+
+static int add_name(struct listing *l, const char *name, int dir) {
+    size_t len = strlen(name) + 1;
+    if (l->names_len + len > l->names_cap) {
+        size_t ncap = l->names_cap ? l->names_cap * 2 : 4096;
+        while (l->names_len + len > ncap) ncap *= 2;
+        char *grown = realloc(l->names, ncap);
+        if (!grown) return -1;
+        l->names = grown;
+        l->names_cap = ncap;
+    }
+    if (l->n == l->cap) {
+        size_t ncap = l->cap ? l->cap * 2 : 256;
+        struct entry *grown = realloc(l->ents, sizeof(*grown) * ncap);
+        if (!grown) return -1;
+        l->ents = grown;
+        l->cap = ncap;
+    }
+    memcpy(l->names + l->names_len, name, len);
+    l->ents[l->n].off = (uint32_t)l->names_len;
+    l->ents[l->n].dir = (unsigned char)dir;
+    l->n++;
+    l->names_len += len;
+    return 0;
+}
+
+static const char *sort_names;  /* blob for by_name (qsort has no context) */
+
+static int by_name(const void *a, const void *b) {
+    const struct entry *x = a, *y = b;
+    return strcmp(sort_names + x->off, sort_names + y->off);
+}
+
+static void scan(struct listing *l) {
+    l->n = 0;
+    l->names_len = 0;
+    l->scanned = 1;
+    DIR *d = opendir(l->path);
+    if (!d) return;
+    int dfd = dirfd(d);
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        const char *name = de->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        int dir = de->d_type == DT_DIR;
+        if (l->exec_only || de->d_type == DT_LNK || de->d_type == DT_UNKNOWN) {
+            /* the entry type alone can't tell: look at what it points to */
+            struct stat st;
+            if (fstatat(dfd, name, &st, 0) != 0) {
+                /* dangling symlink: still a file name to complete */
+                if (l->exec_only) continue;
+                st.st_mode = S_IFREG;
+            }
+            dir = S_ISDIR(st.st_mode);
+            if (l->exec_only && (!S_ISREG(st.st_mode) || !(st.st_mode & 0111))) continue;
+        }
+        if (add_name(l, name, dir) != 0) break;
+    }
+    closedir(d);
+    sort_names = l->names;
+    qsort(l->ents, l->n, sizeof(*l->ents), by_name);
+}
+
+/* Rescan l if its directory changed since the last scan */
+static void refresh(struct listing *l) {
+    struct stat st;
+    if (stat(l->path, &st) != 0) {
+        l->n = 0;
+        l->scanned = 0;
+        return;
+    }
+    if (l->scanned && st.st_dev == l->dev && st.st_ino == l->ino &&
+        st.st_mtim.tv_sec == l->mtime.tv_sec && st.st_mtim.tv_nsec == l->mtime.tv_nsec) {
+        return;
+    }
+    l->dev = st.st_dev;
+    l->ino = st.st_ino;
+    l->mtime = st.st_mtim;
+    scan(l);
+}
+
+/* Listing for a directory used by path completion */
+static struct listing *dir_listing(const char *path) {
+    struct listing *victim = &dir_cache[0];
+    for (int i = 0; i < DIR_CACHE_SLOTS; ++i) {
+        struct listing *l = &dir_cache[i];
+        if (l->path && strcmp(l->path, path) == 0) {
+            victim = l;
+            break;
+        }
+        if (!l->path || l->used < victim->used) victim = l;
+    }
+    if (!victim->path || strcmp(victim->path, path) != 0) {
+        listing_reset(victim);
+        victim->path = strdup(path);
+        if (!victim->path) return NULL;
+    }
+    victim->used = ++lru_clock;
+    refresh(victim);
+    return victim;
+}
+
+/* The $PATH listings, rebuilt when $PATH changes */
+static void load_path_dirs(void) {
+    const char *path = var_get("PATH");
+    if (!path) path = "";
+    if (path_value && strcmp(path_value, path) == 0) return;
+    for (size_t i = 0; i < npath_dirs; ++i) listing_reset(&path_dirs[i]);
+    free(path_dirs);
+    free(path_value);
+    path_dirs = NULL;
+    npath_dirs = 0;
+    path_value = strdup(path);
+
+    size_t ndirs = 1;
+    for (const char *p = path; *p; ++p) ndirs += (*p == ':');
+    path_dirs = calloc(ndirs, sizeof(*path_dirs));
+    if (!path_dirs || !path_value) return;
+    const char *p = path;
+    for (;;) {
+        const char *colon = strchr(p, ':');
+        size_t len = colon ? (size_t)(colon - p) : strlen(p);
+        struct listing *l = &path_dirs[npath_dirs];
+        /* an empty entry means the current directory */
+        l->path = len ? strndup(p, len) : strdup(".");
+        l->exec_only = 1;
+        if (l->path) npath_dirs++;
+        if (!colon) break;
+        p = colon + 1;
+    }
+}
+
+/* ---- candidates ---- */
+
+static void add_item(const char *name, int dir) {
+    if (nitems == items_cap) {
+        size_t ncap = items_cap ? items_cap * 2 : 64;
+        struct completion_item *grown = realloc(items, sizeof(*grown) * ncap);
+        if (!grown) return;
+        items = grown;
+        items_cap = ncap;
+    }
+    items[nitems].name = name;
+    items[nitems].dir = dir;
+    nitems++;
+}
+
+/* Add the entries of l that start with prefix (binary search + run) */
+static void add_matches(const struct listing *l, const char *prefix, size_t plen) {
+    size_t lo = 0, hi = l->n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (strncmp(l->names + l->ents[mid].off, prefix, plen) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    /* dot files only when asked for */
+    int dots = plen > 0 && prefix[0] == '.';
+    for (size_t i = lo; i < l->n; ++i) {
+        const char *name = l->names + l->ents[i].off;
+        if (strncmp(name, prefix, plen) != 0) break;
+        if (name[0] == '.' && !dots) continue;
+        add_item(name, l->ents[i].dir);
+    }
+}
+
+static int by_item(const void *a, const void *b) {
+    const struct completion_item *x = a, *y = b;
+    return strcmp(x->name, y->name);
+}
+
+static void complete_command(const char *prefix, size_t plen) {
+    for (size_t i = 0; i < builtin_count(); ++i) {
+        const char *name = builtin_at(i)->name;
+        if (strncmp(name, prefix, plen) == 0) add_item(name, 0);
+    }
+    size_t pos = 0;
+    const struct alias *al;
+    while ((al = alias_next(&pos))) {
+        if (strncmp(al->name, prefix, plen) == 0) add_item(al->name, 0);
+    }
+    load_path_dirs();
+    for (size_t i = 0; i < npath_dirs; ++i) {
+        refresh(&path_dirs[i]);
+        add_matches(&path_dirs[i], prefix, plen);
+    }
+    /* the same name from several sources is one candidate */
+    qsort(items, nitems, sizeof(*items), by_item);
+    size_t o = 0;
+    for (size_t i = 0; i < nitems; ++i) {
+        if (o == 0 || strcmp(items[o - 1].name, items[i].name) != 0) items[o++] = items[i];
+    }
+    nitems = o;
+}
+
+/* ---- the word under the cursor ---- */
+
+static int is_separator(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == ';' || c == '|' || c == '&' ||
+           c == '(' || c == ')' || c == '<' || c == '>';
+}
+
+/* Copy s[0..n) to out without backslash escapes and quotes */
+static void unescape(const char *s, size_t n, char *out, size_t outlen) {
+    size_t o = 0;
+    for (size_t i = 0; i < n && o + 1 < outlen; ++i) {
+        if (s[i] == '\\' && i + 1 < n) out[o++] = s[++i];
+        else if (s[i] != '\'' && s[i] != '"') out[o++] = s[i];
+    }
+    out[o] = '\0';
+}
+
+size_t complete_line(const char *line, size_t cursor, struct completion *c) {
+    nitems = 0;
+
+    /* back to the start of the word; an escaped separator is part of it */
+    size_t ws = cursor;
+    while (ws > 0 && !(is_separator(line[ws - 1]) && !(ws >= 2 && line[ws - 2] == '\\'))) ws--;
+    size_t j = ws;
+    while (j > 0 && (line[j - 1] == ' ' || line[j - 1] == '\t')) j--;
+    int command = j == 0 || strchr(";|&(\n", line[j - 1]) != NULL;
+
+    /* only the last path component is completed */
+    size_t cs = ws;
+    for (size_t i = ws; i < cursor; ++i) {
+        if (line[i] == '\\') i++;
+        else if (line[i] == '/') cs = i + 1;
+    }
+    char prefix[NAME_MAX + 1];
+    unescape(line + cs, cursor - cs, prefix, sizeof(prefix));
+    size_t plen = strlen(prefix);
+    c->start = cs;
+    c->prefix_len = plen;
+
+    if (command && cs == ws) {
+        complete_command(prefix, plen);
+    } else {
+        char dir[PATH_MAX];
+        if (cs == ws) {
+            strcpy(dir, ".");
+        } else {
+            char typed[PATH_MAX];
+            unescape(line + ws, cs - ws, typed, sizeof(typed));
+            const char *home = var_get("HOME");
+            if (typed[0] == '~' && (typed[1] == '/' || typed[1] == '\0') && home) {
+                snprintf(dir, sizeof(dir), "%s%s", home, typed + 1);
+            } else {
+                snprintf(dir, sizeof(dir), "%s", typed);
+            }
+        }
+        struct listing *l = dir_listing(dir);
+        if (l) add_matches(l, prefix, plen);
+    }
+    c->items = items;
+    c->n = nitems;
+    return nitems;
+}
+
+size_t complete_escape(const char *name, char *out, size_t outlen) {
+    size_t o = 0;
+    for (const char *p = name; *p && o + 2 < outlen; ++p) {
+        if (strchr(" \t\n\\'\"`$&|;()<>*?[]#!{}", *p) || (p == name && *p == '~')) out[o++] = '\\';
+        out[o++] = *p;
+    }
+    out[o] = '\0';
+    return o;
+}
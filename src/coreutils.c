@@ -0,0 +1,1764 @@
+/*
+ * In-process implementations of common text utilities (cat, head, tail,
+ * wc, grep, sort, uniq, tr, seq, yes, tee, sleep).
+ *
+ * These avoid a fork+exec per call and are tuned for throughput: regular
+ * files are mmap'd, line scanning uses memchr/memmem, bulk copies go
+ * through io_copy (copy_file_range/splice/sendfile), and output is
+ * batched into large buffers. Behaviour follows GNU coreutils in the C
+ * locale for the supported options; a command using any other option is
+ * handed to the tool found on PATH.
+ */
+
+#define _GNU_SOURCE
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <regex.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "cmdhash.h"
+#include "exec.h"
+#include "iocopy.h"
+#include "out.h"
+#include "shell.h"
+
+#define IN_BUFSZ (256 * 1024)
+
+/* ---- input ---- */
+
+static int open_input(const char *cmd, const char *name) {
+    if (!name || strcmp(name, "-") == 0) return STDIN_FILENO;
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) fprintf(stderr, "%s: %s: %s\n", cmd, name, strerror(errno));
+    return fd;
+}
+
+static void close_input(int fd) {
+    if (fd > STDIN_FILENO) close(fd);
+}
+
+/* Streaming reader handing out blocks that end on a line boundary (except
+ * possibly the last one). Regular files are mapped and returned whole. */
+struct reader {
+    int fd;
+    char *buf;
+    size_t cap, start, end;
+    int eof;
+    void *base;         /* whole-file mapping */
+    size_t baselen;
+    const char *map;    /* unread part of it */
+    size_t maplen;
+    int map_done;
+};
+
+static void reader_init(struct reader *r, int fd) {
+    struct stat st;
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        if (pos >= 0 && pos < st.st_size) {
+            void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) {
+                madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+                r->base = m;
+                r->baselen = (size_t)st.st_size;
+                r->map = (const char *)m + pos;
+                r->maplen = (size_t)(st.st_size - pos);
+            }
+        } else if (pos >= st.st_size) {
+            r->map_done = 1;
+            r->eof = 1;
+        }
+    }
+}
+
+static void reader_free(struct reader *r) {
+    if (r->base) munmap(r->base, r->baselen);
+    free(r->buf);
+}
+
+/* Returns 1 with a block, 0 at EOF, -1 on error/interrupt. */
+static int reader_block(struct reader *r, const char **p, size_t *n) {
+    if (r->map) {
+        if (r->map_done) return 0;
+        r->map_done = 1;
+        *p = r->map;
+        *n = r->maplen;
+        return 1;
+    }
+    if (r->map_done) return 0;
+    if (!r->buf) {
+        r->cap = IN_BUFSZ;
+        r->buf = malloc(r->cap);
+        if (!r->buf) return -1;
+    }
+    for (;;) {
+        /* move the unfinished line to the front */
+        if (r->start) {
+            memmove(r->buf, r->buf + r->start, r->end - r->start);
+            r->end -= r->start;
+            r->start = 0;
+        }
+        if (r->eof) {
+            if (r->end == 0) return 0;
+            *p = r->buf;
+            *n = r->end;
+            r->start = r->end;
+            r->map_done = 1;
+            return 1;
+        }
+        if (r->end == r->cap) {
+            char *grown = realloc(r->buf, r->cap * 2);
+            if (!grown) return -1;
+            r->buf = grown;
+            r->cap *= 2;
+        }
+        ssize_t got = read(r->fd, r->buf + r->end, r->cap - r->end);
+        if (got < 0) {
+            if (errno == EINTR && !got_sigint) continue;
+            return -1;
+        }
+        if (got == 0) {
+            r->eof = 1;
+            continue;
+        }
+        size_t scanned = r->end;
+        r->end += (size_t)got;
+        const char *nl = memrchr(r->buf + scanned, '\n', r->end - scanned);
+        if (nl) {
+            size_t upto = (size_t)(nl - r->buf) + 1;
+            *p = r->buf;
+            *n = upto;
+            r->start = upto;
+            return 1;
+        }
+    }
+}
+
+/* Point the fd offset just past upto, the end of what the caller used from
+ * the last block, so whoever reads a shared seekable input next carries on
+ * from there. Pipes can't seek and keep whatever was read ahead. */
+static void reader_rewind(struct reader *r, const char *upto) {
+    if (r->map) lseek(r->fd, (off_t)(upto - (const char *)r->base), SEEK_SET);
+    else if (r->buf) lseek(r->fd, -(off_t)(r->end - (size_t)(upto - r->buf)), SEEK_CUR);
+}
+
+/* Read an entire input into memory (mapped when possible). */
+struct slurp {
+    const char *data;
+    size_t len;
+    void *map;
+    char *heap;
+};
+
+static int slurp_fd(int fd, struct slurp *s) {
+    struct stat st;
+    memset(s, 0, sizeof(*s));
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && lseek(fd, 0, SEEK_CUR) == 0) {
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            s->map = m;
+            s->data = m;
+            s->len = (size_t)st.st_size;
+            return 0;
+        }
+    }
+    size_t cap = IN_BUFSZ, len = 0;
+    char *buf = malloc(cap);
+    if (!buf) return -1;
+    for (;;) {
+        if (len == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                return -1;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t r = read(fd, buf + len, cap - len);
+        if (r < 0) {
+            if (errno == EINTR && !got_sigint) continue;
+            free(buf);
+            return -1;
+        }
+        if (r == 0) break;
+        len += (size_t)r;
+    }
+    s->heap = buf;
+    s->data = buf;
+    s->len = len;
+    return 0;
+}
+
+static void slurp_free(struct slurp *s) {
+    if (s->map) munmap(s->map, s->len);
+    free(s->heap);
+}
+
+static size_t count_newlines(const char *p, size_t n) {
+    size_t count = 0, i = 0;
+#ifdef __SSE2__
+    /* 16 bytes per step: matching lanes subtract -1 from per-byte counters,
+     * which are summed with psadbw before they can overflow */
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (i + 16 <= n) {
+        __m128i acc = _mm_setzero_si128();
+        size_t lim = i + 16 * 255 < n ? i + 16 * 255 : n;
+        for (; i + 16 <= lim; i += 16)
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl));
+        __m128i sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += (size_t)_mm_cvtsi128_si32(sum) + (size_t)_mm_extract_epi16(sum, 4);
+    }
+#endif
+    for (; i < n; ++i) count += p[i] == '\n';
+    return count;
+}
+
+/* Parse a non-negative count; returns -1 on error */
+static long long parse_count(const char *s) {
+    char *end;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    if (errno || end == s || *end || v < 0) return -1;
+    return v;
+}
+
+static void bad_option(const char *cmd, const char *opt) {
+    fprintf(stderr, "%s: invalid option -- '%s'\n", cmd, opt);
+}
+
+/* An option the builtin doesn't implement (grep -r, tail -f, sort -h,
+ * long options): the system's own tool runs the command instead, and
+ * only without one is the option an error, with the given status */
+static int unsupported(char **argv, const char *opt, int status) {
+    if (!cmdhash_lookup(argv[0])) {
+        bad_option(argv[0], opt);
+        return status;
+    }
+    return exec_external(argv);
+}
+
+/* ---- cat ---- */
+
+int builtin_cat(int argc, char **argv) {
+    int number = 0, i = 1, status = 0;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            if (*f == 'n') number = 1;
+            else if (*f == 'u') continue;
+            else {
+                char opt[2] = { *f, 0 };
+                return unsupported(argv, opt, 1);
+            }
+        }
+    }
+    fflush(stdout);
+    struct out *o = number ? malloc(sizeof(*o)) : NULL;
+    if (o) out_init(o, STDOUT_FILENO);
+    unsigned long long line = 1;
+    int at_bol = 1;
+    int nfiles = argc - i;
+    for (int k = 0; k < (nfiles ? nfiles : 1) && !got_sigint; ++k) {
+        const char *name = nfiles ? argv[i + k] : NULL;
+        int fd = open_input("cat", name);
+        if (fd < 0) {
+            status = 1;
+            continue;
+        }
+        if (!o) {
+            if (io_copy(fd, STDOUT_FILENO, -1) < 0) {
+                fprintf(stderr, "cat: %s: %s\n", name ? name : "-", strerror(errno));
+                status = 1;
+            }
+        } else {
+            struct reader r;
+            const char *p;
+            size_t n;
+            int rc;
+            reader_init(&r, fd);
+            while ((rc = reader_block(&r, &p, &n)) > 0) {
+                const char *end = p + n;
+                while (p < end) {
+                    if (at_bol) {
+                        out_num(o, line++, 6, ' ');
+                        out_putc(o, '\t');
+                    }
+                    const char *nl = memchr(p, '\n', (size_t)(end - p));
+                    const char *stop = nl ? nl + 1 : end;
+                    out_write(o, p, (size_t)(stop - p));
+                    at_bol = nl != NULL;
+                    p = stop;
+                }
+            }
+            if (rc < 0) status = 1;
+            reader_free(&r);
+        }
+        close_input(fd);
+    }
+    if (o) {
+        if (out_flush(o) != 0) status = 1;
+        free(o);
+    }
+    return status;
+}
+
+/* ---- head / tail ---- */
+
+struct count_opts {
+    long long count;
+    int bytes;      /* -c */
+    int from_start; /* tail -n +N */
+    int first_file;
+    const char *unsupported;    /* an option left to the system's tool */
+};
+
+static int parse_count_opts(const char *cmd, int argc, char **argv, struct count_opts *c) {
+    int i = 1;
+    c->count = 10;
+    c->bytes = 0;
+    c->from_start = 0;
+    c->unsupported = NULL;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        const char *a = argv[i];
+        if (strcmp(a, "--") == 0) { i++; break; }
+        const char *val = NULL;
+        if (isdigit((unsigned char)a[1])) {
+            val = a + 1;
+        } else if ((a[1] == 'n' || a[1] == 'c')) {
+            c->bytes = a[1] == 'c';
+            val = a[2] ? a + 2 : (i + 1 < argc ? argv[++i] : NULL);
+            if (!val) {
+                fprintf(stderr, "%s: option requires an argument -- '%c'\n", cmd, a[1]);
+                return -1;
+            }
+        } else {
+            c->unsupported = a + 1;
+            return -1;
+        }
+        if (*val == '+') {
+            c->from_start = 1;
+            val++;
+        }
+        c->count = parse_count(val);
+        if (c->count < 0) {
+            fprintf(stderr, "%s: invalid number of %s: '%s'\n", cmd, c->bytes ? "bytes" : "lines", val);
+            return -1;
+        }
+    }
+    c->first_file = i;
+    return 0;
+}
+
+static void file_header(struct out *o, const char *name, int first) {
+    if (!first) out_putc(o, '\n');
+    out_str(o, "==> ");
+    out_str(o, name ? name : "standard input");
+    out_str(o, " <==\n");
+}
+
+static int head_fd(struct out *o, int fd, const struct count_opts *c) {
+    if (c->bytes) {
+        out_flush(o);
+        return io_copy(fd, o->fd, c->count) < 0 ? -1 : 0;
+    }
+    long long left = c->count;
+    if (left == 0) return 0;
+    struct reader r;
+    const char *p, *q = NULL;
+    size_t n;
+    int rc;
+    reader_init(&r, fd);
+    while (left > 0 && (rc = reader_block(&r, &p, &n)) > 0) {
+        const char *end = p + n;
+        q = p;
+        while (left > 0 && q < end) {
+            const char *nl = memchr(q, '\n', (size_t)(end - q));
+            q = nl ? nl + 1 : end;
+            left--;
+        }
+        out_write(o, p, (size_t)(q - p));
+    }
+    if (q) reader_rewind(&r, q);
+    reader_free(&r);
+    return 0;
+}
+
+int builtin_head(int argc, char **argv) {
+    struct count_opts c;
+    if (parse_count_opts("head", argc, argv, &c) != 0) {
+        return c.unsupported ? unsupported(argv, c.unsupported, 1) : 1;
+    }
+    struct out *o = malloc(sizeof(*o));
+    if (!o) return 1;
+    out_init(o, STDOUT_FILENO);
+    int nfiles = argc - c.first_file, status = 0;
+    for (int k = 0; k < (nfiles ? nfiles : 1); ++k) {
+        const char *name = nfiles ? argv[c.first_file + k] : NULL;
+        int fd = open_input("head", name);
+        if (fd < 0) {
+            status = 1;
+            continue;
+        }
+        if (nfiles > 1) file_header(o, name, k == 0);
+        if (head_fd(o, fd, &c) != 0) status = 1;
+        close_input(fd);
+    }
+    if (out_flush(o) != 0) status = 1;
+    free(o);
+    return status;
+}
+
+/* Offset where the last `count` lines of data[0..len) start */
+static size_t tail_lines_start(const char *data, size_t len, long long count) {
+    size_t pos = len;
+    if (pos > 0 && data[pos - 1] == '\n') pos--;   /* trailing newline ends the last line */
+    while (count > 0) {
+        const char *nl = pos ? memrchr(data, '\n', pos) : NULL;
+        if (!nl) return 0;
+        pos = (size_t)(nl - data);
+        if (--count == 0) return pos + 1;
+    }
+    return len;
+}
+
+static int tail_fd(struct out *o, int fd, const struct count_opts *c) {
+    struct stat st;
+    out_flush(o);
+    if (c->from_start) {
+        /* tail -n +N / -c +N: skip a prefix, copy the rest */
+        long long skip = c->count > 0 ? c->count - 1 : 0;
+        if (c->bytes) {
+            if (skip && lseek(fd, skip, SEEK_CUR) < 0) {
+                char tmp[8192];
+                while (skip > 0) {
+                    ssize_t r = read(fd, tmp, skip > (long long)sizeof(tmp) ? sizeof(tmp) : (size_t)skip);
+                    if (r <= 0) return r < 0 ? -1 : 0;
+                    skip -= r;
+                }
+            }
+            return io_copy(fd, o->fd, -1) < 0 ? -1 : 0;
+        }
+        struct reader r;
+        const char *p;
+        size_t n;
+        int rc;
+        reader_init(&r, fd);
+        while ((rc = reader_block(&r, &p, &n)) > 0) {
+            const char *end = p + n;
+            while (skip > 0 && p < end) {
+                const char *nl = memchr(p, '\n', (size_t)(end - p));
+                p = nl ? nl + 1 : end;
+                skip--;
+            }
+            out_write(o, p, (size_t)(end - p));
+        }
+        reader_free(&r);
+        return rc < 0 ? -1 : 0;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        /* Seekable: scan backwards from the end, then copy in-kernel */
+        off_t size = st.st_size, start;
+        if (c->bytes) {
+            start = c->count >= size ? 0 : size - c->count;
+        } else {
+            char buf[65536];
+            off_t pos = size;
+            long long need = c->count;
+            int first = 1;
+            start = 0;
+            while (pos > 0 && need >= 0) {
+                size_t chunk = pos > (off_t)sizeof(buf) ? sizeof(buf) : (size_t)pos;
+                pos -= (off_t)chunk;
+                if (pread(fd, buf, chunk, pos) != (ssize_t)chunk) return -1;
+                size_t end = chunk;
+                if (first && end > 0 && buf[end - 1] == '\n') end--;
+                first = 0;
+                const char *nl;
+                while (end > 0 && (nl = memrchr(buf, '\n', end)) != NULL) {
+                    end = (size_t)(nl - buf);
+                    if (--need == 0) break;
+                }
+                if (need == 0) {
+                    start = pos + (off_t)end + 1;
+                    break;
+                }
+            }
+            if (c->count == 0) start = size;
+        }
+        if (lseek(fd, start, SEEK_SET) < 0) return -1;
+        return io_copy(fd, o->fd, size - start) < 0 ? -1 : 0;
+    }
+
+    struct slurp s;
+    if (slurp_fd(fd, &s) != 0) return -1;
+    size_t from;
+    if (c->bytes) from = (size_t)c->count >= s.len ? 0 : s.len - (size_t)c->count;
+    else from = c->count ? tail_lines_start(s.data, s.len, c->count) : s.len;
+    out_write(o, s.data + from, s.len - from);
+    slurp_free(&s);
+    return 0;
+}
+
+int builtin_tail(int argc, char **argv) {
+    struct count_opts c;
+    if (parse_count_opts("tail", argc, argv, &c) != 0) {
+        return c.unsupported ? unsupported(argv, c.unsupported, 1) : 1;
+    }
+    struct out *o = malloc(sizeof(*o));
+    if (!o) return 1;
+    out_init(o, STDOUT_FILENO);
+    int nfiles = argc - c.first_file, status = 0;
+    for (int k = 0; k < (nfiles ? nfiles : 1); ++k) {
+        const char *name = nfiles ? argv[c.first_file + k] : NULL;
+        int fd = open_input("tail", name);
+        if (fd < 0) {
+            status = 1;
+            continue;
+        }
+        if (nfiles > 1) file_header(o, name, k == 0);
+        if (tail_fd(o, fd, &c) != 0) status = 1;
+        close_input(fd);
+    }
+    if (out_flush(o) != 0) status = 1;
+    free(o);
+    return status;
+}
+
+/* ---- wc ---- */
+
+struct wc_counts {
+    unsigned long long lines, words, chars, bytes;
+};
+
+static unsigned char wc_space[256];
+
+static int wc_fd(int fd, int need_words, int need_chars, struct wc_counts *c) {
+    memset(c, 0, sizeof(*c));
+    struct reader r;
+    const char *p;
+    size_t n;
+    int rc, in_word = 0;
+    reader_init(&r, fd);
+    while ((rc = reader_block(&r, &p, &n)) > 0) {
+        c->bytes += n;
+        c->lines += count_newlines(p, n);
+        if (need_words) {
+            for (size_t i = 0; i < n; ++i) {
+                int sp = wc_space[(unsigned char)p[i]];
+                c->words += (unsigned long long)(in_word & sp);
+                in_word = !sp;
+            }
+        }
+        if (need_chars) {
+            /* UTF-8: count every byte that is not a continuation byte */
+            for (size_t i = 0; i < n; ++i) c->chars += ((unsigned char)p[i] & 0xc0) != 0x80;
+        }
+        if (got_sigint) {
+            rc = -1;
+            break;
+        }
+    }
+    c->words += (unsigned long long)in_word;
+    reader_free(&r);
+    return rc < 0 ? -1 : 0;
+}
+
+static int digits(unsigned long long v) {
+    int d = 1;
+    while (v >= 10) {
+        v /= 10;
+        d++;
+    }
+    return d;
+}
+
+int builtin_wc(int argc, char **argv) {
+    int l = 0, w = 0, c = 0, m = 0, i = 1, status = 0;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            if (*f == 'l') l = 1;
+            else if (*f == 'w') w = 1;
+            else if (*f == 'c') c = 1;
+            else if (*f == 'm') m = 1;
+            else {
+                char opt[2] = { *f, 0 };
+                return unsupported(argv, opt, 1);
+            }
+        }
+    }
+    if (!l && !w && !c && !m) l = w = c = 1;
+    if (!wc_space[' ']) {
+        wc_space[' '] = wc_space['\t'] = wc_space['\n'] = 1;
+        wc_space['\v'] = wc_space['\f'] = wc_space['\r'] = 1;
+    }
+
+    int nfiles = argc - i;
+    int n = nfiles ? nfiles : 1;
+    struct wc_counts *counts = calloc((size_t)n + 1, sizeof(*counts));
+    int *ok = calloc((size_t)n, sizeof(int));
+    if (!counts || !ok) {
+        free(counts);
+        free(ok);
+        return 1;
+    }
+    struct wc_counts *total = &counts[n];
+    int all_regular = 1;
+    unsigned long long size_sum = 0;
+    for (int k = 0; k < n; ++k) {
+        const char *name = nfiles ? argv[i + k] : NULL;
+        int fd = open_input("wc", name);
+        if (fd < 0) {
+            status = 1;
+            continue;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) st.st_mode = 0;
+        if (S_ISREG(st.st_mode)) size_sum += (unsigned long long)st.st_size;
+        else all_regular = 0;
+        if (c && !l && !w && !m && S_ISREG(st.st_mode)) {
+            /* -c alone on a regular file: the size is enough */
+            counts[k].bytes = (unsigned long long)st.st_size;
+        } else if (wc_fd(fd, w, m, &counts[k]) != 0) {
+            fprintf(stderr, "wc: %s: %s\n", name ? name : "-", strerror(errno));
+            status = 1;
+            close_input(fd);
+            continue;
+        }
+        ok[k] = 1;
+        total->lines += counts[k].lines;
+        total->words += counts[k].words;
+        total->chars += counts[k].chars;
+        total->bytes += counts[k].bytes;
+        close_input(fd);
+    }
+
+    /* Column width like GNU: none for a single count of a single input */
+    int ncols = l + w + c + m;
+    int width = 1;
+    if (ncols > 1 || n > 1) width = all_regular ? digits(size_sum) : 7;
+
+    struct out *o = malloc(sizeof(*o));
+    if (o) {
+        out_init(o, STDOUT_FILENO);
+        for (int k = 0; k <= n; ++k) {
+            if (k == n && n < 2) break;
+            if (k < n && !ok[k]) continue;
+            const struct wc_counts *wc = &counts[k];
+            int first = 1;
+            unsigned long long vals[4] = { wc->lines, wc->words, wc->chars, wc->bytes };
+            int want[4] = { l, w, m, c };
+            for (int v = 0; v < 4; ++v) {
+                if (!want[v]) continue;
+                if (!first) out_putc(o, ' ');
+                out_num(o, vals[v], width, ' ');
+                first = 0;
+            }
+            const char *label = k == n ? "total" : (nfiles ? argv[i + k] : NULL);
+            if (label) {
+                out_putc(o, ' ');
+                out_str(o, label);
+            }
+            out_putc(o, '\n');
+        }
+        if (out_flush(o) != 0) status = 1;
+        free(o);
+    }
+    free(counts);
+    free(ok);
+    return status;
+}
+
+/* ---- grep ---- */
+
+struct grep_opts {
+    int invert, count, number, list, quiet, no_messages, line_regexp, word_regexp, icase;
+    int with_name;          /* 1 force, 0 never, -1 auto */
+    int fixed;              /* memmem fast path */
+    const char *pattern;
+    size_t patlen;
+    regex_t re;
+    unsigned long long matches;
+};
+
+static int is_word_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+/* Does [line, line+len) match? Used by the regex path and for -x/-w checks. */
+static int grep_line_matches(struct grep_opts *g, const char *line, size_t len) {
+    if (g->fixed) {
+        if (g->line_regexp) return len == g->patlen && memcmp(line, g->pattern, len) == 0;
+        const char *p = line, *end = line + len;
+        while ((p = memmem(p, (size_t)(end - p), g->pattern, g->patlen)) != NULL) {
+            if (!g->word_regexp) return 1;
+            int left_ok = p == line || !is_word_char(p[-1]);
+            int right_ok = p + g->patlen == end || !is_word_char(p[g->patlen]);
+            if (left_ok && right_ok) return 1;
+            p++;
+        }
+        return g->patlen == 0;
+    }
+    regmatch_t m[1];
+#ifdef REG_STARTEND
+    m[0].rm_so = 0;
+    m[0].rm_eo = (regoff_t)len;
+    return regexec(&g->re, line, 1, m, REG_STARTEND) == 0;
+#else
+    char *tmp = strndup(line, len);
+    int rc = tmp ? regexec(&g->re, tmp, 1, m, 0) == 0 : 0;
+    free(tmp);
+    return rc;
+#endif
+}
+
+static void grep_emit(struct out *o, struct grep_opts *g, const char *name,
+                      unsigned long long lineno, const char *line, size_t len) {
+    if (g->with_name == 1) {
+        out_str(o, name);
+        out_putc(o, ':');
+    }
+    if (g->number) {
+        out_num(o, lineno, 0, ' ');
+        out_putc(o, ':');
+    }
+    out_write(o, line, len);
+    out_putc(o, '\n');
+}
+
+/* Returns number of selected lines in this input; -1 on read error */
+static long long grep_fd(struct out *o, struct grep_opts *g, int fd, const char *name) {
+    struct reader r;
+    const char *p;
+    size_t n;
+    int rc;
+    long long selected = 0;
+    unsigned long long lineno = 0;
+    int emit = !g->count && !g->list && !g->quiet;
+    reader_init(&r, fd);
+    while ((rc = reader_block(&r, &p, &n)) > 0) {
+        const char *end = p + n;
+        if (g->fixed && !g->invert && !g->line_regexp && g->patlen > 0) {
+            /* Search the whole block for the pattern, then find the line
+             * around each hit; lines without hits are never looked at. */
+            const char *pos = p;
+            const char *counted = p;
+            const char *hit;
+            while (pos < end && (hit = memmem(pos, (size_t)(end - pos), g->pattern, g->patlen)) != NULL) {
+                const char *ls = hit;
+                while (ls > pos && ls[-1] != '\n') ls--;
+                const char *le = memchr(hit, '\n', (size_t)(end - hit));
+                if (!le) le = end;
+                if (!g->word_regexp || grep_line_matches(g, ls, (size_t)(le - ls))) {
+                    selected++;
+                    if (g->number) {
+                        lineno += count_newlines(counted, (size_t)(ls - counted)) + 1;
+                        counted = le < end ? le + 1 : end;
+                    }
+                    if (emit) grep_emit(o, g, name, lineno, ls, (size_t)(le - ls));
+                    else if (g->quiet || g->list) break;
+                }
+                pos = le < end ? le + 1 : end;
+            }
+            if (g->number) lineno += count_newlines(counted, (size_t)(end - counted));
+            if (selected && (g->quiet || g->list)) break;
+            continue;
+        }
+        while (p < end) {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            const char *le = nl ? nl : end;
+            lineno++;
+            int match = grep_line_matches(g, p, (size_t)(le - p));
+            if (match != g->invert) {
+                selected++;
+                if (emit) grep_emit(o, g, name, lineno, p, (size_t)(le - p));
+                else if (g->quiet || g->list) break;
+            }
+            p = nl ? nl + 1 : end;
+        }
+        if (selected && (g->quiet || g->list)) break;
+        if (got_sigint) {
+            rc = -1;
+            break;
+        }
+    }
+    reader_free(&r);
+    return rc < 0 ? -1 : selected;
+}
+
+static int has_regex_meta(const char *s, int extended) {
+    for (; *s; ++s) {
+        if (strchr(".[]*^$\\", *s)) return 1;
+        if (extended && strchr("+?(){}|", *s)) return 1;
+    }
+    return 0;
+}
+
+static int grep_main(int argc, char **argv, int mode /* 'G', 'E' or 'F' */) {
+    struct grep_opts g;
+    memset(&g, 0, sizeof(g));
+    g.with_name = -1;
+    const char *cmd = argv[0];
+    /* every -e goes in, newline-separated, as GNU grep takes a list */
+    char *patterns = NULL;
+    size_t patterns_len = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            const char *e;
+            switch (*f) {
+                case 'F': mode = 'F'; break;
+                case 'E': mode = 'E'; break;
+                case 'G': mode = 'G'; break;
+                case 'v': g.invert = 1; break;
+                case 'c': g.count = 1; break;
+                case 'n': g.number = 1; break;
+                case 'l': g.list = 1; break;
+                case 'q': g.quiet = 1; break;
+                case 's': g.no_messages = 1; break;
+                case 'x': g.line_regexp = 1; break;
+                case 'w': g.word_regexp = 1; break;
+                case 'i': g.icase = 1; break;
+                case 'H': g.with_name = 1; break;
+                case 'h': g.with_name = 0; break;
+                case 'e': {
+                    if (f[1]) e = f + 1;
+                    else if (i + 1 < argc) e = argv[++i];
+                    else {
+                        fprintf(stderr, "%s: option requires an argument -- 'e'\n", cmd);
+                        free(patterns);
+                        return 2;
+                    }
+                    size_t n = strlen(e);
+                    char *grown = realloc(patterns, patterns_len + n + 2);
+                    if (!grown) {
+                        free(patterns);
+                        return 2;
+                    }
+                    patterns = grown;
+                    if (patterns_len) patterns[patterns_len++] = '\n';
+                    memcpy(patterns + patterns_len, e, n + 1);
+                    patterns_len += n;
+                    f += strlen(f) - 1;
+                    break;
+                }
+                default: {
+                    char opt[2] = { *f, 0 };
+                    free(patterns);
+                    return unsupported(argv, opt, 2);
+                }
+            }
+        }
+    }
+    if (patterns) {
+        g.pattern = patterns;
+    } else {
+        if (i >= argc) {
+            fprintf(stderr, "Usage: %s [OPTION]... PATTERNS [FILE]...\n", cmd);
+            return 2;
+        }
+        g.pattern = argv[i++];
+    }
+    g.patlen = strlen(g.pattern);
+    int several = memchr(g.pattern, '\n', g.patlen) != NULL;
+    if (several && (g.pattern[0] == '\n' || g.pattern[g.patlen - 1] == '\n' || strstr(g.pattern, "\n\n")) &&
+        cmdhash_lookup(cmd)) {
+        /* an empty pattern in the list matches every line, which the
+         * joined regex below can't express */
+        free(patterns);
+        return exec_external(argv);
+    }
+
+    /* Literal patterns take the memmem path even without -F */
+    if (!g.icase && !several && (mode == 'F' || !has_regex_meta(g.pattern, mode == 'E'))) {
+        g.fixed = 1;
+    } else {
+        int ere = mode == 'E';
+        /* the list becomes one alternation; -F patterns are escaped for a
+         * basic regex first (only reached with -i or several patterns) */
+        char *owned = malloc(g.patlen * 2 + 1);
+        if (!owned) {
+            free(patterns);
+            return 2;
+        }
+        size_t o = 0;
+        for (const char *s = g.pattern; *s; ++s) {
+            if (*s == '\n') {
+                if (!ere) owned[o++] = '\\';
+                owned[o++] = '|';
+                continue;
+            }
+            if (mode == 'F' && strchr(".[]*^$\\", *s)) owned[o++] = '\\';
+            owned[o++] = *s;
+        }
+        owned[o] = '\0';
+        char *src = owned;
+        if (g.line_regexp || g.word_regexp) {
+            const char *pre = g.line_regexp ? (ere ? "^(" : "^\\(") : (ere ? "\\<(" : "\\<\\(");
+            const char *post = g.line_regexp ? (ere ? ")$" : "\\)$") : (ere ? ")\\>" : "\\)\\>");
+            char *wrapped = malloc(strlen(src) + 16);
+            if (!wrapped) {
+                free(owned);
+                free(patterns);
+                return 2;
+            }
+            sprintf(wrapped, "%s%s%s", pre, src, post);
+            free(owned);
+            owned = wrapped;
+            src = wrapped;
+        }
+        int rc = regcomp(&g.re, src, (ere ? REG_EXTENDED : 0) | (g.icase ? REG_ICASE : 0) | REG_NOSUB);
+        free(owned);
+        if (rc != 0) {
+            char msg[256];
+            regerror(rc, &g.re, msg, sizeof(msg));
+            fprintf(stderr, "%s: %s\n", cmd, msg);
+            free(patterns);
+            return 2;
+        }
+    }
+
+    int nfiles = argc - i;
+    if (g.with_name < 0) g.with_name = nfiles > 1;
+    struct out *o = malloc(sizeof(*o));
+    if (!o) {
+        if (!g.fixed) regfree(&g.re);
+        free(patterns);
+        return 2;
+    }
+    out_init(o, STDOUT_FILENO);
+    int error = 0;
+    long long total = 0;
+    for (int k = 0; k < (nfiles ? nfiles : 1); ++k) {
+        const char *name = nfiles ? argv[i + k] : "(standard input)";
+        int fd;
+        if (!nfiles || strcmp(name, "-") == 0) {
+            fd = STDIN_FILENO;
+        } else if ((fd = open(name, O_RDONLY | O_CLOEXEC)) < 0) {
+            if (!g.no_messages) fprintf(stderr, "%s: %s: %s\n", cmd, name, strerror(errno));
+            error = 1;
+            continue;
+        }
+        long long sel = grep_fd(o, &g, fd, name);
+        close_input(fd);
+        if (sel < 0) {
+            error = 1;
+            continue;
+        }
+        total += sel;
+        if (g.count) {
+            if (g.with_name == 1) {
+                out_str(o, name);
+                out_putc(o, ':');
+            }
+            out_num(o, (unsigned long long)sel, 0, ' ');
+            out_putc(o, '\n');
+        } else if (g.list && sel) {
+            out_str(o, name);
+            out_putc(o, '\n');
+        }
+        if (g.quiet && total) break;
+    }
+    out_flush(o);
+    free(o);
+    if (!g.fixed) regfree(&g.re);
+    free(patterns);
+    if (error && !(g.quiet && total)) return 2;
+    return total ? 0 : 1;
+}
+
+int builtin_grep(int argc, char **argv) {
+    return grep_main(argc, argv, 'G');
+}
+
+int builtin_egrep(int argc, char **argv) {
+    return grep_main(argc, argv, 'E');
+}
+
+int builtin_fgrep(int argc, char **argv) {
+    return grep_main(argc, argv, 'F');
+}
+
+/* ---- sort ---- */
+
+#define SORT_MAX_KEYS 8
+
+struct sort_key {
+    int start, end;             /* 1-based fields; end 0 = to end of line */
+    int numeric, reverse, fold;
+    int has_mods;               /* key-local letters override the globals */
+};
+
+struct sort_line {
+    const char *p;
+    size_t len;
+    const char *key;    /* first key, extracted once up front */
+    size_t keylen;
+    double num;         /* its value when that key is numeric */
+    uint64_t prefix;    /* its first 8 bytes, big-endian, for plain keys */
+    size_t idx;         /* input order, for -s and -u ties */
+};
+
+static struct {
+    int reverse, numeric, unique, fold, stable;
+    int sep;                    /* -t, or -1 for blank runs */
+    struct sort_key keys[SORT_MAX_KEYS];
+    int nkeys;
+} sort_opt;
+
+static double parse_leading_number(const char *p, size_t len) {
+    char tmp[64];
+    size_t i = 0;
+    while (i < len && (p[i] == ' ' || p[i] == '\t')) i++;
+    size_t n = 0;
+    while (i < len && n + 1 < sizeof(tmp) && (isdigit((unsigned char)p[i]) || p[i] == '-' || p[i] == '.' || p[i] == '+'))
+        tmp[n++] = p[i++];
+    tmp[n] = '\0';
+    return n ? strtod(tmp, NULL) : 0.0;
+}
+
+/* Locate field `field` (1-based); returns pointer within [p, end] */
+static const char *field_start(const char *p, const char *end, int field) {
+    for (int f = 1; f < field && p < end; ++f) {
+        if (sort_opt.sep >= 0) {
+            const char *s = memchr(p, sort_opt.sep, (size_t)(end - p));
+            p = s ? s + 1 : end;
+        } else {
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+            while (p < end && *p != ' ' && *p != '\t') p++;
+        }
+    }
+    return p;
+}
+
+static void key_extent(const struct sort_key *k, const char *p, size_t len, const char **kp, size_t *kl) {
+    const char *end = p + len;
+    const char *ks = k->start > 1 ? field_start(p, end, k->start) : p;
+    const char *ke = end;
+    if (k->end > 0) {
+        /* skip to just past the last field of the key, minus its separator */
+        ke = field_start(ks, end, k->end - k->start + 2);
+        if (sort_opt.sep >= 0 && ke > ks && ke[-1] == sort_opt.sep) ke--;
+    }
+    *kp = ks;
+    *kl = (size_t)(ke - ks);
+}
+
+static int cmp_bytes(const char *a, size_t al, const char *b, size_t bl, int fold) {
+    size_t n = al < bl ? al : bl;
+    int r;
+    if (fold) {
+        r = 0;
+        for (size_t i = 0; i < n && !r; ++i) r = toupper((unsigned char)a[i]) - toupper((unsigned char)b[i]);
+    } else {
+        r = memcmp(a, b, n);
+    }
+    if (r) return r;
+    return (al > bl) - (al < bl);
+}
+
+static int cmp_key(const struct sort_key *k, const char *a, size_t al, double an,
+                   const char *b, size_t bl, double bn) {
+    int r;
+    if (k->numeric) r = (an > bn) - (an < bn);
+    else r = cmp_bytes(a, al, b, bl, k->fold);
+    return k->reverse ? -r : r;
+}
+
+static uint64_t key_prefix(const char *p, size_t len) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; ++i) v = (v << 8) | (i < len ? (unsigned char)p[i] : 0);
+    return v;
+}
+
+static int sort_key_cmp(const struct sort_line *a, const struct sort_line *b) {
+    const struct sort_key *k0 = &sort_opt.keys[0];
+    if (!k0->numeric && !k0->fold && a->prefix != b->prefix) {
+        /* most comparisons end here without touching the line data */
+        int r = a->prefix < b->prefix ? -1 : 1;
+        return k0->reverse ? -r : r;
+    }
+    int r = cmp_key(&sort_opt.keys[0], a->key, a->keylen, a->num, b->key, b->keylen, b->num);
+    /* secondary keys are rare; extract them on demand */
+    for (int i = 1; i < sort_opt.nkeys && r == 0; ++i) {
+        const struct sort_key *k = &sort_opt.keys[i];
+        const char *ak, *bk;
+        size_t akl, bkl;
+        key_extent(k, a->p, a->len, &ak, &akl);
+        key_extent(k, b->p, b->len, &bk, &bkl);
+        double an = k->numeric ? parse_leading_number(ak, akl) : 0;
+        double bn = k->numeric ? parse_leading_number(bk, bkl) : 0;
+        r = cmp_key(k, ak, akl, an, bk, bkl, bn);
+    }
+    return r;
+}
+
+static int sort_cmp(const void *pa, const void *pb) {
+    const struct sort_line *a = pa, *b = pb;
+    int r = sort_key_cmp(a, b);
+    if (r) return r;
+    /* last-resort comparison of the whole line, as GNU sort does */
+    if (!sort_opt.stable && !sort_opt.unique) {
+        r = cmp_bytes(a->p, a->len, b->p, b->len, 0);
+        if (r) return sort_opt.reverse ? -r : r;
+    }
+    return (a->idx > b->idx) - (a->idx < b->idx);
+}
+
+static int key_modifiers(struct sort_key *k, const char *s) {
+    for (; *s && *s != ','; ++s) {
+        if (*s == 'n') k->numeric = 1;
+        else if (*s == 'r') k->reverse = 1;
+        else if (*s == 'f') k->fold = 1;
+        else if (*s == '.' || isdigit((unsigned char)*s) || *s == 'b') continue;  /* char offsets ignored */
+        else return -1;
+        k->has_mods = 1;
+    }
+    return 0;
+}
+
+static int parse_key_spec(const char *s) {
+    if (sort_opt.nkeys == SORT_MAX_KEYS) return -1;
+    struct sort_key *k = &sort_opt.keys[sort_opt.nkeys];
+    memset(k, 0, sizeof(*k));
+    char *end;
+    long start = strtol(s, &end, 10);
+    if (start < 1 || key_modifiers(k, end) != 0) return -1;
+    while (*end && *end != ',') end++;
+    k->start = (int)start;
+    if (*end == ',') {
+        long e = strtol(end + 1, &end, 10);
+        if (e < start || key_modifiers(k, end) != 0) return -1;
+        k->end = (int)e;
+    }
+    sort_opt.nkeys++;
+    return 0;
+}
+
+int builtin_sort(int argc, char **argv) {
+    memset(&sort_opt, 0, sizeof(sort_opt));
+    sort_opt.sep = -1;
+    int i = 1;
+    const char *outfile = NULL;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            const char *val = NULL;
+            if (*f == 'k' || *f == 't' || *f == 'o') {
+                val = f[1] ? f + 1 : (i + 1 < argc ? argv[++i] : NULL);
+                if (!val) {
+                    fprintf(stderr, "sort: option requires an argument -- '%c'\n", *f);
+                    return 2;
+                }
+            }
+            switch (*f) {
+                case 'r': sort_opt.reverse = 1; break;
+                case 'n': sort_opt.numeric = 1; break;
+                case 'u': sort_opt.unique = 1; break;
+                case 'f': sort_opt.fold = 1; break;
+                case 's': sort_opt.stable = 1; break;
+                case 'k':
+                    if (parse_key_spec(val) != 0) {
+                        fprintf(stderr, "sort: invalid key: '%s'\n", val);
+                        return 2;
+                    }
+                    break;
+                case 't': sort_opt.sep = (unsigned char)val[0]; break;
+                case 'o': outfile = val; break;
+                default: {
+                    char opt[2] = { *f, 0 };
+                    return unsupported(argv, opt, 2);
+                }
+            }
+            if (val) break;
+        }
+    }
+    if (sort_opt.nkeys == 0) {
+        memset(&sort_opt.keys[0], 0, sizeof(sort_opt.keys[0]));
+        sort_opt.keys[0].start = 1;
+        sort_opt.nkeys = 1;
+    }
+    for (int k = 0; k < sort_opt.nkeys; ++k) {
+        struct sort_key *key = &sort_opt.keys[k];
+        if (key->has_mods) continue;
+        key->numeric = sort_opt.numeric;
+        key->reverse = sort_opt.reverse;
+        key->fold = sort_opt.fold;
+    }
+
+    int nfiles = argc - i, status = 0;
+    int n = nfiles ? nfiles : 1;
+    struct slurp *inputs = calloc((size_t)n, sizeof(*inputs));
+    if (!inputs) return 2;
+    size_t nlines = 0, cap = 0;
+    struct sort_line *lines = NULL;
+    for (int k = 0; k < n; ++k) {
+        const char *name = nfiles ? argv[i + k] : NULL;
+        int fd = open_input("sort", name);
+        if (fd < 0) {
+            status = 2;
+            continue;
+        }
+        if (slurp_fd(fd, &inputs[k]) != 0) {
+            fprintf(stderr, "sort: %s: %s\n", name ? name : "-", strerror(errno));
+            status = 2;
+            close_input(fd);
+            continue;
+        }
+        close_input(fd);
+        const char *p = inputs[k].data, *end = p + inputs[k].len;
+        while (p < end) {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            const char *le = nl ? nl : end;
+            if (nlines == cap) {
+                cap = cap ? cap * 2 : 4096;
+                struct sort_line *grown = realloc(lines, cap * sizeof(*lines));
+                if (!grown) {
+                    status = 2;
+                    goto done;
+                }
+                lines = grown;
+            }
+            struct sort_line *l = &lines[nlines];
+            l->p = p;
+            l->len = (size_t)(le - p);
+            l->idx = nlines++;
+            key_extent(&sort_opt.keys[0], l->p, l->len, &l->key, &l->keylen);
+            l->num = sort_opt.keys[0].numeric ? parse_leading_number(l->key, l->keylen) : 0;
+            l->prefix = key_prefix(l->key, l->keylen);
+            p = nl ? nl + 1 : end;
+        }
+    }
+
+    qsort(lines, nlines, sizeof(*lines), sort_cmp);
+
+    int ofd = STDOUT_FILENO;
+    if (outfile && (ofd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0) {
+        fprintf(stderr, "sort: %s: %s\n", outfile, strerror(errno));
+        status = 2;
+        goto done;
+    }
+    struct out *o = malloc(sizeof(*o));
+    if (o) {
+        out_init(o, ofd);
+        for (size_t k = 0; k < nlines; ++k) {
+            if (sort_opt.unique && k > 0 && sort_key_cmp(&lines[k - 1], &lines[k]) == 0) continue;
+            out_write(o, lines[k].p, lines[k].len);
+            out_putc(o, '\n');
+        }
+        if (out_flush(o) != 0) status = 2;
+        free(o);
+    }
+    if (ofd != STDOUT_FILENO) close(ofd);
+
+done:
+    free(lines);
+    for (int k = 0; k < n; ++k) slurp_free(&inputs[k]);
+    free(inputs);
+    return status;
+}
+
+/* ---- uniq ---- */
+
+int builtin_uniq(int argc, char **argv) {
+    int count = 0, dups = 0, uniques = 0, icase = 0, i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            if (*f == 'c') count = 1;
+            else if (*f == 'd') dups = 1;
+            else if (*f == 'u') uniques = 1;
+            else if (*f == 'i') icase = 1;
+            else {
+                char opt[2] = { *f, 0 };
+                return unsupported(argv, opt, 1);
+            }
+        }
+    }
+    const char *inname = i < argc ? argv[i++] : NULL;
+    const char *outname = i < argc ? argv[i++] : NULL;
+    int fd = open_input("uniq", inname);
+    if (fd < 0) return 1;
+    int ofd = STDOUT_FILENO;
+    if (outname && (ofd = open(outname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0) {
+        fprintf(stderr, "uniq: %s: %s\n", outname, strerror(errno));
+        close_input(fd);
+        return 1;
+    }
+    struct out *o = malloc(sizeof(*o));
+    if (!o) return 1;
+    out_init(o, ofd);
+
+    /* The previous line is kept in its own buffer since reader blocks move */
+    char *prev = NULL;
+    size_t prev_len = 0, prev_cap = 0;
+    unsigned long long prev_count = 0;
+    struct reader r;
+    const char *p;
+    size_t n;
+    int rc;
+    reader_init(&r, fd);
+    while ((rc = reader_block(&r, &p, &n)) > 0) {
+        const char *end = p + n;
+        while (p < end) {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            size_t len = (size_t)((nl ? nl : end) - p);
+            if (prev_count && cmp_bytes(prev, prev_len, p, len, icase) == 0) {
+                prev_count++;
+            } else {
+                if (prev_count && (!dups || prev_count > 1) && (!uniques || prev_count == 1)) {
+                    if (count) {
+                        out_num(o, prev_count, 7, ' ');
+                        out_putc(o, ' ');
+                    }
+                    out_write(o, prev, prev_len);
+                    out_putc(o, '\n');
+                }
+                if (len > prev_cap) {
+                    prev_cap = len * 2 + 64;
+                    free(prev);
+                    prev = malloc(prev_cap);
+                    if (!prev) {
+                        rc = -1;
+                        goto out;
+                    }
+                }
+                memcpy(prev, p, len);
+                prev_len = len;
+                prev_count = 1;
+            }
+            p = nl ? nl + 1 : end;
+        }
+    }
+    if (prev_count && (!dups || prev_count > 1) && (!uniques || prev_count == 1)) {
+        if (count) {
+            out_num(o, prev_count, 7, ' ');
+            out_putc(o, ' ');
+        }
+        out_write(o, prev, prev_len);
+        out_putc(o, '\n');
+    }
+out:
+    reader_free(&r);
+    close_input(fd);
+    int status = (rc < 0 || out_flush(o) != 0) ? 1 : 0;
+    free(o);
+    free(prev);
+    if (ofd != STDOUT_FILENO) close(ofd);
+    return status;
+}
+
+/* ---- tr ---- */
+
+static int tr_escape(const char **sp) {
+    const char *s = *sp;
+    int c = (unsigned char)*s++;
+    if (c == '\\' && *s) {
+        c = (unsigned char)*s++;
+        switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'a': c = '\a'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'v': c = '\v'; break;
+            case '\\': c = '\\'; break;
+            default:
+                if (c >= '0' && c <= '7') {
+                    c -= '0';
+                    for (int k = 0; k < 2 && *s >= '0' && *s <= '7'; ++k) c = c * 8 + (*s++ - '0');
+                }
+                break;
+        }
+    }
+    *sp = s;
+    return c;
+}
+
+/* Expand a tr SET into out (up to 256 chars); returns its length. */
+static int tr_expand(const char *set, unsigned char *out, int *upper_class, int *lower_class) {
+    static const struct { const char *name; int (*fn)(int); } classes[] = {
+        { "[:alpha:]", isalpha }, { "[:digit:]", isdigit }, { "[:alnum:]", isalnum },
+        { "[:upper:]", isupper }, { "[:lower:]", islower }, { "[:space:]", isspace },
+        { "[:blank:]", isblank }, { "[:punct:]", ispunct }, { "[:print:]", isprint },
+        { "[:graph:]", isgraph }, { "[:cntrl:]", iscntrl }, { "[:xdigit:]", isxdigit },
+    };
+    int n = 0;
+    while (*set && n < 4096) {
+        int matched = 0;
+        if (*set == '[' && set[1] == ':') {
+            for (size_t k = 0; k < sizeof(classes) / sizeof(classes[0]); ++k) {
+                size_t cl = strlen(classes[k].name);
+                if (strncmp(set, classes[k].name, cl) == 0) {
+                    if (classes[k].fn == isupper && upper_class) *upper_class = n;
+                    if (classes[k].fn == islower && lower_class) *lower_class = n;
+                    for (int c = 0; c < 256 && n < 256; ++c) {
+                        if (classes[k].fn(c)) out[n++] = (unsigned char)c;
+                    }
+                    set += cl;
+                    matched = 1;
+                    break;
+                }
+            }
+        }
+        if (matched) continue;
+        int c = tr_escape(&set);
+        if (*set == '-' && set[1]) {
+            set++;
+            int hi = tr_escape(&set);
+            for (int x = c; x <= hi && n < 256; ++x) out[n++] = (unsigned char)x;
+        } else if (n < 256) {
+            out[n++] = (unsigned char)c;
+        }
+    }
+    return n;
+}
+
+int builtin_tr(int argc, char **argv) {
+    int del = 0, squeeze = 0, complement = 0, i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            if (*f == 'd') del = 1;
+            else if (*f == 's') squeeze = 1;
+            else if (*f == 'c' || *f == 'C') complement = 1;
+            else {
+                char opt[2] = { *f, 0 };
+                return unsupported(argv, opt, 1);
+            }
+        }
+    }
+    int nsets = argc - i;
+    if (nsets < 1 || (!del && !squeeze && nsets < 2) || (del && !squeeze && nsets != 1)) {
+        fprintf(stderr, "tr: missing operand\n");
+        return 1;
+    }
+    unsigned char set1[256], set2[256];
+    int up1 = -1, lo1 = -1, up2 = -1, lo2 = -1;
+    int n1 = tr_expand(argv[i], set1, &up1, &lo1);
+    int n2 = nsets > 1 ? tr_expand(argv[i + 1], set2, &up2, &lo2) : 0;
+
+    unsigned char in1[256] = {0};
+    for (int k = 0; k < n1; ++k) in1[set1[k]] = 1;
+    if (complement) {
+        for (int c = 0; c < 256; ++c) in1[c] = !in1[c];
+    }
+
+    unsigned char map[256], delset[256] = {0}, sqset[256] = {0};
+    for (int c = 0; c < 256; ++c) map[c] = (unsigned char)c;
+    if (del) {
+        memcpy(delset, in1, sizeof(delset));
+        if (squeeze) for (int k = 0; k < n2; ++k) sqset[set2[k]] = 1;
+    } else if (nsets > 1) {
+        if (complement) {
+            /* every char outside SET1 maps to the last char of SET2 */
+            for (int c = 0; c < 256; ++c) if (in1[c] && n2) map[c] = set2[n2 - 1];
+        } else {
+            for (int k = 0; k < n1; ++k) {
+                int j = k < n2 ? k : n2 - 1;
+                if (j >= 0) map[set1[k]] = set2[j];
+            }
+        }
+        if (squeeze) for (int k = 0; k < n2; ++k) sqset[set2[k]] = 1;
+    } else if (squeeze) {
+        memcpy(sqset, in1, sizeof(sqset));
+    }
+
+    fflush(stdout);
+    char *buf = malloc(IN_BUFSZ);
+    if (!buf) return 1;
+    int last = -1, status = 0;
+    for (;;) {
+        ssize_t r = read(STDIN_FILENO, buf, IN_BUFSZ);
+        if (r < 0) {
+            if (errno == EINTR && !got_sigint) continue;
+            status = 1;
+            break;
+        }
+        if (r == 0) break;
+        size_t o = 0;
+        for (ssize_t k = 0; k < r; ++k) {
+            unsigned char c = (unsigned char)buf[k];
+            if (delset[c]) continue;
+            c = map[c];
+            if (sqset[c] && last == c) continue;
+            last = c;
+            buf[o++] = (char)c;
+        }
+        if (io_write_all(STDOUT_FILENO, buf, o) != 0) {
+            status = 1;
+            break;
+        }
+    }
+    free(buf);
+    return status;
+}
+
+/* ---- seq ---- */
+
+static int decimals_of(const char *s) {
+    const char *dot = strchr(s, '.');
+    if (!dot) return 0;
+    int n = 0;
+    for (const char *p = dot + 1; isdigit((unsigned char)*p); ++p) n++;
+    return n;
+}
+
+/* Plain decimal integer that fits a long long */
+static int is_integer_arg(const char *s) {
+    const char *p = s;
+    if (*p == '-' || *p == '+') p++;
+    if (!*p) return 0;
+    for (; *p; ++p) if (!isdigit((unsigned char)*p)) return 0;
+    errno = 0;
+    (void)strtoll(s, NULL, 10);
+    return errno == 0;
+}
+
+/* seq's common case: count up by one, bumping an ASCII counter in place
+ * instead of formatting every number from scratch */
+static void seq_count_up(struct out *o, unsigned long long first, unsigned long long last,
+                         const char *sep, size_t seplen) {
+    char num[24], tmp[24];
+    int len = 0;
+    if (first > last) return;
+    unsigned long long v = first;
+    do {
+        tmp[len++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    for (int i = 0; i < len; ++i) num[i] = tmp[len - 1 - i];
+    for (unsigned long long left = last - first;; --left) {
+        if (o->len + (size_t)len + seplen > OUT_BUFSZ) {
+            if (out_flush(o) != 0 || got_sigint) return;
+        }
+        memcpy(o->buf + o->len, num, (size_t)len);
+        o->len += (size_t)len;
+        if (left == 0) break;
+        memcpy(o->buf + o->len, sep, seplen);
+        o->len += seplen;
+        int i = len - 1;
+        while (i >= 0 && num[i] == '9') num[i--] = '0';
+        if (i < 0) {
+            memmove(num + 1, num, (size_t)len++);
+            num[0] = '1';
+        } else {
+            num[i]++;
+        }
+    }
+    out_putc(o, '\n');
+}
+
+int builtin_seq(int argc, char **argv) {
+    const char *sep = "\n";
+    int equal_width = 0, i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] && !isdigit((unsigned char)argv[i][1]) && argv[i][1] != '.'; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        if (strcmp(argv[i], "-w") == 0) equal_width = 1;
+        else if (strncmp(argv[i], "-s", 2) == 0) {
+            sep = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "\n");
+        } else {
+            return unsupported(argv, argv[i] + 1, 1);
+        }
+    }
+    int nargs = argc - i;
+    if (nargs < 1 || nargs > 3) {
+        fprintf(stderr, "seq: missing operand\n");
+        return 1;
+    }
+    const char *sfirst = nargs > 1 ? argv[i] : "1";
+    const char *sincr = nargs > 2 ? argv[i + 1] : "1";
+    const char *slast = argv[argc - 1];
+    size_t seplen = strlen(sep);
+    struct out *o = malloc(sizeof(*o));
+    if (!o) return 1;
+    out_init(o, STDOUT_FILENO);
+    int status = 0;
+
+    if (is_integer_arg(sfirst) && is_integer_arg(sincr) && is_integer_arg(slast)) {
+        /* Integer fast path: format digits by hand into the batch buffer */
+        long long first = atoll(sfirst), incr = atoll(sincr), last = atoll(slast);
+        if (incr == 0) {
+            fprintf(stderr, "seq: invalid Zero increment value: '%s'\n", sincr);
+            free(o);
+            return 1;
+        }
+        int width = 0;
+        if (equal_width) {
+            int wf = digits((unsigned long long)llabs(first)) + (first < 0);
+            int wl = digits((unsigned long long)llabs(last)) + (last < 0);
+            width = wf > wl ? wf : wl;
+        }
+        if (incr == 1 && first >= 0 && !equal_width && seplen < 64) {
+            seq_count_up(o, (unsigned long long)first, (unsigned long long)last, sep, seplen);
+            goto flush;
+        }
+        int any = 0;
+        for (long long v = first; incr > 0 ? v <= last : v >= last; v += incr) {
+            if (any) out_write(o, sep, seplen);
+            any = 1;
+            if (v < 0) {
+                out_putc(o, '-');
+                out_num(o, (unsigned long long)(-(v + 1)) + 1, width ? width - 1 : 0, '0');
+            } else {
+                out_num(o, (unsigned long long)v, width, '0');
+            }
+            if (o->err || got_sigint) break;
+            if ((incr > 0 && v > LLONG_MAX - incr) || (incr < 0 && v < LLONG_MIN - incr)) break;
+        }
+        if (any) out_putc(o, '\n');
+    } else {
+        char *end1, *end2, *end3;
+        double first = strtod(sfirst, &end1), incr = strtod(sincr, &end2), last = strtod(slast, &end3);
+        if (*end1 || *end2 || *end3) {
+            fprintf(stderr, "seq: invalid floating point argument\n");
+            free(o);
+            return 1;
+        }
+        if (incr == 0) {
+            fprintf(stderr, "seq: invalid Zero increment value: '%s'\n", sincr);
+            free(o);
+            return 1;
+        }
+        int prec = decimals_of(sfirst);
+        if (decimals_of(sincr) > prec) prec = decimals_of(sincr);
+        char tmp[64];
+        int any = 0;
+        for (long long k = 0;; ++k) {
+            double v = first + (double)k * incr;
+            if (incr > 0 ? v > last + 1e-12 : v < last - 1e-12) break;
+            if (any) out_write(o, sep, seplen);
+            any = 1;
+            int len = snprintf(tmp, sizeof(tmp), "%.*f", prec, v);
+            out_write(o, tmp, (size_t)len);
+            if (o->err || got_sigint) break;
+        }
+        if (any) out_putc(o, '\n');
+    }
+flush:
+    if (out_flush(o) != 0) status = 1;
+    free(o);
+    return status;
+}
+
+/* ---- yes ---- */
+
+int builtin_yes(int argc, char **argv) {
+    /* Build one line, then replicate it to fill a large buffer */
+    size_t linelen = 0;
+    if (argc < 2) {
+        linelen = 2;
+    } else {
+        for (int i = 1; i < argc; ++i) linelen += strlen(argv[i]) + 1;
+    }
+    size_t cap = OUT_BUFSZ > linelen * 2 ? OUT_BUFSZ : linelen * 2;
+    char *buf = malloc(cap);
+    if (!buf) return 1;
+    size_t len = 0;
+    if (argc < 2) {
+        memcpy(buf, "y\n", 2);
+        len = 2;
+    } else {
+        for (int i = 1; i < argc; ++i) {
+            size_t l = strlen(argv[i]);
+            memcpy(buf + len, argv[i], l);
+            len += l;
+            buf[len++] = i + 1 < argc ? ' ' : '\n';
+        }
+    }
+    while (len + linelen <= cap) {
+        memcpy(buf + len, buf, linelen);
+        len += linelen;
+    }
+    fflush(stdout);
+    while (!got_sigint && io_write_all(STDOUT_FILENO, buf, len) == 0)
+        ;
+    free(buf);
+    return 1;
+}
+
+/* ---- tee ---- */
+
+int builtin_tee(int argc, char **argv) {
+    int append = 0, i = 1, status = 0;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        for (const char *f = argv[i] + 1; *f; ++f) {
+            if (*f == 'a') append = 1;
+            else if (*f == 'i') continue;
+            else {
+                char opt[2] = { *f, 0 };
+                return unsupported(argv, opt, 1);
+            }
+        }
+    }
+    int nfiles = argc - i;
+    int *fds = malloc(sizeof(int) * (size_t)(nfiles + 1));
+    if (!fds) return 1;
+    int nout = 0;
+    fflush(stdout);
+    fds[nout++] = STDOUT_FILENO;
+    for (int k = 0; k < nfiles; ++k) {
+        int fd = open(argv[i + k], O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", argv[i + k], strerror(errno));
+            status = 1;
+            continue;
+        }
+        fds[nout++] = fd;
+    }
+    if (io_tee(STDIN_FILENO, fds, nout) < 0) status = 1;
+    for (int k = 1; k < nout; ++k) close(fds[k]);
+    free(fds);
+    return status;
+}
+
+/* ---- sleep ---- */
+
+int builtin_sleep(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "sleep: missing operand\n");
+        return 1;
+    }
+    double total = 0;
+    for (int i = 1; i < argc; ++i) {
+        char *end;
+        double v = strtod(argv[i], &end);
+        double mult = 1;
+        if (*end == 'm') mult = 60;
+        else if (*end == 'h') mult = 3600;
+        else if (*end == 'd') mult = 86400;
+        else if (*end && *end != 's') end = NULL;
+        if (!end || end == argv[i] || v < 0 || (*end && end[1])) {
+            fprintf(stderr, "sleep: invalid time interval '%s'\n", argv[i]);
+            return 1;
+        }
+        total += v * mult;
+    }
+    struct timespec ts;
+    ts.tv_sec = (time_t)total;
+    ts.tv_nsec = (long)((total - (double)ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) != 0) {
+        if (errno != EINTR || got_sigint) return 130;
+    }
+    return 0;
+}
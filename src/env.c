@@ -1,18 +1,10 @@
 #include "../include/env.h"
-#include <stdio.h>
-#include <stdlib.h>
+#include "../include/out.h"
+#include "../include/var.h"
 
-void env_export(const char *name, const char *value) {
-    setenv(name, value, 1);
-}
-
-void env_unset(const char *name) {
-    unsetenv(name);
-}
-
-void env_show() {
-    extern char **environ;
-    for (char **env = environ; *env; ++env) {
-        printf("%s\n", *env);
+void env_show(struct out *o) {
+    for (char **env = var_envp(); *env; ++env) {
+        out_str(o, *env);
+        out_putc(o, '\n');
     }
 }
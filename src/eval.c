@@ -0,0 +1,619 @@
+/*
+ * AST evaluator: walks lists, and-or chains and pipelines and hands simple
+ * commands to the exec layer (or to a shell function of that name).
+ * Compound commands are compiled and run by the VM in vm.c. Processes are
+ * waited for, or kept as background jobs, through jobs.c.
+ */
+
+#define _GNU_SOURCE
+#include "eval.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "builtins.h"
+#include "exec.h"
+#include "launch.h"
+#include "var.h"
+#include "alias.h"
+#include "expand.h"
+#include "jobs.h"
+#include "vm.h"
+
+int eval_last_status = 0;
+
+char *word_unquote(struct arena *a, const struct word *w) {
+    if (!(w->flags & WORD_QUOTED)) return arena_strndup(a, w->text, w->len);
+
+    char *out = arena_alloc(a, w->len + 1);
+    size_t o = 0;
+    const char *s = w->text;
+    const char *end = w->text + w->len;
+    while (s < end) {
+        char c = *s++;
+        if (c == '\\') {
+            if (s < end) {
+                if (*s != '\n') out[o++] = *s;
+                s++;
+            }
+        } else if (c == '\'') {
+            while (s < end && *s != '\'') out[o++] = *s++;
+            if (s < end) s++;
+        } else if (c == '"') {
+            while (s < end && *s != '"') {
+                if (*s == '\\' && s + 1 < end &&
+                    (s[1] == '$' || s[1] == '`' || s[1] == '"' || s[1] == '\\' || s[1] == '\n')) {
+                    if (s[1] != '\n') out[o++] = s[1];
+                    s += 2;
+                } else {
+                    out[o++] = *s++;
+                }
+            }
+            if (s < end) s++;
+        } else {
+            out[o++] = c;
+        }
+    }
+    out[o] = '\0';
+    return out;
+}
+
+/* NAME=value without a command sets a shell variable; it reaches the
+ * environment only if NAME is exported. */
+static int apply_assignment(struct arena *a, const struct word *w) {
+    char *s = expand_string(a, w, 1);
+    if (!s) return -1;
+    char *eq = strchr(s, '=');
+    if (!eq) return 0;
+    *eq = '\0';
+    return var_set(s, eq + 1, 0);
+}
+
+/* Prefix assignments (FOO=bar cmd) are exported to cmd and only last for
+ * its duration. */
+struct saved_var {
+    char *name;
+    char *old;      /* NULL if previously unset */
+    unsigned flags;
+};
+
+/* Aliases being expanded, innermost last. A word naming one of these is
+ * left alone, which stops `alias ls='ls -F'` and a='b' b='a' loops. Compound
+ * aliases stay on the stack while their command line runs. */
+#define ALIAS_MAX_DEPTH 32
+static const char *alias_stack[ALIAS_MAX_DEPTH];
+static int alias_depth = 0;
+
+/* A word that can be alias-expanded: unquoted and not on the stack */
+static const struct alias *alias_candidate(const struct word *w) {
+    if (w->flags & (WORD_QUOTED | WORD_DOLLAR) || alias_depth == ALIAS_MAX_DEPTH) return NULL;
+    const struct alias *al = alias_lookup_n(w->text, w->len);
+    if (!al) return NULL;
+    for (int i = 0; i < alias_depth; ++i) {
+        if (strcmp(alias_stack[i], al->name) == 0) return NULL;
+    }
+    return al;
+}
+
+struct word_list {
+    const struct word **v;
+    int n, cap;
+};
+
+static void word_list_push(struct arena *a, struct word_list *l, const struct word *w) {
+    if (l->n == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 16;
+        const struct word **v = arena_alloc(a, sizeof(*v) * (size_t)cap);
+        if (l->n) memcpy(v, l->v, sizeof(*v) * (size_t)l->n);
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n++] = w;
+}
+
+/* Append the words of alias al, expanding its first word again (and the
+ * one after any value ending in a blank). A compound alias can only take
+ * the command position; it is reported through *compound. Returns
+ * whether the word following this alias should be checked as well. */
+static int splice_alias(struct arena *a, struct word_list *out, const struct alias *al,
+                        const struct alias **compound) {
+    if (al->compound) {
+        if (out->n == 0 && !*compound) *compound = al;
+        return 0;
+    }
+    alias_stack[alias_depth++] = al->name;
+    int check = 1;
+    for (int i = 0; i < al->nwords; ++i) {
+        const struct alias *inner = check ? alias_candidate(&al->words[i]) : NULL;
+        if (inner && (!inner->compound || (out->n == 0 && !*compound))) {
+            check = splice_alias(a, out, inner, compound);
+        } else {
+            word_list_push(a, out, &al->words[i]);
+            check = 0;
+        }
+    }
+    alias_depth--;
+    return al->trailing_blank || check;
+}
+
+/* Build argv for a simple command: alias expansion, then word expansion,
+ * which can leave argc 0. Returns -1 on an expansion error, and 1 for a
+ * compound alias in command position, setting *script to the command line
+ * to run instead: the alias value followed by the remaining words as
+ * typed. */
+static int build_argv(struct arena *a, struct node *n, char ***argvp, int *argcp, char **script) {
+    struct word_list wl = {0};
+    const struct alias *compound = NULL;
+    int check = 1;
+    *script = NULL;
+    for (struct word *w = n->u.cmd.words; w; w = w->next) {
+        const struct alias *al = check && alias_count() ? alias_candidate(w) : NULL;
+        if (al && (!al->compound || wl.n == 0)) {
+            check = splice_alias(a, &wl, al, &compound);
+        } else {
+            word_list_push(a, &wl, w);
+            check = 0;
+        }
+    }
+
+    if (compound) {
+        size_t len = strlen(compound->value);
+        for (int i = 0; i < wl.n; ++i) len += wl.v[i]->len + 1;
+        char *text = arena_alloc(a, len + 1);
+        size_t o = strlen(compound->value);
+        memcpy(text, compound->value, o);
+        for (int i = 0; i < wl.n; ++i) {
+            text[o++] = ' ';
+            memcpy(text + o, wl.v[i]->text, wl.v[i]->len);
+            o += wl.v[i]->len;
+        }
+        text[o] = '\0';
+        *script = text;
+        *argvp = NULL;
+        *argcp = 0;
+        /* the caller runs it with the alias still marked as in use */
+        alias_stack[alias_depth++] = compound->name;
+        return 1;
+    }
+
+    struct field_list fields = {0};
+    for (int i = 0; i < wl.n; ++i) {
+        if (expand_word(a, wl.v[i], &fields) != 0) return -1;
+    }
+    *argvp = fields.v;
+    *argcp = fields.n;
+    return 0;
+}
+
+/* Run the command line of a compound alias (see build_argv) */
+static int run_alias_script(struct arena *a, const char *text) {
+    struct parse_error err;
+    struct node *body = parse_buffer(a, text, strlen(text), &err);
+    int status;
+    if (err.msg) {
+        parse_error_print("alias", &err);
+        status = 2;
+    } else {
+        status = body ? eval_node(a, body) : 0;
+    }
+    alias_depth--;
+    return status;
+}
+
+static void pop_assignments(struct saved_var *saved, int nsaved) {
+    while (nsaved-- > 0) var_restore(saved[nsaved].name, saved[nsaved].old, saved[nsaved].flags);
+}
+
+/* Returns -1 (with nothing left applied) if one of them could not be set */
+static int push_assignments(struct arena *a, struct node *n, struct saved_var **out) {
+    int nsaved = 0;
+    struct saved_var *saved = NULL;
+    if (n->u.cmd.assigns) {
+        int count = 0;
+        for (struct word *w = n->u.cmd.assigns; w; w = w->next) count++;
+        saved = arena_alloc(a, sizeof(*saved) * (size_t)count);
+        for (struct word *w = n->u.cmd.assigns; w; w = w->next) {
+            char *s = expand_string(a, w, 1);
+            if (!s) {
+                pop_assignments(saved, nsaved);
+                return -1;
+            }
+            char *eq = strchr(s, '=');
+            *eq = '\0';
+            const struct var *v = var_lookup(s);
+            const char *old = v && v->set ? VAR_VALUE(v) : NULL;
+            saved[nsaved].name = s;
+            saved[nsaved].old = old ? arena_strndup(a, old, strlen(old)) : NULL;
+            saved[nsaved].flags = v ? v->flags : 0;
+            if (var_set(s, eq + 1, VAR_EXPORT) != 0) {
+                pop_assignments(saved, nsaved);
+                return -1;
+            }
+            nsaved++;
+        }
+    }
+    *out = saved;
+    return nsaved;
+}
+
+/* An external command in the foreground; under job control it gets its
+ * own process group and the terminal */
+static int run_external(struct arena *a, struct node *n, char **argv) {
+    int status;
+    pid_t pid = exec_spawn(a, argv[0], argv, -1, -1, n->u.cmd.redirs, jobs_control ? 0 : -1,
+                           &status);
+    if (pid < 0) return status;
+    return jobs_wait_fg(jobs_control ? pid : -1, &pid, &status, 1, n);
+}
+
+static int run_argv(struct arena *a, struct node *n, int argc, char **argv) {
+    struct saved_var *saved;
+    int nsaved = push_assignments(a, n, &saved);
+    if (nsaved < 0) return 1;
+    const struct function *fn = vm_function(argv[0]);
+    const struct builtin *b = fn ? NULL : builtin_lookup(argv[0]);
+    int status;
+    if (!fn && !b) {
+        status = run_external(a, n, argv);
+    } else {
+        /* builtins and functions redirect in the shell, without a fork */
+        struct redir_undo undo = {0};
+        fflush(stdout);
+        if (n->u.cmd.redirs && exec_redirect(a, n->u.cmd.redirs, &undo) != 0) {
+            status = 1;
+        } else {
+            status = fn ? vm_call(a, fn, argc, argv) : b->fn(argc, argv);
+            fflush(stdout);
+        }
+        exec_restore(&undo);
+    }
+    if (status == -1) {
+        fprintf(stderr, "kzsh: %s: command not found\n", argv[0]);
+        status = 127;
+    }
+    pop_assignments(saved, nsaved);
+    return status;
+}
+
+static int run_simple(struct arena *a, struct node *n) {
+    expand_subst_status = -1;
+    int argc = 0;
+    char **argv = NULL;
+    if (n->u.cmd.nwords > 0) {
+        char *script;
+        int r = build_argv(a, n, &argv, &argc, &script);
+        if (r < 0) return 1;
+        if (r > 0) return run_alias_script(a, script);
+    }
+    if (argc > 0) return run_argv(a, n, argc, argv);
+
+    /* No command, or words that expanded to nothing: the assignments set
+     * shell variables, and $? comes from the last command substitution */
+    int status = 0;
+    for (struct word *w = n->u.cmd.assigns; w; w = w->next) {
+        if (apply_assignment(a, w) != 0) status = 1;
+    }
+    if (status == 0 && expand_subst_status >= 0) status = expand_subst_status;
+    if (n->u.cmd.redirs) {
+        /* `> file` on its own still creates (or truncates) file */
+        struct redir_undo undo;
+        if (exec_redirect(a, n->u.cmd.redirs, &undo) != 0) status = 1;
+        exec_restore(&undo);
+    }
+    return status;
+}
+
+/* PIPESTATUS: the exit status of every stage of the last pipeline */
+static void set_pipestatus(const int *statuses, int n) {
+    char num[n][12];
+    const char *v[n];
+    for (int i = 0; i < n; ++i) {
+        /* this runs after every command: no snprintf */
+        char *p = num[i] + sizeof(num[i]);
+        unsigned u = statuses[i] < 0 ? 0u - (unsigned)statuses[i] : (unsigned)statuses[i];
+        *--p = '\0';
+        do *--p = (char)('0' + u % 10); while (u /= 10);
+        if (statuses[i] < 0) *--p = '-';
+        v[i] = p;
+    }
+    var_set_array("PIPESTATUS", v, n);
+}
+
+/* One stage of a pipeline, prepared in the parent before anything starts */
+struct stage {
+    struct node *node;
+    int argc;
+    char **argv;                /* NULL unless a plain simple command */
+    const struct builtin *bi;   /* set when argv[0] is a builtin */
+    int function;               /* argv[0] is a shell function */
+    int done;                   /* nothing to run; status is already set */
+    pid_t pid;
+    int status;
+};
+
+/* fork() a copy of the shell that joins process group pgid (-1 the
+ * shell's, 0 a new one); both sides set it so neither races the other */
+static pid_t fork_child(pid_t pgid) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid > 0 && pgid >= 0) setpgid(pid, pgid ? pgid : pid);
+    if (pid != 0) return pid;
+    if (pgid >= 0) setpgid(0, pgid);
+    launch_reset_signals();
+    jobs_forked();
+    return 0;
+}
+
+/* Forked stage: builtins that are not the in-process stage, and anything
+ * that is not a plain command. */
+static pid_t fork_stage(struct arena *a, struct stage *st, int in, int out,
+                        const int *fds, int nfds, pid_t pgid) {
+    pid_t pid = fork_child(pgid);
+    if (pid != 0) return pid;
+    if (in >= 0) dup2(in, STDIN_FILENO);
+    if (out >= 0) dup2(out, STDOUT_FILENO);
+    for (int i = 0; i < nfds; ++i) close(fds[i]);
+    int status = st->argv ? run_argv(a, st->node, st->argc, st->argv) : eval_node(a, st->node);
+    fflush(stdout);
+    _exit(status & 0xff);
+}
+
+/* Run a builtin stage inside the shell with its stdin/stdout swapped in. */
+static int run_inproc_stage(struct arena *a, struct stage *st, int in, int out) {
+    int saved_in = -1, saved_out = -1;
+    struct sigaction ign, old_pipe;
+    fflush(stdout);
+    if (in >= 0) {
+        saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(in, STDIN_FILENO);
+    }
+    if (out >= 0) {
+        /* Writing into a pipe whose reader exited must not kill the shell */
+        memset(&ign, 0, sizeof(ign));
+        ign.sa_handler = SIG_IGN;
+        sigaction(SIGPIPE, &ign, &old_pipe);
+        saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(out, STDOUT_FILENO);
+    }
+    int status = run_argv(a, st->node, st->argc, st->argv);
+    fflush(stdout);
+    if (saved_out >= 0) {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+        clearerr(stdout);
+        sigaction(SIGPIPE, &old_pipe, NULL);
+    }
+    if (saved_in >= 0) {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    return status;
+}
+
+static int inproc_ok(const struct stage *st, int first) {
+    if (!st->bi || !(st->bi->flags & BUILTIN_NOFORK)) return 0;
+    return !(first && jobs_control && (st->bi->flags & BUILTIN_STDIN));
+}
+
+/* All stages start before any is waited for, connected by pipes. At most
+ * one NOFORK builtin stage runs inside the shell and so needs no fork: the
+ * last stage if it is one, otherwise the first. Builtins that change shell
+ * state (cd, exit, export, ...) always fork, so like other shells
+ * `... | exit` leaves the shell running. A first stage that reads stdin
+ * forks too under job control, where the terminal belongs to the job. A
+ * background pipeline forks every stage and becomes a job instead of being
+ * waited for. */
+static int eval_pipeline(struct arena *a, struct node *pl, int background) {
+    int n = pl->u.pipe.ncmds;
+    struct stage *st = arena_calloc(a, sizeof(*st) * (size_t)n);
+    int nfds = 2 * (n - 1);
+    int *fds = arena_alloc(a, sizeof(int) * (size_t)(nfds ? nfds : 1));
+
+    for (int i = 0; i < n - 1; ++i) {
+        if (pipe2(&fds[2 * i], O_CLOEXEC) != 0) {
+            perror("kzsh: pipe");
+            for (int j = 0; j < 2 * i; ++j) close(fds[j]);
+            return 1;
+        }
+    }
+
+    int inproc = -1;
+    for (int i = 0; i < n; ++i) {
+        struct node *c = pl->u.pipe.cmds[i];
+        st[i].node = c;
+        st[i].pid = -1;
+        if (c->type == NODE_CMD && c->u.cmd.nwords > 0) {
+            char *script;
+            expand_subst_status = -1;
+            int r = build_argv(a, c, &st[i].argv, &st[i].argc, &script);
+            if (r > 0) {
+                /* compound alias: the stage re-evaluates its node instead */
+                alias_depth--;
+            } else if (r < 0 || st[i].argc == 0) {
+                st[i].argv = NULL;
+                st[i].done = 1;
+                st[i].status = r < 0 ? 1 : expand_subst_status >= 0 ? expand_subst_status : 0;
+            } else if (vm_function(st[i].argv[0])) {
+                st[i].function = 1;
+            } else {
+                st[i].bi = builtin_lookup(st[i].argv[0]);
+            }
+        }
+    }
+    if (background) {
+        /* nothing runs in the shell */
+    } else if (inproc_ok(&st[n - 1], n == 1)) {
+        inproc = n - 1;
+    } else {
+        for (int i = 0; i < n - 1; ++i) {
+            if (inproc_ok(&st[i], i == 0)) {
+                inproc = i;
+                break;
+            }
+        }
+    }
+
+    /* Without job control a background job reads /dev/null, not the
+     * shell's input */
+    int devnull = background && !jobs_control ? open("/dev/null", O_RDONLY | O_CLOEXEC) : -1;
+    pid_t pgid = jobs_control ? 0 : -1;
+    for (int i = 0; i < n; ++i) {
+        if (i == inproc || st[i].done) continue;
+        int in = i > 0 ? fds[2 * (i - 1)] : devnull;
+        int out = i < n - 1 ? fds[2 * i + 1] : -1;
+        if (st[i].argv && !st[i].bi && !st[i].function) {
+            struct saved_var *saved;
+            int nsaved = push_assignments(a, st[i].node, &saved);
+            st[i].pid = exec_spawn(a, st[i].argv[0], st[i].argv, in, out,
+                                   st[i].node->u.cmd.redirs, pgid, &st[i].status);
+            pop_assignments(saved, nsaved);
+        } else {
+            st[i].pid = fork_stage(a, &st[i], in, out, fds, nfds, pgid);
+            if (st[i].pid < 0) {
+                perror("kzsh: fork");
+                st[i].status = 1;
+            }
+        }
+        if (pgid == 0 && st[i].pid > 0) pgid = st[i].pid;
+    }
+    if (devnull >= 0) close(devnull);
+    if (pgid == 0) pgid = -1;
+
+    /* The shell keeps only the in-process stage's ends open */
+    int keep_in = inproc > 0 ? fds[2 * (inproc - 1)] : -1;
+    int keep_out = (inproc >= 0 && inproc < n - 1) ? fds[2 * inproc + 1] : -1;
+    for (int i = 0; i < nfds; ++i) {
+        if (fds[i] != keep_in && fds[i] != keep_out) close(fds[i]);
+    }
+
+    pid_t *pids = arena_alloc(a, sizeof(pid_t) * (size_t)n);
+    for (int i = 0; i < n; ++i) pids[i] = st[i].pid;
+    if (background) {
+        jobs_add_bg(pgid, pids, n, pl);
+        return 0;
+    }
+    if (inproc >= 0) {
+        /* the other stages may want the terminal while the shell runs this one */
+        jobs_give_terminal(pgid);
+        st[inproc].status = run_inproc_stage(a, &st[inproc], keep_in, keep_out);
+        if (keep_in >= 0) close(keep_in);
+        if (keep_out >= 0) close(keep_out);
+    }
+
+    int *statuses = arena_alloc(a, sizeof(int) * (size_t)n);
+    for (int i = 0; i < n; ++i) statuses[i] = st[i].status;
+    jobs_wait_fg(pgid, pids, statuses, n, pl);
+    set_pipestatus(statuses, n);
+    return statuses[n - 1];
+}
+
+/* ( list ): the list runs in a forked copy of the shell */
+static int eval_subshell(struct arena *a, struct node *n) {
+    pid_t pid = fork_child(jobs_control ? 0 : -1);
+    if (pid < 0) {
+        perror("kzsh: fork");
+        return 1;
+    }
+    if (pid == 0) {
+        int status = eval_node(a, n->u.group.body);
+        fflush(stdout);
+        _exit(status & 0xff);
+    }
+    int status;
+    return jobs_wait_fg(jobs_control ? pid : -1, &pid, &status, 1, n);
+}
+
+/* list &: a pipeline starts its stages and leaves them running; anything
+ * else runs in a forked copy of the shell */
+static int eval_background(struct arena *a, struct node *n) {
+    /* collect finished jobs first, so a loop starting jobs leaves no zombies */
+    jobs_reap();
+    if (n->type == NODE_PIPELINE && !n->u.pipe.bang) return eval_pipeline(a, n, 1);
+    pid_t pid = fork_child(jobs_control ? 0 : -1);
+    if (pid < 0) {
+        perror("kzsh: fork");
+        return 1;
+    }
+    if (pid == 0) {
+        if (!jobs_control) {
+            int fd = open("/dev/null", O_RDONLY);
+            if (fd >= 0 && fd != STDIN_FILENO) {
+                dup2(fd, STDIN_FILENO);
+                close(fd);
+            }
+        }
+        int status = eval_node(a, n);
+        fflush(stdout);
+        _exit(status & 0xff);
+    }
+    jobs_add_bg(jobs_control ? pid : -1, &pid, 1, n);
+    return 0;
+}
+
+/* A compound command with redirections after it: they stay in place in
+ * the shell while a copy of the node without them runs */
+static int eval_redirected(struct arena *a, struct node *n) {
+    struct node body = *n;
+    body.redirs = NULL;
+    struct redir_undo undo;
+    int status = 1;
+    fflush(stdout);
+    if (exec_redirect(a, n->redirs, &undo) == 0) {
+        status = eval_node(a, &body);
+        fflush(stdout);
+    }
+    exec_restore(&undo);
+    return status;
+}
+
+int eval_node(struct arena *a, struct node *n) {
+    int status = 0;
+    if (!n) return eval_last_status;
+    if (n->type != NODE_CMD && n->redirs) {
+        eval_last_status = status = eval_redirected(a, n);
+        return status;
+    }
+    switch (n->type) {
+        case NODE_CMD:
+            status = run_simple(a, n);
+            set_pipestatus(&status, 1);
+            break;
+        case NODE_PIPELINE:
+            if (n->u.pipe.ncmds > 1) status = eval_pipeline(a, n, 0);
+            else status = eval_node(a, n->u.pipe.cmds[0]);
+            if (n->u.pipe.bang) status = !status;
+            break;
+        case NODE_AND:
+            status = eval_node(a, n->u.bin.left);
+            if (status == 0 && !vm_unwinding) status = eval_node(a, n->u.bin.right);
+            break;
+        case NODE_OR:
+            status = eval_node(a, n->u.bin.left);
+            if (status != 0 && !vm_unwinding) status = eval_node(a, n->u.bin.right);
+            break;
+        case NODE_SEQ:
+            status = eval_node(a, n->u.bin.left);
+            if (!vm_unwinding) status = eval_node(a, n->u.bin.right);
+            break;
+        case NODE_BACKGROUND:
+            status = eval_background(a, n->u.bin.left);
+            break;
+        case NODE_SUBSHELL:
+            status = eval_subshell(a, n);
+            break;
+        case NODE_IF:
+        case NODE_WHILE:
+        case NODE_UNTIL:
+        case NODE_FOR:
+        case NODE_CASE:
+        case NODE_GROUP:
+        case NODE_FUNCDEF:
+            status = vm_eval(a, n);
+            break;
+    }
+    eval_last_status = status;
+    return status;
+}
@@ -1,40 +1,388 @@
+#define _GNU_SOURCE
+#include "exec.h"
 #include "builtins.h"
+#include "cmdhash.h"
+#include "expand.h"
+#include "iocopy.h"
+#include "jobs.h"
+#include "launch.h"
+#include "var.h"
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 
 
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <stdlib.h>
 
+/* Here-docs up to this size go through a pipe, larger ones through a memfd */
+#define HEREDOC_PIPE_MAX 65536
 
-int exec_builtin(const char *cmd, int argc, char **argv) {
-    if (strcmp(cmd, "echo") == 0) return builtin_echo(argc, argv);
-    if (strcmp(cmd, "true") == 0) return builtin_true(argc, argv);
-    if (strcmp(cmd, "false") == 0) return builtin_false(argc, argv);
-    if (strcmp(cmd, "cd") == 0) return builtin_cd(argc, argv);
-    if (strcmp(cmd, "source") == 0) return builtin_source(argc, argv);
-    if (strcmp(cmd, "exit") == 0) {
-        int code = (argc > 1) ? atoi(argv[1]) : 0;
-        exit(code);
-    }
-    // Add more builtins here
-    // If not a builtin, try to exec external binary
+/* Convert a waitpid status into a shell exit status */
+int exec_status(int status) {
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int exec_wait(pid_t pid) {
+    int status;
+    if (jobs_take_status(pid, &status)) return exec_status(status);
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return exec_status(status);
+}
+
+/* ---- Redirections ---- */
+
+static int redir_default_fd(const struct redir *r) {
+    if (r->fd >= 0) return r->fd;
+    switch (r->type) {
+        case REDIR_IN:
+        case REDIR_RDWR:
+        case REDIR_DUPIN:
+        case REDIR_HEREDOC:
+        case REDIR_HERESTR:
+            return STDIN_FILENO;
+        default:
+            return STDOUT_FILENO;
+    }
+}
+
+static int redir_oflag(enum redir_type type) {
+    switch (type) {
+        case REDIR_IN: return O_RDONLY;
+        case REDIR_RDWR: return O_RDWR | O_CREAT;
+        case REDIR_APPEND: return O_WRONLY | O_CREAT | O_APPEND;
+        default: return O_WRONLY | O_CREAT | O_TRUNC;
+    }
+}
+
+/* Keep fds the shell opens for itself clear of 0-9, which scripts name */
+static int move_high(int fd) {
+    if (fd < 0 || fd >= 10) return fd;
+    int high = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    close(fd);
+    return high;
+}
+
+/* An fd that reads back iov[0..n-1]: a pipe filled with one writev when
+ * it all fits in the pipe buffer, otherwise a memfd. No temporary files. */
+static int heredoc_fd(struct iovec *iov, int n) {
+    size_t len = 0;
+    for (int i = 0; i < n; ++i) len += iov[i].iov_len;
+    int fds[2];
+    if (len <= HEREDOC_PIPE_MAX && pipe2(fds, O_CLOEXEC) == 0) {
+        long cap = PIPE_BUF;
+#ifdef F_GETPIPE_SZ
+        cap = fcntl(fds[1], F_GETPIPE_SZ);
+#endif
+        if ((size_t)cap >= len) {
+            int err = io_writev_all(fds[1], iov, n);
+            close(fds[1]);
+            if (err == 0) return move_high(fds[0]);
+            close(fds[0]);
+            return -1;
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+#ifdef MFD_CLOEXEC
+    int fd = memfd_create("kzsh-heredoc", MFD_CLOEXEC);
+    if (fd >= 0) {
+        if (io_writev_all(fd, iov, n) == 0 && lseek(fd, 0, SEEK_SET) == 0) return move_high(fd);
+        close(fd);
+        return -1;
+    }
+#endif
+    /* No memfd: a child feeds the pipe */
+    if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+    fflush(stdout);
     pid_t pid = fork();
     if (pid == 0) {
-        /* Restore default signal handlers in child so Ctrl-C and others behave normally */
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTERM, SIG_DFL);
-        signal(SIGQUIT, SIG_DFL);
-        execvp(cmd, argv);
-        perror("execvp");
-        _exit(127);
-    } else if (pid > 0) {
-        int status;
-        waitpid(pid, &status, 0);
-        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
-    } else {
-        perror("fork");
+        close(fds[0]);
+        _exit(io_writev_all(fds[1], iov, n) == 0 ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
         return -1;
     }
+    return move_high(fds[0]);
+}
+
+/* Expand a here-doc body as if it were between double quotes. In a
+ * here-doc a backslash only quotes $ ` \ and newline, and " is plain, so
+ * the other backslashes and the quotes are escaped first; $(...), ${...}
+ * and `...` are copied as they are. */
+static char *heredoc_expand(struct arena *a, const char *s, size_t len) {
+    const char *end = s + len;
+    char *text = arena_alloc(a, 2 * len + 3);
+    size_t o = 0;
+    text[o++] = '"';
+    while (s < end) {
+        char c = *s;
+        if (c == '`' || (c == '$' && s + 1 < end && (s[1] == '(' || s[1] == '{'))) {
+            const char *q = lexer_skip(s, end);
+            if (!q || q > end) q = end;
+            memcpy(text + o, s, (size_t)(q - s));
+            o += (size_t)(q - s);
+            s = q;
+        } else if (c == '\\' && s + 1 < end && s[1] && strchr("$`\\\n", s[1])) {
+            text[o++] = c;
+            text[o++] = s[1];
+            s += 2;
+        } else {
+            if (c == '"' || c == '\\') text[o++] = '\\';
+            text[o++] = c;
+            s++;
+        }
+    }
+    text[o++] = '"';
+    struct word w = { text, o, WORD_QUOTED | WORD_DOLLAR, NULL };
+    return expand_string(a, &w, 0);
+}
+
+/* The fd a here-doc or here-string reads from. The body goes out with
+ * one writev straight from the source text unless it needs expansion;
+ * <<- drops the leading tabs by leaving them out of the iovecs. */
+static int heredoc_open(struct arena *a, const struct redir *r) {
+    struct iovec one[2];
+    struct iovec *iov = one;
+    int n = 0;
+    if (r->type == REDIR_HERESTR) {
+        char *s = expand_string(a, r->target, 0);
+        if (!s) return -2;
+        one[n++] = (struct iovec){ s, strlen(s) };
+        one[n++] = (struct iovec){ "\n", 1 };
+    } else if (r->strip_tabs) {
+        const char *s = r->body, *end = r->body + r->body_len;
+        int lines = 0;
+        for (const char *p = s; p < end; ++p) lines += *p == '\n';
+        iov = arena_alloc(a, sizeof(*iov) * (size_t)(lines + 1));
+        while (s < end) {
+            while (s < end && *s == '\t') s++;
+            const char *eol = memchr(s, '\n', (size_t)(end - s));
+            eol = eol ? eol + 1 : end;
+            iov[n++] = (struct iovec){ (char *)s, (size_t)(eol - s) };
+            s = eol;
+        }
+    } else {
+        one[n++] = (struct iovec){ (char *)r->body, r->body_len };
+    }
+    if (r->type == REDIR_HEREDOC && !r->quoted_delim) {
+        size_t len = 0;
+        for (int i = 0; i < n; ++i) len += iov[i].iov_len;
+        char *text = arena_alloc(a, len + 1);
+        size_t o = 0;
+        for (int i = 0; i < n; ++i) {
+            memcpy(text + o, iov[i].iov_base, iov[i].iov_len);
+            o += iov[i].iov_len;
+        }
+        if (memchr(text, '$', len) || memchr(text, '`', len) || memchr(text, '\\', len)) {
+            char *s = heredoc_expand(a, text, len);
+            if (!s) return -2;
+            iov = one;
+            n = 0;
+            one[n++] = (struct iovec){ s, strlen(s) };
+        }
+    }
+    int fd = heredoc_fd(iov, n);
+    if (fd < 0) {
+        perror("kzsh: here-document");
+        return -2;
+    }
+    return fd;
+}
+
+/* What one redirection puts on its fd: a newly opened fd (*owned set),
+ * an fd of the shell to duplicate, or -1 to close it. *both is set for
+ * >&file, which also sends stderr there. Returns -2 after printing a
+ * message. */
+static int redir_source(struct arena *a, const struct redir *r, int *owned, int *both) {
+    *owned = 0;
+    *both = 0;
+    if (r->type == REDIR_HEREDOC || r->type == REDIR_HERESTR) {
+        int fd = heredoc_open(a, r);
+        *owned = fd >= 0;
+        return fd;
+    }
+    char *target = expand_string(a, r->target, 0);
+    if (!target) return -2;
+    if (r->type == REDIR_DUPIN || r->type == REDIR_DUPOUT) {
+        if (strcmp(target, "-") == 0) return -1;
+        char *end;
+        long fd = strtol(target, &end, 10);
+        if (*target && !*end && fd >= 0 && fd <= INT_MAX) {
+            if (fcntl((int)fd, F_GETFD) < 0) {
+                fprintf(stderr, "kzsh: %s: %s\n", target, strerror(EBADF));
+                return -2;
+            }
+            return (int)fd;
+        }
+        if (r->type == REDIR_DUPIN || r->fd >= 0) {
+            fprintf(stderr, "kzsh: %s: ambiguous redirect\n", target);
+            return -2;
+        }
+        *both = 1;
+    }
+    int fd = move_high(open(target, redir_oflag(*both ? REDIR_OUT : r->type) | O_CLOEXEC, 0666));
+    if (fd < 0) {
+        fprintf(stderr, "kzsh: %s: %s\n", target, strerror(errno));
+        return -2;
+    }
+    *owned = 1;
+    return fd;
+}
+
+static int redir_count(const struct redir *r) {
+    int n = 0;
+    for (; r; r = r->next) n++;
+    return n;
+}
+
+/* Remember fd before it is replaced, once per exec_redirect */
+static int save_fd(struct redir_undo *u, int fd) {
+    for (int i = 0; i < u->n; ++i) {
+        if (u->v[i].fd == fd) return 0;
+    }
+    for (int i = 0; i < u->n; ++i) {
+        /* a script naming one of our copies: move the copy out of its way */
+        if (u->v[i].saved == fd && (u->v[i].saved = fcntl(fd, F_DUPFD_CLOEXEC, 10)) < 0) return -1;
+    }
+    int saved = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    if (saved < 0 && errno != EBADF) return -1;
+    u->v[u->n].fd = fd;
+    u->v[u->n].saved = saved;
+    u->n++;
+    return 0;
+}
+
+int exec_redirect(struct arena *a, const struct redir *r, struct redir_undo *u) {
+    u->v = arena_alloc(a, sizeof(*u->v) * (size_t)(2 * redir_count(r) + 1));
+    u->n = 0;
+    for (; r; r = r->next) {
+        int fd = redir_default_fd(r), owned, both;
+        int src = redir_source(a, r, &owned, &both);
+        if (src == -2) return -1;
+        int err = save_fd(u, fd) != 0 || (both && save_fd(u, STDERR_FILENO) != 0);
+        if (!err && src < 0) close(fd);
+        else if (!err && src != fd) err = dup2(src, fd) < 0;
+        if (!err && both) err = dup2(fd, STDERR_FILENO) < 0;
+        if (owned) close(src);
+        if (err) {
+            fprintf(stderr, "kzsh: redirection error: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void exec_restore(struct redir_undo *u) {
+    while (u->n > 0) {
+        const struct redir_saved *s = &u->v[--u->n];
+        if (s->saved >= 0) {
+            dup2(s->saved, s->fd);
+            close(s->saved);
+        } else {
+            close(s->fd);
+        }
+    }
+}
+
+/* The redirections of an external command as spawn file actions, after
+ * the pipeline's. Files are opened here, so errors come out before
+ * anything starts, and the child gets them with a dup2; the shell's
+ * copies go in opened[] to close after the spawn. Returns -1 after
+ * printing a message. */
+static int redirect_launch(struct arena *a, const struct redir *r, struct launch *l,
+                           int *opened, int *nopened) {
+    for (; r; r = r->next) {
+        int fd = redir_default_fd(r), owned, both;
+        int src = redir_source(a, r, &owned, &both);
+        if (src == -2) return -1;
+        if (owned) opened[(*nopened)++] = src;
+        int err = src < 0 ? launch_close(l, fd) : launch_dup2(l, src, fd);
+        if (!err && both) err = launch_dup2(l, fd, STDERR_FILENO);
+        if (err) {
+            fprintf(stderr, "kzsh: too many redirections\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* More redirections than fit in the spawn actions are applied by the
+ * forked child itself, which reports its own errors */
+struct redirect_child {
+    struct arena *a;
+    const struct redir *redirs;
+};
+
+static int redirect_child(void *arg) {
+    struct redirect_child *rc = arg;
+    struct redir_undo u;
+    return exec_redirect(rc->a, rc->redirs, &u);
+}
+
+pid_t exec_spawn(struct arena *a, const char *cmd, char **argv, int in_fd, int out_fd,
+                 const struct redir *redirs, pid_t pgid, int *status) {
+    struct launch l;
+    launch_init(&l);
+    l.pgid = pgid;
+    if (in_fd >= 0 && in_fd != STDIN_FILENO) launch_dup2(&l, in_fd, STDIN_FILENO);
+    if (out_fd >= 0 && out_fd != STDOUT_FILENO) launch_dup2(&l, out_fd, STDOUT_FILENO);
+    int *opened = NULL, nopened = 0;
+    struct redirect_child rc = { a, redirs };
+    if (redirs && l.nactions + 2 * redir_count(redirs) > LAUNCH_MAX_ACTIONS) {
+        launch_setup(&l, redirect_child, &rc);
+    } else if (redirs) {
+        opened = arena_alloc(a, sizeof(int) * (size_t)redir_count(redirs));
+        if (redirect_launch(a, redirs, &l, opened, &nopened) != 0) {
+            while (nopened > 0) close(opened[--nopened]);
+            *status = 1;
+            return -1;
+        }
+    }
+    /* Resolve through the hash table so PATH is only searched once per name */
+    const char *path = cmdhash_lookup(cmd);
+    pid_t pid = -1;
+    if (!path) {
+        fprintf(stderr, "kzsh: %s: command not found\n", cmd);
+        *status = 127;
+    } else {
+        /* Builtin output still sitting in stdio must come before the child's */
+        fflush(stdout);
+        pid = launch_external(path, argv, var_envp(), &l);
+        if (pid < 0) {
+            int err = errno;
+            fprintf(stderr, "kzsh: %s: %s\n", cmd, strerror(err));
+            *status = err == ENOENT ? 127 : 126;
+        }
+    }
+    while (nopened > 0) close(opened[--nopened]);
+    return pid;
+}
+
+int exec_external(char **argv) {
+    int status;
+    fflush(stdout);
+    pid_t pid = exec_spawn(NULL, argv[0], argv, -1, -1, NULL, jobs_foreground(), &status);
+    if (pid < 0) return status;
+    return exec_wait(pid);
+}
+
+int exec_builtin(const char *cmd, int argc, char **argv) {
+    const struct builtin *b = builtin_lookup(cmd);
+    if (b) return b->fn(argc, argv);
+    // If not a builtin, try to exec external binary
+    int status;
+    pid_t pid = exec_spawn(NULL, cmd, argv, -1, -1, NULL, -1, &status);
+    if (pid < 0) return status;
+    return exec_wait(pid);
 }
@@ -0,0 +1,914 @@
+/*
+ * Word expansion, done in one left-to-right pass over the word's source
+ * text (a view into the parse arena; nothing is copied before expanding).
+ *
+ * Expanded text goes into a single growable buffer per word, which starts
+ * out on the stack; each finished field is copied into the arena once.
+ * Field splitting happens on the fly as unquoted expansion results are
+ * appended, so a word that needs no splitting never gets a second pass.
+ * Words without $, `, ~ or glob characters skip all of this and only
+ * get quote removal.
+ *
+ * A field that may be a pathname pattern is built with its quoted
+ * characters backslash-escaped, and it is only handed to pathglob if an
+ * unquoted * ? or [ actually went into it.
+ */
+
+#define _GNU_SOURCE
+#include "expand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pwd.h>
+#include <unistd.h>
+
+#include "arith.h"
+#include "eval.h"
+#include "exec.h"
+#include "jobs.h"
+#include "launch.h"
+#include "pathglob.h"
+#include "script.h"
+#include "shell.h"
+#include "var.h"
+
+#define XBUF_INLINE 256
+
+int expand_subst_status = -1;
+
+struct param_list expand_params = {NULL, 0};
+const char *expand_arg0 = "kzsh";
+
+static pid_t shell_pid = 0;
+
+/* Growable byte buffer with inline storage; must not be copied. A failed
+ * allocation drops the data and sets oom. */
+struct xbuf {
+    char *s;
+    size_t len, cap;
+    int oom;
+    char inline_buf[XBUF_INLINE];
+};
+
+/* Context flags for expand_text */
+#define CTX_QUOTED 0x01     /* inside "...": no splitting, \ only escapes $`"\ */
+#define CTX_TILDE  0x02     /* ~ is special at the start of the text */
+#define CTX_ASSIGN 0x04     /* ... and after each ':' (assignment values) */
+
+struct expander {
+    struct arena *a;
+    struct xbuf buf;            /* the field being built */
+    struct field_list *fields;  /* NULL: no field splitting */
+    const char *ifs;
+    int ifs_ready;              /* ifs_map has been filled in from ifs */
+    unsigned char ifs_map[256];
+    int in_field;               /* buf holds a field, even an empty one ("") */
+    int split_blank;            /* the last field ended at IFS white space */
+    int pattern;                /* backslash-escape quoted characters for fnmatch */
+    int glob;                   /* fields are pathname patterns (implies pattern) */
+    int glob_meta;              /* an unquoted * ? [ went into the current field */
+    int error;
+};
+
+static void expand_text(struct expander *x, const char *s, const char *end, int ctx);
+
+static void xbuf_init(struct xbuf *b) {
+    b->s = b->inline_buf;
+    b->len = 0;
+    b->cap = sizeof(b->inline_buf);
+    b->oom = 0;
+}
+
+static void xbuf_free(struct xbuf *b) {
+    if (b->s != b->inline_buf) free(b->s);
+}
+
+static int xbuf_reserve(struct xbuf *b, size_t n) {
+    if (b->cap - b->len >= n) return 0;
+    size_t cap = b->cap * 2;
+    while (cap - b->len < n) cap *= 2;
+    char *s = b->s == b->inline_buf ? malloc(cap) : realloc(b->s, cap);
+    if (!s) {
+        b->oom = 1;
+        return -1;
+    }
+    if (b->s == b->inline_buf) memcpy(s, b->s, b->len);
+    b->s = s;
+    b->cap = cap;
+    return 0;
+}
+
+static void xbuf_add(struct xbuf *b, const char *s, size_t n) {
+    if (xbuf_reserve(b, n) != 0) return;
+    memcpy(b->s + b->len, s, n);
+    b->len += n;
+}
+
+static void expander_init(struct expander *x, struct arena *a, struct field_list *fields) {
+    x->a = a;
+    xbuf_init(&x->buf);
+    x->fields = fields;
+    x->ifs = NULL;
+    x->ifs_ready = 0;
+    x->in_field = 0;
+    x->split_blank = 0;
+    x->pattern = 0;
+    x->glob = 0;
+    x->glob_meta = 0;
+    x->error = 0;
+    if (fields) {
+        x->ifs = var_get("IFS");
+        if (!x->ifs) x->ifs = " \t\n";
+    }
+}
+
+/* Whether any of chars occurs in s[0, n) */
+static int strpbrk_n(const char *s, size_t n, const char *chars) {
+    for (size_t i = 0; i < n; ++i) {
+        if (strchr(chars, s[i]) && s[i]) return 1;
+    }
+    return 0;
+}
+
+static int is_name_start(char c) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static int is_name_char(char c) {
+    return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+static void field_push(struct arena *a, struct field_list *l, char *s) {
+    if (l->n + 1 >= l->cap) {
+        int cap = l->cap ? l->cap * 2 : 16;
+        char **v = arena_alloc(a, sizeof(*v) * (size_t)cap);
+        if (l->n) memcpy(v, l->v, sizeof(*v) * (size_t)l->n);
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n++] = s;
+    l->v[l->n] = NULL;
+}
+
+/* Remove the escapes add_quoted put in for a pattern */
+static void unescape(char *s) {
+    char *o = s;
+    for (; *s; ++s) {
+        if (*s == '\\' && s[1]) s++;
+        *o++ = *s;
+    }
+    *o = '\0';
+}
+
+static void emit_field(struct expander *x) {
+    char *s = arena_strndup(x->a, x->buf.s, x->buf.len);
+    int done = 0;
+    if (x->glob) {
+        size_t n;
+        char **m = x->glob_meta ? pathglob(x->a, s, &n) : NULL;
+        for (size_t i = 0; m && i < n; ++i) field_push(x->a, x->fields, m[i]);
+        done = m != NULL;
+        if (!done) unescape(s);
+    }
+    if (!done) field_push(x->a, x->fields, s);
+    x->buf.len = 0;
+    x->in_field = 0;
+    x->glob_meta = 0;
+}
+
+static int has_glob_meta(const char *s, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] == '*' || s[i] == '?' || s[i] == '[') return 1;
+    }
+    return 0;
+}
+
+/* Unquoted text: from the word itself, or (expansion) the result of an
+ * unquoted expansion, whose backslashes are not quoting characters */
+static void add_unquoted(struct expander *x, const char *s, size_t n, int expansion) {
+    if (x->glob) {
+        if (!x->glob_meta) x->glob_meta = has_glob_meta(s, n);
+        if (expansion && memchr(s, '\\', n)) {
+            for (size_t i = 0; i < n; ++i) {
+                if (s[i] == '\\') xbuf_add(&x->buf, "\\", 1);
+                xbuf_add(&x->buf, &s[i], 1);
+            }
+            n = 0;
+        }
+    }
+    xbuf_add(&x->buf, s, n);
+    x->in_field = 1;
+    x->split_blank = 0;
+}
+
+static void add_literal(struct expander *x, const char *s, size_t n) {
+    add_unquoted(x, s, n, 0);
+}
+
+static void add_quoted(struct expander *x, const char *s, size_t n) {
+    if (x->pattern) {
+        for (size_t i = 0; i < n; ++i) {
+            if (strchr("\\*?[]", s[i]) && s[i]) xbuf_add(&x->buf, "\\", 1);
+            xbuf_add(&x->buf, &s[i], 1);
+        }
+    } else {
+        xbuf_add(&x->buf, s, n);
+    }
+    x->in_field = 1;
+    x->split_blank = 0;
+}
+
+/* The result of an expansion: split on IFS unless quoted. IFS white space
+ * runs count as one separator and never make empty fields; each other IFS
+ * character ends a field, even an empty one. */
+static void add_expansion(struct expander *x, const char *s, size_t n, int quoted) {
+    if (quoted) {
+        add_quoted(x, s, n);
+        return;
+    }
+    if (!x->fields) {
+        add_unquoted(x, s, n, 1);
+        return;
+    }
+    if (!x->ifs_ready) {
+        memset(x->ifs_map, 0, sizeof(x->ifs_map));
+        for (const char *p = x->ifs; *p; ++p) x->ifs_map[(unsigned char)*p] = 1;
+        x->ifs_ready = 1;
+    }
+    size_t run = 0;
+    for (size_t i = 0; i < n; ++i) {
+        char c = s[i];
+        if (!x->ifs_map[(unsigned char)c]) continue;
+        if (i > run) add_unquoted(x, s + run, i - run, 1);
+        run = i + 1;
+        if (c == ' ' || c == '\t' || c == '\n') {
+            if (x->in_field) {
+                emit_field(x);
+                x->split_blank = 1;
+            }
+        } else {
+            if (x->in_field || !x->split_blank) emit_field(x);
+            x->split_blank = 0;
+        }
+    }
+    if (n > run) add_unquoted(x, s + run, n - run, 1);
+}
+
+/* Expand [s, end) as a separate string: the word of ${x=word}, ${x%word},
+ * ${x?word} and the text of $((...)). NULL on error. */
+static char *expand_sub(struct expander *x, const char *s, const char *end, int ctx, int pattern) {
+    struct expander sub;
+    expander_init(&sub, x->a, NULL);
+    sub.pattern = pattern;
+    expand_text(&sub, s, end, ctx);
+    char *r = NULL;
+    if (sub.buf.oom) fprintf(stderr, "kzsh: %s\n", strerror(ENOMEM));
+    else if (!sub.error) r = arena_strndup(x->a, sub.buf.s, sub.buf.len);
+    xbuf_free(&sub.buf);
+    if (!r) x->error = 1;
+    return r;
+}
+
+/* ---- tilde ---- */
+
+/* Home directory as the prompt finds it: $HOME, else the passwd entry */
+static const char *home_dir(void) {
+    const char *h = var_get("HOME");
+    if (h && *h) return h;
+    const struct passwd *pw = getpwuid(geteuid());
+    return pw && pw->pw_dir ? pw->pw_dir : NULL;
+}
+
+/* s points at '~'. The prefix runs to the first '/' (or ':' in an
+ * assignment); if any of it is quoted or expanded it is left alone. */
+static const char *expand_tilde(struct expander *x, const char *s, const char *end, int ctx) {
+    const char *p = s + 1;
+    while (p < end && *p != '/' && !((ctx & CTX_ASSIGN) && *p == ':')) {
+        if (strchr("\\'\"$`", *p)) {
+            add_literal(x, s, 1);
+            return s + 1;
+        }
+        p++;
+    }
+    size_t n = (size_t)(p - s - 1);
+    const char *dir = NULL;
+    if (n == 0) {
+        dir = home_dir();
+    } else if (n == 1 && s[1] == '+') {
+        dir = var_get("PWD");
+    } else if (n == 1 && s[1] == '-') {
+        dir = var_get("OLDPWD");
+    } else {
+        const struct passwd *pw = getpwnam(arena_strndup(x->a, s + 1, n));
+        if (pw) dir = pw->pw_dir;
+    }
+    if (dir) add_quoted(x, dir, strlen(dir));
+    else add_literal(x, s, (size_t)(p - s));
+    return p;
+}
+
+/* ---- command substitution ---- */
+
+/* Run text in a subshell and append its output, minus trailing newlines */
+static void command_subst(struct expander *x, const char *text, size_t len, int quoted) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        perror("kzsh: pipe");
+        x->error = 1;
+        return;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("kzsh: fork");
+        close(fds[0]);
+        close(fds[1]);
+        x->error = 1;
+        return;
+    }
+    if (pid == 0) {
+        launch_reset_signals();
+        jobs_forked();
+        close(fds[0]);
+        if (fds[1] != STDOUT_FILENO) {
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[1]);
+        } else {
+            fcntl(STDOUT_FILENO, F_SETFD, 0);
+        }
+        int status = script_run_text("kzsh", text, len, 1);
+        fflush(stdout);
+        _exit(status & 0xff);
+    }
+    close(fds[1]);
+
+    /* Quoted output needs no splitting: read it straight into the field */
+    struct xbuf tmp;
+    struct xbuf *b = quoted ? &x->buf : &tmp;
+    if (!quoted) xbuf_init(&tmp);
+    size_t start = b->len;
+    for (;;) {
+        if (xbuf_reserve(b, 4096) != 0) break;
+        ssize_t r = read(fds[0], b->s + b->len, b->cap - b->len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        b->len += (size_t)r;
+    }
+    close(fds[0]);
+    int status = exec_wait(pid);
+    eval_last_status = status;
+    expand_subst_status = status;
+
+    while (b->len > start && b->s[b->len - 1] == '\n') b->len--;
+    if (quoted) {
+        x->in_field = 1;
+        x->split_blank = 0;
+        /* a pattern needs the output's special characters escaped after all */
+        if (x->pattern && strpbrk_n(b->s + start, b->len - start, "\\*?[]")) {
+            xbuf_init(&tmp);
+            xbuf_add(&tmp, b->s + start, b->len - start);
+            b->len = start;
+            add_quoted(x, tmp.s, tmp.len);
+            if (tmp.oom) x->buf.oom = 1;
+            xbuf_free(&tmp);
+        }
+    } else {
+        add_expansion(x, tmp.s, tmp.len, quoted);
+        if (tmp.oom) x->buf.oom = 1;
+        xbuf_free(&tmp);
+    }
+}
+
+/* s points at the opening backquote. Inside, a backslash only quotes
+ * $ ` \ (and " within double quotes); the rest is the command text. */
+static const char *expand_backquote(struct expander *x, const char *s, const char *end, int ctx) {
+    const char *e = lexer_skip(s, end);
+    if (!e) e = end + 1;
+    const char *body = s + 1, *body_end = e - 1;
+    char *text = arena_alloc(x->a, (size_t)(body_end - body) + 1);
+    size_t n = 0;
+    for (const char *p = body; p < body_end; ++p) {
+        if (*p == '\\' && p + 1 < body_end &&
+            (p[1] == '$' || p[1] == '`' || p[1] == '\\' || ((ctx & CTX_QUOTED) && p[1] == '"'))) {
+            p++;
+        }
+        text[n++] = *p;
+    }
+    text[n] = '\0';
+    command_subst(x, text, n, ctx & CTX_QUOTED);
+    return e > end ? end : e;
+}
+
+/* ---- parameters ---- */
+
+static const char *join_params(struct expander *x, char sep);
+
+/* Value of the parameter named by [name, name + len); NULL when unset.
+ * Special parameters are formatted into tmp. */
+static const char *param_value(struct expander *x, const char *name, size_t len, char *tmp, size_t tmplen) {
+    if (is_name_start(name[0])) return var_get(arena_strndup(x->a, name, len));
+    if (name[0] >= '1' && name[0] <= '9') {
+        long i = 0;
+        for (size_t k = 0; k < len && i <= expand_params.n; ++k) i = i * 10 + (name[k] - '0');
+        return i <= expand_params.n ? expand_params.v[i - 1] : NULL;
+    }
+    switch (name[0]) {
+        case '?':
+            snprintf(tmp, tmplen, "%d", eval_last_status);
+            return tmp;
+        case '$':
+            snprintf(tmp, tmplen, "%ld", (long)shell_pid);
+            return tmp;
+        case '#':
+            snprintf(tmp, tmplen, "%d", expand_params.n);
+            return tmp;
+        case '0':
+            return expand_arg0;
+        case '@':
+        case '*':
+            return join_params(x, ' ');
+        case '-':
+            return "";
+        case '!':
+            if (!jobs_last_bg) return NULL;
+            snprintf(tmp, tmplen, "%ld", (long)jobs_last_bg);
+            return tmp;
+        default:
+            return NULL;
+    }
+}
+
+/* $@ or $* as one string, for ${@:-word} and friends */
+static const char *join_params(struct expander *x, char sep) {
+    size_t len = 0;
+    for (int i = 0; i < expand_params.n; ++i) len += strlen(expand_params.v[i]) + 1;
+    char *s = arena_alloc(x->a, len + 1);
+    size_t o = 0;
+    for (int i = 0; i < expand_params.n; ++i) {
+        size_t n = strlen(expand_params.v[i]);
+        if (i > 0 && sep) s[o++] = sep;
+        memcpy(s + o, expand_params.v[i], n);
+        o += n;
+    }
+    s[o] = '\0';
+    return s;
+}
+
+/* $@ and $*: one field per parameter where fields are split ("$@", or
+ * either one unquoted), otherwise joined: $* by the first character of
+ * IFS, $@ by a space. "$@" keeps empty parameters as empty fields.
+ * ${name[@]} and ${name[*]} do the same with an array's elements. */
+static void add_list(struct expander *x, char which, int quoted, char *const *list, int n) {
+    int separate = x->fields && (which == '@' || !quoted);
+    const char *ifs = var_get("IFS");
+    char sep = which == '@' || !ifs ? ' ' : ifs[0];
+    for (int i = 0; i < n; ++i) {
+        if (i > 0) {
+            if (separate && quoted) emit_field(x);
+            else if (separate && x->in_field) emit_field(x);
+            else if (!separate && sep) add_expansion(x, &sep, 1, quoted);
+        }
+        const char *v = list[i];
+        if (quoted) x->in_field = 1;
+        add_expansion(x, v, strlen(v), quoted);
+    }
+}
+
+static void add_params(struct expander *x, char which, int quoted) {
+    add_list(x, which, quoted, expand_params.v, expand_params.n);
+}
+
+/* Length of a parameter name at s: a variable name, a run of digits for
+ * ${10}, or one special character */
+static size_t param_name_len(const char *s, const char *end, int braced) {
+    if (s >= end) return 0;
+    const char *p = s;
+    if (is_name_start(*p)) {
+        while (p < end && is_name_char(*p)) p++;
+    } else if (*p >= '0' && *p <= '9') {
+        p++;
+        if (braced) {
+            while (p < end && *p >= '0' && *p <= '9') p++;
+        }
+    } else if (strchr("?$#!@*-", *p)) {
+        p++;
+    }
+    return (size_t)(p - s);
+}
+
+/* Characters in a UTF-8 string: every byte that does not continue one */
+static size_t utf8_length(const char *s) {
+    size_t n = 0;
+    for (; *s; ++s) {
+        if (((unsigned char)*s & 0xc0) != 0x80) n++;
+    }
+    return n;
+}
+
+/* Remove the shortest or longest prefix (op '#') or suffix (op '%') of v
+ * that matches pat; the rest is v[*off, *off + *len) */
+static void trim(struct expander *x, const char *v, const char *pat, char op, int longest,
+                 size_t *off, size_t *len) {
+    size_t n = strlen(v);
+    *off = 0;
+    *len = n;
+    if (op == '#') {
+        char *tmp = arena_strndup(x->a, v, n);
+        for (size_t k = 0; k <= n; ++k) {
+            size_t i = longest ? n - k : k;
+            char c = tmp[i];
+            tmp[i] = '\0';
+            int m = fnmatch(pat, tmp, 0) == 0;
+            tmp[i] = c;
+            if (m) {
+                *off = i;
+                *len = n - i;
+                return;
+            }
+        }
+    } else {
+        for (size_t k = 0; k <= n; ++k) {
+            size_t i = longest ? k : n - k;
+            if (fnmatch(pat, v + i, 0) == 0) {
+                *len = i;
+                return;
+            }
+        }
+    }
+}
+
+static void bad_substitution(struct expander *x, const char *s, const char *end) {
+    fprintf(stderr, "kzsh: ${%.*s}: bad substitution\n", (int)(end - s), s);
+    x->error = 1;
+}
+
+/* The elements of array v (a scalar is one element) in the arena */
+static char **array_elems(struct expander *x, const struct var *v, int *n) {
+    *n = !v || !v->set ? 0 : (v->flags & VAR_ARRAY) ? v->nelems : 1;
+    char **list = arena_alloc(x->a, sizeof(*list) * (size_t)(*n + 1));
+    const char *e = *n ? VAR_VALUE(v) : NULL;
+    for (int i = 0; i < *n; ++i, e += strlen(e) + 1) list[i] = (char *)e;
+    return list;
+}
+
+/* name[subscript] at s, where s[len] is '['. Returns the end of the
+ * subscript (after ']'), or NULL if there is none. *which is '@' or '*'
+ * for those subscripts; otherwise *value is the element, NULL if unset.
+ * A negative index counts back from the end. */
+static const char *subscript(struct expander *x, const char *s, size_t len, const char *end,
+                             char *which, const char **value) {
+    const char *open = s + len, *close = open + 1;
+    int depth = 0;
+    for (; close < end; ++close) {
+        if (*close == '[') depth++;
+        else if (*close == ']' && depth-- == 0) break;
+    }
+    if (close >= end) return NULL;
+    const struct var *v = var_lookup(arena_strndup(x->a, s, len));
+    *which = 0;
+    *value = NULL;
+    if (close - open == 2 && (open[1] == '@' || open[1] == '*')) {
+        *which = open[1];
+        return close + 1;
+    }
+    char *expr = expand_sub(x, open + 1, close, 0, 0);
+    long long i;
+    if (!expr) return close + 1;
+    if (arith_eval(expr, &i) != 0) {
+        x->error = 1;
+        return close + 1;
+    }
+    int n;
+    array_elems(x, v, &n);
+    if (i < 0) i += n;
+    if (i >= 0 && i < n) *value = var_elem(v, (int)i);
+    return close + 1;
+}
+
+/* ${...}: [s, end) is the text between the braces */
+static void expand_braced(struct expander *x, const char *s, const char *end, int ctx) {
+    int quoted = ctx & CTX_QUOTED;
+    char tmp[32];
+    /* ${#name}: length; ${#} alone is $# */
+    if (s + 1 < end && *s == '#') {
+        size_t n = param_name_len(s + 1, end, 1);
+        if (n > 0 && is_name_start(s[1]) && s + 1 + n < end && s[1 + n] == '[') {
+            /* ${#name[@]}: element count; ${#name[i]}: element length */
+            char which;
+            const char *v;
+            const char *e = subscript(x, s + 1, n, end, &which, &v);
+            if (e != end) {
+                if (!x->error) bad_substitution(x, s, end);
+                return;
+            }
+            int count = 0;
+            if (which) array_elems(x, var_lookup(arena_strndup(x->a, s + 1, n)), &count);
+            char num[32];
+            int len = which ? snprintf(num, sizeof(num), "%d", count)
+                            : snprintf(num, sizeof(num), "%zu", v ? utf8_length(v) : 0);
+            add_expansion(x, num, (size_t)len, quoted);
+            return;
+        }
+        if (n == 0 || s + 1 + n != end) {
+            bad_substitution(x, s, end);
+            return;
+        }
+        const char *v = param_value(x, s + 1, n, tmp, sizeof(tmp));
+        char num[32];
+        int len = s[1] == '@' || s[1] == '*'
+                      ? snprintf(num, sizeof(num), "%d", expand_params.n)
+                      : snprintf(num, sizeof(num), "%zu", v ? utf8_length(v) : 0);
+        add_expansion(x, num, (size_t)len, quoted);
+        return;
+    }
+
+    size_t n = param_name_len(s, end, 1);
+    if (n == 0) {
+        bad_substitution(x, s, end);
+        return;
+    }
+    const char *name = s;
+    const char *op = s + n;
+    if (op == end && (*name == '@' || *name == '*')) {
+        add_params(x, *name, quoted);
+        return;
+    }
+    const char *v;
+    if (is_name_start(*name) && op < end && *op == '[') {
+        char which;
+        op = subscript(x, name, n, end, &which, &v);
+        if (!op) {
+            bad_substitution(x, s, end);
+            return;
+        }
+        if (x->error) return;
+        if (which) {
+            int count;
+            char **list = array_elems(x, var_lookup(arena_strndup(x->a, name, n)), &count);
+            if (op == end) {
+                add_list(x, which, quoted, list, count);
+                return;
+            }
+            /* with an operator the elements act as one word, joined */
+            v = NULL;
+            if (count > 0) {
+                size_t total = 0;
+                for (int i = 0; i < count; ++i) total += strlen(list[i]) + 1;
+                char *joined = arena_alloc(x->a, total);
+                char *p = joined;
+                for (int i = 0; i < count; ++i) {
+                    size_t k = strlen(list[i]);
+                    memcpy(p, list[i], k);
+                    p += k;
+                    *p++ = ' ';
+                }
+                p[-1] = '\0';
+                v = joined;
+            }
+        }
+    } else {
+        v = param_value(x, name, n, tmp, sizeof(tmp));
+    }
+    if (op == end) {
+        if (v) add_expansion(x, v, strlen(v), quoted);
+        return;
+    }
+
+    int colon = *op == ':';
+    if (colon) op++;
+    if (op == end) {
+        bad_substitution(x, s, end);
+        return;
+    }
+    char c = *op++;
+    int longest = 0;
+    if ((c == '#' || c == '%') && !colon && op < end && *op == c) {
+        longest = 1;
+        op++;
+    }
+    int null = !v || (colon && !*v);
+    /* the word keeps the quoting context of the whole expansion */
+    int wctx = quoted | CTX_TILDE;
+
+    switch (c) {
+        case '-':
+            if (null) expand_text(x, op, end, wctx);
+            else add_expansion(x, v, strlen(v), quoted);
+            return;
+        case '+':
+            if (!null) expand_text(x, op, end, wctx);
+            return;
+        case '=': {
+            if (!null) {
+                add_expansion(x, v, strlen(v), quoted);
+                return;
+            }
+            char *w = expand_sub(x, op, end, wctx, 0);
+            if (!w) return;
+            if (!is_name_start(*name)) {
+                fprintf(stderr, "kzsh: $%.*s: cannot assign in this way\n", (int)n, name);
+                x->error = 1;
+                return;
+            }
+            if (var_set(arena_strndup(x->a, name, n), w, 0) != 0) {
+                x->error = 1;
+                return;
+            }
+            add_expansion(x, w, strlen(w), quoted);
+            return;
+        }
+        case '?': {
+            if (!null) {
+                add_expansion(x, v, strlen(v), quoted);
+                return;
+            }
+            const char *msg = op < end ? expand_sub(x, op, end, wctx, 0) : NULL;
+            if (op < end && !msg) return;
+            if (!msg) msg = colon ? "parameter null or not set" : "parameter not set";
+            fprintf(stderr, "kzsh: %.*s: %s\n", (int)n, name, msg);
+            /* fatal in a script, as POSIX requires; interactively only
+             * the command fails */
+            if (!shell_interactive) exit(1);
+            x->error = 1;
+            return;
+        }
+        case '#':
+        case '%': {
+            if (colon) break;
+            char *pat = expand_sub(x, op, end, wctx, 1);
+            if (!pat) return;
+            if (!v) return;
+            size_t off, len;
+            trim(x, v, pat, c, longest, &off, &len);
+            add_expansion(x, v + off, len, quoted);
+            return;
+        }
+        default:
+            break;
+    }
+    bad_substitution(x, s, end);
+}
+
+/* s points at '$'; returns the end of the expansion */
+static const char *expand_dollar(struct expander *x, const char *s, const char *end, int ctx) {
+    int quoted = ctx & CTX_QUOTED;
+    const char *p = s + 1;
+    if (p < end && (*p == '(' || *p == '{')) {
+        const char *e = lexer_skip(s, end);
+        if (!e) e = end + 1;    /* the lexer accepted the word, so never */
+        if (*p == '{') {
+            expand_braced(x, p + 1, e - 1, ctx);
+        } else if (p + 1 < e && p[1] == '(' && e - s >= 5 && e[-2] == ')') {
+            /* $((expr)) */
+            char *expr = expand_sub(x, p + 2, e - 2, 0, 0);
+            long long r;
+            if (!expr) return e;
+            if (arith_eval(expr, &r) != 0) {
+                x->error = 1;
+                return e;
+            }
+            char num[32];
+            int len = snprintf(num, sizeof(num), "%lld", r);
+            add_expansion(x, num, (size_t)len, quoted);
+        } else {
+            command_subst(x, p + 1, (size_t)(e - 1 - (p + 1)), quoted);
+        }
+        return e > end ? end : e;
+    }
+
+    size_t n = param_name_len(p, end, 0);
+    if (n == 0) {
+        /* a lone $ is literal */
+        if (quoted) add_quoted(x, s, 1);
+        else add_literal(x, s, 1);
+        return p;
+    }
+    if (*p == '@' || *p == '*') {
+        add_params(x, *p, quoted);
+        return p + n;
+    }
+    char tmp[32];
+    const char *v = param_value(x, p, n, tmp, sizeof(tmp));
+    if (v) add_expansion(x, v, strlen(v), quoted);
+    return p + n;
+}
+
+/* ---- the word ---- */
+
+/* Expand [s, end). Unquoted text handles quotes, backslashes and tilde
+ * itself; the inside of "..." is expanded with CTX_QUOTED. */
+static void expand_text(struct expander *x, const char *s, const char *end, int ctx) {
+    const char *start = s;
+    while (s < end && !x->error) {
+        char c = *s;
+        if (c == '$') {
+            s = expand_dollar(x, s, end, ctx);
+        } else if (c == '`') {
+            s = expand_backquote(x, s, end, ctx);
+        } else if (ctx & CTX_QUOTED) {
+            if (c == '\\' && s + 1 < end && strchr("$`\"\\\n", s[1])) {
+                if (s[1] != '\n') add_quoted(x, s + 1, 1);
+                s += 2;
+            } else {
+                const char *run = s++;
+                while (s < end && *s != '$' && *s != '`' && *s != '\\') s++;
+                add_quoted(x, run, (size_t)(s - run));
+            }
+        } else if (c == '\\') {
+            if (s + 1 < end) {
+                if (s[1] != '\n') add_quoted(x, s + 1, 1);
+                s += 2;
+            } else {
+                add_literal(x, s++, 1);
+            }
+        } else if (c == '\'') {
+            const char *q = memchr(s + 1, '\'', (size_t)(end - s - 1));
+            if (!q) q = end;
+            add_quoted(x, s + 1, (size_t)(q - s - 1));
+            s = q < end ? q + 1 : end;
+        } else if (c == '"') {
+            const char *q = lexer_skip(s, end);
+            if (!q) q = end + 1;
+            /* "$@" with no parameters makes no field at all */
+            if (expand_params.n > 0 || q - s != 4 || memcmp(s, "\"$@\"", 4) != 0) x->in_field = 1;
+            expand_text(x, s + 1, q - 1, CTX_QUOTED);
+            s = q > end ? end : q;
+        } else if (c == '~' && (((ctx & CTX_TILDE) && s == start) ||
+                                ((ctx & CTX_ASSIGN) && s > start && s[-1] == ':'))) {
+            s = expand_tilde(x, s, end, ctx);
+        } else {
+            const char *run = s++;
+            while (s < end && !strchr("$`\\'\"~", *s)) s++;
+            add_literal(x, run, (size_t)(s - run));
+        }
+    }
+}
+
+static int expander_finish(struct expander *x) {
+    int status = 0;
+    if (x->buf.oom) {
+        fprintf(stderr, "kzsh: %s\n", strerror(ENOMEM));
+        status = -1;
+    } else if (x->error) {
+        status = -1;
+    }
+    return status;
+}
+
+/* ---- public interface ---- */
+
+void expand_init(void) {
+    shell_pid = getpid();
+}
+
+int expand_word(struct arena *a, const struct word *w, struct field_list *out) {
+    if (!(w->flags & (WORD_DOLLAR | WORD_TILDE | WORD_GLOB))) {
+        field_push(a, out, word_unquote(a, w));
+        return 0;
+    }
+    struct expander x;
+    expander_init(&x, a, out);
+    /* an unquoted expansion can bring in glob characters as well */
+    x.glob = x.pattern = (w->flags & (WORD_DOLLAR | WORD_GLOB)) != 0;
+    expand_text(&x, w->text, w->text + w->len, CTX_TILDE);
+    int status = expander_finish(&x);
+    if (status == 0 && x.in_field) emit_field(&x);
+    xbuf_free(&x.buf);
+    return status;
+}
+
+char *expand_pattern(struct arena *a, const struct word *w) {
+    if (!(w->flags & (WORD_QUOTED | WORD_DOLLAR | WORD_TILDE))) return arena_strndup(a, w->text, w->len);
+    struct expander x;
+    expander_init(&x, a, NULL);
+    x.pattern = 1;
+    expand_text(&x, w->text, w->text + w->len, CTX_TILDE);
+    char *r = expander_finish(&x) == 0 ? arena_strndup(a, x.buf.s, x.buf.len) : NULL;
+    xbuf_free(&x.buf);
+    return r;
+}
+
+char *expand_string(struct arena *a, const struct word *w, int assign) {
+    const char *s = w->text, *end = w->text + w->len;
+    if (!(w->flags & (WORD_DOLLAR | WORD_TILDE)) && !(assign && memchr(s, '~', w->len))) {
+        return word_unquote(a, w);
+    }
+    struct expander x;
+    expander_init(&x, a, NULL);
+    if (assign) {
+        /* the name is plain text; the value starts a new tilde context */
+        const char *eq = memchr(s, '=', w->len);
+        if (eq) {
+            add_literal(&x, s, (size_t)(eq - s + 1));
+            expand_text(&x, eq + 1, end, CTX_TILDE | CTX_ASSIGN);
+        }
+    } else {
+        expand_text(&x, s, end, CTX_TILDE);
+    }
+    char *r = expander_finish(&x) == 0 ? arena_strndup(a, x.buf.s, x.buf.len) : NULL;
+    xbuf_free(&x.buf);
+    return r;
+}
@@ -1,29 +1,432 @@
+/*
+ * Command history.
+ *
+ * Entries live in a ring of HISTSIZE slots; their text is packed into one
+ * circular byte arena, so adding a line is a memcpy plus O(1) index work
+ * and never a malloc. When the arena or the ring is full the oldest
+ * entries are dropped.
+ *
+ * Interactive shells persist history to $HISTFILE (~/.kzsh_history by
+ * default): every entry is appended to the file as it is added, fsync()
+ * runs once per HISTORY_SYNC_EVERY entries and at exit, and the file is
+ * mmap'd when loaded so large histories start quickly.
+ *
+ * For incremental search (Ctrl-R) entries are grouped into blocks of
+ * HISTORY_BLOCK consecutive entries, each with a bloom filter over the
+ * bytes and trigrams of its lines. The filters are stored bit-sliced:
+ * row r holds bit r of every block's filter, so a query ANDs the rows
+ * of its own n-grams (a few KiB of sequential memory even for 1M
+ * entries) and then only runs memmem() over the blocks that survive.
+ * Filters are updated as entries are added.
+ */
+
+#define _GNU_SOURCE
 #include "../include/history.h"
+#include "../include/out.h"
+#include "../include/var.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HISTORY_DEFAULT_SIZE 1000
+#define HISTORY_SYNC_EVERY 32
+/* arena bytes reserved per slot; lines longer than that just evict more */
+#define HISTORY_BYTES_PER_ENTRY 128
+#define HISTORY_MIN_ARENA (64 * 1024)
+
+struct hist_entry {
+    uint32_t off;
+    uint32_t len;
+};
 
-#define HISTORY_MAX 100
-static char *history[HISTORY_MAX];
+static struct hist_entry *ring;
+static int ring_cap = -1;       /* HISTSIZE; -1 until first use */
+static int ring_head;           /* slot of the oldest entry */
 static int history_count = 0;
+static long history_base;       /* number of entries ever dropped */
+
+static char *arena;
+static size_t arena_size;
+static size_t arena_pos;        /* where the next entry is written */
+
+static int hist_fd = -1;
+static int unsynced;
+
+#define HISTORY_BLOCK 64
+#define HISTORY_BLOOM_BITS 16384   /* 14-bit indexes, see bloom_bits() */
+
+/* sig[r * sig_words + j / 64] bit j % 64 is bit r of block slot j's
+ * filter. A block slot is (entry id / HISTORY_BLOCK) % nblocks, where an
+ * entry's id is history_base + its index and never changes while it is
+ * stored. */
+static uint64_t *sig;
+static int sig_words;
+static int nblocks;
+
+static int size_from_env(void) {
+    const char *s = var_get("HISTSIZE");
+    if (!s || !*s) return HISTORY_DEFAULT_SIZE;
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (*end || v < 0) return HISTORY_DEFAULT_SIZE;
+    if (v > 10000000) v = 10000000;
+    return (int)v;
+}
+
+static struct hist_entry *slot(int index) {
+    return &ring[(ring_head + index) % ring_cap];
+}
+
+static void drop_oldest(void) {
+    ring_head = (ring_head + 1) % ring_cap;
+    history_count--;
+    history_base++;
+}
+
+static uint32_t gram_hash(uint32_t gram) {
+    return gram * 2654435761u;
+}
+
+static uint32_t trigram(const char *s) {
+    return (uint32_t)(unsigned char)s[0] | (uint32_t)(unsigned char)s[1] << 8 |
+           (uint32_t)(unsigned char)s[2] << 16;
+}
+
+/* Each key sets two bits taken from different parts of its hash, so one
+ * unlucky collision with a common trigram does not pass every block. */
+static void bloom_bits(uint32_t h, unsigned *b1, unsigned *b2) {
+    *b1 = h >> 18;
+    *b2 = (h >> 4) & (HISTORY_BLOOM_BITS - 1);
+}
+
+static int block_slot(long id) {
+    return (int)((id / HISTORY_BLOCK) % nblocks);
+}
+
+static void index_key(int j, uint32_t h) {
+    unsigned b1, b2;
+    bloom_bits(h, &b1, &b2);
+    sig[(size_t)b1 * sig_words + j / 64] |= 1ull << (j % 64);
+    sig[(size_t)b2 * sig_words + j / 64] |= 1ull << (j % 64);
+}
+
+/* Bloom keys of a line: one per byte (tagged to keep them apart from
+ * trigrams) and one per trigram. */
+static void index_entry(long id, const char *s, size_t len) {
+    if (!sig) return;
+    int j = block_slot(id);
+    if (id % HISTORY_BLOCK == 0) {
+        /* first entry of a block: the slot's old bits belong to dropped ids */
+        uint64_t keep = ~(1ull << (j % 64));
+        for (size_t r = 0; r < HISTORY_BLOOM_BITS; ++r) sig[r * sig_words + j / 64] &= keep;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        index_key(j, gram_hash(0x1000000u | (unsigned char)s[i]));
+        if (i + 2 < len) index_key(j, gram_hash(trigram(s + i)));
+    }
+}
+
+/* Rebuild ring and arena with the given capacities, keeping the newest
+ * entries that fit. Used at startup, on HISTSIZE changes and when a line
+ * is too long for the current arena. */
+static int rebuild(int cap, size_t bytes) {
+    int keep = history_count < cap ? history_count : cap;
+    size_t need = 0;
+    int first = history_count - keep;
+    for (int i = first; i < history_count; ++i) need += slot(i)->len + 1;
+    while (need > bytes && keep > 0) {
+        need -= slot(first)->len + 1;
+        first++;
+        keep--;
+    }
+
+    struct hist_entry *nring = cap ? malloc(sizeof(*nring) * (size_t)cap) : NULL;
+    char *narena = bytes ? malloc(bytes) : NULL;
+    if ((cap && !nring) || (bytes && !narena)) {
+        free(nring);
+        free(narena);
+        return -1;
+    }
+    size_t pos = 0;
+    for (int i = 0; i < keep; ++i) {
+        struct hist_entry *e = slot(first + i);
+        memcpy(narena + pos, arena + e->off, e->len + 1);
+        nring[i].off = (uint32_t)pos;
+        nring[i].len = e->len;
+        pos += e->len + 1;
+    }
+    history_base += history_count - keep;
+    free(ring);
+    free(arena);
+    ring = nring;
+    ring_cap = cap;
+    ring_head = 0;
+    history_count = keep;
+    arena = narena;
+    arena_size = bytes;
+    arena_pos = pos;
+
+    /* live ids span at most cap entries, so they touch at most
+     * cap / HISTORY_BLOCK + 1 blocks; one spare keeps the block being
+     * filled from aliasing the oldest live one */
+    free(sig);
+    nblocks = cap / HISTORY_BLOCK + 2;
+    sig_words = (nblocks + 63) / 64;
+    sig = calloc((size_t)HISTORY_BLOOM_BITS * (size_t)sig_words, sizeof(*sig));
+    for (int i = 0; i < history_count && sig; ++i) {
+        long id = history_base + i;
+        index_entry(id, arena + ring[i].off, ring[i].len);
+    }
+    return 0;
+}
+
+static size_t arena_bytes_for(int cap) {
+    size_t bytes = (size_t)cap * HISTORY_BYTES_PER_ENTRY;
+    return bytes < HISTORY_MIN_ARENA ? HISTORY_MIN_ARENA : bytes;
+}
+
+static void ensure_init(void) {
+    if (ring_cap < 0) rebuild(size_from_env(), arena_bytes_for(size_from_env()));
+}
+
+/* Store one entry in memory only */
+static void history_store(const char *line, size_t len) {
+    if (ring_cap <= 0 || len > UINT32_MAX - 1) return;
+    size_t need = len + 1;
+    if (need > arena_size / 2) {
+        size_t bytes = arena_size;
+        while (need > bytes / 2) bytes *= 2;
+        if (rebuild(ring_cap, bytes) != 0) return;
+    }
+    if (history_count == ring_cap) drop_oldest();
+
+    size_t pos = arena_pos;
+    if (pos + need > arena_size) {
+        /* wrap: everything still stored past pos is older than what sits
+         * at the front of the arena, so it goes first */
+        while (history_count > 0 && slot(0)->off >= pos) drop_oldest();
+        pos = 0;
+    }
+    /* drop the oldest entries the new text would overwrite */
+    while (history_count > 0) {
+        struct hist_entry *old = slot(0);
+        if (old->off >= pos + need || old->off + old->len + 1 <= pos) break;
+        drop_oldest();
+    }
+
+    memcpy(arena + pos, line, len);
+    arena[pos + len] = '\0';
+    struct hist_entry *e = &ring[(ring_head + history_count) % ring_cap];
+    e->off = (uint32_t)pos;
+    e->len = (uint32_t)len;
+    history_count++;
+    arena_pos = pos + need;
+    index_entry(history_base + history_count - 1, line, len);
+}
 
 void history_add(const char *line) {
-    if (history_count < HISTORY_MAX) {
-        history[history_count++] = strdup(line);
-    } else {
-        /* simple rolling: free oldest, shift left, append at end */
-        free(history[0]);
-        for (int i = 1; i < HISTORY_MAX; ++i) history[i-1] = history[i];
-        history[HISTORY_MAX-1] = strdup(line);
+    ensure_init();
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) len--;
+    if (len == 0) return;
+    history_store(line, len);
+
+    /* the file is line-oriented; multi-line input is not persisted */
+    if (hist_fd >= 0 && ring_cap > 0 && !memchr(line, '\n', len)) {
+        /* one O_APPEND write per entry keeps concurrent shells from
+         * interleaving partial lines */
+        char stackbuf[1024];
+        char *buf = len + 1 <= sizeof(stackbuf) ? stackbuf : malloc(len + 1);
+        if (buf) {
+            memcpy(buf, line, len);
+            buf[len] = '\n';
+            ssize_t w;
+            do {
+                w = write(hist_fd, buf, len + 1);
+            } while (w < 0 && errno == EINTR);
+            if (buf != stackbuf) free(buf);
+        }
+        if (++unsynced >= HISTORY_SYNC_EVERY) {
+            fdatasync(hist_fd);
+            unsynced = 0;
+        }
     }
 }
 
-void history_show(void) {
+void history_show(struct out *o) {
     for (int i = 0; i < history_count; ++i) {
-        printf("%d: %s\n", i + 1, history[i]);
+        out_num(o, (unsigned long long)(history_base + i + 1), 0, ' ');
+        out_write(o, ": ", 2);
+        out_str(o, history_get(i));
+        out_putc(o, '\n');
     }
 }
 
+void history_set_size(int size) {
+    ensure_init();
+    if (size < 0) size = size_from_env();
+    if (size == ring_cap) return;
+    size_t bytes = arena_bytes_for(size);
+    /* never shrink the arena below what long lines already forced */
+    if (size > ring_cap && bytes < arena_size) bytes = arena_size;
+    rebuild(size, bytes);
+}
+
+int history_search(const char *query, int from) {
+    if (from >= history_count) from = history_count - 1;
+    if (from < 0) return -1;
+    size_t qlen = strlen(query);
+    if (qlen == 0) return from;
+
+    /* blocks whose filter has every n-gram of the query */
+    uint64_t stackcand[64];
+    uint64_t *cand = NULL;
+    if (sig) {
+        cand = sig_words <= 64 ? stackcand : malloc(sizeof(uint64_t) * (size_t)sig_words);
+        if (!cand) return -1;
+        for (int w = 0; w < sig_words; ++w) cand[w] = ~0ull;
+        for (size_t i = 0; i < qlen; ++i) {
+            uint32_t keys[2];
+            int nk = 0;
+            keys[nk++] = gram_hash(0x1000000u | (unsigned char)query[i]);
+            if (i + 2 < qlen) keys[nk++] = gram_hash(trigram(query + i));
+            for (int k = 0; k < nk; ++k) {
+                unsigned b1, b2;
+                bloom_bits(keys[k], &b1, &b2);
+                const uint64_t *r1 = sig + (size_t)b1 * sig_words, *r2 = sig + (size_t)b2 * sig_words;
+                for (int w = 0; w < sig_words; ++w) cand[w] &= r1[w] & r2[w];
+            }
+        }
+    }
+
+    int found = -1;
+    for (int i = from; i >= 0 && found < 0;) {
+        long id = history_base + i;
+        /* first index of this block that is still stored */
+        int lo = (int)(id - id % HISTORY_BLOCK - history_base);
+        if (lo < 0) lo = 0;
+        int j = block_slot(id);
+        if (!cand || ((cand[j / 64] >> (j % 64)) & 1)) {
+            for (; i >= lo; --i) {
+                const struct hist_entry *e = slot(i);
+                if (memmem(arena + e->off, e->len, query, qlen)) {
+                    found = i;
+                    break;
+                }
+            }
+        }
+        i = lo - 1;
+    }
+    if (cand != stackcand) free(cand);
+    return found;
+}
+
+/* Default $HISTFILE: ~/.kzsh_history */
+static char *default_histfile(void) {
+    const char *home = var_get("HOME");
+    if (!home || !*home) return NULL;
+    size_t n = strlen(home) + sizeof("/.kzsh_history");
+    char *path = malloc(n);
+    if (path) snprintf(path, n, "%s/.kzsh_history", home);
+    return path;
+}
+
+/* Rewrite the file with just the entries in memory (temp file + rename,
+ * so a crash never leaves it truncated). */
+static void compact_file(const char *path) {
+    size_t n = strlen(path) + 8;
+    char *tmp = malloc(n);
+    if (!tmp) return;
+    snprintf(tmp, n, "%s.XXXXXX", path);
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return;
+    }
+    FILE *f = fdopen(fd, "w");
+    if (!f) {
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        return;
+    }
+    for (int i = 0; i < history_count; ++i) {
+        const struct hist_entry *e = slot(i);
+        fwrite(arena + e->off, 1, e->len, f);
+        fputc('\n', f);
+    }
+    int ok = fflush(f) == 0 && fdatasync(fd) == 0;
+    fchmod(fd, 0600);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) unlink(tmp);
+    free(tmp);
+}
+
+static void history_close(void) {
+    if (hist_fd < 0) return;
+    if (unsynced) fdatasync(hist_fd);
+    close(hist_fd);
+    hist_fd = -1;
+    unsynced = 0;
+}
+
+int history_open(void) {
+    ensure_init();
+    if (hist_fd >= 0) return 0;
+    const char *env = var_get("HISTFILE");
+    char *path = env && *env ? strdup(env) : default_histfile();
+    if (!path) return -1;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    int compact = 0;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            const char *data = map;
+            size_t size = (size_t)st.st_size;
+            /* walk back from the end to the first of the last HISTSIZE lines */
+            size_t scan = size, begin = ring_cap > 0 ? 0 : size;
+            if (scan > 0 && data[scan - 1] == '\n') scan--;
+            for (int want = ring_cap; want > 0 && scan > 0; --want) {
+                const char *nl = memrchr(data, '\n', scan);
+                if (!nl) {
+                    begin = 0;
+                    break;
+                }
+                scan = (size_t)(nl - data);
+                begin = scan + 1;
+            }
+            const char *p = data + begin, *end = data + size;
+            while (p < end) {
+                const char *nl = memchr(p, '\n', (size_t)(end - p));
+                const char *le = nl ? nl : end;
+                if (le > p) history_store(p, (size_t)(le - p));
+                p = nl ? nl + 1 : end;
+            }
+            /* Keep the file from growing without bound: rewrite it once
+             * most of it is lines that no longer fit in HISTSIZE */
+            compact = begin > size / 2;
+            munmap(map, size);
+        }
+    }
+    if (fd >= 0) close(fd);
+
+    if (compact) compact_file(path);
+
+    hist_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    free(path);
+    if (hist_fd < 0) return -1;
+    atexit(history_close);
+    return 0;
+}
+
 /* Accessor implementations */
 int history_count_get(void) {
     return history_count;
@@ -31,5 +434,5 @@ int history_count_get(void) {
 
 const char *history_get(int index) {
     if (index < 0 || index >= history_count) return NULL;
-    return history[index];
+    return arena + slot(index)->off;
 }
@@ -0,0 +1,190 @@
+/*
+ * Zero-copy descriptor plumbing for data-moving builtins.
+ */
+
+#define _GNU_SOURCE
+#include "iocopy.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+
+#define IO_CHUNK (1 << 20)
+#define IO_BUFSZ (128 * 1024)
+
+enum io_method { IO_COPY_RANGE, IO_SPLICE, IO_SENDFILE, IO_READWRITE };
+
+int io_write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+int io_writev_all(int fd, struct iovec *iov, int n) {
+    while (n > 0) {
+        ssize_t w = writev(fd, iov, n > IOV_MAX ? IOV_MAX : n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= (ssize_t)iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= (size_t)w;
+        }
+    }
+    return 0;
+}
+
+/* Errors that mean "this mechanism does not apply to these fds" */
+static int unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP ||
+           err == EBADF || err == ESPIPE;
+}
+
+static enum io_method pick_method(int in, int out) {
+    struct stat si, so;
+    if (fstat(in, &si) != 0 || fstat(out, &so) != 0) return IO_READWRITE;
+    if (S_ISREG(si.st_mode) && S_ISREG(so.st_mode)) return IO_COPY_RANGE;
+    if (S_ISFIFO(si.st_mode) || S_ISFIFO(so.st_mode)) return IO_SPLICE;
+    if (S_ISREG(si.st_mode)) return IO_SENDFILE;
+    return IO_READWRITE;
+}
+
+static ssize_t copy_once(enum io_method m, int in, int out, size_t want, char **buf) {
+    switch (m) {
+        case IO_COPY_RANGE:
+            return copy_file_range(in, NULL, out, NULL, want, 0);
+        case IO_SPLICE:
+            return splice(in, NULL, out, NULL, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+        case IO_SENDFILE:
+            return sendfile(out, in, NULL, want);
+        case IO_READWRITE:
+        default: {
+            if (!*buf && !(*buf = malloc(IO_BUFSZ))) return -1;
+            if (want > IO_BUFSZ) want = IO_BUFSZ;
+            ssize_t r = read(in, *buf, want);
+            if (r > 0 && io_write_all(out, *buf, (size_t)r) != 0) return -1;
+            return r;
+        }
+    }
+}
+
+off_t io_copy(int in, int out, off_t limit) {
+    enum io_method m = pick_method(in, out);
+    char *buf = NULL;
+    off_t total = 0;
+    while (limit < 0 || total < limit) {
+        size_t want = IO_CHUNK;
+        if (limit >= 0 && (off_t)want > limit - total) want = (size_t)(limit - total);
+        ssize_t n = copy_once(m, in, out, want, &buf);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (m != IO_READWRITE && unsupported(errno)) {
+                /* splice/sendfile refuse some fd kinds (ttys, O_APPEND, ...) */
+                m = (m == IO_COPY_RANGE) ? IO_SENDFILE : IO_READWRITE;
+                continue;
+            }
+            free(buf);
+            return -1;
+        }
+        if (n == 0) break;
+        total += n;
+    }
+    free(buf);
+    return total;
+}
+
+static int is_fifo(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+/* Move exactly len bytes from in to out through buf */
+static int read_exact(int in, int out, size_t len, char *buf) {
+    while (len > 0) {
+        ssize_t r = read(in, buf, len > IO_BUFSZ ? IO_BUFSZ : len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        if (io_write_all(out, buf, (size_t)r) != 0) return -1;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+off_t io_tee(int in, const int *outs, int nout) {
+    if (nout <= 0) return 0;
+    if (nout == 1) return io_copy(in, outs[0], -1);
+
+    off_t total = 0;
+    char *buf = malloc(IO_BUFSZ);
+    if (!buf) return -1;
+    /* pipe -> pipe + anything: duplicate with tee(2), then consume with splice */
+    if (nout == 2 && is_fifo(in) && is_fifo(outs[0])) {
+        for (;;) {
+            ssize_t n = tee(in, outs[0], IO_CHUNK, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (total == 0 && unsupported(errno)) break;
+                free(buf);
+                return -1;
+            }
+            if (n == 0) {
+                free(buf);
+                return total;
+            }
+            ssize_t left = n;
+            while (left > 0) {
+                ssize_t s = splice(in, NULL, outs[1], NULL, (size_t)left, SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (s < 0 && errno == EINTR) continue;
+                if (s > 0) {
+                    left -= s;
+                    continue;
+                }
+                /* outs[1] refuses splice (O_APPEND, a tty, ...): outs[0]
+                 * already has this chunk, so hand the rest of it to outs[1]
+                 * alone and carry on with read/write */
+                if (s < 0 && unsupported(errno) && read_exact(in, outs[1], (size_t)left, buf) == 0) break;
+                free(buf);
+                return -1;
+            }
+            total += n;
+            if (left > 0) break;
+        }
+    }
+
+    for (;;) {
+        ssize_t r = read(in, buf, IO_BUFSZ);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            free(buf);
+            return -1;
+        }
+        if (r == 0) break;
+        for (int i = 0; i < nout; ++i) {
+            if (io_write_all(outs[i], buf, (size_t)r) != 0) {
+                free(buf);
+                return -1;
+            }
+        }
+        total += r;
+    }
+    free(buf);
+    return total;
+}
@@ -0,0 +1,1072 @@
+/*
+ * Job control.
+ *
+ * Jobs live in a table indexed by job number. A pid -> process hash (open
+ * addressing, FNV-1a, backward-shift deletion) maps what waitpid returns
+ * back to its job, so reaping costs O(children that changed state) no
+ * matter how many jobs there are. The SIGCHLD handler only writes a byte
+ * to a self-pipe; jobs_reap drains it and calls waitpid(-1, WNOHANG)
+ * until nothing is left, and returns after one read when the pipe is
+ * empty. Jobs whose state changed are queued, so the prompt reports them
+ * without walking the table.
+ *
+ * Under job control each pipeline is its own process group, and the
+ * foreground one owns the terminal until it finishes or stops.
+ */
+
+#define _GNU_SOURCE
+#include "jobs.h"
+#include "builtins.h"
+#include "exec.h"
+#include "shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+int jobs_control = 0;
+pid_t jobs_last_bg = 0;
+
+enum proc_state { PROC_RUNNING, PROC_STOPPED, PROC_DONE };
+enum job_state { JOB_RUNNING, JOB_STOPPED, JOB_DONE };
+
+struct proc {
+    pid_t pid;
+    enum proc_state state;
+    int status;                 /* wait status once stopped or done */
+};
+
+struct job {
+    int id;                     /* 0 until the job enters the table */
+    pid_t pgid;                 /* -1 without job control */
+    char *text;
+    int nrunning, nstopped;     /* processes by state; the rest are done */
+    struct job *qprev, *qnext;  /* changed-state queue */
+    int queued;
+    int foreign;                /* inherited from the parent shell: listed only */
+    int have_tmodes;
+    struct termios tmodes;      /* terminal modes it stopped with */
+    int nprocs;
+    struct proc procs[];
+};
+
+/* Terminal */
+static int tty_fd = -1;
+static pid_t shell_pgid = 0;
+static pid_t tty_owner = 0;
+static struct termios shell_tmodes;
+
+/* Job table, indexed by job number */
+static struct job **table = NULL;
+static int table_cap = 0;
+static int max_id = 0;
+static int cur_id = 0, prev_id = 0;     /* %+ and %- */
+static int njobs_running = 0;
+static int njobs_stopped = 0;
+static int exit_warned = 0;
+
+/* Jobs to report at the next prompt, oldest first */
+static struct job *queue_head = NULL, *queue_tail = NULL;
+
+/* pid -> (job, process index) for the live processes of table jobs */
+struct pid_slot {
+    pid_t pid;                  /* 0 marks an empty slot */
+    int index;
+    struct job *job;
+};
+
+static struct pid_slot *pids = NULL;
+static size_t pids_cap = 0;     /* always a power of two */
+static size_t pids_used = 0;
+
+/* Children the reaper collected without knowing them: foreground ones
+ * waited for right after, and the odd helper nobody asks about again
+ * (hence a small ring rather than a table) */
+#define ORPHAN_MAX 64
+static struct { pid_t pid; int status; } orphans[ORPHAN_MAX];
+static int orphan_count = 0;
+static int orphan_next = 0;
+
+static int chld_pipe[2] = { -1, -1 };
+
+/* ---- pid hash ---- */
+
+static uint32_t hash_pid(pid_t pid) {
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    uint32_t v = (uint32_t)pid;
+    for (int i = 0; i < 4; ++i) {
+        h ^= (v >> (8 * i)) & 0xff;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct pid_slot *pid_slot(pid_t pid) {
+    size_t mask = pids_cap - 1;
+    for (size_t i = hash_pid(pid) & mask;; i = (i + 1) & mask) {
+        if (pids[i].pid == pid || pids[i].pid == 0) return &pids[i];
+    }
+}
+
+static struct pid_slot *pid_find(pid_t pid) {
+    if (!pids_used) return NULL;
+    struct pid_slot *s = pid_slot(pid);
+    return s->pid ? s : NULL;
+}
+
+static int pid_insert(pid_t pid, struct job *j, int index) {
+    if ((pids_used + 1) * 2 > pids_cap) {
+        size_t ncap = pids_cap ? pids_cap * 2 : 64;
+        struct pid_slot *old = pids;
+        size_t ocap = pids_cap;
+        pids = calloc(ncap, sizeof(*pids));
+        if (!pids) {
+            pids = old;
+            return -1;
+        }
+        pids_cap = ncap;
+        for (size_t i = 0; i < ocap; ++i) {
+            if (old[i].pid) *pid_slot(old[i].pid) = old[i];
+        }
+        free(old);
+    }
+    struct pid_slot *s = pid_slot(pid);
+    if (!s->pid) pids_used++;
+    s->pid = pid;
+    s->job = j;
+    s->index = index;
+    return 0;
+}
+
+static void pid_remove(pid_t pid) {
+    struct pid_slot *s = pid_find(pid);
+    if (!s) return;
+    pids_used--;
+
+    /* backward-shift: pull later members of the probe run into the hole */
+    size_t mask = pids_cap - 1;
+    size_t hole = (size_t)(s - pids);
+    for (size_t i = (hole + 1) & mask; pids[i].pid; i = (i + 1) & mask) {
+        size_t home = hash_pid(pids[i].pid) & mask;
+        /* move it unless its home lies cyclically in (hole, i] */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            pids[hole] = pids[i];
+            hole = i;
+        }
+    }
+    pids[hole].pid = 0;
+}
+
+/* ---- orphans ---- */
+
+static void orphan_add(pid_t pid, int status) {
+    if (orphans[orphan_next].pid == 0) orphan_count++;
+    orphans[orphan_next].pid = pid;
+    orphans[orphan_next].status = status;
+    orphan_next = (orphan_next + 1) % ORPHAN_MAX;
+}
+
+int jobs_take_status(pid_t pid, int *status) {
+    if (!orphan_count) return 0;
+    for (int i = 0; i < ORPHAN_MAX; ++i) {
+        if (orphans[i].pid == pid) {
+            *status = orphans[i].status;
+            orphans[i].pid = 0;
+            orphan_count--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* ---- jobs ---- */
+
+static enum job_state job_state(const struct job *j) {
+    if (j->nrunning) return JOB_RUNNING;
+    return j->nstopped ? JOB_STOPPED : JOB_DONE;
+}
+
+static void count_job(const struct job *j, int delta) {
+    if (j->foreign) return;
+    switch (job_state(j)) {
+        case JOB_RUNNING: njobs_running += delta; break;
+        case JOB_STOPPED: njobs_stopped += delta; break;
+        case JOB_DONE: break;
+    }
+}
+
+static void unqueue(struct job *j) {
+    if (!j->queued) return;
+    if (j->qprev) j->qprev->qnext = j->qnext;
+    else queue_head = j->qnext;
+    if (j->qnext) j->qnext->qprev = j->qprev;
+    else queue_tail = j->qprev;
+    j->queued = 0;
+}
+
+static void enqueue(struct job *j) {
+    if (j->queued || !jobs_control) return;
+    j->qprev = queue_tail;
+    j->qnext = NULL;
+    if (queue_tail) queue_tail->qnext = j;
+    else queue_head = j;
+    queue_tail = j;
+    j->queued = 1;
+}
+
+/* Move process i of j to state, keeping the counts in step. A table job
+ * that changes state is queued for the next prompt. */
+static void set_proc(struct job *j, int i, enum proc_state state, int status) {
+    struct proc *p = &j->procs[i];
+    enum job_state before = job_state(j);
+    if (j->id) count_job(j, -1);
+    if (p->state == PROC_RUNNING) j->nrunning--;
+    else if (p->state == PROC_STOPPED) j->nstopped--;
+    p->state = state;
+    p->status = status;
+    if (state == PROC_RUNNING) j->nrunning++;
+    else if (state == PROC_STOPPED) j->nstopped++;
+    if (!j->id) return;
+    count_job(j, 1);
+    if (state == PROC_DONE) pid_remove(p->pid);
+    if (job_state(j) != before) enqueue(j);
+}
+
+static void apply_status(struct job *j, int i, int ws) {
+    if (WIFSTOPPED(ws)) set_proc(j, i, PROC_STOPPED, ws);
+    else if (WIFCONTINUED(ws)) set_proc(j, i, PROC_RUNNING, 0);
+    else set_proc(j, i, PROC_DONE, ws);
+}
+
+static struct job *job_new(pid_t pgid, const pid_t *pv, int n) {
+    int m = 0;
+    for (int i = 0; i < n; ++i) m += pv[i] > 0;
+    if (!m) return NULL;
+    struct job *j = calloc(1, sizeof(*j) + sizeof(struct proc) * (size_t)m);
+    if (!j) return NULL;
+    j->pgid = pgid;
+    for (int i = 0; i < n; ++i) {
+        if (pv[i] > 0) j->procs[j->nprocs++].pid = pv[i];
+    }
+    j->nrunning = m;
+    return j;
+}
+
+/* ---- describing jobs ---- */
+
+static void put_words(FILE *f, const struct word *w, const char *sep) {
+    for (; w; w = w->next) fprintf(f, "%.*s%s", (int)w->len, w->text, w->next ? sep : "");
+}
+
+static void put_redirs(FILE *f, const struct redir *r) {
+    static const char *const ops[] = {
+        [REDIR_IN] = "<", [REDIR_OUT] = ">", [REDIR_APPEND] = ">>",
+        [REDIR_CLOBBER] = ">|", [REDIR_RDWR] = "<>", [REDIR_DUPIN] = "<&",
+        [REDIR_DUPOUT] = ">&", [REDIR_HEREDOC] = "<<", [REDIR_HERESTR] = "<<<"
+    };
+    for (; r; r = r->next) {
+        fputc(' ', f);
+        if (r->fd >= 0) fprintf(f, "%d", r->fd);
+        fputs(r->type == REDIR_HEREDOC && r->strip_tabs ? "<<-" : ops[r->type], f);
+        if (r->target) fprintf(f, "%.*s", (int)r->target->len, r->target->text);
+    }
+}
+
+static void put_node(FILE *f, const struct node *n);
+
+/* A list as the body of a compound command: "list; " */
+static void put_body(FILE *f, const struct node *n) {
+    put_node(f, n);
+    if (n && n->type != NODE_BACKGROUND) fputc(';', f);
+    fputc(' ', f);
+}
+
+/* Roughly the command as typed: the AST keeps the words' source text */
+static void put_node(FILE *f, const struct node *n) {
+    if (!n) return;
+    switch (n->type) {
+        case NODE_CMD:
+            put_words(f, n->u.cmd.assigns, " ");
+            if (n->u.cmd.assigns && n->u.cmd.words) fputc(' ', f);
+            put_words(f, n->u.cmd.words, " ");
+            put_redirs(f, n->u.cmd.redirs);
+            return;
+        case NODE_PIPELINE:
+            if (n->u.pipe.bang) fputs("! ", f);
+            for (int i = 0; i < n->u.pipe.ncmds; ++i) {
+                if (i) fputs(" | ", f);
+                put_node(f, n->u.pipe.cmds[i]);
+            }
+            return;
+        case NODE_AND:
+        case NODE_OR:
+            put_node(f, n->u.bin.left);
+            fputs(n->type == NODE_AND ? " && " : " || ", f);
+            put_node(f, n->u.bin.right);
+            return;
+        case NODE_SEQ:
+            put_node(f, n->u.bin.left);
+            fputs(n->u.bin.left && n->u.bin.left->type == NODE_BACKGROUND ? " " : "; ", f);
+            put_node(f, n->u.bin.right);
+            return;
+        case NODE_BACKGROUND:
+            put_node(f, n->u.bin.left);
+            fputs(" &", f);
+            return;
+        case NODE_IF:
+            fputs("if ", f);
+            for (;;) {
+                put_body(f, n->u.ctl.cond);
+                fputs("then ", f);
+                put_body(f, n->u.ctl.body);
+                const struct node *e = n->u.ctl.else_part;
+                if (e && e->type == NODE_IF && !e->redirs) {
+                    fputs("elif ", f);
+                    n = e;
+                    continue;
+                }
+                if (e) {
+                    fputs("else ", f);
+                    put_body(f, e);
+                }
+                break;
+            }
+            fputs("fi", f);
+            break;
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            fputs(n->type == NODE_WHILE ? "while " : "until ", f);
+            put_body(f, n->u.ctl.cond);
+            fputs("do ", f);
+            put_body(f, n->u.ctl.body);
+            fputs("done", f);
+            break;
+        case NODE_FOR:
+            fputs("for ", f);
+            put_words(f, n->u.loop.var, " ");
+            if (n->u.loop.has_in) {
+                fputs(" in", f);
+                if (n->u.loop.words) fputc(' ', f);
+                put_words(f, n->u.loop.words, " ");
+            }
+            fputs("; do ", f);
+            put_body(f, n->u.loop.body);
+            fputs("done", f);
+            break;
+        case NODE_CASE:
+            fputs("case ", f);
+            put_words(f, n->u.cas.subject, " ");
+            fputs(" in ", f);
+            for (const struct case_item *it = n->u.cas.items; it; it = it->next) {
+                put_words(f, it->patterns, " | ");
+                fputs(") ", f);
+                if (it->body) put_node(f, it->body);
+                fputs(";; ", f);
+            }
+            fputs("esac", f);
+            break;
+        case NODE_GROUP:
+            fputs("{ ", f);
+            put_body(f, n->u.group.body);
+            fputc('}', f);
+            break;
+        case NODE_SUBSHELL:
+            fputc('(', f);
+            put_node(f, n->u.group.body);
+            fputc(')', f);
+            break;
+        case NODE_FUNCDEF:
+            put_words(f, n->u.func.name, " ");
+            fputs("() ", f);
+            put_node(f, n->u.func.body);
+            return;
+    }
+    put_redirs(f, n->redirs);
+}
+
+static char *describe(const struct node *n) {
+    char *text = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&text, &len);
+    if (!f) return strdup("");
+    put_node(f, n);
+    fclose(f);
+    return text;
+}
+
+/* "Running", "Done", "Exit 2", "Terminated", ... */
+static void state_text(const struct job *j, char *buf, size_t size) {
+    switch (job_state(j)) {
+        case JOB_RUNNING:
+            snprintf(buf, size, "Running");
+            return;
+        case JOB_STOPPED: {
+            int sig = SIGTSTP;
+            for (int i = 0; i < j->nprocs; ++i) {
+                if (j->procs[i].state == PROC_STOPPED) sig = WSTOPSIG(j->procs[i].status);
+            }
+            snprintf(buf, size, "Stopped%s", sig == SIGTTIN ? " (tty input)" :
+                                             sig == SIGTTOU ? " (tty output)" : "");
+            return;
+        }
+        case JOB_DONE:
+            break;
+    }
+    int ws = j->procs[j->nprocs - 1].status;
+    if (WIFSIGNALED(ws)) {
+        snprintf(buf, size, "%s%s", strsignal(WTERMSIG(ws)), WCOREDUMP(ws) ? " (core dumped)" : "");
+    } else if (WEXITSTATUS(ws)) {
+        snprintf(buf, size, "Exit %d", WEXITSTATUS(ws));
+    } else {
+        snprintf(buf, size, "Done");
+    }
+}
+
+static void print_job(FILE *f, const struct job *j, int with_pid) {
+    char state[64];
+    state_text(j, state, sizeof(state));
+    char mark = j->id == cur_id ? '+' : j->id == prev_id ? '-' : ' ';
+    if (with_pid) fprintf(f, "[%d]%c %ld ", j->id, mark, (long)j->procs[0].pid);
+    else fprintf(f, "[%d]%c  ", j->id, mark);
+    fprintf(f, "%-24s%s%s\n", state, j->text, job_state(j) == JOB_RUNNING ? " &" : "");
+}
+
+/* ---- the table ---- */
+
+/* Newest job other than except, for %+ and %- after a removal */
+static int newest_job(int except) {
+    for (int id = max_id; id > 0; --id) {
+        if (table[id] && id != except) return id;
+    }
+    return 0;
+}
+
+static void make_current(int id) {
+    if (cur_id == id) return;
+    prev_id = cur_id;
+    cur_id = id;
+}
+
+static void sigchld_handler(int signo) {
+    (void)signo;
+    int saved = errno;
+    /* a full pipe means a wakeup is already pending */
+    if (write(chld_pipe[1], "", 1) < 0) {}
+    errno = saved;
+}
+
+static int high_fd(int fd) {
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    if (moved < 0) return fd;
+    close(fd);
+    return moved;
+}
+
+static void reaper_init(void) {
+    if (chld_pipe[0] >= 0) return;
+    if (pipe2(chld_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        perror("kzsh: pipe");
+        chld_pipe[0] = chld_pipe[1] = -1;
+        return;
+    }
+    /* keep the low descriptors free for the user */
+    chld_pipe[0] = high_fd(chld_pipe[0]);
+    chld_pipe[1] = high_fd(chld_pipe[1]);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &sa, NULL);
+}
+
+static int job_insert(struct job *j, const struct node *src) {
+    if (max_id + 1 >= table_cap) {
+        int cap = table_cap ? table_cap * 2 : 16;
+        struct job **grown = realloc(table, sizeof(*table) * (size_t)cap);
+        if (!grown) return -1;
+        memset(grown + table_cap, 0, sizeof(*table) * (size_t)(cap - table_cap));
+        table = grown;
+        table_cap = cap;
+    }
+    reaper_init();
+    j->text = describe(src);
+    j->id = ++max_id;
+    table[j->id] = j;
+    count_job(j, 1);
+    for (int i = 0; i < j->nprocs; ++i) {
+        if (j->procs[i].state != PROC_DONE) pid_insert(j->procs[i].pid, j, i);
+    }
+    /* whatever changed before the handler was in place */
+    for (int i = 0; i < j->nprocs; ++i) {
+        int ws;
+        if (j->procs[i].state != PROC_DONE &&
+            waitpid(j->procs[i].pid, &ws, WNOHANG | WUNTRACED | WCONTINUED) > 0) {
+            apply_status(j, i, ws);
+        }
+    }
+    return 0;
+}
+
+static void job_remove(struct job *j) {
+    for (int i = 0; i < j->nprocs; ++i) {
+        if (j->procs[i].state != PROC_DONE) pid_remove(j->procs[i].pid);
+    }
+    unqueue(j);
+    count_job(j, -1);
+    table[j->id] = NULL;
+    while (max_id > 0 && !table[max_id]) max_id--;
+    if (cur_id == j->id) {
+        cur_id = prev_id ? prev_id : newest_job(0);
+        prev_id = newest_job(cur_id);
+    } else if (prev_id == j->id) {
+        prev_id = newest_job(cur_id);
+    }
+    free(j->text);
+    free(j);
+}
+
+void jobs_reap(void) {
+    char buf[64];
+    if (chld_pipe[0] < 0 || read(chld_pipe[0], buf, sizeof(buf)) <= 0) return;
+    while (read(chld_pipe[0], buf, sizeof(buf)) > 0) {}
+    int ws;
+    pid_t pid;
+    while ((pid = waitpid(-1, &ws, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+        struct pid_slot *s = pid_find(pid);
+        if (s) apply_status(s->job, s->index, ws);
+        else if (WIFEXITED(ws) || WIFSIGNALED(ws)) orphan_add(pid, ws);
+    }
+}
+
+void jobs_notify(void) {
+    jobs_reap();
+    if (exit_warned) exit_warned--;
+    while (queue_head) {
+        struct job *j = queue_head;
+        unqueue(j);
+        if (job_state(j) == JOB_RUNNING) continue;
+        print_job(stderr, j, 0);
+        if (job_state(j) == JOB_DONE) job_remove(j);
+    }
+}
+
+int jobs_exit_check(void) {
+    if (!jobs_control || !njobs_stopped || exit_warned) return 0;
+    fprintf(stderr, "There are stopped jobs.\n");
+    exit_warned = 2;
+    return 1;
+}
+
+/* ---- terminal and foreground ---- */
+
+void jobs_init_interactive(void) {
+    if (!isatty(STDIN_FILENO)) return;
+    int fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    if (fd < 0) return;
+    /* started in the background: wait until we are put in the foreground */
+    pid_t fg;
+    while ((fg = tcgetpgrp(fd)) >= 0 && fg != getpgrp()) kill(-getpgrp(), SIGTTIN);
+    if (fg < 0) {
+        close(fd);
+        return;
+    }
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+    /* fails harmlessly for a session leader, which leads its group already */
+    setpgid(0, 0);
+    shell_pgid = getpgrp();
+    if (tcsetpgrp(fd, shell_pgid) != 0) {
+        close(fd);
+        return;
+    }
+    tcgetattr(fd, &shell_tmodes);
+    tty_fd = fd;
+    tty_owner = shell_pgid;
+    jobs_control = 1;
+    reaper_init();
+}
+
+void jobs_forked(void) {
+    jobs_control = 0;
+    if (tty_fd >= 0) close(tty_fd);
+    tty_fd = -1;
+    if (chld_pipe[0] >= 0) {
+        close(chld_pipe[0]);
+        close(chld_pipe[1]);
+        chld_pipe[0] = chld_pipe[1] = -1;
+    }
+    /* `jobs | ...` still lists the parent's jobs, but they are not ours
+     * to wait for */
+    for (int id = 1; id <= max_id; ++id) {
+        if (table[id]) table[id]->foreign = 1;
+    }
+    njobs_running = njobs_stopped = 0;
+    queue_head = queue_tail = NULL;
+    memset(orphans, 0, sizeof(orphans));
+    orphan_count = 0;
+}
+
+void jobs_give_terminal(pid_t pgid) {
+    if (!jobs_control || pgid <= 0 || pgid == tty_owner) return;
+    if (tcsetpgrp(tty_fd, pgid) == 0) tty_owner = pgid;
+}
+
+pid_t jobs_foreground(void) {
+    return jobs_control && tty_owner != shell_pgid ? tty_owner : -1;
+}
+
+/* Wait until no process of j is running */
+static void wait_fg(struct job *j) {
+    int resumed = 0;
+    for (int i = 0; i < j->nprocs; ++i) {
+        struct proc *p = &j->procs[i];
+        while (p->state == PROC_RUNNING) {
+            int ws;
+            if (!jobs_take_status(p->pid, &ws) && waitpid(p->pid, &ws, WUNTRACED) < 0) {
+                if (errno == EINTR) continue;
+                /* collected behind our back, status unknown */
+                set_proc(j, i, PROC_DONE, 0);
+                break;
+            }
+            if (WIFSTOPPED(ws) && (WSTOPSIG(ws) == SIGTTIN || WSTOPSIG(ws) == SIGTTOU) &&
+                !resumed && j->pgid > 0) {
+                /* it went for the terminal before it was handed over */
+                resumed = 1;
+                kill(-j->pgid, SIGCONT);
+                continue;
+            }
+            apply_status(j, i, ws);
+        }
+    }
+}
+
+/* Take the terminal back after j ran in the foreground. A stopped j
+ * keeps its terminal modes and enters the table. Returns 1 if stopped. */
+static int finish_fg(struct job *j, const struct node *src) {
+    jobs_give_terminal(shell_pgid);
+    if (job_state(j) == JOB_STOPPED) {
+        j->have_tmodes = tcgetattr(tty_fd, &j->tmodes) == 0;
+        tcsetattr(tty_fd, TCSADRAIN, &shell_tmodes);
+        if (!j->id && job_insert(j, src) != 0) {
+            /* no room to keep it: let it go on rather than lose it */
+            kill(-j->pgid, SIGCONT);
+            return 0;
+        }
+        make_current(j->id);
+        unqueue(j);
+        fputc('\n', stderr);
+        print_job(stderr, j, 0);
+        return 1;
+    }
+    int ws = j->procs[j->nprocs - 1].status;
+    if (WIFSIGNALED(ws)) {
+        tcsetattr(tty_fd, TCSADRAIN, &shell_tmodes);
+        int sig = WTERMSIG(ws);
+        if (sig == SIGINT) {
+            /* the shell did not see the Ctrl-C itself; loops still have to stop */
+            got_sigint = 1;
+            fputc('\n', stderr);
+        } else if (sig != SIGPIPE) {
+            fprintf(stderr, "%s%s\n", strsignal(sig), WCOREDUMP(ws) ? " (core dumped)" : "");
+        }
+    } else {
+        tcgetattr(tty_fd, &shell_tmodes);
+    }
+    return 0;
+}
+
+static int proc_status(const struct proc *p) {
+    return p->state == PROC_STOPPED ? 128 + WSTOPSIG(p->status) : exec_status(p->status);
+}
+
+int jobs_wait_fg(pid_t pgid, const pid_t *pv, int *statuses, int n, const struct node *src) {
+    struct job *j = jobs_control && pgid > 0 ? job_new(pgid, pv, n) : NULL;
+    if (!j) {
+        for (int i = 0; i < n; ++i) {
+            if (pv[i] > 0) statuses[i] = exec_wait(pv[i]);
+        }
+        return statuses[n - 1];
+    }
+    jobs_give_terminal(pgid);
+    wait_fg(j);
+    int stopped = finish_fg(j, src);
+    for (int i = 0, k = 0; i < n; ++i) {
+        if (pv[i] > 0) statuses[i] = proc_status(&j->procs[k++]);
+    }
+    if (!stopped && !j->id) free(j);
+    return statuses[n - 1];
+}
+
+void jobs_add_bg(pid_t pgid, const pid_t *pv, int n, const struct node *src) {
+    struct job *j = job_new(pgid, pv, n);
+    if (!j) return;
+    if (job_insert(j, src) != 0) {
+        free(j);
+        return;
+    }
+    make_current(j->id);
+    jobs_last_bg = j->procs[j->nprocs - 1].pid;
+    if (jobs_control) fprintf(stderr, "[%d] %ld\n", j->id, (long)jobs_last_bg);
+}
+
+/* ---- builtins ---- */
+
+/* %n, %%, %+, %-, %prefix, %?text, or a pid of one of the jobs */
+static struct job *find_job(const char *who, const char *spec) {
+    struct job *j = NULL;
+    if (!spec || strcmp(spec, "%") == 0 || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+        j = cur_id ? table[cur_id] : NULL;
+    } else if (strcmp(spec, "%-") == 0) {
+        j = prev_id ? table[prev_id] : NULL;
+    } else if (spec[0] == '%' && isdigit((unsigned char)spec[1])) {
+        char *end;
+        long id = strtol(spec + 1, &end, 10);
+        if (!*end && id > 0 && id <= max_id) j = table[id];
+    } else if (spec[0] == '%') {
+        int sub = spec[1] == '?';
+        const char *text = spec + 1 + sub;
+        for (int id = 1; id <= max_id; ++id) {
+            struct job *c = table[id];
+            if (!c || !(sub ? strstr(c->text, text) != NULL
+                            : strncmp(c->text, text, strlen(text)) == 0)) {
+                continue;
+            }
+            if (j) {
+                fprintf(stderr, "%s: %s: ambiguous job spec\n", who, spec);
+                return NULL;
+            }
+            j = c;
+        }
+    } else {
+        char *end;
+        long pid = strtol(spec, &end, 10);
+        struct pid_slot *s = !*end && pid > 0 ? pid_find((pid_t)pid) : NULL;
+        if (s) j = s->job;
+    }
+    if (!j) fprintf(stderr, "%s: %s: no such job\n", who, spec ? spec : "current");
+    return j;
+}
+
+static void continue_job(struct job *j) {
+    if (j->pgid > 0) {
+        kill(-j->pgid, SIGCONT);
+    } else {
+        for (int i = 0; i < j->nprocs; ++i) {
+            if (j->procs[i].state == PROC_STOPPED) kill(j->procs[i].pid, SIGCONT);
+        }
+    }
+    for (int i = 0; i < j->nprocs; ++i) {
+        if (j->procs[i].state == PROC_STOPPED) set_proc(j, i, PROC_RUNNING, 0);
+    }
+    unqueue(j);
+}
+
+static void report_job(struct job *j, int mode) {
+    if (mode == 'p') printf("%ld\n", (long)(j->pgid > 0 ? j->pgid : j->procs[0].pid));
+    else print_job(stdout, j, mode == 'l');
+    /* reported now, so the prompt has nothing left to say about it */
+    unqueue(j);
+    if (job_state(j) == JOB_DONE) job_remove(j);
+}
+
+int builtin_jobs(int argc, char **argv) {
+    int mode = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *o = argv[i] + 1; *o; ++o) {
+            if (*o != 'l' && *o != 'p') {
+                fprintf(stderr, "jobs: -%c: invalid option\n", *o);
+                fprintf(stderr, "usage: jobs [-lp] [jobspec ...]\n");
+                return 2;
+            }
+            mode = *o;
+        }
+    }
+    jobs_reap();
+    int status = 0;
+    if (i < argc) {
+        for (; i < argc; ++i) {
+            struct job *j = find_job("jobs", argv[i]);
+            if (j) report_job(j, mode);
+            else status = 1;
+        }
+    } else {
+        for (int id = 1; id <= max_id; ++id) {
+            if (table[id]) report_job(table[id], mode);
+        }
+    }
+    return status;
+}
+
+int builtin_fg(int argc, char **argv) {
+    if (!jobs_control) {
+        fprintf(stderr, "fg: no job control\n");
+        return 1;
+    }
+    jobs_reap();
+    struct job *j = find_job("fg", argc > 1 ? argv[1] : NULL);
+    if (!j) return 1;
+    if (job_state(j) == JOB_DONE) {
+        fprintf(stderr, "fg: job has terminated\n");
+        job_remove(j);
+        return 1;
+    }
+    printf("%s\n", j->text);
+    fflush(stdout);
+    jobs_give_terminal(j->pgid);
+    if (j->have_tmodes) tcsetattr(tty_fd, TCSADRAIN, &j->tmodes);
+    continue_job(j);
+    wait_fg(j);
+    int stopped = finish_fg(j, NULL);
+    int status = proc_status(&j->procs[j->nprocs - 1]);
+    if (!stopped) job_remove(j);
+    return status;
+}
+
+int builtin_bg(int argc, char **argv) {
+    if (!jobs_control) {
+        fprintf(stderr, "bg: no job control\n");
+        return 1;
+    }
+    jobs_reap();
+    int status = 0;
+    int i = 1;
+    do {
+        struct job *j = find_job("bg", i < argc ? argv[i] : NULL);
+        if (!j) {
+            status = 1;
+        } else if (job_state(j) == JOB_DONE) {
+            fprintf(stderr, "bg: job has terminated\n");
+            status = 1;
+        } else if (job_state(j) == JOB_RUNNING) {
+            fprintf(stderr, "bg: job %d already in background\n", j->id);
+        } else {
+            continue_job(j);
+            printf("[%d]%c %s &\n", j->id, j->id == cur_id ? '+' : j->id == prev_id ? '-' : ' ', j->text);
+        }
+    } while (++i < argc);
+    return status;
+}
+
+/* The job and index of process pid, finished ones included */
+static int find_proc(pid_t pid, struct job **jp, int *index) {
+    struct pid_slot *s = pid_find(pid);
+    if (s) {
+        *jp = s->job;
+        *index = s->index;
+        return 1;
+    }
+    /* done already, so out of the hash: look among the unreported jobs */
+    for (int id = 1; id <= max_id; ++id) {
+        for (int k = 0; table[id] && k < table[id]->nprocs; ++k) {
+            if (table[id]->procs[k].pid == pid) {
+                *jp = table[id];
+                *index = k;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Sleep until the next SIGCHLD. Returns -1 on Ctrl-C. */
+static int wait_for_child(void) {
+    struct pollfd pfd = { .fd = chld_pipe[0], .events = POLLIN };
+    while (poll(&pfd, 1, -1) < 0) {
+        if (errno != EINTR || got_sigint) return -1;
+    }
+    return 0;
+}
+
+int builtin_wait(int argc, char **argv) {
+    if (argc < 2) {
+        for (;;) {
+            jobs_reap();
+            if (!njobs_running) break;
+            if (wait_for_child() != 0) return 130;
+        }
+        for (int id = max_id; id > 0; --id) {
+            if (table[id] && job_state(table[id]) == JOB_DONE) job_remove(table[id]);
+        }
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; i < argc; ++i) {
+        jobs_reap();
+        struct job *j;
+        int index = -1;
+        if (argv[i][0] == '%') {
+            if (!(j = find_job("wait", argv[i]))) {
+                status = 127;
+                continue;
+            }
+        } else {
+            char *end;
+            long pid = strtol(argv[i], &end, 10);
+            if (*end || pid <= 0) {
+                fprintf(stderr, "wait: `%s': not a pid or valid job spec\n", argv[i]);
+                status = 2;
+                continue;
+            }
+            if (!find_proc((pid_t)pid, &j, &index)) {
+                int ws;
+                if (jobs_take_status((pid_t)pid, &ws)) {
+                    status = exec_status(ws);
+                } else {
+                    fprintf(stderr, "wait: pid %ld is not a child of this shell\n", pid);
+                    status = 127;
+                }
+                continue;
+            }
+        }
+        if (j->foreign) {
+            fprintf(stderr, "wait: %s: not a child of this shell\n", argv[i]);
+            status = 127;
+            continue;
+        }
+        for (;;) {
+            int busy = index < 0 ? job_state(j) == JOB_RUNNING
+                                 : j->procs[index].state == PROC_RUNNING;
+            if (!busy) break;
+            if (wait_for_child() != 0) return 130;
+            jobs_reap();
+        }
+        status = proc_status(&j->procs[index < 0 ? j->nprocs - 1 : index]);
+        if (job_state(j) == JOB_DONE) job_remove(j);
+    }
+    return status;
+}
+
+static const struct {
+    const char *name;
+    int sig;
+} signals[] = {
+    { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "ILL", SIGILL },
+    { "TRAP", SIGTRAP }, { "ABRT", SIGABRT }, { "BUS", SIGBUS }, { "FPE", SIGFPE },
+    { "KILL", SIGKILL }, { "USR1", SIGUSR1 }, { "SEGV", SIGSEGV }, { "USR2", SIGUSR2 },
+    { "PIPE", SIGPIPE }, { "ALRM", SIGALRM }, { "TERM", SIGTERM }, { "CHLD", SIGCHLD },
+    { "CONT", SIGCONT }, { "STOP", SIGSTOP }, { "TSTP", SIGTSTP }, { "TTIN", SIGTTIN },
+    { "TTOU", SIGTTOU }, { "URG", SIGURG }, { "XCPU", SIGXCPU }, { "XFSZ", SIGXFSZ },
+    { "VTALRM", SIGVTALRM }, { "PROF", SIGPROF }, { "WINCH", SIGWINCH }, { "IO", SIGIO },
+    { "SYS", SIGSYS }
+};
+#define NSIGNALS (int)(sizeof(signals) / sizeof(signals[0]))
+
+/* A signal by name (TERM, SIGTERM, term) or number; -1 if unknown */
+static int signal_number(const char *s) {
+    if (isdigit((unsigned char)*s)) {
+        char *end;
+        long n = strtol(s, &end, 10);
+        return !*end && n < NSIG ? (int)n : -1;
+    }
+    if (strncasecmp(s, "SIG", 3) == 0) s += 3;
+    for (int i = 0; i < NSIGNALS; ++i) {
+        if (strcasecmp(s, signals[i].name) == 0) return signals[i].sig;
+    }
+    return -1;
+}
+
+static const char *signal_name(int sig) {
+    for (int i = 0; i < NSIGNALS; ++i) {
+        if (signals[i].sig == sig) return signals[i].name;
+    }
+    return NULL;
+}
+
+static int kill_list(int argc, char **argv) {
+    if (argc == 0) {
+        for (int i = 0; i < NSIGNALS; ++i) printf("%s%c", signals[i].name, i + 1 < NSIGNALS ? ' ' : '\n');
+        return 0;
+    }
+    int status = 0;
+    for (int i = 0; i < argc; ++i) {
+        /* an exit status names the signal that caused it */
+        int sig = isdigit((unsigned char)argv[i][0]) ? atoi(argv[i]) % 128 : signal_number(argv[i]);
+        const char *name = sig > 0 ? signal_name(sig) : NULL;
+        if (!name) {
+            fprintf(stderr, "kill: %s: invalid signal specification\n", argv[i]);
+            status = 1;
+        } else if (isdigit((unsigned char)argv[i][0])) {
+            printf("%s\n", name);
+        } else {
+            printf("%d\n", sig);
+        }
+    }
+    return status;
+}
+
+int builtin_kill(int argc, char **argv) {
+    int sig = SIGTERM;
+    int i = 1;
+    if (i < argc && argv[i][0] == '-' && argv[i][1]) {
+        const char *opt = argv[i] + 1;
+        if (strcmp(opt, "l") == 0 || strcmp(opt, "L") == 0) return kill_list(argc - 2, argv + 2);
+        if (strcmp(opt, "s") == 0 || strcmp(opt, "n") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "kill: -%s: option requires an argument\n", opt);
+                return 2;
+            }
+            opt = argv[i];
+        }
+        if (strcmp(opt, "-") != 0) {
+            sig = signal_number(opt);
+            if (sig < 0) {
+                fprintf(stderr, "kill: %s: invalid signal specification\n", opt);
+                return 1;
+            }
+        }
+        i++;
+    }
+    if (i >= argc) {
+        fprintf(stderr, "usage: kill [-s sigspec | -n signum | -sigspec] pid | jobspec ...\n");
+        return 2;
+    }
+    jobs_reap();
+    int status = 0;
+    for (; i < argc; ++i) {
+        if (argv[i][0] == '%') {
+            struct job *j = find_job("kill", argv[i]);
+            if (!j) {
+                status = 1;
+                continue;
+            }
+            if (j->pgid > 0) {
+                if (kill(-j->pgid, sig) != 0) {
+                    fprintf(stderr, "kill: (%ld) - %s\n", (long)-j->pgid, strerror(errno));
+                    status = 1;
+                }
+            } else {
+                for (int k = 0; k < j->nprocs; ++k) {
+                    if (j->procs[k].state != PROC_DONE) kill(j->procs[k].pid, sig);
+                }
+            }
+            /* a stopped job only acts on the signal once it runs again */
+            if (job_state(j) == JOB_STOPPED && (sig == SIGTERM || sig == SIGHUP)) continue_job(j);
+            continue;
+        }
+        char *end;
+        long pid = strtol(argv[i], &end, 10);
+        if (*end || end == argv[i]) {
+            fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", argv[i]);
+            status = 1;
+        } else if (kill((pid_t)pid, sig) != 0) {
+            fprintf(stderr, "kill: (%ld) - %s\n", pid, strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,213 @@
+/*
+ * posix_spawn based launcher with a fork fallback.
+ *
+ * fork() has to copy the shell's page tables, so its cost grows with the
+ * shell's RSS; posix_spawn in glibc uses clone(CLONE_VM|CLONE_VFORK) and
+ * costs the same regardless of how big the shell is.
+ */
+
+#define _GNU_SOURCE
+#include "launch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <paths.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+
+enum launch_backend launch_default_backend = LAUNCH_SPAWN;
+
+/* Signals the shell may catch or ignore; children get SIG_DFL for these */
+static const int reset_signals[] = {
+    SIGINT, SIGQUIT, SIGTERM, SIGTSTP, SIGTTIN, SIGTTOU, SIGPIPE, SIGCHLD
+};
+#define NRESET (int)(sizeof(reset_signals) / sizeof(reset_signals[0]))
+
+void launch_init(struct launch *l) {
+    l->nactions = 0;
+    l->pgid = -1;
+    l->need_fork = 0;
+    l->setup = NULL;
+    l->setup_arg = NULL;
+}
+
+static struct launch_action *add_action(struct launch *l, enum launch_action_type type, int fd) {
+    if (l->nactions >= LAUNCH_MAX_ACTIONS) {
+        errno = E2BIG;
+        return NULL;
+    }
+    struct launch_action *a = &l->actions[l->nactions++];
+    memset(a, 0, sizeof(*a));
+    a->type = type;
+    a->fd = fd;
+    return a;
+}
+
+int launch_dup2(struct launch *l, int src, int fd) {
+    struct launch_action *a = add_action(l, LAUNCH_DUP2, fd);
+    if (!a) return -1;
+    a->src = src;
+    return 0;
+}
+
+int launch_close(struct launch *l, int fd) {
+    return add_action(l, LAUNCH_CLOSE, fd) ? 0 : -1;
+}
+
+int launch_open(struct launch *l, int fd, const char *path, int oflag, mode_t mode) {
+    struct launch_action *a = add_action(l, LAUNCH_OPEN, fd);
+    if (!a) return -1;
+    a->path = path;
+    a->oflag = oflag;
+    a->mode = mode;
+    return 0;
+}
+
+void launch_setup(struct launch *l, int (*fn)(void *), void *arg) {
+    l->setup = fn;
+    l->setup_arg = arg;
+    l->need_fork = 1;
+}
+
+void launch_reset_signals(void) {
+    for (int i = 0; i < NRESET; ++i) signal(reset_signals[i], SIG_DFL);
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+}
+
+/* A file the kernel won't exec (ENOEXEC: a script without a #! line) is
+ * run by /bin/sh, as execvp does: sh_args gets `/bin/sh path args...`
+ * and needs room for argc + 2 pointers. */
+static size_t arg_count(char *const argv[]) {
+    size_t n = 0;
+    while (argv[n]) ++n;
+    return n;
+}
+
+static void sh_args(char **out, const char *path, char *const argv[]) {
+    out[0] = (char *)_PATH_BSHELL;
+    out[1] = (char *)path;
+    for (size_t i = 1; argv[i]; ++i) out[i + 1] = argv[i];
+    out[arg_count(argv) + 1] = NULL;
+}
+
+static pid_t launch_spawn(const char *path, char *const argv[], char *const envp[],
+                          const struct launch *l) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t fa;
+    sigset_t def, none;
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    pid_t pid = -1;
+    int err;
+
+    sigemptyset(&def);
+    for (int i = 0; i < NRESET; ++i) sigaddset(&def, reset_signals[i]);
+    sigemptyset(&none);
+
+    if ((err = posix_spawnattr_init(&attr)) != 0) {
+        errno = err;
+        return -1;
+    }
+    posix_spawnattr_setsigdefault(&attr, &def);
+    posix_spawnattr_setsigmask(&attr, &none);
+    if (l && l->pgid >= 0) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, l->pgid);
+    }
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+
+    posix_spawn_file_actions_init(&fa);
+    for (int i = 0; l && i < l->nactions; ++i) {
+        const struct launch_action *a = &l->actions[i];
+        switch (a->type) {
+            case LAUNCH_DUP2:
+                posix_spawn_file_actions_adddup2(&fa, a->src, a->fd);
+                break;
+            case LAUNCH_CLOSE:
+                posix_spawn_file_actions_addclose(&fa, a->fd);
+                break;
+            case LAUNCH_OPEN:
+                posix_spawn_file_actions_addopen(&fa, a->fd, a->path, a->oflag, a->mode);
+                break;
+        }
+    }
+
+    err = posix_spawn(&pid, path, &fa, &attr, argv, envp);
+    if (err == ENOEXEC) {
+        char **args = malloc((arg_count(argv) + 2) * sizeof(*args));
+        if (args) {
+            sh_args(args, path, argv);
+            err = posix_spawn(&pid, _PATH_BSHELL, &fa, &attr, args, envp);
+            free(args);
+        }
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+static pid_t launch_fork(const char *path, char *const argv[], char *const envp[],
+                         const struct launch *l) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        /* Set the group from both sides to avoid racing the child */
+        if (pid > 0 && l && l->pgid >= 0) setpgid(pid, l->pgid ? l->pgid : pid);
+        return pid;
+    }
+    if (l && l->pgid >= 0) setpgid(0, l->pgid);
+    launch_reset_signals();
+    for (int i = 0; l && i < l->nactions; ++i) {
+        const struct launch_action *a = &l->actions[i];
+        switch (a->type) {
+            case LAUNCH_DUP2:
+                if (dup2(a->src, a->fd) < 0) _exit(126);
+                break;
+            case LAUNCH_CLOSE:
+                close(a->fd);
+                break;
+            case LAUNCH_OPEN: {
+                int fd = open(a->path, a->oflag, a->mode);
+                if (fd < 0) {
+                    fprintf(stderr, "kzsh: %s: %s\n", a->path, strerror(errno));
+                    _exit(1);
+                }
+                if (fd != a->fd) {
+                    dup2(fd, a->fd);
+                    close(fd);
+                }
+                break;
+            }
+        }
+    }
+    if (l && l->setup && l->setup(l->setup_arg) != 0) _exit(1);
+    execve(path, argv, envp);
+    if (errno == ENOEXEC) {
+        char *args[arg_count(argv) + 2];
+        sh_args(args, path, argv);
+        execve(_PATH_BSHELL, args, envp);
+    }
+    fprintf(stderr, "kzsh: %s: %s\n", argv[0], strerror(errno));
+    _exit(errno == ENOENT ? 127 : 126);
+}
+
+pid_t launch_with(enum launch_backend backend, const char *path, char *const argv[],
+                  char *const envp[], const struct launch *l) {
+    if (backend == LAUNCH_FORK || (l && l->need_fork)) return launch_fork(path, argv, envp, l);
+    return launch_spawn(path, argv, envp, l);
+}
+
+pid_t launch_external(const char *path, char *const argv[], char *const envp[],
+                      const struct launch *l) {
+    return launch_with(launch_default_backend, path, argv, envp, l);
+}
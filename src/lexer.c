@@ -0,0 +1,321 @@
+/*
+ * Single-pass tokenizer for kzsh.
+ *
+ * Words are returned as views into the source buffer with their quoting
+ * left intact; the lexer only finds the word boundaries (balancing quotes,
+ * $(...), ${...} and backquotes) and records a few flags about the word.
+ */
+
+#include "parser.h"
+#include <string.h>
+
+void lexer_init(struct lexer *lx, const char *src, size_t len) {
+    lx->src = src;
+    lx->cur = src;
+    lx->end = src + len;
+    lx->line = 1;
+    lx->error = NULL;
+    lx->incomplete = 0;
+    lx->nheredocs = 0;
+}
+
+static int is_meta(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == ';' || c == '&' ||
+           c == '|' || c == '<' || c == '>' || c == '(' || c == ')';
+}
+
+static int is_name_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int is_name_char(char c) {
+    return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+static const char *scan_dollar(struct lexer *lx, const char *p);
+static const char *scan_backquote(struct lexer *lx, const char *p);
+
+static const char *unterminated(struct lexer *lx, const char *msg) {
+    lx->error = msg;
+    lx->incomplete = 1;
+    return NULL;
+}
+
+/* p points just past the opening quote; returns pointer past the closing one */
+static const char *scan_squote(struct lexer *lx, const char *p) {
+    while (p < lx->end && *p != '\'') {
+        if (*p == '\n') lx->line++;
+        p++;
+    }
+    if (p >= lx->end) return unterminated(lx, "unexpected EOF while looking for matching `''");
+    return p + 1;
+}
+
+static const char *scan_dquote(struct lexer *lx, const char *p) {
+    while (p < lx->end && *p != '"') {
+        if (*p == '\\' && p + 1 < lx->end) {
+            if (p[1] == '\n') lx->line++;
+            p += 2;
+        } else if (*p == '$') {
+            p = scan_dollar(lx, p);
+            if (!p) return NULL;
+        } else if (*p == '`') {
+            p = scan_backquote(lx, p + 1);
+            if (!p) return NULL;
+        } else {
+            if (*p == '\n') lx->line++;
+            p++;
+        }
+    }
+    if (p >= lx->end) return unterminated(lx, "unexpected EOF while looking for matching `\"'");
+    return p + 1;
+}
+
+static const char *scan_backquote(struct lexer *lx, const char *p) {
+    while (p < lx->end && *p != '`') {
+        if (*p == '\\' && p + 1 < lx->end) p++;
+        if (*p == '\n') lx->line++;
+        p++;
+    }
+    if (p >= lx->end) return unterminated(lx, "unexpected EOF while looking for matching ``'");
+    return p + 1;
+}
+
+/* Scan a balanced (...) or {...} group; p points just past the opener. */
+static const char *scan_group(struct lexer *lx, const char *p, char open, char close) {
+    int depth = 1;
+    while (p < lx->end) {
+        char c = *p;
+        if (c == '\\' && p + 1 < lx->end) {
+            p += 2;
+        } else if (c == '\'') {
+            p = scan_squote(lx, p + 1);
+            if (!p) return NULL;
+        } else if (c == '"') {
+            p = scan_dquote(lx, p + 1);
+            if (!p) return NULL;
+        } else if (c == '`') {
+            p = scan_backquote(lx, p + 1);
+            if (!p) return NULL;
+        } else if (c == '$') {
+            p = scan_dollar(lx, p);
+            if (!p) return NULL;
+        } else {
+            if (c == '\n') lx->line++;
+            if (c == open) depth++;
+            else if (c == close && --depth == 0) return p + 1;
+            p++;
+        }
+    }
+    return unterminated(lx, open == '(' ? "unexpected EOF while looking for matching `)'"
+                                        : "unexpected EOF while looking for matching `}'");
+}
+
+/* p points at '$' */
+static const char *scan_dollar(struct lexer *lx, const char *p) {
+    p++;
+    if (p < lx->end && *p == '(') return scan_group(lx, p + 1, '(', ')');
+    if (p < lx->end && *p == '{') return scan_group(lx, p + 1, '{', '}');
+    return p;
+}
+
+const char *lexer_skip(const char *p, const char *end) {
+    struct lexer lx;
+    lexer_init(&lx, p, (size_t)(end - p));
+    switch (*p) {
+        case '\'': return scan_squote(&lx, p + 1);
+        case '"': return scan_dquote(&lx, p + 1);
+        case '`': return scan_backquote(&lx, p + 1);
+        case '$': return scan_dollar(&lx, p);
+        default: return p + 1;
+    }
+}
+
+static struct token make_tok(struct lexer *lx, enum token_type type, const char *start, size_t len) {
+    struct token t;
+    t.type = type;
+    t.start = start;
+    t.len = len;
+    t.flags = 0;
+    t.line = lx->line;
+    return t;
+}
+
+/* Copy a here-doc delimiter with quotes removed. Returns 1 if it was quoted. */
+static int delimiter_text(const struct word *w, char *out, size_t outlen, size_t *olen) {
+    int quoted = 0;
+    size_t o = 0;
+    for (size_t i = 0; i < w->len && o + 1 < outlen; ++i) {
+        char c = w->text[i];
+        if (c == '\'' || c == '"') { quoted = 1; continue; }
+        if (c == '\\' && i + 1 < w->len) { quoted = 1; c = w->text[++i]; }
+        out[o++] = c;
+    }
+    out[o] = '\0';
+    *olen = o;
+    return quoted;
+}
+
+/* Called right after a newline: collect bodies for pending here-documents. */
+static void read_heredocs(struct lexer *lx) {
+    for (int i = 0; i < lx->nheredocs; ++i) {
+        struct redir *r = lx->heredocs[i];
+        char delim[256];
+        size_t dlen;
+        r->quoted_delim = delimiter_text(r->target, delim, sizeof(delim), &dlen);
+        const char *body = lx->cur;
+        const char *p = lx->cur;
+        for (;;) {
+            if (p >= lx->end) {
+                /* Like bash: a missing delimiter ends the body at EOF.
+                 * Flagged so a reader with more input to come can retry. */
+                lx->incomplete = 1;
+                r->body = body;
+                r->body_len = (size_t)(lx->end - body);
+                lx->cur = lx->end;
+                break;
+            }
+            const char *eol = memchr(p, '\n', (size_t)(lx->end - p));
+            if (!eol) eol = lx->end;
+            const char *s = p;
+            if (r->strip_tabs) while (s < eol && *s == '\t') s++;
+            if ((size_t)(eol - s) == dlen && memcmp(s, delim, dlen) == 0) {
+                r->body = body;
+                r->body_len = (size_t)(p - body);
+                lx->cur = eol < lx->end ? eol + 1 : eol;
+                lx->line++;
+                break;
+            }
+            lx->line++;
+            p = eol < lx->end ? eol + 1 : eol;
+        }
+    }
+    lx->nheredocs = 0;
+}
+
+struct token lexer_next(struct lexer *lx) {
+    const char *p = lx->cur;
+
+    /* skip blanks, line continuations and comments */
+    for (;;) {
+        while (p < lx->end && (*p == ' ' || *p == '\t')) p++;
+        if (p + 1 < lx->end && p[0] == '\\' && p[1] == '\n') {
+            lx->line++;
+            p += 2;
+            continue;
+        }
+        if (p < lx->end && *p == '#') {
+            while (p < lx->end && *p != '\n') p++;
+        }
+        break;
+    }
+
+    if (p >= lx->end) {
+        lx->cur = p;
+        if (lx->nheredocs) read_heredocs(lx);
+        return make_tok(lx, TOK_EOF, p, 0);
+    }
+
+    const char *start = p;
+    char c = *p;
+    char n = (p + 1 < lx->end) ? p[1] : '\0';
+    char n2 = (p + 2 < lx->end) ? p[2] : '\0';
+    enum token_type type = TOK_WORD;
+    size_t oplen = 1;
+
+    switch (c) {
+        case '\n': type = TOK_NEWLINE; break;
+        case ';': if (n == ';') { type = TOK_DSEMI; oplen = 2; } else type = TOK_SEMI; break;
+        case '&': if (n == '&') { type = TOK_AND_IF; oplen = 2; } else type = TOK_AMP; break;
+        case '|': if (n == '|') { type = TOK_OR_IF; oplen = 2; } else type = TOK_PIPE; break;
+        case '(': type = TOK_LPAREN; break;
+        case ')': type = TOK_RPAREN; break;
+        case '<':
+            if (n == '<') {
+                if (n2 == '-') { type = TOK_DLESSDASH; oplen = 3; }
+                else if (n2 == '<') { type = TOK_TLESS; oplen = 3; }
+                else { type = TOK_DLESS; oplen = 2; }
+            } else if (n == '&') { type = TOK_LESSAND; oplen = 2; }
+            else if (n == '>') { type = TOK_LESSGREAT; oplen = 2; }
+            else type = TOK_LESS;
+            break;
+        case '>':
+            if (n == '>') { type = TOK_DGREAT; oplen = 2; }
+            else if (n == '&') { type = TOK_GREATAND; oplen = 2; }
+            else if (n == '|') { type = TOK_CLOBBER; oplen = 2; }
+            else type = TOK_GREAT;
+            break;
+        default:
+            break;
+    }
+
+    if (type != TOK_WORD) {
+        struct token t = make_tok(lx, type, start, oplen);
+        lx->cur = p + oplen;
+        if (type == TOK_NEWLINE) {
+            lx->line++;
+            if (lx->nheredocs) read_heredocs(lx);
+        }
+        return t;
+    }
+
+    /* Word */
+    int tok_line = lx->line;
+    unsigned flags = 0;
+    if (c == '~') flags |= WORD_TILDE;
+    while (p < lx->end && !is_meta(*p)) {
+        c = *p;
+        if (c == '\\') {
+            flags |= WORD_QUOTED;
+            if (p + 1 < lx->end && p[1] == '\n') lx->line++;
+            p += (p + 1 < lx->end) ? 2 : 1;
+        } else if (c == '\'') {
+            flags |= WORD_QUOTED;
+            p = scan_squote(lx, p + 1);
+        } else if (c == '"') {
+            flags |= WORD_QUOTED;
+            const char *q = p + 1;
+            p = scan_dquote(lx, q);
+            if (p && memchr(q, '$', (size_t)(p - q))) flags |= WORD_DOLLAR;
+            if (p && memchr(q, '`', (size_t)(p - q))) flags |= WORD_DOLLAR;
+        } else if (c == '`') {
+            flags |= WORD_DOLLAR;
+            p = scan_backquote(lx, p + 1);
+        } else if (c == '$') {
+            flags |= WORD_DOLLAR;
+            p = scan_dollar(lx, p);
+        } else {
+            if (c == '*' || c == '?' || c == '[') flags |= WORD_GLOB;
+            p++;
+        }
+        if (!p) {
+            lx->cur = lx->end;
+            struct token t = make_tok(lx, TOK_ERROR, start, (size_t)(lx->end - start));
+            t.line = tok_line;
+            return t;
+        }
+    }
+
+    struct token t = make_tok(lx, TOK_WORD, start, (size_t)(p - start));
+    t.line = tok_line;
+    lx->cur = p;
+
+    /* IO_NUMBER: all digits and immediately followed by a redirection */
+    if (p < lx->end && (*p == '<' || *p == '>')) {
+        size_t i = 0;
+        while (i < t.len && start[i] >= '0' && start[i] <= '9') i++;
+        if (i == t.len) {
+            t.type = TOK_IO_NUMBER;
+            return t;
+        }
+    }
+
+    /* NAME=... assignment */
+    if (is_name_start(start[0])) {
+        size_t i = 1;
+        while (i < t.len && is_name_char(start[i])) i++;
+        if (i < t.len && start[i] == '=') flags |= WORD_ASSIGN;
+    }
+    t.flags = flags;
+    return t;
+}
@@ -0,0 +1,975 @@
+/*
+ * Line editor (termios-based, no readline) with history recall and Ctrl-R
+ * incremental search.
+ *
+ * The line lives in a gap buffer whose gap sits at the cursor, so typing,
+ * deleting and pasting anywhere in the line cost only the bytes involved.
+ * The screen is updated the same way: an edit redraws from the cursor to
+ * the end of the line, and cursor motions are plain cursor moves. The
+ * editor tracks the cursor as a cell offset from the start of the prompt's
+ * last line (UTF-8 aware: wide characters take two cells, combining marks
+ * none, control characters are shown as ^X) and uses the terminal width to
+ * handle lines that wrap.
+ *
+ * Terminal I/O is batched both ways. Input is read in chunks, and every
+ * byte already received is handled before the editor waits again, so a
+ * paste is one batch however large it is. Everything drawn meanwhile goes
+ * into an output frame that is written with one write() when the batch
+ * is done. Bracketed paste mode is on while editing, so pasted text is
+ * inserted in one go and never run as commands or read as key bindings.
+ *
+ * Keys: Left/Right, Ctrl-B/F     move by character
+ *       Alt-B/F, Ctrl-Left/Right move by word
+ *       Home/End, Ctrl-A/E       start/end of line
+ *       Backspace, Delete, Ctrl-D delete a character (Ctrl-D: EOF on an empty line)
+ *       Ctrl-W, Alt-D            delete word before/after the cursor
+ *       Ctrl-U, Ctrl-K           delete to start/end of line
+ *       Ctrl-Y                   insert the last deleted text
+ *       Up/Down, Ctrl-P/N        history
+ *       Ctrl-R                   incremental history search
+ *       Tab                      complete a command or file name; twice lists
+ *       Ctrl-L                   clear the screen
+ */
+
+#include "lineedit.h"
+#include "shell.h"
+#include "history.h"
+#include "prompt.h"
+#include "iocopy.h"
+#include "complete.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+/* How long a lone ESC waits for the rest of a key sequence */
+#define ESC_TIMEOUT_MS 50
+
+/* More completion candidates than this are only listed after asking */
+#define COMPLETE_ASK_OVER 100
+
+/* ---- output frame ---- */
+
+static char frame[8192];
+static size_t frame_len = 0;
+
+static void fr_flush(void) {
+    if (frame_len) (void)io_write_all(STDOUT_FILENO, frame, frame_len);
+    frame_len = 0;
+}
+
+static void fr_put(const char *s, size_t n) {
+    if (frame_len + n > sizeof(frame)) {
+        fr_flush();
+        if (n > sizeof(frame)) {
+            (void)io_write_all(STDOUT_FILENO, s, n);
+            return;
+        }
+    }
+    memcpy(frame + frame_len, s, n);
+    frame_len += n;
+}
+
+static void fr_str(const char *s) {
+    fr_put(s, strlen(s));
+}
+
+/* CSI n <op>, for cursor movement */
+static void fr_csi(size_t n, char op) {
+    char seq[32];
+    int len = snprintf(seq, sizeof(seq), "\x1b[%zu%c", n, op);
+    fr_put(seq, (size_t)len);
+}
+
+/* ---- gap buffer ---- */
+
+struct gapbuf {
+    char *b;
+    size_t cap;
+    size_t gs, ge;          /* the gap is b[gs..ge); the cursor is at gs */
+};
+
+static size_t gb_len(const struct gapbuf *g) {
+    return g->cap - (g->ge - g->gs);
+}
+
+/* Byte at logical position i */
+static unsigned char gb_at(const struct gapbuf *g, size_t i) {
+    return (unsigned char)g->b[i < g->gs ? i : i + (g->ge - g->gs)];
+}
+
+static int gb_reserve(struct gapbuf *g, size_t n) {
+    if (g->ge - g->gs >= n) return 0;
+    size_t len = gb_len(g);
+    size_t tail = g->cap - g->ge;
+    size_t ncap = g->cap ? g->cap : 256;
+    while (ncap - len < n) ncap *= 2;
+    char *nb = realloc(g->b, ncap);
+    if (!nb) return -1;
+    memmove(nb + ncap - tail, nb + g->ge, tail);
+    g->b = nb;
+    g->ge = ncap - tail;
+    g->cap = ncap;
+    return 0;
+}
+
+/* Move the gap (cursor) to logical position pos */
+static void gb_move(struct gapbuf *g, size_t pos) {
+    if (pos < g->gs) {
+        size_t n = g->gs - pos;
+        memmove(g->b + g->ge - n, g->b + pos, n);
+        g->gs -= n;
+        g->ge -= n;
+    } else if (pos > g->gs) {
+        size_t n = pos - g->gs;
+        memmove(g->b + g->gs, g->b + g->ge, n);
+        g->gs += n;
+        g->ge += n;
+    }
+}
+
+static int gb_insert(struct gapbuf *g, const char *s, size_t n) {
+    if (gb_reserve(g, n) != 0) return -1;
+    memcpy(g->b + g->gs, s, n);
+    g->gs += n;
+    return 0;
+}
+
+static void gb_clear(struct gapbuf *g) {
+    g->gs = 0;
+    g->ge = g->cap;
+}
+
+/* The whole line as a C string (moves the cursor to the end) */
+static char *gb_text(struct gapbuf *g) {
+    gb_move(g, gb_len(g));
+    if (gb_reserve(g, 1) != 0) return NULL;
+    g->b[g->gs] = '\0';
+    return g->b;
+}
+
+/* ---- UTF-8 and display width ---- */
+
+/* Decode one character from s[0..n); invalid bytes decode one at a time
+ * as U+FFFD. Returns its length in bytes. */
+static size_t utf8_decode(const unsigned char *s, size_t n, uint32_t *cp) {
+    unsigned char c = s[0];
+    size_t len;
+    uint32_t v;
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    } else if ((c & 0xe0) == 0xc0) {
+        len = 2; v = c & 0x1f;
+    } else if ((c & 0xf0) == 0xe0) {
+        len = 3; v = c & 0x0f;
+    } else if ((c & 0xf8) == 0xf0) {
+        len = 4; v = c & 0x07;
+    } else {
+        *cp = 0xfffd;
+        return 1;
+    }
+    if (len > n) {
+        *cp = 0xfffd;
+        return 1;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        if ((s[i] & 0xc0) != 0x80) {
+            *cp = 0xfffd;
+            return 1;
+        }
+        v = (v << 6) | (s[i] & 0x3f);
+    }
+    *cp = v;
+    return len;
+}
+
+struct cp_range {
+    uint32_t lo, hi;
+};
+
+static const struct cp_range zero_width[] = {
+    {0x0300, 0x036f}, {0x0483, 0x0489}, {0x0591, 0x05bd}, {0x0610, 0x061a},
+    {0x064b, 0x065f}, {0x0e31, 0x0e31}, {0x0e34, 0x0e3a}, {0x1ab0, 0x1aff},
+    {0x1dc0, 0x1dff}, {0x200b, 0x200f}, {0x20d0, 0x20ff}, {0xfe00, 0xfe0f},
+    {0xfe20, 0xfe2f}, {0xfeff, 0xfeff}, {0xe0100, 0xe01ef}
+};
+
+static const struct cp_range wide[] = {
+    {0x1100, 0x115f}, {0x2e80, 0x303e}, {0x3041, 0x33ff}, {0x3400, 0x4dbf},
+    {0x4e00, 0x9fff}, {0xa000, 0xa4cf}, {0xac00, 0xd7a3}, {0xf900, 0xfaff},
+    {0xfe30, 0xfe4f}, {0xff00, 0xff60}, {0xffe0, 0xffe6}, {0x1f300, 0x1f64f},
+    {0x1f900, 0x1f9ff}, {0x20000, 0x2fffd}, {0x30000, 0x3fffd}
+};
+
+static int in_ranges(uint32_t cp, const struct cp_range *r, size_t n) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (cp < r[mid].lo) hi = mid;
+        else if (cp > r[mid].hi) lo = mid + 1;
+        else return 1;
+    }
+    return 0;
+}
+
+/* Terminal cells for one character of the line */
+static size_t cp_width(uint32_t cp) {
+    if (cp < 0x20 || cp == 0x7f) return 2;     /* ^X */
+    if (cp < 0x300) return 1;
+    if (in_ranges(cp, zero_width, sizeof(zero_width) / sizeof(zero_width[0]))) return 0;
+    if (in_ranges(cp, wide, sizeof(wide) / sizeof(wide[0]))) return 2;
+    return 1;
+}
+
+/* Width of s[0..n) on screen; with draw set it is also put in the frame,
+ * control characters as ^X and invalid bytes as '?'. */
+static size_t text_cells(const char *s, size_t n, int draw) {
+    const unsigned char *p = (const unsigned char *)s;
+    size_t cells = 0;
+    size_t i = 0;
+    while (i < n) {
+        /* plain ASCII runs go out as they are */
+        size_t j = i;
+        while (j < n && p[j] >= 0x20 && p[j] < 0x7f) j++;
+        if (j > i) {
+            if (draw) fr_put(s + i, j - i);
+            cells += j - i;
+            i = j;
+            continue;
+        }
+        uint32_t cp;
+        size_t len = utf8_decode(p + i, n - i, &cp);
+        if (cp < 0x20 || cp == 0x7f) {
+            char caret[2] = { '^', (char)(cp ^ 0x40) };
+            if (draw) fr_put(caret, 2);
+        } else if (cp == 0xfffd && len == 1) {
+            if (draw) fr_put("?", 1);
+        } else if (draw) {
+            fr_put(s + i, len);
+        }
+        cells += cp_width(cp);
+        i += len;
+    }
+    return cells;
+}
+
+/* Width of a prompt: escape sequences (colors, titles) take no cells */
+static size_t prompt_cells(const char *s, size_t n) {
+    const unsigned char *p = (const unsigned char *)s;
+    size_t cells = 0;
+    size_t i = 0;
+    while (i < n) {
+        if (p[i] == 0x1b && i + 1 < n && p[i+1] == '[') {
+            i += 2;
+            while (i < n && !(p[i] >= 0x40 && p[i] <= 0x7e)) i++;
+            i++;
+        } else if (p[i] == 0x1b && i + 1 < n && p[i+1] == ']') {
+            /* OSC, ended by BEL or ESC \ */
+            i += 2;
+            while (i < n && p[i] != 0x07 && p[i] != 0x1b) i++;
+            i += (i < n && p[i] == 0x1b) ? 2 : 1;
+        } else if (p[i] < 0x20 || p[i] == 0x7f) {
+            i++;
+        } else {
+            uint32_t cp;
+            i += utf8_decode(p + i, n - i, &cp);
+            cells += cp_width(cp);
+        }
+    }
+    return cells;
+}
+
+/* ---- input ---- */
+
+/* Bytes read but not yet handled. They survive across lines, so text
+ * pasted as several lines is run line by line without being lost to the
+ * terminal mode switches in between. */
+static unsigned char inbuf[4096];
+static size_t in_pos = 0, in_len = 0;
+
+struct editor {
+    struct gapbuf g;
+    const char *prompt;     /* rendered by prompt.c */
+    size_t prompt_len;
+    size_t prompt_w;        /* cells of the prompt's last line */
+    size_t cols;            /* terminal width */
+    size_t cur;             /* cursor cell, counted from the prompt's last line */
+    int hist;               /* history entry shown; history_count_get() for the new line */
+    int tab_again;          /* the last key was a Tab that could not complete further */
+};
+
+/* The editor's line buffer, reused from line to line */
+static struct gapbuf line;
+
+/* Text removed by the kill commands, for Ctrl-Y */
+static char *killed = NULL;
+static size_t killed_len = 0;
+
+static void refresh(struct editor *e, int full, int up);
+
+/* Refill inbuf. While a prompt segment is being computed in the
+ * background its pipe is polled next to stdin, and the prompt is redrawn
+ * in place when the result lands. Returns like read(). */
+static ssize_t fill_input(struct editor *e) {
+    for (;;) {
+        int afd = e ? prompt_async_fd() : -1;
+        if (afd >= 0) {
+            struct pollfd pfd[2] = {
+                { .fd = STDIN_FILENO, .events = POLLIN },
+                { .fd = afd, .events = POLLIN }
+            };
+            if (poll(pfd, 2, -1) < 0) return -1;   /* EINTR: caller checks SIGINT */
+            if (pfd[1].revents) {
+                /* collecting rewrites the cached text e->prompt points into,
+                 * so count its lines first */
+                int lines = 0;
+                for (const char *p = e->prompt; *p; ++p) lines += (*p == '\n');
+                if (prompt_async_collect()) {
+                    refresh(e, 1, lines);
+                    fr_flush();
+                }
+            }
+            if (!pfd[0].revents) continue;
+        }
+        ssize_t r = read(STDIN_FILENO, inbuf, sizeof(inbuf));
+        if (r > 0) {
+            in_pos = 0;
+            in_len = (size_t)r;
+        }
+        return r;
+    }
+}
+
+/* Next input byte: 1 ok, 0 EOF, -1 error or SIGINT. The output frame is
+ * flushed whenever the editor is about to wait for more input. */
+static int next_byte(struct editor *e, unsigned char *c) {
+    while (in_pos == in_len) {
+        fr_flush();
+        ssize_t r = fill_input(e);
+        if (r == 0) return 0;
+        if (r < 0) {
+            if (errno == EINTR && !got_sigint) continue;
+            return -1;
+        }
+    }
+    *c = inbuf[in_pos++];
+    return 1;
+}
+
+/* Like next_byte, but gives up (returning 0) when nothing arrives within
+ * timeout_ms. Key sequences come in one piece, so this only ever waits
+ * after a lone ESC. */
+static int next_byte_within(unsigned char *c, int timeout_ms) {
+    if (in_pos == in_len) {
+        fr_flush();
+        struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+        if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+    }
+    return next_byte(NULL, c) == 1;
+}
+
+enum key {
+    KEY_NONE,
+    KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT,
+    KEY_HOME, KEY_END, KEY_DELETE,
+    KEY_WORD_LEFT, KEY_WORD_RIGHT,
+    KEY_KILL_WORD_LEFT, KEY_KILL_WORD_RIGHT,
+    KEY_PASTE
+};
+
+/* Decode what follows an ESC: CSI / SS3 sequences and Alt-<key> */
+static enum key read_escape(void) {
+    unsigned char c;
+    if (!next_byte_within(&c, ESC_TIMEOUT_MS)) return KEY_NONE;
+    if (c == 'b' || c == 'B') return KEY_WORD_LEFT;
+    if (c == 'f' || c == 'F') return KEY_WORD_RIGHT;
+    if (c == 'd' || c == 'D') return KEY_KILL_WORD_RIGHT;
+    if (c == 0x7f || c == 0x08) return KEY_KILL_WORD_LEFT;
+    if (c != '[' && c != 'O') return KEY_NONE;
+
+    /* parameters, then a final byte in 0x40..0x7e */
+    char param[16];
+    size_t np = 0;
+    unsigned char fin;
+    for (;;) {
+        if (!next_byte_within(&fin, ESC_TIMEOUT_MS)) return KEY_NONE;
+        if (fin >= 0x40 && fin <= 0x7e) break;
+        if (np + 1 < sizeof(param)) param[np++] = (char)fin;
+    }
+    param[np] = '\0';
+    /* "1;5" (Ctrl) or "1;3" (Alt) turns arrows into word motions */
+    int modified = strcmp(param, "1;5") == 0 || strcmp(param, "1;3") == 0;
+    switch (fin) {
+        case 'A': return KEY_UP;
+        case 'B': return KEY_DOWN;
+        case 'C': return modified ? KEY_WORD_RIGHT : KEY_RIGHT;
+        case 'D': return modified ? KEY_WORD_LEFT : KEY_LEFT;
+        case 'H': return KEY_HOME;
+        case 'F': return KEY_END;
+        case '~':
+            if (!strcmp(param, "1") || !strcmp(param, "7")) return KEY_HOME;
+            if (!strcmp(param, "4") || !strcmp(param, "8")) return KEY_END;
+            if (!strcmp(param, "3")) return KEY_DELETE;
+            if (!strcmp(param, "200")) return KEY_PASTE;
+            return KEY_NONE;
+        default:
+            return KEY_NONE;
+    }
+}
+
+/* ---- screen updates ---- */
+
+/* Move the terminal cursor between two cells of the (wrapped) line */
+static void move_to(const struct editor *e, size_t from, size_t to) {
+    size_t fr = from / e->cols, fc = from % e->cols;
+    size_t tr = to / e->cols, tc = to % e->cols;
+    if (tr < fr) fr_csi(fr - tr, 'A');
+    else if (tr > fr) fr_csi(tr - fr, 'B');
+    if (tc == fc) return;
+    if (tc == 0) fr_put("\r", 1);
+    else if (tc > fc) fr_csi(tc - fc, 'C');
+    else fr_csi(fc - tc, 'D');
+}
+
+/* After drawing up to the end of the line at cell end: step off a pending
+ * wrap at the right margin, so the cursor really is where end says, and
+ * erase whatever an older, longer line left below. */
+static void end_of_line(const struct editor *e, size_t end) {
+    if (end > 0 && end % e->cols == 0) fr_put(" \r", 2);
+    fr_put("\x1b[J", 3);
+}
+
+/* Redraw from the cursor to the end of the line and return the cursor */
+static void redraw_tail(struct editor *e) {
+    struct gapbuf *g = &e->g;
+    size_t end = e->cur + text_cells(g->b + g->ge, g->cap - g->ge, 1);
+    end_of_line(e, end);
+    move_to(e, end, e->cur);
+}
+
+/* Redraw the whole line. With full set the prompt is drawn again from its
+ * first line (`up` lines above the cursor's), otherwise only its last line. */
+static void refresh(struct editor *e, int full, int up) {
+    struct gapbuf *g = &e->g;
+    move_to(e, e->cur, 0);
+    if (full) {
+        if (up > 0) fr_csi((size_t)up, 'A');
+        e->prompt = prompt_render(&e->prompt_len);
+        fr_put("\r\x1b[J", 4);
+        fr_put(e->prompt, e->prompt_len);
+    } else {
+        fr_put("\r", 1);
+    }
+    const char *last = strrchr(e->prompt, '\n');
+    last = last ? last + 1 : e->prompt;
+    size_t lastlen = e->prompt_len - (size_t)(last - e->prompt);
+    if (!full) fr_put(last, lastlen);
+    e->prompt_w = prompt_cells(last, lastlen);
+    e->cur = e->prompt_w + text_cells(g->b, g->gs, 1);
+    redraw_tail(e);
+}
+
+/* Move the cursor to logical position pos */
+static void cursor_to(struct editor *e, size_t pos) {
+    struct gapbuf *g = &e->g;
+    size_t cur = e->cur;
+    if (pos < g->gs) cur -= text_cells(g->b + pos, g->gs - pos, 0);
+    else if (pos > g->gs) cur += text_cells(g->b + g->ge, pos - g->gs, 0);
+    gb_move(g, pos);
+    move_to(e, e->cur, cur);
+    e->cur = cur;
+}
+
+static void insert(struct editor *e, const char *s, size_t n) {
+    struct gapbuf *g = &e->g;
+    if (n == 0 || gb_insert(g, s, n) != 0) return;
+    e->cur += text_cells(s, n, 1);
+    if (g->ge == g->cap) end_of_line(e, e->cur);
+    else redraw_tail(e);
+}
+
+/* Delete logical range [from, to), remembering it for Ctrl-Y if kill */
+static void delete_range(struct editor *e, size_t from, size_t to, int kill) {
+    if (from >= to) return;
+    cursor_to(e, from);
+    struct gapbuf *g = &e->g;
+    if (kill) {
+        char *k = realloc(killed, to - from);
+        if (k) {
+            memcpy(k, g->b + g->ge, to - from);
+            killed = k;
+            killed_len = to - from;
+        }
+    }
+    g->ge += to - from;
+    redraw_tail(e);
+}
+
+/* ---- motions ---- */
+
+/* Start of the character before pos (combining marks stay with their base) */
+static size_t char_before(const struct gapbuf *g, size_t pos) {
+    while (pos > 0) {
+        size_t start = pos - 1;
+        while (start > 0 && (gb_at(g, start) & 0xc0) == 0x80) start--;
+        unsigned char tmp[4];
+        size_t n = pos - start > 4 ? 4 : pos - start;
+        for (size_t i = 0; i < n; ++i) tmp[i] = gb_at(g, start + i);
+        uint32_t cp;
+        utf8_decode(tmp, n, &cp);
+        pos = start;
+        if (cp_width(cp) != 0) break;
+    }
+    return pos;
+}
+
+/* End of the character at pos, with any combining marks after it */
+static size_t char_after(const struct gapbuf *g, size_t pos) {
+    size_t len = gb_len(g);
+    int first = 1;
+    while (pos < len) {
+        unsigned char tmp[4];
+        size_t n = len - pos > 4 ? 4 : len - pos;
+        for (size_t i = 0; i < n; ++i) tmp[i] = gb_at(g, pos + i);
+        uint32_t cp;
+        size_t clen = utf8_decode(tmp, n, &cp);
+        if (!first && cp_width(cp) != 0) break;
+        pos += clen;
+        first = 0;
+    }
+    return pos;
+}
+
+static int is_word(unsigned char c) {
+    return isalnum(c) || c == '_' || c >= 0x80;
+}
+
+static size_t word_before(const struct gapbuf *g, size_t pos) {
+    while (pos > 0 && !is_word(gb_at(g, pos - 1))) pos--;
+    while (pos > 0 && is_word(gb_at(g, pos - 1))) pos--;
+    return pos;
+}
+
+static size_t word_after(const struct gapbuf *g, size_t pos) {
+    size_t len = gb_len(g);
+    while (pos < len && !is_word(gb_at(g, pos))) pos++;
+    while (pos < len && is_word(gb_at(g, pos))) pos++;
+    return pos;
+}
+
+/* ---- editing commands ---- */
+
+/* Put history entry idx (or an empty line for one past the end) in the buffer */
+static void load_history(struct editor *e, int idx) {
+    const char *hline = idx < history_count_get() ? history_get(idx) : NULL;
+    gb_clear(&e->g);
+    if (hline) gb_insert(&e->g, hline, strlen(hline));
+    e->hist = idx;
+    refresh(e, 0, 0);
+}
+
+/* Bracketed paste: everything up to ESC [ 201 ~ is text. Terminals send
+ * line breaks in a paste as CR; they come back as LF. Returns malloc'd
+ * text (or NULL) and its length in *outlen. */
+static char *read_paste(size_t *outlen) {
+    static const char end[] = "\x1b[201~";
+    const size_t endlen = sizeof(end) - 1;
+    char *text = NULL;
+    size_t len = 0, cap = 0;
+    unsigned char c;
+    while (next_byte(NULL, &c) == 1) {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 4096;
+            char *grown = realloc(text, cap);
+            if (!grown) break;
+            text = grown;
+        }
+        text[len++] = (char)c;
+        if (len >= endlen && memcmp(text + len - endlen, end, endlen) == 0) {
+            len -= endlen;
+            break;
+        }
+    }
+    size_t o = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (text[i] == '\r') {
+            text[o++] = '\n';
+            if (i + 1 < len && text[i + 1] == '\n') i++;
+        } else {
+            text[o++] = text[i];
+        }
+    }
+    *outlen = o;
+    return text;
+}
+
+/* A paste is inserted as one edit, whatever its size */
+static void paste(struct editor *e) {
+    size_t len;
+    char *text = read_paste(&len);
+    if (text) insert(e, text, len);
+    free(text);
+}
+
+/* Move below the line, leaving the line itself as it is on screen */
+static void leave_line(struct editor *e) {
+    struct gapbuf *g = &e->g;
+    size_t end = e->cur + text_cells(g->b + g->ge, g->cap - g->ge, 0);
+    move_to(e, e->cur, end);
+    if (end == 0 || end % e->cols != 0) fr_put("\n", 1);
+}
+
+/* List candidates in columns under the line (like ls), then draw the
+ * prompt and the line again below them. */
+static void list_candidates(struct editor *e, const struct completion *c) {
+    leave_line(e);
+    if (c->n > COMPLETE_ASK_OVER) {
+        char ask[80];
+        int n = snprintf(ask, sizeof(ask), "Display all %zu possibilities? (y or n)", c->n);
+        fr_put(ask, (size_t)n);
+        unsigned char k;
+        int yes = next_byte(e, &k) == 1 && (k == 'y' || k == 'Y');
+        fr_put("\r\n", 2);
+        if (!yes) {
+            e->cur = 0;
+            refresh(e, 1, 0);
+            return;
+        }
+    }
+    size_t width = 0;
+    for (size_t i = 0; i < c->n; ++i) {
+        size_t w = text_cells(c->items[i].name, strlen(c->items[i].name), 0) + c->items[i].dir;
+        if (w > width) width = w;
+    }
+    width += 2;
+    size_t per_row = e->cols / width ? e->cols / width : 1;
+    size_t rows = (c->n + per_row - 1) / per_row;
+    for (size_t r = 0; r < rows; ++r) {
+        for (size_t col = 0; col < per_row; ++col) {
+            size_t i = col * rows + r;
+            if (i >= c->n) break;
+            const char *name = c->items[i].name;
+            size_t w = text_cells(name, strlen(name), 1);
+            if (c->items[i].dir) {
+                fr_put("/", 1);
+                w++;
+            }
+            if (col + 1 < per_row && i + rows < c->n) {
+                for (; w < width; ++w) fr_put(" ", 1);
+            }
+        }
+        fr_put("\r\n", 2);
+    }
+    e->cur = 0;
+    refresh(e, 1, 0);
+}
+
+/* Tab: a single candidate is inserted whole, followed by '/' or a space;
+ * several extend the word to their common prefix, and when there is
+ * nothing to add a second Tab lists them. */
+static void tab_complete(struct editor *e) {
+    struct gapbuf *g = &e->g;
+    struct completion c;
+    int again = e->tab_again;
+    e->tab_again = 0;
+    if (complete_line(g->b, g->gs, &c) == 0) {
+        fr_put("\a", 1);
+        return;
+    }
+    const char *first = c.items[0].name;
+    const char *last = c.items[c.n - 1].name;
+    size_t common = 0;
+    while (first[common] && first[common] == last[common]) common++;
+    /* never stop inside a UTF-8 sequence */
+    while (common > 0 && c.n > 1 && (first[common] & 0xc0) == 0x80) common--;
+
+    if (c.n > 1 && common <= c.prefix_len) {
+        if (again) list_candidates(e, &c);
+        else fr_put("\a", 1);
+        e->tab_again = !again;
+        return;
+    }
+    char name[1024];
+    char text[2048 + 2];
+    if (common >= sizeof(name)) return;
+    memcpy(name, first, common);
+    name[common] = '\0';
+    size_t n = complete_escape(name, text, sizeof(text) - 1);
+    if (c.n == 1) text[n++] = c.items[0].dir ? '/' : ' ';
+    delete_range(e, c.start, g->gs, 0);
+    insert(e, text, n);
+}
+
+/* Ctrl-R incremental reverse search (bash-style). Each keystroke is one
+ * indexed history_search() call plus a single redraw of the search line.
+ * On return *match is the history index shown (or -1) and the return
+ * value says what to do with it:
+ *   1 - Enter: run the match
+ *   0 - any other key: put the match in the buffer and keep editing
+ *  -1 - Ctrl-G / Ctrl-C: leave the buffer as it was
+ */
+static int reverse_search(int *match) {
+    char query[256];
+    size_t qlen = 0;
+    int found = -1;     /* index of the match on display */
+    int failed = 0;
+
+    for (;;) {
+        const char *shown = found >= 0 ? history_get(found) : "";
+        fr_str(failed ? "\r(failed reverse-i-search)`" : "\r(reverse-i-search)`");
+        fr_put(query, qlen);
+        fr_str("': ");
+        fr_str(shown);
+        fr_str("\x1b[K");
+
+        unsigned char c;
+        if (next_byte(NULL, &c) <= 0 || c == 0x03 || c == 0x07) {
+            got_sigint = 0;
+            *match = -1;
+            return -1;
+        }
+        if (c == '\r' || c == '\n') {
+            *match = found;
+            return 1;
+        }
+        if (c == 0x12) {
+            /* Ctrl-R again: next older match */
+            int from = found >= 0 ? found - 1 : history_count_get() - 1;
+            int next = qlen ? history_search(query, from) : -1;
+            if (next >= 0) found = next;
+            failed = qlen && next < 0;
+        } else if (c == 0x7f || c == 0x08) {
+            if (qlen > 0) qlen--;
+            query[qlen] = '\0';
+            found = qlen ? history_search(query, history_count_get() - 1) : -1;
+            failed = qlen && found < 0;
+        } else if (c >= 0x20 && c < 0x7f) {
+            if (qlen + 1 < sizeof(query)) {
+                query[qlen++] = (char)c;
+                query[qlen] = '\0';
+                /* a longer query can still match the current entry */
+                int from = found >= 0 ? found : history_count_get() - 1;
+                int next = history_search(query, from);
+                if (next >= 0) found = next;
+                failed = next < 0;
+            }
+        } else {
+            if (c == 0x1b && read_escape() == KEY_PASTE) {
+                /* drop the pasted text rather than take it as keys */
+                size_t len;
+                free(read_paste(&len));
+            }
+            *match = found;
+            return 0;
+        }
+    }
+}
+
+/* Read one UTF-8 character starting with lead byte c and insert it */
+static void insert_char(struct editor *e, unsigned char c) {
+    char ch[4];
+    size_t n = 1;
+    ch[0] = (char)c;
+    size_t want = (c & 0xe0) == 0xc0 ? 2 : (c & 0xf0) == 0xe0 ? 3 : (c & 0xf8) == 0xf0 ? 4 : 1;
+    while (n < want && in_pos < in_len && (inbuf[in_pos] & 0xc0) == 0x80) {
+        ch[n++] = (char)inbuf[in_pos++];
+    }
+    /* a sequence split across reads */
+    while (n < want) {
+        unsigned char d;
+        if (next_byte(e, &d) != 1) break;
+        if ((d & 0xc0) != 0x80) {
+            in_pos--;
+            break;
+        }
+        ch[n++] = (char)d;
+    }
+    insert(e, ch, n);
+}
+
+/* Apply one key. Returns 1 (line done), 0 (EOF), -1 (cancelled), or 2 to
+ * keep editing. */
+static int handle_key(struct editor *e, unsigned char c) {
+    struct gapbuf *g = &e->g;
+    enum key k = KEY_NONE;
+
+    if (c != '\t') e->tab_again = 0;
+    switch (c) {
+        case '\r':
+        case '\n':
+            /* Enter: finish, leaving the cursor below the line */
+            leave_line(e);
+            return 1;
+        case '\t':
+            tab_complete(e);
+            return 2;
+        case 0x03: /* Ctrl-C: cancel line and whatever was typed after it */
+            in_pos = in_len;
+            fr_put("\n", 1);
+            return -1;
+        case 0x04: /* Ctrl-D */
+            if (gb_len(g) == 0) {
+                fr_put("\n", 1);
+                return 0;
+            }
+            k = KEY_DELETE;
+            break;
+        case 0x01: k = KEY_HOME; break;
+        case 0x05: k = KEY_END; break;
+        case 0x02: k = KEY_LEFT; break;
+        case 0x06: k = KEY_RIGHT; break;
+        case 0x10: k = KEY_UP; break;
+        case 0x0e: k = KEY_DOWN; break;
+        case 0x7f:
+        case 0x08: /* Backspace */
+            delete_range(e, char_before(g, g->gs), g->gs, 0);
+            return 2;
+        case 0x17: /* Ctrl-W */
+            delete_range(e, word_before(g, g->gs), g->gs, 1);
+            return 2;
+        case 0x15: /* Ctrl-U */
+            delete_range(e, 0, g->gs, 1);
+            return 2;
+        case 0x0b: /* Ctrl-K */
+            delete_range(e, g->gs, gb_len(g), 1);
+            return 2;
+        case 0x19: /* Ctrl-Y */
+            insert(e, killed, killed_len);
+            return 2;
+        case 0x0c: /* Ctrl-L */
+            fr_str("\x1b[H\x1b[2J");
+            e->cur = 0;
+            refresh(e, 1, 0);
+            return 2;
+        case 0x12: { /* Ctrl-R */
+            int match;
+            move_to(e, e->cur, 0);
+            fr_put("\r\x1b[J", 4);
+            int action = reverse_search(&match);
+            /* back to the normal prompt line */
+            fr_put("\r\x1b[K", 4);
+            e->cur = 0;
+            if (action >= 0 && match >= 0) load_history(e, match);
+            else refresh(e, 0, 0);
+            return action == 1 ? handle_key(e, '\r') : 2;
+        }
+        case 0x1b:
+            k = read_escape();
+            break;
+        default:
+            /* printable text; other control chars are ignored */
+            if (c >= 0x20 && c != 0x7f) {
+                if (c < 0x80) {
+                    /* take the whole run of typed/pasted ASCII at once */
+                    size_t start = in_pos - 1;
+                    while (in_pos < in_len && inbuf[in_pos] >= 0x20 && inbuf[in_pos] < 0x7f) in_pos++;
+                    insert(e, (const char *)inbuf + start, in_pos - start);
+                } else {
+                    insert_char(e, c);
+                }
+            }
+            return 2;
+    }
+
+    switch (k) {
+        case KEY_LEFT: cursor_to(e, char_before(g, g->gs)); break;
+        case KEY_RIGHT: cursor_to(e, char_after(g, g->gs)); break;
+        case KEY_WORD_LEFT: cursor_to(e, word_before(g, g->gs)); break;
+        case KEY_WORD_RIGHT: cursor_to(e, word_after(g, g->gs)); break;
+        case KEY_HOME: cursor_to(e, 0); break;
+        case KEY_END: cursor_to(e, gb_len(g)); break;
+        case KEY_DELETE: delete_range(e, g->gs, char_after(g, g->gs), 0); break;
+        case KEY_KILL_WORD_LEFT: delete_range(e, word_before(g, g->gs), g->gs, 1); break;
+        case KEY_KILL_WORD_RIGHT: delete_range(e, g->gs, word_after(g, g->gs), 1); break;
+        case KEY_UP:
+            /* previous history */
+            if (e->hist > 0) load_history(e, e->hist - 1);
+            break;
+        case KEY_DOWN:
+            /* next history (or clear) */
+            if (e->hist < history_count_get()) load_history(e, e->hist + 1);
+            break;
+        case KEY_PASTE: paste(e); break;
+        case KEY_NONE: break;
+    }
+    return 2;
+}
+
+static int edit(struct editor *e) {
+    fr_put(e->prompt, e->prompt_len);
+    const char *last = strrchr(e->prompt, '\n');
+    last = last ? last + 1 : e->prompt;
+    e->prompt_w = prompt_cells(last, e->prompt_len - (size_t)(last - e->prompt));
+    e->cur = e->prompt_w;
+
+    for (;;) {
+        unsigned char c;
+        int r = next_byte(e, &c);
+        if (r == 0) return 0;
+        if (r < 0) {
+            if (!got_sigint) return 0;
+            /* clear line and return interrupted */
+            got_sigint = 0;
+            fr_put("\n", 1);
+            return -1;
+        }
+        int rc = handle_key(e, c);
+        if (rc != 2) return rc;
+    }
+}
+
+static int read_fallback(char **out) {
+    static char *buf = NULL;
+    static size_t cap = 0;
+    ssize_t len = getline(&buf, &cap, stdin);
+    if (len < 0) return 0;
+    if (len && (buf[len-1] == '\n' || buf[len-1] == '\r')) buf[--len] = '\0';
+    *out = buf;
+    return 1;
+}
+
+int lineedit_read(const char *prompt, char **out) {
+    struct termios orig, raw;
+    if (tcgetattr(STDIN_FILENO, &orig) == -1) {
+        /* Fallback: use getline if tcgetattr not supported */
+        return read_fallback(out);
+    }
+    raw = orig;
+    raw.c_lflag &= ~(ECHO | ICANON);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    /* TCSADRAIN, not TCSAFLUSH: keys typed while the last command ran
+     * are input too */
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1) {
+        /* If we can't set, fallback to getline */
+        return read_fallback(out);
+    }
+
+    struct editor e;
+    struct winsize ws;
+    e.cols = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) ? ws.ws_col : 80;
+    gb_clear(&line);
+    e.g = line;
+    e.prompt = prompt;
+    e.prompt_len = strlen(prompt);
+    e.hist = history_count_get(); /* one past last */
+    e.tab_again = 0;
+
+    fr_str("\x1b[?2004h");  /* bracketed paste on */
+    int rc = edit(&e);
+    fr_str("\x1b[?2004l");
+    fr_flush();
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &orig);
+
+    line = e.g;
+    *out = gb_text(&line);
+    if (!*out) *out = "";
+    return rc;
+}
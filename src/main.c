@@ -1,7 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "shell.h"
+#include "expand.h"
+#include "script.h"
+#include "var.h"
 
 /* Build-time defines (provided by Meson) */
 #ifndef KSH_RELEASE
@@ -18,11 +22,49 @@
 #endif
 
 int main(int argc, char **argv) {
-    (void)argc;
-    (void)argv;
+    /* The variable table takes over the environment before anything reads it */
+    var_init();
+    expand_init();
 
-    /* Line-buffer stdout for interactive responsiveness */
-    setvbuf(stdout, NULL, _IOLBF, 0);
+    /* kzsh -c 'cmd' [name [args...]]: run the string and exit with its status */
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "kzsh: -c: option requires an argument\n");
+            return 2;
+        }
+        var_set("KSH_VERSION", KSH_RELEASE, VAR_EXPORT);
+        if (argc > 3) {
+            expand_arg0 = argv[3];
+            expand_params.v = argv + 4;
+            expand_params.n = argc - 4;
+        }
+        int status = script_run_string(argv[2], strlen(argv[2]));
+        fflush(stdout);
+        return status;
+    }
+
+    /* kzsh script.sh [args...]: run the file non-interactively and exit with its status */
+    if (argc > 1) {
+        var_set("KSH_VERSION", KSH_RELEASE, VAR_EXPORT);
+        expand_arg0 = argv[1];
+        expand_params.v = argv + 2;
+        expand_params.n = argc - 2;
+        int status = script_run_file(argv[1]);
+        fflush(stdout);
+        return status;
+    }
+
+    /* kzsh < script, producer | kzsh: no prompt, terminal setup or history */
+    if (!isatty(STDIN_FILENO)) {
+        var_set("KSH_VERSION", KSH_RELEASE, VAR_EXPORT);
+        int status = script_run_fd(STDIN_FILENO);
+        fflush(stdout);
+        return status;
+    }
+
+    /* Line-buffer stdout on a terminal for responsiveness; into a pipe or
+     * file it stays fully buffered (builtins mostly go through out.h) */
+    setvbuf(stdout, NULL, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, 0);
 
     /* Set KSH_VERSION environment variable for compatibility (shell_start will ensure)
      * and then start the shell frontend (banner and prompt handled there).
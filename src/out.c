@@ -0,0 +1,82 @@
+/*
+ * Buffered output for builtins (see out.h).
+ */
+
+#include "out.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "iocopy.h"
+
+void out_init(struct out *o, int fd) {
+    /* anything printed through stdio must come out first */
+    fflush(stdout);
+    o->fd = fd;
+    o->err = 0;
+    o->tty = -1;
+    o->len = 0;
+}
+
+struct out *out_open(int fd) {
+    struct out *o = malloc(sizeof(*o));
+    if (o) out_init(o, fd);
+    return o;
+}
+
+int out_close(struct out *o) {
+    int status = out_flush(o);
+    free(o);
+    return status;
+}
+
+int out_flush(struct out *o) {
+    if (o->len && !o->err && io_write_all(o->fd, o->buf, o->len) != 0) o->err = errno ? errno : EIO;
+    o->len = 0;
+    return o->err ? -1 : 0;
+}
+
+void out_write_slow(struct out *o, const void *p, size_t n) {
+    if (o->err) return;
+    if (o->len + n > OUT_BUFSZ) {
+        /* what is buffered and what does not fit, in one syscall */
+        struct iovec iov[2] = {
+            { o->buf, o->len },
+            { (void *)p, n },
+        };
+        if (io_writev_all(o->fd, iov, 2) != 0) o->err = errno ? errno : EIO;
+        o->len = 0;
+        return;
+    }
+    memcpy(o->buf + o->len, p, n);
+    o->len += n;
+    if (o->tty && memchr(p, '\n', n)) out_line(o);
+}
+
+void out_line(struct out *o) {
+    if (o->tty < 0) o->tty = isatty(o->fd);
+    if (o->tty) out_flush(o);
+}
+
+void out_num(struct out *o, unsigned long long v, int width, char pad) {
+    char tmp[32];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (width-- > n) out_putc(o, pad);
+    while (n) out_putc(o, tmp[--n]);
+}
+
+void out_quoted(struct out *o, const char *s) {
+    out_putc(o, '\'');
+    for (const char *q; (q = strchr(s, '\'')) != NULL; s = q + 1) {
+        out_write(o, s, (size_t)(q - s));
+        out_write(o, "'\\''", 4);
+    }
+    out_str(o, s);
+    out_putc(o, '\'');
+}
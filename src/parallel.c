@@ -0,0 +1,790 @@
+/*
+ * xargs and parallel: run a command over many inputs with a bounded pool
+ * of children.
+ *
+ * The pool is filled up to its limit before the shell waits at all, and
+ * each wakeup handles every child that finished. Children are tracked
+ * through pidfds in an epoll set next to their output pipes, so a wakeup
+ * costs O(events) however many are running; without pidfd support the
+ * pool falls back to poll() and a WNOHANG sweep. External commands start
+ * with posix_spawn (launch.c); builtins, functions and command lines run
+ * in a forked copy of the shell.
+ *
+ * With ordered output (parallel -k) each child writes into a pipe. The
+ * oldest unfinished command streams straight through; later ones are
+ * held back until it is their turn.
+ */
+
+#define _GNU_SOURCE
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#endif
+
+#include "arena.h"
+#include "cmdhash.h"
+#include "iocopy.h"
+#include "jobs.h"
+#include "launch.h"
+#include "script.h"
+#include "shell.h"
+#include "var.h"
+#include "vm.h"
+
+/* -P 0 / -j 0: "as many as possible" */
+#define POOL_UNLIMITED 1024
+
+/* xargs: bytes of arguments per command line, as GNU xargs defaults to */
+#define XARGS_MAX_CHARS (128 * 1024)
+
+/* ---- output buffers ---- */
+
+struct buf {
+    char *data;
+    size_t len, cap;
+};
+
+static void buf_add(struct buf *b, const char *s, size_t n) {
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n) cap *= 2;
+        char *grown = realloc(b->data, cap);
+        if (!grown) return;
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static void buf_flush(struct buf *b) {
+    if (b->len) io_write_all(STDOUT_FILENO, b->data, b->len);
+    b->len = 0;
+}
+
+/* ---- the pool ---- */
+
+struct task {
+    pid_t pid;                  /* 0 marks a free slot */
+    int pidfd;
+    int out;                    /* read end of its output pipe, -1 if none */
+    int exited;
+    int status;                 /* wait status */
+    unsigned long seq;          /* start order */
+    struct buf held;            /* output produced before its turn */
+};
+
+/* Output of a finished command still waiting for its turn */
+struct held {
+    unsigned long seq;
+    struct buf buf;
+    struct held *next;
+};
+
+struct pool {
+    struct task *tasks;
+    struct pollfd *pfds;
+    int *pslots;
+    int max, nrunning;
+    int ordered;
+    int epfd;                   /* -1: poll() and waitpid sweeps instead */
+    pid_t pgid;                 /* process group for the children, -1 ours */
+    unsigned long next_seq;     /* seq of the next command started */
+    unsigned long next_out;     /* seq whose output goes out next */
+    struct held *held;          /* sorted by seq */
+    const char *who;
+    void (*finished)(struct pool *p, const struct task *t);
+    int stop;                   /* start nothing more */
+    int interrupted;
+    int result;                 /* kept by the finished callback */
+};
+
+static int pool_init(struct pool *p, const char *who, int max, int ordered,
+                     void (*finished)(struct pool *, const struct task *)) {
+    memset(p, 0, sizeof(*p));
+    p->tasks = calloc((size_t)max, sizeof(*p->tasks));
+    p->pfds = calloc((size_t)max, sizeof(*p->pfds));
+    p->pslots = calloc((size_t)max, sizeof(*p->pslots));
+    if (!p->tasks || !p->pfds || !p->pslots) {
+        free(p->tasks);
+        free(p->pfds);
+        free(p->pslots);
+        fprintf(stderr, "%s: out of memory\n", who);
+        return -1;
+    }
+    for (int i = 0; i < max; ++i) {
+        p->tasks[i].pidfd = -1;
+        p->tasks[i].out = -1;
+    }
+    p->max = max;
+    p->ordered = ordered;
+    p->who = who;
+    p->finished = finished;
+    p->pgid = jobs_foreground();
+#ifdef __linux__
+    p->epfd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    p->epfd = -1;
+#endif
+    return 0;
+}
+
+static void pool_free(struct pool *p) {
+    if (p->epfd >= 0) close(p->epfd);
+    for (int i = 0; i < p->max; ++i) free(p->tasks[i].held.data);
+    while (p->held) {
+        struct held *h = p->held;
+        p->held = h->next;
+        free(h->buf.data);
+        free(h);
+    }
+    free(p->tasks);
+    free(p->pfds);
+    free(p->pslots);
+}
+
+static int open_pidfd(pid_t pid) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* Watch fd for slot; the low bit of the key tells pipes from pidfds */
+static int watch(struct pool *p, int fd, int slot, int is_pipe) {
+#ifdef __linux__
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)slot << 1) | (uint64_t)is_pipe;
+    return epoll_ctl(p->epfd, EPOLL_CTL_ADD, fd, &ev);
+#else
+    (void)p; (void)fd; (void)slot; (void)is_pipe;
+    return -1;
+#endif
+}
+
+/* Output that can go out now: finished commands next in line, then the
+ * running one whose turn it is, which writes straight through from here */
+static void advance(struct pool *p) {
+    while (p->held && p->held->seq == p->next_out) {
+        struct held *h = p->held;
+        p->held = h->next;
+        buf_flush(&h->buf);
+        free(h->buf.data);
+        free(h);
+        p->next_out++;
+    }
+    for (int i = 0; i < p->max; ++i) {
+        struct task *t = &p->tasks[i];
+        if (t->pid && t->seq == p->next_out) {
+            buf_flush(&t->held);
+            break;
+        }
+    }
+}
+
+static void task_done(struct pool *p, int slot) {
+    struct task *t = &p->tasks[slot];
+    t->pid = 0;
+    p->nrunning--;
+    p->finished(p, t);
+    if (!p->ordered) return;
+    if (t->seq != p->next_out) {
+        /* hold on to its output until the ones before it are through */
+        struct held *h = malloc(sizeof(*h));
+        if (!h) {
+            buf_flush(&t->held);
+            return;
+        }
+        h->seq = t->seq;
+        h->buf = t->held;
+        memset(&t->held, 0, sizeof(t->held));
+        struct held **pp = &p->held;
+        while (*pp && (*pp)->seq < h->seq) pp = &(*pp)->next;
+        h->next = *pp;
+        *pp = h;
+        return;
+    }
+    buf_flush(&t->held);
+    p->next_out++;
+    advance(p);
+}
+
+static void task_read(struct pool *p, int slot) {
+    struct task *t = &p->tasks[slot];
+    char chunk[64 * 1024];
+    ssize_t r = read(t->out, chunk, sizeof(chunk));
+    if (r < 0 && errno == EINTR) return;
+    if (r > 0) {
+        if (t->seq == p->next_out) io_write_all(STDOUT_FILENO, chunk, (size_t)r);
+        else buf_add(&t->held, chunk, (size_t)r);
+        return;
+    }
+    close(t->out);
+    t->out = -1;
+    if (t->exited) task_done(p, slot);
+}
+
+static void task_reap(struct pool *p, int slot) {
+    struct task *t = &p->tasks[slot];
+    if (!t->pid || t->exited) return;
+    int ws;
+    pid_t r = waitpid(t->pid, &ws, WNOHANG);
+    if (r == 0) return;
+    /* collected behind our back, status unknown */
+    if (r < 0 && !jobs_take_status(t->pid, &ws)) ws = 0;
+    t->exited = 1;
+    t->status = ws;
+    /* Ctrl-C went to the children rather than to the shell */
+    if (WIFSIGNALED(ws) && WTERMSIG(ws) == SIGINT) p->stop = p->interrupted = 1;
+    if (t->pidfd >= 0) {
+        close(t->pidfd);
+        t->pidfd = -1;
+    }
+    if (t->out < 0) task_done(p, slot);
+}
+
+/* pidfds are not available: stay on poll() and sweeps from now on */
+static void pool_fallback(struct pool *p) {
+    if (p->epfd >= 0) close(p->epfd);
+    p->epfd = -1;
+}
+
+/* Wait for something to happen and handle all of it */
+static void pool_step(struct pool *p) {
+#ifdef __linux__
+    if (p->epfd >= 0) {
+        struct epoll_event ev[64];
+        int n = epoll_wait(p->epfd, ev, 64, -1);
+        for (int i = 0; i < n; ++i) {
+            int slot = (int)(ev[i].data.u64 >> 1);
+            if (!(ev[i].data.u64 & 1)) task_reap(p, slot);
+            else if (p->tasks[slot].out >= 0) task_read(p, slot);
+        }
+        return;
+    }
+#endif
+    int n = 0;
+    for (int i = 0; i < p->max; ++i) {
+        if (p->tasks[i].pid && p->tasks[i].out >= 0) {
+            p->pfds[n].fd = p->tasks[i].out;
+            p->pfds[n].events = POLLIN;
+            p->pslots[n++] = i;
+        }
+    }
+    if (poll(p->pfds, (nfds_t)n, 1) > 0) {
+        for (int i = 0; i < n; ++i) {
+            if (p->pfds[i].revents) task_read(p, p->pslots[i]);
+        }
+    }
+    for (int i = 0; i < p->max; ++i) task_reap(p, i);
+}
+
+/* Block until fewer than limit commands run. Returns -1 once the pool
+ * is stopping (an error, or Ctrl-C). */
+static int pool_wait(struct pool *p, int limit) {
+    while (p->nrunning >= limit && p->nrunning > 0) {
+        pool_step(p);
+        if (got_sigint) p->stop = p->interrupted = 1;
+    }
+    return p->stop ? -1 : 0;
+}
+
+/* Spawn failures still count as a finished command */
+static void pool_failed(struct pool *p, int exit_status) {
+    struct task t;
+    memset(&t, 0, sizeof(t));
+    t.status = exit_status << 8;
+    p->finished(p, &t);
+}
+
+/* Start argv, or when argv is NULL the command line script, in a free
+ * slot. Its stdin is /dev/null: the pool's own input is the shell's. */
+static void pool_start(struct pool *p, char **argv, const char *script) {
+    int slot = 0;
+    while (p->tasks[slot].pid) slot++;
+    struct task *t = &p->tasks[slot];
+    int fds[2] = { -1, -1 };
+    if (p->ordered && pipe2(fds, O_CLOEXEC) != 0) {
+        perror("kzsh: pipe");
+        pool_failed(p, 1);
+        return;
+    }
+    fflush(stdout);
+    const struct function *fn = argv ? vm_function(argv[0]) : NULL;
+    const struct builtin *b = argv && !fn ? builtin_lookup(argv[0]) : NULL;
+    pid_t pid;
+    if (argv && !fn && !b) {
+        const char *path = cmdhash_lookup(argv[0]);
+        int err = ENOENT;
+        pid = -1;
+        if (path) {
+            struct launch l;
+            launch_init(&l);
+            launch_open(&l, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+            if (fds[1] >= 0) launch_dup2(&l, fds[1], STDOUT_FILENO);
+            l.pgid = p->pgid;
+            pid = launch_external(path, argv, var_envp(), &l);
+            err = errno;
+            if (pid < 0 && p->pgid > 0 && (err == EPERM || err == ESRCH)) {
+                /* the pipeline's group is gone */
+                p->pgid = l.pgid = -1;
+                pid = launch_external(path, argv, var_envp(), &l);
+                err = errno;
+            }
+        }
+        if (pid < 0) {
+            if (!path) fprintf(stderr, "kzsh: %s: command not found\n", argv[0]);
+            else fprintf(stderr, "kzsh: %s: %s\n", argv[0], strerror(err));
+            pool_failed(p, err == ENOENT ? 127 : 126);
+        }
+    } else {
+        pid = fork();
+        if (pid > 0 && p->pgid > 0) setpgid(pid, p->pgid);
+        if (pid == 0) {
+            if (p->pgid > 0) setpgid(0, p->pgid);
+            launch_reset_signals();
+            jobs_forked();
+            int fd = open("/dev/null", O_RDONLY);
+            if (fd > STDIN_FILENO) {
+                dup2(fd, STDIN_FILENO);
+                close(fd);
+            }
+            if (fds[1] >= 0) dup2(fds[1], STDOUT_FILENO);
+            int argc = 0;
+            while (argv && argv[argc]) argc++;
+            int status;
+            if (fn) {
+                struct arena a;
+                arena_init(&a, ARENA_DEFAULT_CHUNK);
+                status = vm_call(&a, fn, argc, argv);
+            } else if (b) {
+                status = b->fn(argc, argv);
+            } else {
+                status = script_run_string(script, strlen(script));
+            }
+            fflush(stdout);
+            _exit(status & 0xff);
+        }
+        if (pid < 0) {
+            perror("kzsh: fork");
+            pool_failed(p, 1);
+        }
+    }
+    if (fds[1] >= 0) close(fds[1]);
+    if (pid < 0) {
+        if (fds[0] >= 0) close(fds[0]);
+        return;
+    }
+    t->pid = pid;
+    t->exited = 0;
+    t->out = fds[0];
+    t->seq = p->next_seq++;
+    p->nrunning++;
+    if (p->epfd >= 0) {
+        t->pidfd = open_pidfd(pid);
+        if (t->pidfd < 0 || watch(p, t->pidfd, slot, 0) != 0 ||
+            (t->out >= 0 && watch(p, t->out, slot, 1) != 0)) {
+            pool_fallback(p);
+        }
+    }
+}
+
+static int pool_size(const char *who, const char *arg) {
+    char *end;
+    long n = strtol(arg, &end, 10);
+    if (*end || end == arg || n < 0) {
+        fprintf(stderr, "%s: %s: invalid number of jobs\n", who, arg);
+        return -1;
+    }
+    return n == 0 || n > POOL_UNLIMITED ? POOL_UNLIMITED : (int)n;
+}
+
+static int nproc(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/* ---- input ---- */
+
+struct input {
+    int fd;
+    char *buf;
+    size_t len, pos, cap;
+    int eof;
+};
+
+/* Next record ending in delim (or at end of input), NUL-terminated in
+ * place. Valid until the next call; NULL at the end. */
+static char *input_record(struct input *in, char delim, size_t *lenp) {
+    for (;;) {
+        char *start = in->buf + in->pos;
+        char *e = in->len > in->pos ? memchr(start, delim, in->len - in->pos) : NULL;
+        if (e || (in->eof && in->pos < in->len)) {
+            if (!e) e = in->buf + in->len;
+            *e = '\0';
+            *lenp = (size_t)(e - start);
+            in->pos = (size_t)(e - in->buf) + (e < in->buf + in->len);
+            return start;
+        }
+        if (in->eof) return NULL;
+        if (in->pos) {
+            memmove(in->buf, start, in->len - in->pos);
+            in->len -= in->pos;
+            in->pos = 0;
+        }
+        if (in->len + 1 >= in->cap) {
+            size_t cap = in->cap ? in->cap * 2 : 64 * 1024;
+            char *grown = realloc(in->buf, cap);
+            if (!grown) {
+                in->eof = 1;
+                continue;
+            }
+            in->buf = grown;
+            in->cap = cap;
+        }
+        ssize_t r = read(in->fd, in->buf + in->len, in->cap - in->len - 1);
+        if (r < 0 && errno == EINTR && !got_sigint) continue;
+        if (r <= 0) in->eof = 1;
+        else in->len += (size_t)r;
+    }
+}
+
+/* ---- xargs ---- */
+
+struct xargs {
+    struct input in;
+    char delim;                 /* -0: items end in NUL, no quoting */
+    int lines;                  /* -I: one item per line */
+    char *line;                 /* rest of the current line (default mode) */
+    int error;
+};
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+/* Next item, malloc'd: by default blank-separated with '...', "..." and
+ * backslash quoting, one line at a time. NULL at the end or on error. */
+static char *xargs_item(struct xargs *x) {
+    size_t len;
+    if (x->delim == '\0' || x->lines) {
+        for (;;) {
+            char *rec = input_record(&x->in, x->delim, &len);
+            if (!rec) return NULL;
+            if (x->lines) {
+                while (is_blank(*rec)) rec++;
+                if (!*rec) continue;
+            }
+            return strdup(rec);
+        }
+    }
+    for (;;) {
+        while (x->line && is_blank(*x->line)) x->line++;
+        if (x->line && *x->line) break;
+        x->line = input_record(&x->in, '\n', &len);
+        if (!x->line) return NULL;
+    }
+    char *s = x->line;
+    char *item = malloc(strlen(s) + 1);
+    if (!item) return NULL;
+    size_t o = 0;
+    while (*s && !is_blank(*s)) {
+        if (*s == '\\' && s[1]) {
+            item[o++] = s[1];
+            s += 2;
+        } else if (*s == '\'' || *s == '"') {
+            char q = *s++;
+            while (*s && *s != q) item[o++] = *s++;
+            if (!*s) {
+                fprintf(stderr, "xargs: unmatched %s quote; by default quotes are special to "
+                        "xargs unless you use the -0 option\n", q == '\'' ? "single" : "double");
+                free(item);
+                x->error = 1;
+                return NULL;
+            }
+            s++;
+        } else {
+            item[o++] = *s++;
+        }
+    }
+    item[o] = '\0';
+    x->line = s;
+    return item;
+}
+
+/* Exit statuses as GNU xargs reports them; the worst one wins */
+static void xargs_finished(struct pool *p, const struct task *t) {
+    int code = 0;
+    int ws = t->status;
+    if (WIFSIGNALED(ws)) {
+        fprintf(stderr, "xargs: %s: terminated by signal %d\n", p->who, WTERMSIG(ws));
+        code = 125;
+    } else if (WEXITSTATUS(ws) == 255) {
+        fprintf(stderr, "xargs: %s: exited with status 255; aborting\n", p->who);
+        code = 124;
+    } else if (WEXITSTATUS(ws) == 126 || WEXITSTATUS(ws) == 127) {
+        code = WEXITSTATUS(ws);
+    } else if (WEXITSTATUS(ws)) {
+        code = 123;
+    }
+    if (code > 123) p->stop = 1;
+    if (code > p->result) p->result = code;
+}
+
+/* arg with every occurrence of repl replaced by item */
+static char *replace_all(const char *arg, const char *repl, const char *item) {
+    size_t rlen = strlen(repl), ilen = strlen(item), n = 0;
+    for (const char *s = strstr(arg, repl); s && rlen; s = strstr(s + rlen, repl)) n++;
+    char *out = malloc(strlen(arg) + n * ilen + 1);
+    if (!out) return NULL;
+    char *o = out;
+    const char *s = arg;
+    for (const char *m = n ? strstr(s, repl) : NULL; m; m = strstr(s, repl)) {
+        memcpy(o, s, (size_t)(m - s));
+        o += m - s;
+        memcpy(o, item, ilen);
+        o += ilen;
+        s = m + rlen;
+    }
+    strcpy(o, s);
+    return out;
+}
+
+static void trace(char **argv) {
+    for (int i = 0; argv[i]; ++i) fprintf(stderr, "%s%s", i ? " " : "", argv[i]);
+    fputc('\n', stderr);
+}
+
+static void free_args(char **v, int from, int to) {
+    for (int i = from; i < to; ++i) free(v[i]);
+}
+
+int builtin_xargs(int argc, char **argv) {
+    struct xargs x;
+    memset(&x, 0, sizeof(x));
+    x.in.fd = STDIN_FILENO;
+    x.delim = '\n';
+    long max_args = 0;
+    int procs = 1, no_empty = 0, verbose = 0;
+    const char *repl = NULL;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        char opt = argv[i][1];
+        const char *val = NULL;
+        if (opt == 'n' || opt == 'P' || opt == 'I') {
+            val = argv[i][2] ? argv[i] + 2 : i + 1 < argc ? argv[++i] : NULL;
+            if (!val) {
+                fprintf(stderr, "xargs: option requires an argument -- '%c'\n", opt);
+                return 1;
+            }
+        } else if (argv[i][2]) {
+            opt = '?';
+        }
+        switch (opt) {
+            case '0': x.delim = '\0'; break;
+            case 'r': no_empty = 1; break;
+            case 't': verbose = 1; break;
+            case 'I': repl = val; x.lines = 1; break;
+            case 'n':
+                max_args = strtol(val, NULL, 10);
+                if (max_args < 1) {
+                    fprintf(stderr, "xargs: value %s for -n option should be >= 1\n", val);
+                    return 1;
+                }
+                break;
+            case 'P':
+                if ((procs = pool_size("xargs", val)) < 0) return 1;
+                break;
+            default:
+                fprintf(stderr, "xargs: invalid option -- '%s'\n", argv[i] + 1);
+                fprintf(stderr, "usage: xargs [-0rt] [-n max-args] [-P max-procs] [-I replace-str] "
+                        "[command [initial-arguments]]\n");
+                return 1;
+        }
+    }
+    if (repl) x.lines = x.delim != '\0';
+
+    static char *default_cmd[] = { "echo", NULL };
+    char **cmd = i < argc ? argv + i : default_cmd;
+    int ncmd = i < argc ? argc - i : 1;
+    size_t base = 0;
+    for (int k = 0; k < ncmd; ++k) base += strlen(cmd[k]) + 1;
+
+    struct pool p;
+    if (pool_init(&p, "xargs", procs, 0, xargs_finished) != 0) return 1;
+    p.who = cmd[0];
+    int cap = ncmd + 64;
+    char **args = malloc(sizeof(char *) * (size_t)(cap + 1));
+    char *pending = NULL;       /* an item that did not fit the last command */
+    int started = 0;
+    while (args && !p.stop) {
+        int n = ncmd;
+        if (repl) {
+            char *item = xargs_item(&x);
+            if (!item) break;
+            for (int k = 0; k < ncmd; ++k) args[k] = replace_all(cmd[k], repl, item);
+            free(item);
+        } else {
+            memcpy(args, cmd, sizeof(char *) * (size_t)ncmd);
+            size_t size = base;
+            for (;;) {
+                if (max_args && n - ncmd >= max_args) break;
+                char *item = pending ? pending : xargs_item(&x);
+                pending = NULL;
+                if (!item) break;
+                if (n > ncmd && size + strlen(item) + 1 > XARGS_MAX_CHARS) {
+                    pending = item;
+                    break;
+                }
+                if (n == cap) {
+                    cap *= 2;
+                    char **grown = realloc(args, sizeof(char *) * (size_t)(cap + 1));
+                    if (!grown) {
+                        free(item);
+                        break;
+                    }
+                    args = grown;
+                }
+                size += strlen(item) + 1;
+                args[n++] = item;
+            }
+            if (x.error) {
+                free_args(args, ncmd, n);
+                break;
+            }
+            /* no input at all still runs the command once, unless -r */
+            if (n == ncmd && (started || no_empty)) break;
+        }
+        args[n] = NULL;
+        if (pool_wait(&p, p.max) == 0) {
+            if (verbose) trace(args);
+            pool_start(&p, args, NULL);
+            started = 1;
+        }
+        free_args(args, repl ? 0 : ncmd, repl ? ncmd : n);
+    }
+    free(pending);
+    free(args);
+    pool_wait(&p, 1);
+    int status = p.interrupted ? 130 : x.error && !p.result ? 1 : p.result;
+    pool_free(&p);
+    free(x.in.buf);
+    return status;
+}
+
+/* ---- parallel ---- */
+
+static void parallel_finished(struct pool *p, const struct task *t) {
+    if (t->status != 0) p->result++;
+}
+
+/* The command for one item: {} replaced by it, or it appended when no
+ * argument mentions {} */
+static char **parallel_args(char **cmd, int ncmd, const char *item) {
+    char **v = malloc(sizeof(char *) * (size_t)(ncmd + 2));
+    if (!v) return NULL;
+    int n = 0, used = 0;
+    for (int k = 0; k < ncmd; ++k) {
+        if (strstr(cmd[k], "{}")) {
+            v[n++] = replace_all(cmd[k], "{}", item);
+            used = 1;
+        } else {
+            v[n++] = strdup(cmd[k]);
+        }
+    }
+    if (!used) v[n++] = strdup(item);
+    v[n] = NULL;
+    return v;
+}
+
+int builtin_parallel(int argc, char **argv) {
+    int procs = nproc(), ordered = 0;
+    char delim = '\n';
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "-k") == 0) {
+            ordered = 1;
+        } else if (strcmp(argv[i], "-0") == 0) {
+            delim = '\0';
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char *val = argv[i][2] ? argv[i] + 2 : i + 1 < argc ? argv[++i] : NULL;
+            if (!val) {
+                fprintf(stderr, "parallel: option requires an argument -- 'j'\n");
+                return 1;
+            }
+            if ((procs = pool_size("parallel", val)) < 0) return 1;
+        } else {
+            fprintf(stderr, "parallel: invalid option -- '%s'\n", argv[i] + 1);
+            fprintf(stderr, "usage: parallel [-k0] [-j jobs] [command [args...]] [::: items...]\n");
+            return 1;
+        }
+    }
+    char **cmd = argv + i;
+    int ncmd = 0;
+    while (i + ncmd < argc && strcmp(argv[i + ncmd], ":::") != 0) ncmd++;
+    int from_args = i + ncmd < argc;
+    int next_arg = i + ncmd + 1;
+    int line = ncmd == 1 && strpbrk(cmd[0], " \t;|&$<>()") != NULL;
+
+    struct pool p;
+    if (pool_init(&p, "parallel", procs, ordered, parallel_finished) != 0) return 1;
+    struct input in = { .fd = STDIN_FILENO };
+    for (;;) {
+        size_t len;
+        const char *item = from_args ? (next_arg < argc ? argv[next_arg++] : NULL)
+                                     : input_record(&in, delim, &len);
+        if (!item || pool_wait(&p, p.max) != 0) break;
+        if (!ncmd) {
+            /* each item is a command line of its own */
+            pool_start(&p, NULL, item);
+            continue;
+        }
+        char **args = parallel_args(cmd, ncmd, item);
+        if (!args) break;
+        if (line) {
+            /* a quoted command line: the item goes in before the shell
+             * sees it, as in GNU parallel */
+            if (args[1]) {
+                char *joined = malloc(strlen(args[0]) + strlen(args[1]) + 2);
+                if (joined) sprintf(joined, "%s %s", args[0], args[1]);
+                free(args[0]);
+                args[0] = joined;
+            }
+            if (args[0]) pool_start(&p, NULL, args[0]);
+        } else {
+            pool_start(&p, args, NULL);
+        }
+        for (int k = 0; k < ncmd + 1 && args[k]; ++k) free(args[k]);
+        free(args);
+    }
+    pool_wait(&p, 1);
+    /* like GNU parallel: the number of failed commands, at most 101 */
+    int status = p.interrupted ? 130 : p.result > 101 ? 101 : p.result;
+    pool_free(&p);
+    free(in.buf);
+    return status;
+}
@@ -0,0 +1,699 @@
+/*
+ * Recursive-descent parser producing the kzsh AST.
+ *
+ *   complete_command : and_or ((';' | '&') and_or)* [';' | '&']
+ *   and_or           : pipeline (('&&' | '||') linebreak pipeline)*
+ *   pipeline         : ['!'] command ('|' linebreak command)*
+ *   command          : compound_command redirection*
+ *                    | name '(' ')' linebreak compound_command
+ *                    | 'function' name ['(' ')'] linebreak compound_command
+ *                    | (assignment | redirection)* (word | redirection)*
+ *   compound_command : '{' list '}' | '(' list ')'
+ *                    | 'if' list 'then' list ('elif' list 'then' list)* ['else' list] 'fi'
+ *                    | ('while' | 'until') list 'do' list 'done'
+ *                    | 'for' name [linebreak 'in' word* (';' | newline)] linebreak
+ *                      'do' list 'done'
+ *                    | 'case' word linebreak 'in' linebreak
+ *                      (['('] word ('|' word)* ')' [list] [';;' linebreak])* 'esac'
+ *   list             : linebreak and_or ((';' | '&' | newline) linebreak and_or)* [separator]
+ *
+ * Reserved words are only recognised unquoted and where a command name
+ * could start; anywhere else they are ordinary words. A list ends at the
+ * reserved word, ')' or ';;' that closes the construct it is part of.
+ *
+ * All nodes are allocated from the caller's arena; words are views into
+ * the source text, which must outlive the AST (see node_copy).
+ */
+
+#include "parser.h"
+#include <stdio.h>
+#include <string.h>
+
+#define PIPELINE_INLINE 8
+
+static struct token *peek(struct parser *p) {
+    if (!p->have_tok) {
+        p->tok = lexer_next(&p->lx);
+        p->have_tok = 1;
+    }
+    return &p->tok;
+}
+
+static struct token next(struct parser *p) {
+    struct token t = *peek(p);
+    p->have_tok = 0;
+    return t;
+}
+
+static void set_error(struct parser *p, const char *msg, int line) {
+    if (p->err.msg) return;
+    p->err.msg = msg;
+    p->err.line = line;
+}
+
+static const char *token_text(enum token_type t) {
+    switch (t) {
+        case TOK_EOF: return "newline";
+        case TOK_NEWLINE: return "newline";
+        case TOK_SEMI: return ";";
+        case TOK_DSEMI: return ";;";
+        case TOK_AMP: return "&";
+        case TOK_PIPE: return "|";
+        case TOK_AND_IF: return "&&";
+        case TOK_OR_IF: return "||";
+        case TOK_LPAREN: return "(";
+        case TOK_RPAREN: return ")";
+        case TOK_LESS: return "<";
+        case TOK_GREAT: return ">";
+        case TOK_DGREAT: return ">>";
+        case TOK_LESSAND: return "<&";
+        case TOK_GREATAND: return ">&";
+        case TOK_LESSGREAT: return "<>";
+        case TOK_CLOBBER: return ">|";
+        case TOK_DLESS: return "<<";
+        case TOK_DLESSDASH: return "<<-";
+        case TOK_TLESS: return "<<<";
+        default: return "word";
+    }
+}
+
+static void unexpected(struct parser *p, const struct token *t) {
+    static char msg[96];
+    if (t->type == TOK_ERROR) {
+        p->err.incomplete = p->lx.incomplete;
+        set_error(p, p->lx.error, t->line);
+        return;
+    }
+    if (t->type == TOK_EOF) p->err.incomplete = 1;
+    if (t->type == TOK_WORD) {
+        int n = t->len > 32 ? 32 : (int)t->len;
+        snprintf(msg, sizeof(msg), "syntax error near unexpected token `%.*s'", n, t->start);
+    } else {
+        snprintf(msg, sizeof(msg), "syntax error near unexpected token `%s'", token_text(t->type));
+    }
+    set_error(p, msg, t->line);
+}
+
+/* An unquoted word spelled exactly like the reserved word w */
+static int is_reserved(const struct token *t, const char *w) {
+    size_t n = strlen(w);
+    return t->type == TOK_WORD && !t->flags && t->len == n && memcmp(t->start, w, n) == 0;
+}
+
+/* Reserved words that close a construct, so they end the list before them */
+static int is_terminator(const struct token *t) {
+    static const char *const words[] = {"then", "elif", "else", "fi", "do", "done", "esac", "}"};
+    if (t->type != TOK_WORD || t->flags) return 0;
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i) {
+        if (is_reserved(t, words[i])) return 1;
+    }
+    return 0;
+}
+
+/* A word that can name a variable or a function */
+static int is_name(const struct token *t) {
+    if (t->type != TOK_WORD || t->flags || t->len == 0) return 0;
+    for (size_t i = 0; i < t->len; ++i) {
+        char c = t->start[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (i > 0 && c >= '0' && c <= '9'))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int is_redir_op(enum token_type t) {
+    return t >= TOK_LESS && t <= TOK_TLESS;
+}
+
+static struct word *new_word(struct parser *p, const struct token *t) {
+    struct word *w = arena_alloc(p->arena, sizeof(*w));
+    w->text = t->start;
+    w->len = t->len;
+    w->flags = t->flags;
+    w->next = NULL;
+    return w;
+}
+
+static struct node *new_node(struct parser *p, enum node_type type, int line) {
+    struct node *n = arena_calloc(p->arena, sizeof(*n));
+    n->type = type;
+    n->line = line;
+    return n;
+}
+
+/* Skip newlines (allowed after |, && and ||) */
+static void linebreak(struct parser *p) {
+    while (peek(p)->type == TOK_NEWLINE) next(p);
+}
+
+static struct redir *parse_redirect(struct parser *p) {
+    int fd = -1;
+    struct token t = next(p);
+    if (t.type == TOK_IO_NUMBER) {
+        fd = 0;
+        for (size_t i = 0; i < t.len; ++i) fd = fd * 10 + (t.start[i] - '0');
+        t = next(p);
+    }
+    struct redir *r = arena_calloc(p->arena, sizeof(*r));
+    r->fd = fd;
+    switch (t.type) {
+        case TOK_LESS: r->type = REDIR_IN; break;
+        case TOK_GREAT: r->type = REDIR_OUT; break;
+        case TOK_DGREAT: r->type = REDIR_APPEND; break;
+        case TOK_CLOBBER: r->type = REDIR_CLOBBER; break;
+        case TOK_LESSGREAT: r->type = REDIR_RDWR; break;
+        case TOK_LESSAND: r->type = REDIR_DUPIN; break;
+        case TOK_GREATAND: r->type = REDIR_DUPOUT; break;
+        case TOK_DLESS: r->type = REDIR_HEREDOC; break;
+        case TOK_DLESSDASH: r->type = REDIR_HEREDOC; r->strip_tabs = 1; break;
+        case TOK_TLESS: r->type = REDIR_HERESTR; break;
+        default:
+            unexpected(p, &t);
+            return NULL;
+    }
+    struct token *w = peek(p);
+    if (w->type != TOK_WORD) {
+        unexpected(p, w);
+        return NULL;
+    }
+    struct token wt = next(p);
+    r->target = new_word(p, &wt);
+    if (r->type == REDIR_HEREDOC) {
+        if (p->lx.nheredocs >= (int)(sizeof(p->lx.heredocs) / sizeof(p->lx.heredocs[0]))) {
+            set_error(p, "too many pending here-documents", wt.line);
+            return NULL;
+        }
+        p->lx.heredocs[p->lx.nheredocs++] = r;
+    }
+    return r;
+}
+
+static struct node *parse_list(struct parser *p);
+static struct node *parse_command(struct parser *p);
+
+/* A list that must not be empty, as in every construct except a case arm */
+static struct node *expect_list(struct parser *p) {
+    struct node *n = parse_list(p);
+    if (!n && !p->err.msg) unexpected(p, peek(p));
+    return n;
+}
+
+static int expect_reserved(struct parser *p, const char *w) {
+    if (!is_reserved(peek(p), w)) {
+        unexpected(p, peek(p));
+        return -1;
+    }
+    next(p);
+    return 0;
+}
+
+static int expect_token(struct parser *p, enum token_type type) {
+    if (peek(p)->type != type) {
+        unexpected(p, peek(p));
+        return -1;
+    }
+    next(p);
+    return 0;
+}
+
+/* 'do' list 'done' */
+static struct node *parse_do_group(struct parser *p) {
+    if (expect_reserved(p, "do") != 0) return NULL;
+    struct node *body = expect_list(p);
+    if (!body || expect_reserved(p, "done") != 0) return NULL;
+    return body;
+}
+
+/* After 'if' or 'elif': an elif chain nests, and the innermost if takes the 'fi' */
+static struct node *parse_if(struct parser *p, int line) {
+    struct node *n = new_node(p, NODE_IF, line);
+    if (!(n->u.ctl.cond = expect_list(p))) return NULL;
+    if (expect_reserved(p, "then") != 0) return NULL;
+    if (!(n->u.ctl.body = expect_list(p))) return NULL;
+    struct token *t = peek(p);
+    if (is_reserved(t, "elif")) {
+        int elif_line = next(p).line;
+        n->u.ctl.else_part = parse_if(p, elif_line);
+        return n->u.ctl.else_part ? n : NULL;
+    }
+    if (is_reserved(t, "else")) {
+        next(p);
+        if (!(n->u.ctl.else_part = expect_list(p))) return NULL;
+    }
+    return expect_reserved(p, "fi") == 0 ? n : NULL;
+}
+
+static struct node *parse_while(struct parser *p, enum node_type type, int line) {
+    struct node *n = new_node(p, type, line);
+    if (!(n->u.ctl.cond = expect_list(p))) return NULL;
+    if (!(n->u.ctl.body = parse_do_group(p))) return NULL;
+    return n;
+}
+
+static struct node *parse_for(struct parser *p, int line) {
+    struct node *n = new_node(p, NODE_FOR, line);
+    if (!is_name(peek(p))) {
+        unexpected(p, peek(p));
+        return NULL;
+    }
+    struct token name = next(p);
+    n->u.loop.var = new_word(p, &name);
+    linebreak(p);
+    if (is_reserved(peek(p), "in")) {
+        next(p);
+        n->u.loop.has_in = 1;
+        struct word **tail = &n->u.loop.words;
+        while (peek(p)->type == TOK_WORD) {
+            struct token wt = next(p);
+            *tail = new_word(p, &wt);
+            tail = &(*tail)->next;
+        }
+        enum token_type t = peek(p)->type;
+        if (t != TOK_SEMI && t != TOK_NEWLINE) {
+            unexpected(p, peek(p));
+            return NULL;
+        }
+        next(p);
+    } else if (peek(p)->type == TOK_SEMI) {
+        next(p);
+    }
+    linebreak(p);
+    if (!(n->u.loop.body = parse_do_group(p))) return NULL;
+    return n;
+}
+
+static struct node *parse_case(struct parser *p, int line) {
+    struct node *n = new_node(p, NODE_CASE, line);
+    if (peek(p)->type != TOK_WORD) {
+        unexpected(p, peek(p));
+        return NULL;
+    }
+    struct token subject = next(p);
+    n->u.cas.subject = new_word(p, &subject);
+    linebreak(p);
+    if (expect_reserved(p, "in") != 0) return NULL;
+    linebreak(p);
+    struct case_item **tail = &n->u.cas.items;
+    while (!is_reserved(peek(p), "esac")) {
+        struct case_item *item = arena_calloc(p->arena, sizeof(*item));
+        if (peek(p)->type == TOK_LPAREN) next(p);
+        struct word **ptail = &item->patterns;
+        for (;;) {
+            if (peek(p)->type != TOK_WORD) {
+                unexpected(p, peek(p));
+                return NULL;
+            }
+            struct token wt = next(p);
+            *ptail = new_word(p, &wt);
+            ptail = &(*ptail)->next;
+            if (peek(p)->type != TOK_PIPE) break;
+            next(p);
+        }
+        if (expect_token(p, TOK_RPAREN) != 0) return NULL;
+        item->body = parse_list(p);
+        if (p->err.msg) return NULL;
+        *tail = item;
+        tail = &item->next;
+        if (peek(p)->type == TOK_DSEMI) {
+            next(p);
+            linebreak(p);
+        } else if (!is_reserved(peek(p), "esac")) {
+            unexpected(p, peek(p));
+            return NULL;
+        }
+    }
+    next(p);
+    return n;
+}
+
+/* The part of a function definition after the name (and its parentheses) */
+static struct node *parse_function_body(struct parser *p, struct word *name, int line) {
+    linebreak(p);
+    struct node *body = parse_command(p);
+    if (!body) return NULL;
+    if (body->type == NODE_CMD) {
+        set_error(p, "syntax error: function body must be a compound command", line);
+        return NULL;
+    }
+    struct node *n = new_node(p, NODE_FUNCDEF, line);
+    n->u.func.name = name;
+    n->u.func.body = body;
+    return n;
+}
+
+/* 'function' name ['(' ')'] compound_command */
+static struct node *parse_function(struct parser *p, int line) {
+    struct token *t = peek(p);
+    if (t->type != TOK_WORD || t->flags) {
+        unexpected(p, t);
+        return NULL;
+    }
+    struct token name = next(p);
+    if (peek(p)->type == TOK_LPAREN) {
+        next(p);
+        if (expect_token(p, TOK_RPAREN) != 0) return NULL;
+    }
+    return parse_function_body(p, new_word(p, &name), line);
+}
+
+/* A compound command and any redirections after it; NULL without an
+ * error when the next token does not start one */
+static struct node *parse_compound(struct parser *p) {
+    struct token *t = peek(p);
+    int line = t->line;
+    struct node *n;
+    if (t->type == TOK_LPAREN) {
+        next(p);
+        n = new_node(p, NODE_SUBSHELL, line);
+        if (!(n->u.group.body = expect_list(p))) return NULL;
+        if (expect_token(p, TOK_RPAREN) != 0) return NULL;
+    } else if (is_reserved(t, "{")) {
+        next(p);
+        n = new_node(p, NODE_GROUP, line);
+        if (!(n->u.group.body = expect_list(p))) return NULL;
+        if (expect_reserved(p, "}") != 0) return NULL;
+    } else if (is_reserved(t, "if")) {
+        next(p);
+        n = parse_if(p, line);
+    } else if (is_reserved(t, "while") || is_reserved(t, "until")) {
+        enum node_type type = t->start[0] == 'w' ? NODE_WHILE : NODE_UNTIL;
+        next(p);
+        n = parse_while(p, type, line);
+    } else if (is_reserved(t, "for")) {
+        next(p);
+        n = parse_for(p, line);
+    } else if (is_reserved(t, "case")) {
+        next(p);
+        n = parse_case(p, line);
+    } else {
+        return NULL;
+    }
+    if (!n) return NULL;
+    struct redir **rtail = &n->redirs;
+    while (peek(p)->type == TOK_IO_NUMBER || is_redir_op(peek(p)->type)) {
+        struct redir *r = parse_redirect(p);
+        if (!r) return NULL;
+        *rtail = r;
+        rtail = &r->next;
+    }
+    return n;
+}
+
+static struct node *parse_command(struct parser *p) {
+    struct token *t = peek(p);
+    if (is_terminator(t)) {
+        unexpected(p, t);
+        return NULL;
+    }
+    struct node *compound = parse_compound(p);
+    if (compound || p->err.msg) return compound;
+    if (is_reserved(t, "function")) {
+        int line = next(p).line;
+        return parse_function(p, line);
+    }
+    struct node *n = new_node(p, NODE_CMD, t->line);
+    struct word **wtail = &n->u.cmd.words;
+    struct word **atail = &n->u.cmd.assigns;
+    struct redir **rtail = &n->u.cmd.redirs;
+
+    for (;;) {
+        t = peek(p);
+        if (t->type == TOK_IO_NUMBER || is_redir_op(t->type)) {
+            struct redir *r = parse_redirect(p);
+            if (!r) return NULL;
+            *rtail = r;
+            rtail = &r->next;
+        } else if (t->type == TOK_WORD) {
+            struct token wt = next(p);
+            struct word *w = new_word(p, &wt);
+            if ((wt.flags & WORD_ASSIGN) && n->u.cmd.nwords == 0) {
+                *atail = w;
+                atail = &w->next;
+            } else {
+                *wtail = w;
+                wtail = &w->next;
+                n->u.cmd.nwords++;
+            }
+        } else {
+            break;
+        }
+    }
+    if (!n->u.cmd.words && !n->u.cmd.assigns && !n->u.cmd.redirs) {
+        unexpected(p, t);
+        return NULL;
+    }
+    if (t->type == TOK_LPAREN && n->u.cmd.nwords == 1 && !n->u.cmd.assigns &&
+        !n->u.cmd.redirs && !n->u.cmd.words->flags) {
+        /* name() compound_command */
+        next(p);
+        if (expect_token(p, TOK_RPAREN) != 0) return NULL;
+        return parse_function_body(p, n->u.cmd.words, n->line);
+    }
+    return n;
+}
+
+static int is_bang(const struct token *t) {
+    return t->type == TOK_WORD && t->len == 1 && t->start[0] == '!';
+}
+
+static struct node *parse_pipeline(struct parser *p) {
+    int line = peek(p)->line;
+    int bang = 0;
+    if (is_bang(peek(p))) {
+        next(p);
+        bang = 1;
+    }
+    struct node *stack[PIPELINE_INLINE];
+    struct node **cmds = stack;
+    int n = 0, cap = PIPELINE_INLINE;
+    for (;;) {
+        struct node *c = parse_command(p);
+        if (!c) return NULL;
+        if (n == cap) {
+            struct node **grown = arena_alloc(p->arena, sizeof(*grown) * (size_t)cap * 2);
+            memcpy(grown, cmds, sizeof(*grown) * (size_t)n);
+            cmds = grown;
+            cap *= 2;
+        }
+        cmds[n++] = c;
+        if (peek(p)->type != TOK_PIPE) break;
+        next(p);
+        linebreak(p);
+    }
+    if (n == 1 && !bang) return cmds[0];
+    struct node *pl = new_node(p, NODE_PIPELINE, line);
+    pl->u.pipe.cmds = arena_alloc(p->arena, sizeof(*cmds) * (size_t)n);
+    memcpy(pl->u.pipe.cmds, cmds, sizeof(*cmds) * (size_t)n);
+    pl->u.pipe.ncmds = n;
+    pl->u.pipe.bang = bang;
+    return pl;
+}
+
+static struct node *parse_and_or(struct parser *p) {
+    struct node *left = parse_pipeline(p);
+    if (!left) return NULL;
+    for (;;) {
+        enum token_type t = peek(p)->type;
+        if (t != TOK_AND_IF && t != TOK_OR_IF) return left;
+        int line = next(p).line;
+        linebreak(p);
+        struct node *right = parse_pipeline(p);
+        if (!right) return NULL;
+        struct node *n = new_node(p, t == TOK_AND_IF ? NODE_AND : NODE_OR, line);
+        n->u.bin.left = left;
+        n->u.bin.right = right;
+        left = n;
+    }
+}
+
+static struct node *seq(struct parser *p, struct node *left, struct node *right) {
+    if (!left) return right;
+    struct node *n = new_node(p, NODE_SEQ, left->line);
+    n->u.bin.left = left;
+    n->u.bin.right = right;
+    return n;
+}
+
+/* The list inside a compound command. Newlines separate commands here,
+ * and it ends without consuming whatever closes it. */
+static struct node *parse_list(struct parser *p) {
+    struct node *list = NULL;
+    linebreak(p);
+    for (;;) {
+        struct token *t = peek(p);
+        if (t->type == TOK_RPAREN || t->type == TOK_DSEMI || t->type == TOK_EOF ||
+            is_terminator(t)) {
+            return list;
+        }
+        struct node *item = parse_and_or(p);
+        if (!item) return NULL;
+        enum token_type type = peek(p)->type;
+        if (type == TOK_AMP) {
+            struct node *bg = new_node(p, NODE_BACKGROUND, item->line);
+            bg->u.bin.left = item;
+            item = bg;
+        }
+        list = seq(p, list, item);
+        if (type == TOK_AMP || type == TOK_SEMI || type == TOK_NEWLINE) {
+            next(p);
+            linebreak(p);
+        } else if (type != TOK_RPAREN && type != TOK_DSEMI && type != TOK_EOF &&
+                   !is_terminator(peek(p))) {
+            unexpected(p, peek(p));
+            return NULL;
+        }
+    }
+}
+
+static struct node *parse_complete(struct parser *p) {
+    struct node *list = NULL;
+    for (;;) {
+        struct node *item = parse_and_or(p);
+        if (!item) return NULL;
+        enum token_type t = peek(p)->type;
+        if (t == TOK_AMP) {
+            next(p);
+            struct node *bg = new_node(p, NODE_BACKGROUND, item->line);
+            bg->u.bin.left = item;
+            item = bg;
+        } else if (t == TOK_SEMI) {
+            next(p);
+        }
+        list = seq(p, list, item);
+        if (t != TOK_AMP && t != TOK_SEMI) break;
+        t = peek(p)->type;
+        if (t == TOK_NEWLINE || t == TOK_EOF) break;
+    }
+    enum token_type t = peek(p)->type;
+    if (t == TOK_NEWLINE) {
+        next(p);
+    } else if (t != TOK_EOF) {
+        unexpected(p, peek(p));
+        return NULL;
+    }
+    return list;
+}
+
+void parser_init(struct parser *p, struct arena *a, const char *src, size_t len) {
+    lexer_init(&p->lx, src, len);
+    p->arena = a;
+    p->have_tok = 0;
+    p->err.msg = NULL;
+    p->err.line = 0;
+    p->err.incomplete = 0;
+}
+
+struct node *parser_next(struct parser *p) {
+    linebreak(p);
+    if (peek(p)->type == TOK_EOF) return NULL;
+    return parse_complete(p);
+}
+
+struct node *parse_buffer(struct arena *a, const char *src, size_t len, struct parse_error *err) {
+    struct parser p;
+    struct node *all = NULL;
+    parser_init(&p, a, src, len);
+    struct node *n;
+    while ((n = parser_next(&p)) != NULL) all = seq(&p, all, n);
+    *err = p.err;
+    return p.err.msg ? NULL : all;
+}
+
+void parse_error_print(const char *origin, const struct parse_error *err) {
+    if (!err || !err->msg) return;
+    if (origin) fprintf(stderr, "%s: line %d: %s\n", origin, err->line, err->msg);
+    else fprintf(stderr, "kzsh: %s\n", err->msg);
+}
+
+/* ---- copying ---- */
+
+static struct word *copy_words(struct arena *a, const struct word *w) {
+    struct word *head = NULL, **tail = &head;
+    for (; w; w = w->next) {
+        struct word *c = arena_alloc(a, sizeof(*c));
+        c->text = arena_strndup(a, w->text, w->len);
+        c->len = w->len;
+        c->flags = w->flags;
+        c->next = NULL;
+        *tail = c;
+        tail = &c->next;
+    }
+    return head;
+}
+
+static struct redir *copy_redirs(struct arena *a, const struct redir *r) {
+    struct redir *head = NULL, **tail = &head;
+    for (; r; r = r->next) {
+        struct redir *c = arena_alloc(a, sizeof(*c));
+        *c = *r;
+        c->target = copy_words(a, r->target);
+        if (r->body) c->body = arena_strndup(a, r->body, r->body_len);
+        c->next = NULL;
+        *tail = c;
+        tail = &c->next;
+    }
+    return head;
+}
+
+struct node *node_copy(struct arena *a, const struct node *n) {
+    if (!n) return NULL;
+    struct node *c = arena_alloc(a, sizeof(*c));
+    *c = *n;
+    c->redirs = copy_redirs(a, n->redirs);
+    switch (n->type) {
+        case NODE_CMD:
+            c->u.cmd.assigns = copy_words(a, n->u.cmd.assigns);
+            c->u.cmd.words = copy_words(a, n->u.cmd.words);
+            c->u.cmd.redirs = copy_redirs(a, n->u.cmd.redirs);
+            break;
+        case NODE_PIPELINE:
+            c->u.pipe.cmds = arena_alloc(a, sizeof(*c->u.pipe.cmds) * (size_t)n->u.pipe.ncmds);
+            for (int i = 0; i < n->u.pipe.ncmds; ++i) {
+                c->u.pipe.cmds[i] = node_copy(a, n->u.pipe.cmds[i]);
+            }
+            break;
+        case NODE_AND:
+        case NODE_OR:
+        case NODE_SEQ:
+        case NODE_BACKGROUND:
+            c->u.bin.left = node_copy(a, n->u.bin.left);
+            c->u.bin.right = node_copy(a, n->u.bin.right);
+            break;
+        case NODE_IF:
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            c->u.ctl.cond = node_copy(a, n->u.ctl.cond);
+            c->u.ctl.body = node_copy(a, n->u.ctl.body);
+            c->u.ctl.else_part = node_copy(a, n->u.ctl.else_part);
+            break;
+        case NODE_FOR:
+            c->u.loop.var = copy_words(a, n->u.loop.var);
+            c->u.loop.words = copy_words(a, n->u.loop.words);
+            c->u.loop.body = node_copy(a, n->u.loop.body);
+            break;
+        case NODE_CASE: {
+            c->u.cas.subject = copy_words(a, n->u.cas.subject);
+            struct case_item **tail = &c->u.cas.items;
+            for (const struct case_item *it = n->u.cas.items; it; it = it->next) {
+                struct case_item *ci = arena_alloc(a, sizeof(*ci));
+                ci->patterns = copy_words(a, it->patterns);
+                ci->body = node_copy(a, it->body);
+                ci->next = NULL;
+                *tail = ci;
+                tail = &ci->next;
+            }
+            break;
+        }
+        case NODE_GROUP:
+        case NODE_SUBSHELL:
+            c->u.group.body = node_copy(a, n->u.group.body);
+            break;
+        case NODE_FUNCDEF:
+            c->u.func.name = copy_words(a, n->u.func.name);
+            c->u.func.body = node_copy(a, n->u.func.body);
+            break;
+    }
+    return c;
+}
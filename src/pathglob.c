@@ -0,0 +1,753 @@
+/*
+ * Pathname expansion.
+ *
+ * A pattern is compiled once per call into its '/'-separated components.
+ * Components without glob characters are appended to the path as they are,
+ * so for `src/lib/[a-m]*.c` only src/lib is read. The others become a
+ * token list whose leading and trailing literals are compared with memcmp
+ * before the full match runs.
+ *
+ * Directories are read with getdents64 into a large buffer, and listings
+ * are cached by path: a later glob that finds the same inode with the
+ * same mtime uses the cached names, costing one open and fstat instead of
+ * a full read. A directory modified within the last second is not cached,
+ * since a change in the same timestamp tick would go unnoticed.
+ *
+ * A ** walk can be shared out to a thread pool (pathglob_set_threads):
+ * subdirectories become tasks on a queue, each thread collects its own
+ * results, and everything is merged and sorted once at the end.
+ */
+
+#define _GNU_SOURCE
+#include "pathglob.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define DENTS_BUF     (256 * 1024)
+#define CACHE_SLOTS   4096                  /* direct-mapped, power of two */
+#define CACHE_BUDGET  ((size_t)64 << 20)    /* bytes of cached listings */
+#define MAX_THREADS   64
+
+/* ---- directory listings ---- */
+
+/* Names of one directory, without . and .. */
+struct listing {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    char *names;        /* per entry: the d_type byte, then the name and a NUL */
+    size_t *offs;
+    size_t count;
+    size_t bytes;
+    struct listing *next_retired;
+};
+
+static struct listing *cache[CACHE_SLOTS];
+static size_t cache_bytes = 0;
+/* Listings that may still be in use by the running glob: freed when it ends */
+static struct listing *retired = NULL;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int glob_threads = 0;
+
+static uint32_t hash_str(const char *s) {
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    for (; *s; ++s) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void listing_free(struct listing *l) {
+    free(l->path);
+    free(l->names);
+    free(l->offs);
+    free(l);
+}
+
+/* Caller holds cache_lock */
+static void retire(struct listing *l) {
+    l->next_retired = retired;
+    retired = l;
+}
+
+static void free_retired(void) {
+    while (retired) {
+        struct listing *next = retired->next_retired;
+        listing_free(retired);
+        retired = next;
+    }
+}
+
+static int add_name(struct listing *l, size_t *names_cap, size_t *offs_cap,
+                    const char *name, unsigned char type) {
+    size_t n = strlen(name);
+    if (name[0] == '.' && (n == 1 || (n == 2 && name[1] == '.'))) return 0;
+    if (l->bytes + n + 2 > *names_cap) {
+        size_t cap = *names_cap ? *names_cap * 2 : 4096;
+        while (cap < l->bytes + n + 2) cap *= 2;
+        char *names = realloc(l->names, cap);
+        if (!names) return -1;
+        l->names = names;
+        *names_cap = cap;
+    }
+    if (l->count == *offs_cap) {
+        size_t cap = *offs_cap ? *offs_cap * 2 : 64;
+        size_t *offs = realloc(l->offs, sizeof(*offs) * cap);
+        if (!offs) return -1;
+        l->offs = offs;
+        *offs_cap = cap;
+    }
+    l->offs[l->count++] = l->bytes;
+    l->names[l->bytes++] = (char)type;
+    memcpy(l->names + l->bytes, name, n + 1);
+    l->bytes += n + 1;
+    return 0;
+}
+
+#ifdef SYS_getdents64
+struct dirent64_raw {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static int read_entries(int fd, struct listing *l) {
+    size_t names_cap = 0, offs_cap = 0;
+    char *buf = malloc(DENTS_BUF);
+    if (!buf) return -1;
+    int status = 0;
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buf, DENTS_BUF);
+        if (n <= 0) {
+            if (n < 0) status = -1;
+            break;
+        }
+        for (long off = 0; off < n;) {
+            struct dirent64_raw *d = (struct dirent64_raw *)(buf + off);
+            if (add_name(l, &names_cap, &offs_cap, d->d_name, d->d_type) != 0) {
+                status = -1;
+                break;
+            }
+            off += d->d_reclen;
+        }
+        if (status != 0) break;
+    }
+    free(buf);
+    return status;
+}
+#else
+static int read_entries(int fd, struct listing *l) {
+    size_t names_cap = 0, offs_cap = 0;
+    DIR *dir = fdopendir(dup(fd));
+    if (!dir) return -1;
+    struct dirent *d;
+    int status = 0;
+    while (status == 0 && (d = readdir(dir))) {
+        status = add_name(l, &names_cap, &offs_cap, d->d_name, d->d_type);
+    }
+    closedir(dir);
+    return status;
+}
+#endif
+
+/* Listing of dir ("" is the current directory), from the cache when the
+ * directory has not changed. Valid until the current pathglob returns. */
+static const struct listing *read_dir(const char *dir) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int fd = open(*dir ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    uint32_t slot = hash_str(dir) & (CACHE_SLOTS - 1);
+    pthread_mutex_lock(&cache_lock);
+    struct listing *l = cache[slot];
+    if (l && l->dev == st.st_dev && l->ino == st.st_ino &&
+        l->mtime.tv_sec == st.st_mtim.tv_sec && l->mtime.tv_nsec == st.st_mtim.tv_nsec &&
+        strcmp(l->path, dir) == 0) {
+        pthread_mutex_unlock(&cache_lock);
+        close(fd);
+        return l;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    l = calloc(1, sizeof(*l));
+    if (!l || !(l->path = strdup(dir)) || read_entries(fd, l) != 0) {
+        close(fd);
+        if (l) listing_free(l);
+        return NULL;
+    }
+    close(fd);
+    l->dev = st.st_dev;
+    l->ino = st.st_ino;
+    l->mtime = st.st_mtim;
+
+    pthread_mutex_lock(&cache_lock);
+    int racy = st.st_mtim.tv_sec + 1 >= now.tv_sec;
+    if (racy || l->bytes > CACHE_BUDGET / 4) {
+        retire(l);
+    } else {
+        if (cache_bytes + l->bytes > CACHE_BUDGET) {
+            for (size_t i = 0; i < CACHE_SLOTS; ++i) {
+                if (cache[i]) retire(cache[i]);
+                cache[i] = NULL;
+            }
+            cache_bytes = 0;
+        }
+        if (cache[slot]) {
+            cache_bytes -= cache[slot]->bytes;
+            retire(cache[slot]);
+        }
+        cache[slot] = l;
+        cache_bytes += l->bytes;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return l;
+}
+
+/* ---- compiled patterns ---- */
+
+enum seg_kind { SEG_LITERAL, SEG_MATCH, SEG_GLOBSTAR };
+enum tok_kind { TOK_LIT, TOK_ONE, TOK_STAR, TOK_SET };
+
+struct gtok {
+    enum tok_kind kind;
+    size_t off, len;            /* TOK_LIT: bytes of seg->lit */
+    unsigned char *set;         /* TOK_SET: 256-bit membership map */
+};
+
+struct segment {
+    enum seg_kind kind;
+    char *lit;                  /* SEG_LITERAL: the component, unquoted */
+    size_t lit_len;
+    struct gtok *toks;
+    int ntoks;
+    int dot_ok;                 /* starts with a literal '.': hidden names can match */
+};
+
+struct pattern {
+    struct segment *segs;
+    int nsegs;
+    int absolute;
+    int dir_only;               /* trailing '/': directories only */
+    int globstar;
+    int base_slash;             /* a trailing ** after literal components only */
+};
+
+static int class_match(const char *name, size_t len, int c) {
+    static const struct {
+        const char *name;
+        int (*fn)(int);
+    } classes[] = {
+        { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+        { "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+        { "lower", islower }, { "print", isprint }, { "punct", ispunct },
+        { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+    };
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); ++i) {
+        if (strlen(classes[i].name) == len && memcmp(classes[i].name, name, len) == 0) {
+            return c < 128 && classes[i].fn(c);
+        }
+    }
+    return 0;
+}
+
+/* [...] at s: fill bits and return its length, or 0 if it is not closed
+ * (the '[' is then an ordinary character) */
+static size_t parse_set(const char *s, const char *end, unsigned char *bits) {
+    const char *p = s + 1;
+    int negate = p < end && (*p == '!' || *p == '^');
+    if (negate) p++;
+    memset(bits, 0, 32);
+    int first = 1;
+    while (p < end && (*p != ']' || first)) {
+        first = 0;
+        if (*p == '[' && p + 1 < end && p[1] == ':') {
+            const char *name = p + 2, *q = name;
+            while (q + 1 < end && !(q[0] == ':' && q[1] == ']')) q++;
+            if (q + 1 < end) {
+                for (int c = 0; c < 256; ++c) {
+                    if (class_match(name, (size_t)(q - name), c)) bits[c >> 3] |= (unsigned char)(1u << (c & 7));
+                }
+                p = q + 2;
+                continue;
+            }
+        }
+        if (*p == '\\' && p + 1 < end) p++;
+        unsigned char lo = (unsigned char)*p++, hi = lo;
+        if (p + 1 < end && *p == '-' && p[1] != ']') {
+            p++;
+            if (*p == '\\' && p + 1 < end) p++;
+            hi = (unsigned char)*p++;
+        }
+        for (unsigned c = lo; c <= hi; ++c) bits[c >> 3] |= (unsigned char)(1u << (c & 7));
+    }
+    if (p >= end) return 0;
+    if (negate) {
+        for (int i = 0; i < 32; ++i) bits[i] = (unsigned char)~bits[i];
+    }
+    return (size_t)(p + 1 - s);
+}
+
+static void compile_segment(struct arena *a, const char *s, size_t n, struct segment *sg) {
+    memset(sg, 0, sizeof(*sg));
+    sg->dot_ok = n > 0 && (s[0] == '.' || (n > 1 && s[0] == '\\' && s[1] == '.'));
+    if (n == 2 && s[0] == '*' && s[1] == '*') {
+        sg->kind = SEG_GLOBSTAR;
+        return;
+    }
+    sg->lit = arena_alloc(a, n + 1);
+    sg->toks = arena_alloc(a, sizeof(struct gtok) * (n ? n : 1));
+    unsigned char bits[32];
+    int magic = 0;
+    const char *end = s + n;
+    for (const char *p = s; p < end;) {
+        struct gtok *t = sg->ntoks ? &sg->toks[sg->ntoks - 1] : NULL;
+        size_t setlen;
+        if (*p == '*') {
+            if (!t || t->kind != TOK_STAR) sg->toks[sg->ntoks++] = (struct gtok){ TOK_STAR, 0, 0, NULL };
+            p++;
+            magic = 1;
+        } else if (*p == '?') {
+            sg->toks[sg->ntoks++] = (struct gtok){ TOK_ONE, 0, 0, NULL };
+            p++;
+            magic = 1;
+        } else if (*p == '[' && (setlen = parse_set(p, end, bits)) > 0) {
+            unsigned char *set = arena_alloc(a, 32);
+            memcpy(set, bits, 32);
+            sg->toks[sg->ntoks++] = (struct gtok){ TOK_SET, 0, 0, set };
+            p += setlen;
+            magic = 1;
+        } else {
+            if (*p == '\\' && p + 1 < end) p++;
+            if (!t || t->kind != TOK_LIT) {
+                sg->toks[sg->ntoks++] = (struct gtok){ TOK_LIT, sg->lit_len, 0, NULL };
+                t = &sg->toks[sg->ntoks - 1];
+            }
+            sg->lit[sg->lit_len++] = *p++;
+            t->len++;
+        }
+    }
+    sg->lit[sg->lit_len] = '\0';
+    sg->kind = magic ? SEG_MATCH : SEG_LITERAL;
+}
+
+static struct pattern *compile(struct arena *a, const char *pat) {
+    struct pattern *pt = arena_calloc(a, sizeof(*pt));
+    size_t len = strlen(pat);
+    pt->segs = arena_alloc(a, sizeof(struct segment) * (len / 2 + 1));
+    pt->absolute = pat[0] == '/';
+    const char *p = pat, *end = pat + len;
+    int magic = 0;
+    while (p < end) {
+        while (p < end && *p == '/') p++;
+        if (p == end) break;
+        const char *q = p;
+        while (q < end && *q != '/') q += (*q == '\\' && q + 1 < end) ? 2 : 1;
+        struct segment *sg = &pt->segs[pt->nsegs];
+        compile_segment(a, p, (size_t)(q - p), sg);
+        /* ** / ** is the same as ** */
+        if (!(sg->kind == SEG_GLOBSTAR && pt->nsegs > 0 && sg[-1].kind == SEG_GLOBSTAR)) pt->nsegs++;
+        if (sg->kind == SEG_GLOBSTAR) pt->globstar = 1;
+        pt->base_slash = sg->kind == SEG_GLOBSTAR && !magic;
+        if (sg->kind != SEG_LITERAL) magic = 1;
+        p = q;
+    }
+    pt->dir_only = len > 0 && pat[len - 1] == '/' && pt->nsegs > 0;
+    return pt;
+}
+
+/* One UTF-8 character at s (at least one byte, never past n) */
+static size_t char_len(const unsigned char *s, size_t n) {
+    size_t k = 1;
+    if (s[0] >= 0xc0) {
+        while (k < n && k < 4 && (s[k] & 0xc0) == 0x80) k++;
+    }
+    return k;
+}
+
+static int match_segment(const struct segment *sg, const char *name, size_t n) {
+    const struct gtok *toks = sg->toks;
+    int nt = sg->ntoks;
+    /* cheap rejects on the literal text every match starts and ends with */
+    if (nt > 1) {
+        const struct gtok *f = &toks[0], *l = &toks[nt - 1];
+        if (f->kind == TOK_LIT && (n < f->len || memcmp(name, sg->lit + f->off, f->len) != 0)) return 0;
+        if (l->kind == TOK_LIT &&
+            (n < l->len || memcmp(name + n - l->len, sg->lit + l->off, l->len) != 0)) return 0;
+    }
+    const unsigned char *s = (const unsigned char *)name;
+    size_t si = 0;
+    int ti = 0, star_ti = -1;
+    size_t star_si = 0;
+    while (si < n || ti < nt) {
+        if (ti < nt) {
+            const struct gtok *t = &toks[ti];
+            switch (t->kind) {
+                case TOK_STAR:
+                    star_ti = ti++;
+                    star_si = si;
+                    continue;
+                case TOK_LIT:
+                    if (n - si >= t->len && memcmp(s + si, sg->lit + t->off, t->len) == 0) {
+                        si += t->len;
+                        ti++;
+                        continue;
+                    }
+                    break;
+                case TOK_ONE:
+                    if (si < n) {
+                        si += char_len(s + si, n - si);
+                        ti++;
+                        continue;
+                    }
+                    break;
+                case TOK_SET:
+                    if (si < n && (t->set[s[si] >> 3] & (1u << (s[si] & 7)))) {
+                        si++;
+                        ti++;
+                        continue;
+                    }
+                    break;
+            }
+        }
+        /* mismatch: let the last * take one more character */
+        if (star_ti < 0 || star_si >= n) return 0;
+        star_si += char_len(s + star_si, n - star_si);
+        si = star_si;
+        ti = star_ti + 1;
+    }
+    return 1;
+}
+
+/* ---- walking ---- */
+
+struct pathbuf {
+    char *s;
+    size_t len, cap;
+};
+
+struct results {
+    char *buf;
+    size_t len, cap;
+    size_t *offs;
+    size_t n, ncap;
+};
+
+struct task {
+    struct task *next;
+    int si;
+    char path[];
+};
+
+struct glob_ctx {
+    const struct pattern *pat;
+    int parallel;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct task *queue;
+    int pending;            /* tasks queued or running */
+    int oom;
+};
+
+struct worker {
+    struct glob_ctx *g;
+    struct pathbuf path;
+    struct results res;
+    int oom;
+};
+
+static int path_reserve(struct worker *w, size_t n) {
+    if (w->path.len + n + 1 <= w->path.cap) return 0;
+    size_t cap = w->path.cap ? w->path.cap * 2 : 256;
+    while (cap < w->path.len + n + 1) cap *= 2;
+    char *s = realloc(w->path.s, cap);
+    if (!s) {
+        w->oom = 1;
+        return -1;
+    }
+    w->path.s = s;
+    w->path.cap = cap;
+    return 0;
+}
+
+/* Append /name to the path; returns the old length to truncate back to */
+static size_t path_join(struct worker *w, const char *name, size_t n, int *ok) {
+    size_t mark = w->path.len;
+    *ok = path_reserve(w, n + 1) == 0;
+    if (!*ok) return mark;
+    if (w->path.len > 0 && w->path.s[w->path.len - 1] != '/') w->path.s[w->path.len++] = '/';
+    memcpy(w->path.s + w->path.len, name, n);
+    w->path.len += n;
+    w->path.s[w->path.len] = '\0';
+    return mark;
+}
+
+static void path_truncate(struct worker *w, size_t mark) {
+    w->path.len = mark;
+    if (w->path.s) w->path.s[mark] = '\0';
+}
+
+static void add_result(struct worker *w, int slash) {
+    struct results *r = &w->res;
+    if (slash && w->path.len > 0 && w->path.s[w->path.len - 1] == '/') slash = 0;
+    size_t n = w->path.len + (size_t)slash + 1;
+    if (r->len + n > r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 4096;
+        while (cap < r->len + n) cap *= 2;
+        char *buf = realloc(r->buf, cap);
+        if (!buf) {
+            w->oom = 1;
+            return;
+        }
+        r->buf = buf;
+        r->cap = cap;
+    }
+    if (r->n == r->ncap) {
+        size_t cap = r->ncap ? r->ncap * 2 : 64;
+        size_t *offs = realloc(r->offs, sizeof(*offs) * cap);
+        if (!offs) {
+            w->oom = 1;
+            return;
+        }
+        r->offs = offs;
+        r->ncap = cap;
+    }
+    r->offs[r->n++] = r->len;
+    memcpy(r->buf + r->len, w->path.s, w->path.len);
+    r->len += w->path.len;
+    if (slash) r->buf[r->len++] = '/';
+    r->buf[r->len++] = '\0';
+}
+
+/* Whether the entry just joined onto the path is a directory; symlinks
+ * are followed unless nofollow */
+static int entry_is_dir(struct worker *w, unsigned char type, int nofollow) {
+    if (type == DT_DIR) return 1;
+    if (type != DT_UNKNOWN && (type != DT_LNK || nofollow)) return 0;
+    struct stat st;
+    int r = nofollow ? lstat(w->path.s, &st) : stat(w->path.s, &st);
+    return r == 0 && S_ISDIR(st.st_mode);
+}
+
+static void walk(struct worker *w, int si);
+
+static void enqueue(struct glob_ctx *g, const char *path, size_t len, int si) {
+    struct task *t = malloc(sizeof(*t) + len + 1);
+    if (!t) {
+        g->oom = 1;
+        return;
+    }
+    t->si = si;
+    memcpy(t->path, path, len + 1);
+    pthread_mutex_lock(&g->lock);
+    t->next = g->queue;
+    g->queue = t;
+    g->pending++;
+    pthread_cond_signal(&g->cond);
+    pthread_mutex_unlock(&g->lock);
+}
+
+/* Segment si is a trailing ** that lists files too (not ** /): it also
+ * matches the directory it starts from, which is listed before walking.
+ * bash writes that one as a/ when everything before the ** is literal
+ * and without the slash otherwise. */
+static int trailing_globstar(const struct pattern *pt, int si) {
+    return si + 1 == pt->nsegs && pt->segs[si].kind == SEG_GLOBSTAR && !pt->dir_only;
+}
+
+/* Walk the directory in w->path against segments si.. */
+static void walk(struct worker *w, int si) {
+    const struct pattern *pt = w->g->pat;
+    if (w->oom) return;
+    const struct segment *sg = &pt->segs[si];
+    int last = si + 1 == pt->nsegs;
+    int ok;
+
+    if (sg->kind == SEG_LITERAL) {
+        size_t mark = path_join(w, sg->lit, sg->lit_len, &ok);
+        if (!ok) return;
+        if (!last) {
+            struct stat st;
+            if (trailing_globstar(pt, si + 1) && stat(w->path.s, &st) == 0 && S_ISDIR(st.st_mode)) {
+                add_result(w, pt->base_slash);
+            }
+            walk(w, si + 1);
+        } else {
+            struct stat st;
+            int r = pt->dir_only ? stat(w->path.s, &st) : lstat(w->path.s, &st);
+            if (r == 0 && (!pt->dir_only || S_ISDIR(st.st_mode))) add_result(w, pt->dir_only);
+        }
+        path_truncate(w, mark);
+        return;
+    }
+
+    /* ** matches zero directories too; a trailing ** / lists every
+     * directory it walks, as each is entered */
+    if (sg->kind == SEG_GLOBSTAR && !last) walk(w, si + 1);
+    if (sg->kind == SEG_GLOBSTAR && last && pt->dir_only && w->path.len > 0) add_result(w, 1);
+
+    const struct listing *l = read_dir(w->path.s ? w->path.s : "");
+    if (!l) return;
+    for (size_t i = 0; i < l->count && !w->oom; ++i) {
+        const char *e = l->names + l->offs[i];
+        unsigned char type = (unsigned char)e[0];
+        const char *name = e + 1;
+        size_t n = strlen(name);
+        if (name[0] == '.' && !sg->dot_ok) continue;
+        if (sg->kind == SEG_MATCH && !match_segment(sg, name, n)) continue;
+
+        size_t mark = path_join(w, name, n, &ok);
+        if (!ok) return;
+        if (sg->kind == SEG_MATCH) {
+            if (last) {
+                if (!pt->dir_only || entry_is_dir(w, type, 0)) add_result(w, pt->dir_only);
+            } else if (entry_is_dir(w, type, 0)) {
+                if (trailing_globstar(pt, si + 1)) add_result(w, 0);
+                walk(w, si + 1);
+            }
+        } else {
+            /* **: every entry, descending into real directories only; a
+             * symlink to a directory is still listed by a trailing ** / */
+            int dir = entry_is_dir(w, type, 1);
+            if (last && !pt->dir_only) add_result(w, 0);
+            else if (last && !dir && entry_is_dir(w, type, 0)) add_result(w, 1);
+            if (dir) {
+                if (w->g->parallel) enqueue(w->g, w->path.s, w->path.len, si);
+                else walk(w, si);
+            }
+        }
+        path_truncate(w, mark);
+    }
+}
+
+static void run_tasks(struct worker *w) {
+    struct glob_ctx *g = w->g;
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        while (!g->queue && g->pending > 0) pthread_cond_wait(&g->cond, &g->lock);
+        if (!g->queue) break;
+        struct task *t = g->queue;
+        g->queue = t->next;
+        pthread_mutex_unlock(&g->lock);
+
+        int ok;
+        path_truncate(w, 0);
+        path_join(w, t->path, strlen(t->path), &ok);
+        if (ok) walk(w, t->si);
+        free(t);
+
+        pthread_mutex_lock(&g->lock);
+        if (--g->pending == 0) pthread_cond_broadcast(&g->cond);
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+static void *worker_main(void *arg) {
+    run_tasks(arg);
+    return NULL;
+}
+
+static int compare_paths(const void *x, const void *y) {
+    return strcmp(*(char *const *)x, *(char *const *)y);
+}
+
+/* ---- public interface ---- */
+
+char **pathglob(struct arena *a, const char *pattern, size_t *count) {
+    *count = 0;
+    struct pattern *pt = compile(a, pattern);
+    if (pt->nsegs == 0) return NULL;
+
+    int nthreads = pt->globstar && glob_threads > 1 ? glob_threads : 1;
+    struct glob_ctx g = { .pat = pt, .parallel = nthreads > 1 };
+    struct worker *ws = calloc((size_t)nthreads, sizeof(*ws));
+    if (!ws) return NULL;
+    for (int i = 0; i < nthreads; ++i) ws[i].g = &g;
+
+    int ok;
+    if (pt->absolute) path_join(&ws[0], "/", 1, &ok);
+    else ok = path_reserve(&ws[0], 0) == 0;
+    if (ok && !g.parallel) {
+        ws[0].path.s[ws[0].path.len] = '\0';
+        walk(&ws[0], 0);
+    } else if (ok) {
+        pthread_mutex_init(&g.lock, NULL);
+        pthread_cond_init(&g.cond, NULL);
+        ws[0].path.s[ws[0].path.len] = '\0';
+        enqueue(&g, ws[0].path.s, ws[0].path.len, 0);
+        pthread_t *tids = calloc((size_t)nthreads, sizeof(*tids));
+        int started = 1;
+        while (tids && started < nthreads &&
+               pthread_create(&tids[started], NULL, worker_main, &ws[started]) == 0) {
+            started++;
+        }
+        run_tasks(&ws[0]);
+        for (int i = 1; i < started; ++i) pthread_join(tids[i], NULL);
+        free(tids);
+        pthread_cond_destroy(&g.cond);
+        pthread_mutex_destroy(&g.lock);
+    }
+
+    size_t total = 0;
+    int oom = g.oom;
+    for (int i = 0; i < nthreads; ++i) {
+        total += ws[i].res.n;
+        oom |= ws[i].oom;
+    }
+    char **v = NULL;
+    if (oom) {
+        fprintf(stderr, "kzsh: glob: out of memory\n");
+    } else if (total > 0) {
+        v = arena_alloc(a, sizeof(char *) * (total + 1));
+        size_t k = 0;
+        for (int i = 0; i < nthreads; ++i) {
+            struct results *r = &ws[i].res;
+            char *copy = arena_alloc(a, r->len ? r->len : 1);
+            memcpy(copy, r->buf, r->len);
+            for (size_t j = 0; j < r->n; ++j) v[k++] = copy + r->offs[j];
+        }
+        qsort(v, total, sizeof(char *), compare_paths);
+        v[total] = NULL;
+        *count = total;
+    }
+    for (int i = 0; i < nthreads; ++i) {
+        free(ws[i].path.s);
+        free(ws[i].res.buf);
+        free(ws[i].res.offs);
+    }
+    free(ws);
+    free_retired();
+    return v;
+}
+
+void pathglob_set_threads(int n) {
+    glob_threads = n < 0 ? 0 : n > MAX_THREADS ? MAX_THREADS : n;
+}
+
+void pathglob_cache_clear(void) {
+    for (size_t i = 0; i < CACHE_SLOTS; ++i) {
+        if (cache[i]) listing_free(cache[i]);
+        cache[i] = NULL;
+    }
+    cache_bytes = 0;
+}
@@ -0,0 +1,481 @@
+/*
+ * Prompt rendering
+ *
+ * Prompt format:
+ *   [{username}@{hostname} {folder}] $
+ *
+ * PS1 escapes include \u, \h, \w, \W, \$, \n, \e, \\ and
+ *   \?  exit status of the last command
+ *   \c  how long the last command took (e.g. 850ms, 2.4s, 3m07s)
+ *   \g  git branch of the working directory, with "*" when it is dirty
+ *
+ * PS1 is compiled once into a list of segments: runs of literal text and
+ * references to the user, host and working directory. The rendered prompt
+ * is cached and rebuilt only after prompt_invalidate() marks one of the
+ * inputs it actually uses as changed, so an unchanged prompt is drawn
+ * without a single syscall. User and host are looked up once.
+ *
+ * \g can take hundreds of milliseconds in a big repository, so it never
+ * runs on the input path: `git status` runs as a child process writing
+ * into a pipe, the prompt shows the previous value for the same directory
+ * (or nothing) until the answer arrives, and the line editor polls the
+ * pipe next to stdin and redraws the prompt when it does.
+ */
+
+#include "prompt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "cmdhash.h"
+#include "launch.h"
+#include "var.h"
+
+enum seg_kind {
+    SEG_TEXT,           /* literal bytes: text.s[off .. off+len) */
+    SEG_USER,           /* \u */
+    SEG_HOST,           /* \h */
+    SEG_CWD,            /* \w: cwd, ~-abbreviated */
+    SEG_CWD_BASE,       /* \W: last component of \w */
+    SEG_STATUS,         /* \? */
+    SEG_DURATION,       /* \c */
+    SEG_GIT             /* \g */
+};
+
+struct seg {
+    enum seg_kind kind;
+    size_t off, len;
+};
+
+struct strbuf {
+    char *s;
+    size_t len, cap;
+};
+
+static struct seg *segs = NULL;
+static size_t nsegs = 0, segs_cap = 0;
+static struct strbuf text;      /* literal bytes of the compiled PS1 */
+static struct strbuf out;       /* the rendered prompt */
+static unsigned needs = 0;      /* PROMPT_* inputs referenced by segments */
+
+static int ready = 0;
+static unsigned dirty = 0;
+static int is_root = 0;
+static int use_colors = 0;
+
+static char username[256];
+static char hostname[256];
+static char home[PATH_MAX];
+static char cwd[PATH_MAX];
+static char cwd_full[PATH_MAX + 1];
+static char cwd_base[PATH_MAX + 1];
+
+static int last_status = 0;
+static long long last_ns = 0;
+static char status_text[16] = "0";
+static char duration_text[32] = "0ms";
+
+/* Background `git status`: the running child and what it has sent so far */
+static pid_t git_pid = -1;
+static int git_fd = -1;
+static char git_line[256];      /* first output line: "## branch...upstream" */
+static size_t git_line_len = 0;
+static int git_line_done = 0;   /* saw the end of the first line */
+static int git_more = 0;        /* saw output past it: the tree is dirty */
+static char git_text[256];      /* what \g shows */
+static char git_cwd[PATH_MAX];  /* directory git_text belongs to */
+
+static void sb_append(struct strbuf *b, const char *s, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        size_t ncap = b->cap ? b->cap : 256;
+        while (b->len + n + 1 > ncap) ncap *= 2;
+        char *grown = realloc(b->s, ncap);
+        if (!grown) return;
+        b->s = grown;
+        b->cap = ncap;
+    }
+    memcpy(b->s + b->len, s, n);
+    b->len += n;
+    b->s[b->len] = '\0';
+}
+
+/* ---- lookups, done once or on invalidation ---- */
+
+/* passwd entry of the effective user; read at most once */
+static const struct passwd *self_pw(void) {
+    static int looked = 0;
+    static const struct passwd *pw = NULL;
+    if (!looked) {
+        pw = getpwuid(geteuid());
+        looked = 1;
+    }
+    return pw;
+}
+
+static void copy_str(char *dst, size_t dstlen, const char *src) {
+    size_t n = strnlen(src, dstlen - 1);
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+static void load_username(void) {
+    const char *u = var_get("USER");
+    if (!u) u = var_get("USERNAME"); /* Windows compatibility */
+    if (u && u[0] != '\0') {
+        copy_str(username, sizeof(username), u);
+        return;
+    }
+    const struct passwd *pw = self_pw();
+    if (pw && pw->pw_name && pw->pw_name[0] != '\0') {
+        copy_str(username, sizeof(username), pw->pw_name);
+        return;
+    }
+    copy_str(username, sizeof(username), "I have no name!");
+}
+
+/* Empty when the hostname is unavailable; \h then expands to nothing */
+static void load_hostname(void) {
+    hostname[0] = '\0';
+    if (gethostname(hostname, sizeof(hostname)) == 0) {
+        hostname[sizeof(hostname) - 1] = '\0';
+        if (hostname[0] != '\0') return;
+    }
+    const char *h = var_get("HOSTNAME");
+    copy_str(hostname, sizeof(hostname), h ? h : "");
+}
+
+static void load_home(void) {
+    const char *h = var_get("HOME");
+    if (!h || h[0] == '\0') {
+        const struct passwd *pw = self_pw();
+        h = (pw && pw->pw_dir) ? pw->pw_dir : "";
+    }
+    copy_str(home, sizeof(home), h);
+}
+
+static void load_cwd(void) {
+    if (getcwd(cwd, sizeof(cwd))) return;
+    /* getcwd failed; try PWD env as fallback */
+    const char *pwd = var_get("PWD");
+    copy_str(cwd, sizeof(cwd), pwd ? pwd : "");
+}
+
+/* \w is cwd with $HOME replaced by "~" (not for root); \W is its last
+ * component, or "~" / "/" as a whole. */
+static void format_cwd(void) {
+    size_t hl = strlen(home);
+    if (!is_root && hl > 0 && strncmp(cwd, home, hl) == 0 &&
+        (cwd[hl] == '\0' || cwd[hl] == '/')) {
+        snprintf(cwd_full, sizeof(cwd_full), "~%s", cwd + hl);
+    } else {
+        copy_str(cwd_full, sizeof(cwd_full), cwd);
+    }
+
+    size_t end = strlen(cwd_full);
+    while (end > 1 && cwd_full[end - 1] == '/') end--;
+    size_t start = end;
+    while (start > 0 && cwd_full[start - 1] != '/') start--;
+    if (start == end && end > 0) {
+        copy_str(cwd_base, sizeof(cwd_base), "/");
+        return;
+    }
+    memcpy(cwd_base, cwd_full + start, end - start);
+    cwd_base[end - start] = '\0';
+}
+
+/* ---- compilation ---- */
+
+static void seg_add(enum seg_kind kind, size_t off, size_t len) {
+    if (nsegs == segs_cap) {
+        size_t ncap = segs_cap ? segs_cap * 2 : 16;
+        struct seg *grown = realloc(segs, sizeof(*grown) * ncap);
+        if (!grown) return;
+        segs = grown;
+        segs_cap = ncap;
+    }
+    segs[nsegs].kind = kind;
+    segs[nsegs].off = off;
+    segs[nsegs].len = len;
+    nsegs++;
+    if (kind == SEG_CWD || kind == SEG_CWD_BASE) needs |= PROMPT_CWD | PROMPT_HOME;
+    else if (kind == SEG_STATUS || kind == SEG_DURATION) needs |= PROMPT_LAST;
+    else if (kind == SEG_GIT) needs |= PROMPT_CWD | PROMPT_GIT;
+}
+
+/* Literal text; joined onto the previous segment when that is text too */
+static void seg_text(const char *s, size_t n) {
+    if (n == 0) return;
+    size_t off = text.len;
+    sb_append(&text, s, n);
+    if (text.len != off + n) return;
+    if (nsegs > 0 && segs[nsegs - 1].kind == SEG_TEXT &&
+        segs[nsegs - 1].off + segs[nsegs - 1].len == off) {
+        segs[nsegs - 1].len += n;
+        return;
+    }
+    seg_add(SEG_TEXT, off, n);
+}
+
+static void seg_str(const char *s) {
+    seg_text(s, strlen(s));
+}
+
+static void compile_ps1(const char *ps1) {
+    for (size_t i = 0; ps1[i] != '\0'; ++i) {
+        char c = ps1[i];
+        if (c != '\\' || ps1[i+1] == '\0') {
+            seg_text(&ps1[i], 1);
+            continue;
+        }
+        char esc = ps1[++i];
+        switch (esc) {
+            case 'u': seg_add(SEG_USER, 0, 0); break;
+            case 'h': seg_add(SEG_HOST, 0, 0); break;
+            case 'w': seg_add(SEG_CWD, 0, 0); break;
+            case 'W': seg_add(SEG_CWD_BASE, 0, 0); break;
+            case '?': seg_add(SEG_STATUS, 0, 0); break;
+            case 'c': seg_add(SEG_DURATION, 0, 0); break;
+            case 'g': seg_add(SEG_GIT, 0, 0); break;
+            case '$': seg_str("$"); break;
+            case 'n': seg_str("\n"); break;
+            case 'e': seg_str("\x1b"); break;
+            case '\\': seg_str("\\"); break;
+            default:
+                /* unknown escape -> keep backslash + char */
+                seg_text(&ps1[i - 1], 2);
+                break;
+        }
+    }
+}
+
+/* Default: [user@host folder] $ with colors on a terminal */
+static void compile_default(void) {
+    const char *clr_user = use_colors ? "\x1b[32m" : ""; /* green */
+    const char *clr_host = use_colors ? "\x1b[36m" : ""; /* cyan */
+    const char *clr_folder = use_colors ? "\x1b[33m" : ""; /* yellow */
+    const char *clr_reset = use_colors ? "\x1b[0m"  : "";
+
+    seg_str("[");
+    seg_str(clr_user);
+    seg_add(SEG_USER, 0, 0);
+    seg_str(clr_reset);
+    if (hostname[0] != '\0') {
+        seg_str("@");
+        seg_str(clr_host);
+        seg_add(SEG_HOST, 0, 0);
+        seg_str(clr_reset);
+    }
+    seg_str(" ");
+    seg_str(clr_folder);
+    seg_add(SEG_CWD_BASE, 0, 0);
+    seg_str(clr_reset);
+    seg_str("] $ ");
+}
+
+static void compile(void) {
+    nsegs = 0;
+    text.len = 0;
+    needs = 0;
+    const char *ps1 = var_get("PS1");
+    if (ps1 && ps1[0] != '\0') compile_ps1(ps1);
+    else compile_default();
+}
+
+/* ---- rendering ---- */
+
+static void render(void) {
+    out.len = 0;
+    sb_append(&out, "", 0);
+    for (size_t i = 0; i < nsegs; ++i) {
+        const struct seg *s = &segs[i];
+        switch (s->kind) {
+            case SEG_TEXT: sb_append(&out, text.s + s->off, s->len); break;
+            case SEG_USER: sb_append(&out, username, strlen(username)); break;
+            case SEG_HOST: sb_append(&out, hostname, strlen(hostname)); break;
+            case SEG_CWD: sb_append(&out, cwd_full, strlen(cwd_full)); break;
+            case SEG_CWD_BASE: sb_append(&out, cwd_base, strlen(cwd_base)); break;
+            case SEG_STATUS: sb_append(&out, status_text, strlen(status_text)); break;
+            case SEG_DURATION: sb_append(&out, duration_text, strlen(duration_text)); break;
+            case SEG_GIT: sb_append(&out, git_text, strlen(git_text)); break;
+        }
+    }
+}
+
+/* ---- last command ---- */
+
+static void format_last(void) {
+    snprintf(status_text, sizeof(status_text), "%d", last_status);
+    long long ms = last_ns / 1000000;
+    if (ms < 1000) {
+        snprintf(duration_text, sizeof(duration_text), "%lldms", ms);
+    } else if (ms < 60000) {
+        snprintf(duration_text, sizeof(duration_text), "%lld.%llds", ms / 1000, ms % 1000 / 100);
+    } else {
+        snprintf(duration_text, sizeof(duration_text), "%lldm%02llds", ms / 60000, ms % 60000 / 1000);
+    }
+}
+
+void prompt_command_done(int status, long long elapsed_ns) {
+    last_status = status;
+    last_ns = elapsed_ns;
+    dirty |= PROMPT_LAST | PROMPT_GIT;
+}
+
+/* ---- git segment ---- */
+
+static void git_stop(void) {
+    if (git_fd >= 0) {
+        close(git_fd);
+        git_fd = -1;
+    }
+    if (git_pid > 0) {
+        kill(git_pid, SIGTERM);
+        while (waitpid(git_pid, NULL, 0) < 0 && errno == EINTR) {}
+        git_pid = -1;
+    }
+}
+
+/* Start `git status` for cwd. Until it answers, \g keeps its old value
+ * if that was for this same directory and is blank otherwise. */
+static void git_start(void) {
+    git_stop();
+    if (strcmp(git_cwd, cwd) != 0) {
+        git_text[0] = '\0';
+        copy_str(git_cwd, sizeof(git_cwd), cwd);
+    }
+    /* through the command hash, so PATH is only searched the first time;
+     * peek first so prompts don't count as hits in `hash` */
+    const char *path = cmdhash_peek("git");
+    if (!path && !(path = cmdhash_lookup("git"))) return;
+
+    int p[2];
+    if (pipe(p) != 0) return;
+    fcntl(p[0], F_SETFD, FD_CLOEXEC);
+    fcntl(p[1], F_SETFD, FD_CLOEXEC);
+    fcntl(p[0], F_SETFL, O_NONBLOCK);
+
+    char *argv[] = {
+        "git", "--no-optional-locks", "status", "--porcelain", "--branch",
+        "--untracked-files=no", NULL
+    };
+    struct launch l;
+    launch_init(&l);
+    launch_open(&l, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    launch_dup2(&l, p[1], STDOUT_FILENO);
+    launch_open(&l, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    git_pid = launch_external(path, argv, var_envp(), &l);
+    close(p[1]);
+    if (git_pid < 0) {
+        close(p[0]);
+        return;
+    }
+    git_fd = p[0];
+    git_line_len = 0;
+    git_line_done = 0;
+    git_more = 0;
+}
+
+/* Branch name out of "## main...origin/main [ahead 1]",
+ * "## No commits yet on main" or "## HEAD (no branch)" */
+static void git_finish(void) {
+    char result[sizeof(git_text)];
+    result[0] = '\0';
+    git_line[git_line_len] = '\0';
+    if (git_line_done && strncmp(git_line, "## ", 3) == 0) {
+        const char *b = git_line + 3;
+        const char *on = strstr(b, " on ");
+        if (strncmp(b, "No commits yet", 14) == 0 && on) b = on + 4;
+        else if (strncmp(b, "Initial commit", 14) == 0 && on) b = on + 4;
+        size_t n = strcspn(b, " ");
+        const char *dots = strstr(b, "...");
+        if (dots && (size_t)(dots - b) < n) n = (size_t)(dots - b);
+        if (n > sizeof(result) - 2) n = sizeof(result) - 2;
+        memcpy(result, b, n);
+        if (git_more) result[n++] = '*';
+        result[n] = '\0';
+    }
+    git_stop();
+    copy_str(git_text, sizeof(git_text), result);
+}
+
+int prompt_async_fd(void) {
+    return git_fd;
+}
+
+int prompt_async_collect(void) {
+    if (git_fd < 0) return 0;
+    char chunk[4096];
+    for (;;) {
+        ssize_t r = read(git_fd, chunk, sizeof(chunk));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            break;
+        }
+        if (r == 0) break;
+        for (ssize_t i = 0; i < r && !git_more; ++i) {
+            if (git_line_done) {
+                git_more = 1;
+            } else if (chunk[i] == '\n') {
+                git_line_done = 1;
+            } else if (git_line_len + 1 < sizeof(git_line)) {
+                git_line[git_line_len++] = chunk[i];
+            }
+        }
+        /* one changed file is enough to know the answer */
+        if (git_more) break;
+    }
+    char old[sizeof(git_text)];
+    memcpy(old, git_text, sizeof(old));
+    git_finish();
+    if (strcmp(old, git_text) == 0) return 0;
+    if (ready) render();
+    return 1;
+}
+
+/* ---- public interface ---- */
+
+void prompt_invalidate(unsigned what) {
+    /* the git state belongs to the working directory */
+    if (what & PROMPT_CWD) what |= PROMPT_GIT;
+    dirty |= what;
+}
+
+const char *prompt_render(size_t *len) {
+    if (!ready) {
+        load_username();
+        load_hostname();
+        is_root = (geteuid() == 0);
+        use_colors = isatty(STDOUT_FILENO);
+        dirty = PROMPT_CWD | PROMPT_HOME | PROMPT_PS1 | PROMPT_GIT | PROMPT_LAST;
+        ready = 1;
+    }
+    if (dirty) {
+        int changed = 0;
+        if (dirty & PROMPT_PS1) {
+            compile();
+            dirty &= ~PROMPT_PS1;
+            changed = 1;
+        }
+        /* inputs the current PS1 does not use stay dirty until it does */
+        unsigned todo = dirty & needs;
+        if (todo) {
+            if (todo & PROMPT_HOME) load_home();
+            if (todo & PROMPT_CWD) load_cwd();
+            if (todo & (PROMPT_HOME | PROMPT_CWD)) format_cwd();
+            if (todo & PROMPT_LAST) format_last();
+            if (todo & PROMPT_GIT) git_start();
+            dirty &= ~todo;
+            changed = 1;
+        }
+        if (changed) render();
+    }
+    if (len) *len = out.len;
+    return out.s ? out.s : "";
+}
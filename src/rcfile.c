@@ -0,0 +1,358 @@
+/*
+ * rc file snapshots.
+ *
+ * Most of an rc file is alias, export and unset lines that do nothing but
+ * change shell state. The first time an rc file runs, each such command is
+ * recorded as the argv of the builtin it calls; every other command
+ * (expansions, redirections, external programs, ...) is recorded as its
+ * source text, since its effects have to happen again on every start.
+ * Function definitions are recorded as source text too: a compiled body is
+ * VM bytecode whose instructions point into the parsed syntax tree, which
+ * has no on-disk form, so each start parses and compiles them again.
+ * The records go to a snapshot file under $XDG_CACHE_HOME/kzsh (or
+ * ~/.cache/kzsh), keyed on the rc file's size, mtime and content hash.
+ *
+ * While the key matches, later starts map the snapshot and replay it in
+ * order: builtins are called directly with argv pointing into the mapping,
+ * and only the recorded source text is parsed.
+ */
+
+#define _GNU_SOURCE
+#include "rcfile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alias.h"
+#include "arena.h"
+#include "builtins.h"
+#include "eval.h"
+#include "parser.h"
+#include "script.h"
+#include "var.h"
+
+#define SNAPSHOT_MAGIC "KZSHRC\0"
+#define SNAPSHOT_VERSION 1
+
+struct snap_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t nrecs;
+    uint64_t rc_size;
+    int64_t rc_mtime_sec;
+    int64_t rc_mtime_nsec;
+    uint64_t rc_hash;
+};
+
+enum { REC_BUILTIN, REC_SOURCE };
+
+/* Followed by len bytes of payload, padded to 8 bytes */
+struct snap_rec {
+    uint32_t kind;
+    uint32_t line;          /* REC_SOURCE: line the text starts on */
+    uint32_t argc;          /* REC_BUILTIN: payload is argc NUL-terminated words */
+    uint32_t len;           /* payload length, final NUL included */
+};
+
+struct snap_buf {
+    char *data;
+    size_t len, cap;
+    uint32_t nrecs;
+    int failed;
+};
+
+static uint64_t hash64(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ull;    /* FNV-1a */
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/* $XDG_CACHE_HOME/kzsh/rc-<hash of path>.snap; NULL without a cache dir */
+static char *snapshot_path(const char *rc_path, int create_dirs) {
+    const char *xdg = var_get("XDG_CACHE_HOME");
+    const char *home = var_get("HOME");
+    char dir[4096];
+    if (xdg && *xdg) snprintf(dir, sizeof(dir), "%s", xdg);
+    else if (home && *home) snprintf(dir, sizeof(dir), "%s/.cache", home);
+    else return NULL;
+    if (create_dirs) mkdir(dir, 0700);
+    size_t n = strlen(dir);
+    snprintf(dir + n, sizeof(dir) - n, "/kzsh");
+    if (create_dirs) mkdir(dir, 0700);
+
+    size_t len = strlen(dir) + 32;
+    char *path = malloc(len);
+    if (path) snprintf(path, len, "%s/rc-%016llx.snap", dir,
+                       (unsigned long long)hash64(rc_path, strlen(rc_path)));
+    return path;
+}
+
+/* ---- replay ---- */
+
+/* Run a mapped snapshot if its key matches. Returns -1 (having run
+ * nothing) when it is missing, stale or damaged. */
+static int replay(const char *snap_path, const char *origin, const struct stat *rc_st,
+                  uint64_t rc_hash, int *status) {
+    int fd = open(snap_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct snap_header)) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    /* private and writable: builtins may poke at their argv strings */
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const struct snap_header *h = (const struct snap_header *)map;
+    int ok = memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) == 0 &&
+             h->version == SNAPSHOT_VERSION &&
+             h->rc_size == (uint64_t)rc_st->st_size &&
+             h->rc_mtime_sec == (int64_t)rc_st->st_mtim.tv_sec &&
+             h->rc_mtime_nsec == (int64_t)rc_st->st_mtim.tv_nsec &&
+             h->rc_hash == rc_hash;
+
+    /* Check every record before running any, so a damaged snapshot never
+     * leaves the rc file half applied */
+    size_t max_argc = 0;
+    size_t off = sizeof(*h);
+    for (uint32_t i = 0; ok && i < h->nrecs; ++i) {
+        if (size - off < sizeof(struct snap_rec)) {
+            ok = 0;
+            break;
+        }
+        const struct snap_rec *r = (const struct snap_rec *)(map + off);
+        const char *payload = map + off + sizeof(*r);
+        size_t avail = size - off - sizeof(*r);
+        if (r->len == 0 || r->len > avail || payload[r->len - 1] != '\0') {
+            ok = 0;
+        } else if (r->kind == REC_BUILTIN) {
+            uint32_t words = 0;
+            for (uint32_t j = 0; j < r->len; ++j) words += payload[j] == '\0';
+            ok = r->argc > 0 && words == r->argc && builtin_lookup(payload) != NULL;
+            if (r->argc > max_argc) max_argc = r->argc;
+        } else if (r->kind != REC_SOURCE) {
+            ok = 0;
+        }
+        off += sizeof(*r) + ((r->len + 7) & ~(size_t)7);
+    }
+    char **argv = ok ? malloc(sizeof(char *) * (max_argc + 1)) : NULL;
+    if (!argv) {
+        munmap(map, size);
+        return -1;
+    }
+
+    *status = 0;
+    off = sizeof(*h);
+    for (uint32_t i = 0; i < h->nrecs; ++i) {
+        const struct snap_rec *r = (const struct snap_rec *)(map + off);
+        char *payload = map + off + sizeof(*r);
+        if (r->kind == REC_BUILTIN) {
+            char *p = payload;
+            for (uint32_t j = 0; j < r->argc; ++j) {
+                argv[j] = p;
+                p += strlen(p) + 1;
+            }
+            argv[r->argc] = NULL;
+            *status = builtin_lookup(argv[0])->fn((int)r->argc, argv);
+        } else {
+            *status = script_run_text(origin, payload, r->len - 1, (int)r->line);
+        }
+        off += sizeof(*r) + ((r->len + 7) & ~(size_t)7);
+    }
+    free(argv);
+    munmap(map, size);
+    return 0;
+}
+
+/* ---- recording ---- */
+
+static void *buf_reserve(struct snap_buf *b, size_t n) {
+    if (b->failed) return NULL;
+    if (b->len + n > b->cap) {
+        size_t ncap = b->cap ? b->cap * 2 : 4096;
+        while (b->len + n > ncap) ncap *= 2;
+        char *grown = realloc(b->data, ncap);
+        if (!grown) {
+            b->failed = 1;
+            return NULL;
+        }
+        b->data = grown;
+        b->cap = ncap;
+    }
+    void *p = b->data + b->len;
+    b->len += n;
+    return p;
+}
+
+static char *add_record(struct snap_buf *b, uint32_t kind, uint32_t line, uint32_t argc,
+                        size_t len) {
+    size_t padded = (len + 7) & ~(size_t)7;
+    struct snap_rec *r = buf_reserve(b, sizeof(*r) + padded);
+    if (!r) return NULL;
+    r->kind = kind;
+    r->line = line;
+    r->argc = argc;
+    r->len = (uint32_t)len;
+    char *payload = (char *)(r + 1);
+    memset(payload + len, 0, padded - len);
+    b->nrecs++;
+    return payload;
+}
+
+/* argv of a command that only changes shell state, so that calling its
+ * builtin directly on a later start has the same effect; NULL otherwise */
+static char **state_argv(struct arena *a, const struct node *n, int *argcp) {
+    if (n->type != NODE_CMD || n->u.cmd.redirs || n->u.cmd.assigns || n->u.cmd.nwords < 2) {
+        return NULL;
+    }
+    for (const struct word *w = n->u.cmd.words; w; w = w->next) {
+        if (w->flags & (WORD_DOLLAR | WORD_GLOB | WORD_TILDE)) return NULL;
+    }
+    const struct word *first = n->u.cmd.words;
+    if (alias_lookup_n(first->text, first->len)) return NULL;
+
+    int argc = n->u.cmd.nwords;
+    char **argv = arena_alloc(a, sizeof(char *) * (size_t)(argc + 1));
+    int i = 0;
+    for (const struct word *w = n->u.cmd.words; w; w = w->next) argv[i++] = word_unquote(a, w);
+    argv[argc] = NULL;
+
+    const char *name = argv[0];
+    if (strcmp(name, "alias") == 0 || strcmp(name, "export") == 0) {
+        /* without '=' these print or look things up */
+        for (i = 1; i < argc; ++i) {
+            if (!strchr(argv[i], '=')) return NULL;
+        }
+    } else if (strcmp(name, "unalias") != 0 && strcmp(name, "unset") != 0 &&
+               !(strcmp(name, "umask") == 0 && argc == 2)) {
+        return NULL;
+    }
+    *argcp = argc;
+    return argv;
+}
+
+static void write_snapshot(const char *snap_path, const struct snap_header *h,
+                           const struct snap_buf *b) {
+    size_t n = strlen(snap_path) + 8;
+    char *tmp = malloc(n);
+    if (!tmp) return;
+    snprintf(tmp, n, "%s.XXXXXX", snap_path);
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return;
+    }
+    int ok = write(fd, h, sizeof(*h)) == (ssize_t)sizeof(*h) &&
+             write(fd, b->data, b->len) == (ssize_t)b->len;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp, snap_path) != 0) unlink(tmp);
+    free(tmp);
+}
+
+/* Run the rc file normally, recording each command as it goes */
+static int record(const char *origin, const char *text, size_t len, const struct stat *rc_st,
+                  uint64_t rc_hash, const char *snap_path) {
+    struct snap_buf b = {0};
+    struct arena scratch;
+    arena_init(&scratch, ARENA_DEFAULT_CHUNK);
+    struct parser p;
+    parser_init(&p, &scratch, text, len);
+    int status = 0;
+    for (;;) {
+        struct arena_mark mark = arena_mark(&scratch);
+        const char *start = p.lx.cur;
+        int line = p.lx.line;
+        struct node *n = parser_next(&p);
+        if (!n) break;
+        int argc;
+        char **argv = state_argv(&scratch, n, &argc);
+        if (argv) {
+            size_t total = 0;
+            for (int i = 0; i < argc; ++i) total += strlen(argv[i]) + 1;
+            char *payload = add_record(&b, REC_BUILTIN, (uint32_t)line, (uint32_t)argc, total);
+            for (int i = 0; payload && i < argc; ++i) {
+                size_t wl = strlen(argv[i]) + 1;
+                memcpy(payload, argv[i], wl);
+                payload += wl;
+            }
+        } else {
+            size_t tl = (size_t)(p.lx.cur - start);
+            char *payload = add_record(&b, REC_SOURCE, (uint32_t)line, 0, tl + 1);
+            if (payload) {
+                memcpy(payload, start, tl);
+                payload[tl] = '\0';
+            }
+        }
+        status = eval_node(&scratch, n);
+        arena_release(&scratch, mark);
+    }
+    if (p.err.msg) {
+        /* not cached: the error has to be reported on every start */
+        fflush(stdout);
+        parse_error_print(origin, &p.err);
+        status = 2;
+    } else if (!b.failed && snap_path) {
+        struct snap_header h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+        h.version = SNAPSHOT_VERSION;
+        h.nrecs = b.nrecs;
+        h.rc_size = (uint64_t)rc_st->st_size;
+        h.rc_mtime_sec = (int64_t)rc_st->st_mtim.tv_sec;
+        h.rc_mtime_nsec = (int64_t)rc_st->st_mtim.tv_nsec;
+        h.rc_hash = rc_hash;
+        write_snapshot(snap_path, &h, &b);
+    }
+    arena_free(&scratch);
+    free(b.data);
+    return status;
+}
+
+/* ---- public interface ---- */
+
+int rcfile_load(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *text = "";
+    if (size > 0) {
+        void *m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) {
+            fprintf(stderr, "kzsh: %s: %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        text = m;
+    }
+    close(fd);
+
+    uint64_t h = hash64(text, size);
+    int status;
+    char *snap = snapshot_path(path, 0);
+    if (!snap || replay(snap, path, &st, h, &status) != 0) {
+        free(snap);
+        snap = snapshot_path(path, 1);
+        status = record(path, text, size, &st, h, snap);
+    }
+    free(snap);
+    if (size > 0) munmap((void *)text, size);
+    eval_last_status = status;
+    return status;
+}
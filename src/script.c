@@ -0,0 +1,240 @@
+/*
+ * Compile-once script execution.
+ *
+ * The whole file is mapped and parsed up front; the resulting program is
+ * then executed command by command without touching the text again, and
+ * without going through interactive history.
+ *
+ * Command strings and streamed input (`kzsh -c`, a script on stdin) are
+ * parsed and run one complete command at a time instead; neither touches
+ * the terminal, the prompt or history.
+ */
+
+#define _GNU_SOURCE
+#include "script.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "eval.h"
+
+#define BATCH_BLOCK 65536
+
+/* Fallback for files that cannot be mapped (pipes, /dev/stdin, ...) */
+static char *read_all(int fd, size_t *out_len) {
+    size_t cap = 65536, len = 0;
+    char *buf = malloc(cap);
+    if (!buf) return NULL;
+    for (;;) {
+        if (len == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                return NULL;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t r = read(fd, buf + len, cap - len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            free(buf);
+            return NULL;
+        }
+        if (r == 0) break;
+        len += (size_t)r;
+    }
+    *out_len = len;
+    return buf;
+}
+
+struct program *program_load(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "kzsh: %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    struct program *prog = calloc(1, sizeof(*prog));
+    if (!prog) {
+        close(fd);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            prog->text = m;
+            prog->len = (size_t)st.st_size;
+            prog->mapped = 1;
+        }
+    }
+    if (!prog->mapped) {
+        prog->text = read_all(fd, &prog->len);
+        if (!prog->text) {
+            fprintf(stderr, "kzsh: %s: %s\n", path, strerror(errno));
+            close(fd);
+            free(prog);
+            return NULL;
+        }
+    }
+    close(fd);
+
+    /* Parse everything now so the program never re-reads its source */
+    arena_init(&prog->arena, 65536);
+    struct parser p;
+    parser_init(&p, &prog->arena, prog->text, prog->len);
+    int cap = 64;
+    prog->cmds = malloc(sizeof(*prog->cmds) * (size_t)cap);
+    struct node *n;
+    while (prog->cmds && (n = parser_next(&p)) != NULL) {
+        if (prog->ncmds == cap) {
+            struct node **grown = realloc(prog->cmds, sizeof(*grown) * (size_t)cap * 2);
+            if (!grown) break;
+            prog->cmds = grown;
+            cap *= 2;
+        }
+        prog->cmds[prog->ncmds++] = n;
+    }
+    if (p.err.msg || !prog->cmds) {
+        parse_error_print(path, &p.err);
+        program_free(prog);
+        return NULL;
+    }
+    return prog;
+}
+
+int program_run(struct program *prog) {
+    struct arena scratch;
+    arena_init(&scratch, ARENA_DEFAULT_CHUNK);
+    int status = 0;
+    for (int i = 0; i < prog->ncmds; ++i) {
+        status = eval_node(&scratch, prog->cmds[i]);
+        arena_reset(&scratch);
+    }
+    arena_free(&scratch);
+    return status;
+}
+
+void program_free(struct program *prog) {
+    if (!prog) return;
+    if (prog->mapped) munmap((void *)prog->text, prog->len);
+    else free((void *)prog->text);
+    arena_free(&prog->arena);
+    free(prog->cmds);
+    free(prog);
+}
+
+int script_run_file(const char *path) {
+    struct program *prog = program_load(path);
+    if (!prog) return 2;
+    int status = program_run(prog);
+    program_free(prog);
+    return status;
+}
+
+/* Parse and run the complete commands in text[0..len). Unless final (no
+ * more input will follow), a command that runs out of text is left alone
+ * to be retried with more input. *consumed is how much of text was run;
+ * *line the line number where it ends. Returns -1 on a syntax error. */
+static int run_commands(const char *origin, const char *text, size_t len, int final,
+                        struct arena *scratch, size_t *consumed, int *line, int *status) {
+    struct parser p;
+    parser_init(&p, scratch, text, len);
+    p.lx.line = *line;
+    *consumed = 0;
+    for (;;) {
+        struct arena_mark mark = arena_mark(scratch);
+        struct node *n = parser_next(&p);
+        if (!final && (p.err.incomplete || p.lx.incomplete)) {
+            arena_release(scratch, mark);
+            return 0;
+        }
+        if (p.err.msg) {
+            fflush(stdout);
+            parse_error_print(origin, &p.err);
+            *status = eval_last_status = 2;
+            return -1;
+        }
+        if (n) *status = eval_node(scratch, n);
+        arena_release(scratch, mark);
+        *consumed = (size_t)(p.lx.cur - text);
+        *line = p.lx.line;
+        if (!n) return 0;
+    }
+}
+
+int script_run_text(const char *origin, const char *text, size_t len, int line) {
+    struct arena scratch;
+    arena_init(&scratch, ARENA_DEFAULT_CHUNK);
+    size_t consumed;
+    int status = 0;
+    run_commands(origin, text, len, 1, &scratch, &consumed, &line, &status);
+    arena_free(&scratch);
+    return status;
+}
+
+int script_run_string(const char *text, size_t len) {
+    return script_run_text("kzsh: -c", text, len, 1);
+}
+
+/* Length of the prefix of buf that ends in an unescaped newline: commands
+ * are only parsed up to there while more input may follow. */
+static size_t complete_lines(const char *buf, size_t len) {
+    while (len > 0) {
+        const char *nl = memrchr(buf, '\n', len);
+        if (!nl) return 0;
+        size_t end = (size_t)(nl - buf);
+        size_t bs = 0;
+        while (bs < end && buf[end - 1 - bs] == '\\') bs++;
+        if (bs % 2 == 0) return end + 1;
+        len = end;      /* a line continuation: the command goes on */
+    }
+    return 0;
+}
+
+int script_run_fd(int fd) {
+    size_t cap = BATCH_BLOCK, len = 0;
+    char *buf = malloc(cap);
+    if (!buf) return 2;
+    struct arena scratch;
+    arena_init(&scratch, ARENA_DEFAULT_CHUNK);
+    int line = 1, status = 0, eof = 0;
+    while (!eof) {
+        /* keep at least a whole block free so each read() is a big one */
+        if (cap - len < BATCH_BLOCK) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                fprintf(stderr, "kzsh: %s\n", strerror(errno));
+                status = 2;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t r = read(fd, buf + len, cap - len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "kzsh: read error: %s\n", strerror(errno));
+            status = 2;
+            break;
+        }
+        if (r == 0) eof = 1;
+        len += (size_t)r;
+
+        size_t avail = eof ? len : complete_lines(buf, len);
+        if (avail == 0) continue;
+        size_t consumed;
+        if (run_commands("kzsh", buf, avail, eof, &scratch, &consumed, &line, &status) < 0) break;
+        /* whatever is left is the start of a command still being read */
+        memmove(buf, buf + consumed, len - consumed);
+        len -= consumed;
+    }
+    arena_free(&scratch);
+    free(buf);
+    return status;
+}
@@ -1,12 +1,8 @@
 /*
  * Portable shell front-end (no readline)
  *
- * Prompt format:
- *   [{username}@{hostname} {folder}] $
- *
- * PS1 escapes include \u, \h, \w, \W, \$, \n, \e, \\
- *
- * Minimal builtin line editor (termios-based on POSIX) with history recall.
+ * The prompt itself is rendered and cached by prompt.c, and lines are
+ * read with the line editor in lineedit.c.
  */
 
 #include "shell.h"
@@ -15,21 +11,22 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
-#include <pwd.h>
 #include <sys/types.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include <limits.h>
 #include <errno.h>
+#include <time.h>
 
-#include "exec.h"
 #include "history.h"
-#include "env.h"
-#include "alias.h"
-
-extern int alias_count;
-extern char *names[];
-extern char *values[];
+#include "prompt.h"
+#include "lineedit.h"
+#include "arena.h"
+#include "parser.h"
+#include "eval.h"
+#include "jobs.h"
+#include "utils.h"
+#include "var.h"
 
 /* Build-time defines from Meson (fall back to safe defaults) */
 #ifndef KSH_RELEASE
@@ -42,473 +39,22 @@ extern char *values[];
 #define KSH_CURRENT_YEAR "1970"
 #endif
 
+int shell_interactive = 0;
+
 /* SIGINT handling */
-static volatile sig_atomic_t got_sigint = 0;
+volatile sig_atomic_t got_sigint = 0;
 static void sigint_handler(int signo) {
     (void)signo;
     got_sigint = 1;
 }
 
-/* Helpers to obtain username and hostname in a portable manner. */
-/* Returns pointer to a static buffer (do not free). */
-static const char *get_username(void) {
-    static char unamebuf[256];
-    const char *u = getenv("USER");
-    if (!u) u = getenv("USERNAME"); /* Windows compatibility */
-    if (u && u[0] != '\0') {
-        strncpy(unamebuf, u, sizeof(unamebuf) - 1);
-        unamebuf[sizeof(unamebuf) - 1] = '\0';
-        return unamebuf;
-    }
-    /* Try getpwuid if available */
-    struct passwd *pw = getpwuid(geteuid());
-    if (pw && pw->pw_name && pw->pw_name[0] != '\0') {
-        strncpy(unamebuf, pw->pw_name, sizeof(unamebuf) - 1);
-        unamebuf[sizeof(unamebuf) - 1] = '\0';
-        return unamebuf;
-    }
-    /* Fallback string */
-    strncpy(unamebuf, "I have no name!", sizeof(unamebuf) - 1);
-    unamebuf[sizeof(unamebuf) - 1] = '\0';
-    return unamebuf;
-}
-
-/* Returns pointer to a static buffer; if hostname unavailable returns empty string. */
-static const char *get_hostname(void) {
-    static char hostbuf[256];
-    hostbuf[0] = '\0';
-    if (gethostname(hostbuf, sizeof(hostbuf)) == 0) {
-        hostbuf[sizeof(hostbuf) - 1] = '\0';
-        if (hostbuf[0] != '\0') return hostbuf;
-    }
-    const char *h = getenv("HOSTNAME");
-    if (h && h[0] != '\0') {
-        strncpy(hostbuf, h, sizeof(hostbuf) - 1);
-        hostbuf[sizeof(hostbuf) - 1] = '\0';
-        return hostbuf;
-    }
-    return "";
-}
-
-/* Return user's home directory path (or empty string) */
-static const char *get_home_dir(void) {
-    static char homebuf[PATH_MAX];
-    const char *h = getenv("HOME");
-    if (h && h[0] != '\0') {
-        strncpy(homebuf, h, sizeof(homebuf) - 1);
-        homebuf[sizeof(homebuf) - 1] = '\0';
-        return homebuf;
-    }
-    struct passwd *pw = getpwuid(geteuid());
-    if (pw && pw->pw_dir && pw->pw_dir[0] != '\0') {
-        strncpy(homebuf, pw->pw_dir, sizeof(homebuf) - 1);
-        homebuf[sizeof(homebuf) - 1] = '\0';
-        return homebuf;
-    }
-    homebuf[0] = '\0';
-    return homebuf;
-}
-
-/* Get current working directory into out (size outlen). Returns 0 on success, -1 on error. */
-static int get_cwd_safe(char *out, size_t outlen) {
-    if (!getcwd(out, outlen)) {
-        /* getcwd failed; try PWD env as fallback */
-        const char *pwd = getenv("PWD");
-        if (pwd && pwd[0] != '\0') {
-            strncpy(out, pwd, outlen - 1);
-            out[outlen - 1] = '\0';
-            return 0;
-        }
-        out[0] = '\0';
-        return -1;
-    }
-    return 0;
-}
-
-/* Abbreviate path: if path equals home and NOT running as root -> "~"
- * else if path is inside home and NOT root -> "~/<rest>"
- * else return full path or basename depending on mode.
- *
- * mode: 0 -> full path with home abbrev (used by \w)
- *       1 -> basename with home-abbrev rules (used by \W and default folder shown)
- */
-static void format_path_abbrev(const char *path, char *out, size_t outlen, int mode) {
-    const char *home = get_home_dir();
-    bool have_home = (home && home[0] != '\0');
-    uid_t euid = geteuid();
-    bool is_root = (euid == 0);
-
-    if (mode == 0) {
-        /* full path, possibly abbreviated */
-        if (have_home && !is_root) {
-            size_t homelen = strlen(home);
-            if (strncmp(path, home, homelen) == 0) {
-                if (path[homelen] == '\0') {
-                    /* equals home */
-                    snprintf(out, outlen, "~");
-                    return;
-                } else if (path[homelen] == '/') {
-                    /* inside home */
-                    size_t restlen = strlen(path + homelen);
-                    if (restlen + 2 <= outlen) { /* "~" + "/" + rest */
-                        snprintf(out, outlen, "~%s", path + homelen);
-                        return;
-                    } else {
-                        /* not enough space, fall back to truncated */
-                    }
-                }
-            }
-        }
-        /* default: copy full path */
-        strncpy(out, path, outlen - 1);
-        out[outlen - 1] = '\0';
-        return;
-    } else {
-        /* basename with home-abbrev rules */
-        if (have_home && !is_root) {
-            size_t homelen = strlen(home);
-            if (strncmp(path, home, homelen) == 0) {
-                if (path[homelen] == '\0') {
-                    /* equals home */
-                    snprintf(out, outlen, "~");
-                    return;
-                } else if (path[homelen] == '/') {
-                    /* inside home: last component of rest */
-                    const char *rest = path + homelen + 1; /* skip '/' */
-                    const char *last = strrchr(rest, '/');
-                    if (!last) {
-                        /* rest is single component */
-                        strncpy(out, rest, outlen - 1);
-                        out[outlen - 1] = '\0';
-                        return;
-                    } else {
-                        const char *b = last + 1;
-                        strncpy(out, b, outlen - 1);
-                        out[outlen - 1] = '\0';
-                        return;
-                    }
-                }
-            }
-        }
-        /* else: basename of full path */
-        if (strcmp(path, "/") == 0) {
-            strncpy(out, "/", outlen - 1);
-            out[outlen - 1] = '\0';
-            return;
-        }
-        const char *last = strrchr(path, '/');
-        if (!last) {
-            strncpy(out, path, outlen - 1);
-            out[outlen - 1] = '\0';
-            return;
-        } else {
-            const char *b = last + 1;
-            if (*b == '\0') {
-                /* path ends with '/', remove trailing slashes and retry */
-                size_t plen = strlen(path);
-                while (plen > 1 && path[plen - 1] == '/') plen--;
-                /* find previous slash */
-                size_t i = plen;
-                while (i > 0 && path[i-1] != '/') i--;
-                if (i == plen) {
-                    strncpy(out, "/", outlen - 1);
-                    out[outlen - 1] = '\0';
-                    return;
-                }
-                const char *bb = path + i;
-                strncpy(out, bb, outlen - 1);
-                out[outlen - 1] = '\0';
-                return;
-            } else {
-                strncpy(out, b, outlen - 1);
-                out[outlen - 1] = '\0';
-                return;
-            }
-        }
-    }
-}
-
-/* Expand PS1-like escapes into out buffer, safe for given outlen.
- * Recognizes: \u \h \$ \n \e \\ \w \W
- * If hostname is empty, \h expands to nothing.
- */
-static void expand_ps1(const char *ps1, char *out, size_t outlen, const char *username, const char *hostname) {
-    size_t o = 0;
-    char tmpbuf[PATH_MAX * 2];
-    char cwd[PATH_MAX];
-    cwd[0] = '\0';
-    (void)get_cwd_safe(cwd, sizeof(cwd));
-    for (size_t i = 0; ps1[i] != '\0' && o + 1 < outlen; ++i) {
-        char c = ps1[i];
-        if (c == '\\' && ps1[i+1] != '\0') {
-            ++i;
-            char esc = ps1[i];
-            const char *rep = NULL;
-            char tmp[2] = {0,0};
-            switch (esc) {
-                case 'u':
-                    rep = username;
-                    break;
-                case 'h':
-                    rep = (hostname && hostname[0] != '\0') ? hostname : "";
-                    break;
-                case '$':
-                    tmp[0] = '$'; rep = tmp; break;
-                case 'n':
-                    tmp[0] = '\n'; rep = tmp; break;
-                case 'e':
-                    tmp[0] = '\x1b'; rep = tmp; break;
-                case '\\':
-                    tmp[0] = '\\'; rep = tmp; break;
-                case 'w':
-                    /* full cwd with home abbrev for non-root */
-                    format_path_abbrev(cwd, tmpbuf, sizeof(tmpbuf), 0);
-                    rep = tmpbuf;
-                    break;
-                case 'W':
-                    /* basename with home-abbrev rules */
-                    format_path_abbrev(cwd, tmpbuf, sizeof(tmpbuf), 1);
-                    rep = tmpbuf;
-                    break;
-                default:
-                    /* unknown escape -> keep backslash + char */
-                    if (o + 2 < outlen) {
-                        out[o++] = '\\';
-                        out[o++] = esc;
-                    }
-                    rep = NULL;
-                    break;
-            }
-            if (rep) {
-                size_t rlen = strlen(rep);
-                size_t copy = rlen;
-                if (o + copy >= outlen) copy = outlen - 1 - o;
-                if (copy > 0) {
-                    memcpy(out + o, rep, copy);
-                    o += copy;
-                }
-            }
-        } else {
-            out[o++] = c;
-        }
-    }
-    out[o] = '\0';
-}
-
-/* Build the prompt string into dst (of dstlen). If PS1 env var present, expand it
- * with supported escapes. Otherwise build default: [username@hostname folder] $ with colors.
- */
-static void build_prompt(char *dst, size_t dstlen, const char *username, const char *hostname) {
-    const char *ps1 = getenv("PS1");
-    bool use_tty_colors = isatty(STDOUT_FILENO);
-    char folder[PATH_MAX];
-    char cwd[PATH_MAX];
-    cwd[0] = '\0';
-    get_cwd_safe(cwd, sizeof(cwd));
-    format_path_abbrev(cwd, folder, sizeof(folder), 1); /* basename with home-abbrev rules */
-
-    if (ps1 && ps1[0] != '\0') {
-        expand_ps1(ps1, dst, dstlen, username, hostname);
-        return;
-    }
-
-    const char *clr_user = use_tty_colors ? "\x1b[32m" : ""; /* green */
-    const char *clr_host = use_tty_colors ? "\x1b[36m" : ""; /* cyan */
-    const char *clr_folder = use_tty_colors ? "\x1b[33m" : ""; /* yellow */
-    const char *clr_reset = use_tty_colors ? "\x1b[0m"  : "";
-
-    if (hostname && hostname[0] != '\0') {
-        /* [user@host folder] $ */
-        snprintf(dst, dstlen, "[%s%s%s@%s%s%s %s%s%s] $ ",
-                 clr_user, username, clr_reset,
-                 clr_host, hostname, clr_reset,
-                 clr_folder, folder, clr_reset);
-    } else {
-        /* [user folder] $ */
-        snprintf(dst, dstlen, "[%s%s%s %s%s%s] $ ",
-                 clr_user, username, clr_reset,
-                 clr_folder, folder, clr_reset);
-    }
-}
-
-#ifndef _WIN32
-/* POSIX: simple line reader with basic editing and history navigation.
- * Returns:
- *  1 - read a line successfully (buf filled, NUL-terminated)
- *  0 - EOF (caller should exit)
- * -1 - input cancelled (Ctrl-C) -> caller should continue loop and show prompt
- */
-static int read_line_posix(char *buf, size_t buflen, const char *prompt) {
-    #include <termios.h>
-    struct termios orig, raw;
-    if (tcgetattr(STDIN_FILENO, &orig) == -1) {
-        /* Fallback: use fgets if tcgetattr not supported */
-        if (!fgets(buf, buflen, stdin)) return 0;
-        size_t len = strlen(buf);
-        if (len && (buf[len-1] == '\n' || buf[len-1] == '\r')) buf[len-1] = '\0';
-        return 1;
-    }
-    raw = orig;
-    raw.c_lflag &= ~(ECHO | ICANON);
-    raw.c_cc[VMIN] = 1;
-    raw.c_cc[VTIME] = 0;
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
-        /* If we can't set, fallback to fgets */
-        if (!fgets(buf, buflen, stdin)) return 0;
-        size_t len = strlen(buf);
-        if (len && (buf[len-1] == '\n' || buf[len-1] == '\r')) buf[len-1] = '\0';
-        return 1;
-    }
-
-    size_t len = 0;
-    size_t prev_display_len = 0;
-    size_t prompt_len = strlen(prompt);
-    int history_index = history_count_get(); /* one past last */
-    bool done = false;
-
-    /* Print prompt */
-    (void)write(STDOUT_FILENO, prompt, prompt_len);
-
-    while (!done) {
-        unsigned char c;
-        ssize_t r = read(STDIN_FILENO, &c, 1);
-        if (r == 0) {
-            /* EOF */
-            tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig);
-            return 0;
-        }
-        if (r < 0) {
-            if (errno == EINTR) {
-                if (got_sigint) {
-                    /* clear line and return interrupted */
-                    tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig);
-                    write(STDOUT_FILENO, "\n", 1);
-                    got_sigint = 0;
-                    return -1;
-                }
-                continue;
-            } else {
-                tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig);
-                return 0;
-            }
-        }
-
-        if (c == 0x03) { /* Ctrl-C */
-            /* cancel line */
-            write(STDOUT_FILENO, "\n", 1);
-            tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig);
-            return -1;
-        } else if (c == '\r' || c == '\n') {
-            /* Enter: finish */
-            write(STDOUT_FILENO, "\n", 1);
-            buf[len] = '\0';
-            tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig);
-            return 1;
-        } else if (c == 0x7f || c == 0x08) {
-            /* Backspace/Delete */
-            if (len > 0) {
-                len--;
-                /* erase character on screen */
-                const char *bs = "\b \b";
-                write(STDOUT_FILENO, bs, 3);
-            }
-        } else if (c == 0x1b) {
-            /* Escape sequence: attempt to read two more bytes (CSI) */
-            unsigned char seq[2] = {0,0};
-            /* Try to read next two bytes without blocking for too long */
-            ssize_t r1 = read(STDIN_FILENO, &seq[0], 1);
-            if (r1 <= 0) continue;
-            ssize_t r2 = read(STDIN_FILENO, &seq[1], 1);
-            if (r2 <= 0) continue;
-            if (seq[0] == '[') {
-                if (seq[1] == 'A') {
-                    /* Up arrow -> previous history */
-                    if (history_count_get() == 0) continue;
-                    if (history_index > 0) history_index--;
-                    /* load history[history_index] into buf */
-                    const char *hline = history_get(history_index);
-                    if (!hline) continue;
-                    size_t hlen = strlen(hline);
-                    if (hlen >= buflen) hlen = buflen - 1;
-                    /* overwrite buffer */
-                    len = hlen;
-                    memcpy(buf, hline, hlen);
-                    buf[len] = '\0';
-                    /* redraw prompt + buffer, clearing leftover */
-                    size_t now_display_len = prompt_len + len;
-                    /* clear line: move to beginning and print prompt+content + padding */
-                    write(STDOUT_FILENO, "\r", 1);
-                    write(STDOUT_FILENO, prompt, prompt_len);
-                    write(STDOUT_FILENO, buf, len);
-                    /* if previous display longer, pad spaces to erase */
-                    if (prev_display_len > now_display_len) {
-                        size_t pad = prev_display_len - now_display_len;
-                        for (size_t i = 0; i < pad; ++i) write(STDOUT_FILENO, " ", 1);
-                    }
-                    /* move cursor to end of new content */
-                    /* and update prev_display_len */
-                    prev_display_len = now_display_len;
-                } else if (seq[1] == 'B') {
-                    /* Down arrow -> next history (or clear) */
-                    if (history_count_get() == 0) continue;
-                    if (history_index < history_count_get() - 1) {
-                        history_index++;
-                        const char *hline = history_get(history_index);
-                        if (!hline) continue;
-                        size_t hlen = strlen(hline);
-                        if (hlen >= buflen) hlen = buflen - 1;
-                        len = hlen;
-                        memcpy(buf, hline, hlen);
-                        buf[len] = '\0';
-                    } else {
-                        /* move to empty new entry (one past last) */
-                        history_index = history_count_get();
-                        len = 0;
-                        buf[0] = '\0';
-                    }
-                    size_t now_display_len = prompt_len + len;
-                    write(STDOUT_FILENO, "\r", 1);
-                    write(STDOUT_FILENO, prompt, prompt_len);
-                    write(STDOUT_FILENO, buf, len);
-                    if (prev_display_len > now_display_len) {
-                        size_t pad = prev_display_len - now_display_len;
-                        for (size_t i = 0; i < pad; ++i) write(STDOUT_FILENO, " ", 1);
-                    }
-                    prev_display_len = now_display_len;
-                } else if (seq[1] == 'C') {
-                    /* Right arrow - ignore for now (no cursor history) */
-                } else if (seq[1] == 'D') {
-                    /* Left arrow - ignore for now */
-                }
-            }
-        } else if (c >= 0x20 && c < 0x7f) {
-            /* Printable ASCII */
-            if (len + 1 < buflen) {
-                buf[len++] = (char)c;
-                /* echo char */
-                char ch = (char)c;
-                write(STDOUT_FILENO, &ch, 1);
-                prev_display_len = prompt_len + len;
-            } else {
-                /* buffer full; ignore further chars */
-            }
-        } else {
-            /* ignore other control chars */
-        }
-    }
-
-    /* restore */
-    tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig);
-    return 0;
-}
-#endif
-
 /* Fallback read_line for systems without termios (Windows builds) */
 #ifdef _WIN32
-static int read_line_fgets(char *buf, size_t buflen, const char *prompt) {
+static int read_line_fgets(const char *prompt, char **line) {
+    static char buf[4096];
     fputs(prompt, stdout);
     fflush(stdout);
-    if (!fgets(buf, buflen, stdin)) {
+    if (!fgets(buf, sizeof(buf), stdin)) {
         if (feof(stdin)) {
             fputs("\n", stdout);
             return 0;
@@ -517,66 +63,101 @@ static int read_line_fgets(char *buf, size_t buflen, const char *prompt) {
     }
     size_t len = strlen(buf);
     if (len && (buf[len-1] == '\n' || buf[len-1] == '\r')) buf[len-1] = '\0';
+    *line = buf;
     return 1;
 }
 #endif
 
 /* Portable wrapper */
-static int read_line(char *buf, size_t buflen, const char *prompt) {
+static int read_line(const char *prompt, char **line) {
 #ifndef _WIN32
-    return read_line_posix(buf, buflen, prompt);
+    return lineedit_read(prompt, line);
 #else
-    return read_line_fgets(buf, buflen, prompt);
+    return read_line_fgets(prompt, line);
 #endif
 }
 
+/* Per-line parse/eval storage, rolled back after each line is executed */
+static struct arena line_arena;
+static int line_arena_ready = 0;
+
+static void line_arena_init(void) {
+    if (!line_arena_ready) {
+        arena_init(&line_arena, ARENA_DEFAULT_CHUNK);
+        line_arena_ready = 1;
+    }
+}
+
+/* Whether text stops inside a compound command, a quote, after an
+ * operator or before the end of a here-document, so that the command goes
+ * on in the next line */
+static bool needs_more(const char *text) {
+    line_arena_init();
+    struct arena_mark mark = arena_mark(&line_arena);
+    struct parser p;
+    parser_init(&p, &line_arena, text, strlen(text));
+    while (parser_next(&p) != NULL) {
+    }
+    arena_release(&line_arena, mark);
+    return (p.err.msg && p.err.incomplete) || p.lx.incomplete;
+}
+
+/* Read a whole command: the first line, then continuation lines with $PS2
+ * for as long as it is incomplete. Returns a malloc'd string, or NULL if
+ * reading was interrupted. */
+static char *read_command(char *first) {
+    char *text = strdup(first);
+    while (text && needs_more(text)) {
+        const char *ps2 = var_get("PS2");
+        char *more;
+        if (read_line(ps2 ? ps2 : "> ", &more) != 1) {
+            free(text);
+            return NULL;
+        }
+        size_t len = strlen(text), n = strlen(more);
+        char *grown = realloc(text, len + n + 2);
+        if (!grown) {
+            free(text);
+            return NULL;
+        }
+        text = grown;
+        text[len] = '\n';
+        memcpy(text + len + 1, more, n + 1);
+    }
+    return text;
+}
+
 /* Forward-declare helper used by `source` builtin too */
 int shell_eval_line(const char *line) {
     if (!line) return -1;
-    char buf[512];
-    strncpy(buf, line, sizeof(buf) - 1);
-    buf[sizeof(buf) - 1] = '\0';
+    size_t len = strlen(line);
     /* Trim trailing newline/carriage return */
-    size_t len = strlen(buf);
-    while (len > 0 && (buf[len-1] == '\n' || buf[len-1] == '\r')) {
-        buf[--len] = '\0';
-    }
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) len--;
     /* Ignore empty lines */
     if (len == 0) return 0;
-    history_add(buf);
-    char *argv[32];
-    int argc = 0;
-    char *tok = strtok(buf, " ");
-    while (tok && argc < 31) {
-        argv[argc++] = tok;
-        tok = strtok(NULL, " ");
-    }
-    if (argc == 0) return 0;
-    argv[argc] = NULL;
-    /* Alias expansion */
-    for (int i = 0; i < alias_count; ++i) {
-        if (strcmp(argv[0], names[i]) == 0) {
-            argv[0] = values[i];
-            break;
-        }
-    }
-    /* Builtins handled inline */
-    if (strcmp(argv[0], "history") == 0) { history_show(); return 0; }
-    if (strcmp(argv[0], "export") == 0 && argc == 2) { char *eq = strchr(argv[1], '='); if (eq) { *eq = 0; env_export(argv[1], eq + 1); } return 0; }
-    if (strcmp(argv[0], "unset") == 0 && argc == 2) { env_unset(argv[1]); return 0; }
-    if (strcmp(argv[0], "env") == 0) { env_show(); return 0; }
-    if (strcmp(argv[0], "alias") == 0) { if (argc == 3) alias_set(argv[1], argv[2]); alias_show(); return 0; }
-    if (strcmp(argv[0], "unalias") == 0 && argc == 2) { alias_unset(argv[1]); return 0; }
-
-    if (exec_builtin(argv[0], argc, argv) == -1) {
-        printf("Unknown command: %s\n", argv[0]);
+    history_add(line);
+
+    line_arena_init();
+    /* A mark (rather than a reset) keeps nested calls from `source` safe */
+    struct arena_mark mark = arena_mark(&line_arena);
+    struct parse_error err;
+    struct node *n = parse_buffer(&line_arena, line, len, &err);
+    int status;
+    if (err.msg) {
+        parse_error_print(NULL, &err);
+        status = 2;
+        eval_last_status = status;
+    } else {
+        status = eval_node(&line_arena, n);
     }
-    return 0;
+    arena_release(&line_arena, mark);
+    return status;
 }
 
 void shell_start(const char *version) {
+    shell_interactive = 1;
     /* For fastfetch / compatibility */
-    setenv("KSH_VERSION", version ? version : KSH_RELEASE, 1);
+    var_set("KSH_VERSION", version ? version : KSH_RELEASE, VAR_EXPORT);
 
     /* Install SIGINT handler */
     struct sigaction sa;
@@ -586,22 +167,27 @@ void shell_start(const char *version) {
     sa.sa_flags = 0;
     sigaction(SIGINT, &sa, NULL);
 
+    /* Own process group and the terminal; jobs get groups of their own */
+    jobs_init_interactive();
+
+    /* Piped input never gets here (see main), so this is a terminal session */
+    history_open();
+    load_kshrc();
+
     /* Interactive loop using our portable read_line */
-    char buf[512];
-    char prompt[512];
-    const char *username = get_username();
-    const char *hostname = get_hostname();
+    char *line;
 
-    /* Line-buffer stdout for speed when not redirected */
-    setvbuf(stdout, NULL, _IOLBF, 0);
+    /* Line-buffered on a terminal, fully buffered otherwise */
+    setvbuf(stdout, NULL, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, 0);
 
     for (;;) {
-        username = get_username();
-        hostname = get_hostname();
+        /* finished and stopped background jobs, since the last prompt */
+        jobs_notify();
 
-        build_prompt(prompt, sizeof(prompt), username, hostname);
+        /* cached; rebuilt only after cd, a command, or a change to PS1/HOME */
+        const char *prompt = prompt_render(NULL);
 
-        int rl = read_line(buf, sizeof(buf), prompt);
+        int rl = read_line(prompt, &line);
         if (rl == 0) {
             /* EOF -> exit */
             break;
@@ -609,7 +195,19 @@ void shell_start(const char *version) {
             /* interrupted (Ctrl-C) -> show fresh prompt */
             continue;
         } else {
-            shell_eval_line(buf);
+            char *text = read_command(line);
+            if (!text) continue;
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            /* a Ctrl-C from the last command must not stop this one */
+            got_sigint = 0;
+            shell_eval_line(text);
+            fflush(stdout);
+            free(text);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            prompt_command_done(eval_last_status,
+                                (long long)(t1.tv_sec - t0.tv_sec) * 1000000000LL +
+                                (t1.tv_nsec - t0.tv_nsec));
         }
     }
 
@@ -0,0 +1,258 @@
+/*
+ * test and [: conditional expressions, evaluated in-process.
+ *
+ * Up to four arguments follow the POSIX rules, which decide by argument
+ * count how ambiguous words like "!" or "-a" are read. Longer expressions
+ * go through a small recursive-descent parser:
+ *
+ *     or      := and { -o and }
+ *     and     := not { -a not }
+ *     not     := ! not | primary
+ *     primary := ( or ) | unary-op word | word binary-op word | word
+ *
+ * Exit status is 0 for true, 1 for false and 2 for a malformed expression.
+ */
+
+#define _GNU_SOURCE
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "var.h"
+
+struct texpr {
+    const char *cmd;            /* "test" or "[", for messages */
+    char **argv;
+    int pos, end;
+    int err;
+};
+
+static void texpr_error(struct texpr *t, const char *word, const char *msg) {
+    if (t->err) return;
+    t->err = 1;
+    if (word) fprintf(stderr, "%s: %s: %s\n", t->cmd, word, msg);
+    else fprintf(stderr, "%s: %s\n", t->cmd, msg);
+}
+
+static int is_unary_op(const char *s) {
+    return s[0] == '-' && s[1] && !s[2] && strchr("bcdefghkLnprsStuwxzOGNv", s[1]);
+}
+
+static int is_binary_op(const char *s) {
+    static const char *const ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+        "-nt", "-ot", "-ef", NULL,
+    };
+    for (int i = 0; ops[i]; ++i) {
+        if (strcmp(s, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/* Integers may have surrounding blanks and a sign, as in bash */
+static int to_int(struct texpr *t, const char *s, long long *out) {
+    const char *p = s;
+    while (isblank((unsigned char)*p)) ++p;
+    char *end;
+    errno = 0;
+    *out = strtoll(p, &end, 10);
+    const char *rest = end;
+    while (isblank((unsigned char)*rest)) ++rest;
+    if (end == p || *rest || errno == ERANGE) {
+        texpr_error(t, s, "integer expression expected");
+        return -1;
+    }
+    return 0;
+}
+
+static int unary(const char *op, const char *arg) {
+    struct stat st;
+    switch (op[1]) {
+    case 'n': return *arg != 0;
+    case 'z': return *arg == 0;
+    case 't': return isatty(atoi(arg));
+    case 'v': {
+        const struct var *v = var_lookup(arg);
+        return v && v->set;
+    }
+    case 'h':
+    case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    case 'r': return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+    case 'w': return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+    case 'x': return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+    }
+    if (stat(arg, &st) != 0) return 0;
+    switch (op[1]) {
+    case 'e': return 1;
+    case 'f': return S_ISREG(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 'S': return S_ISSOCK(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    case 'k': return (st.st_mode & S_ISVTX) != 0;
+    case 'O': return st.st_uid == geteuid();
+    case 'G': return st.st_gid == getegid();
+    case 'N':
+        return st.st_mtim.tv_sec > st.st_atim.tv_sec ||
+               (st.st_mtim.tv_sec == st.st_atim.tv_sec && st.st_mtim.tv_nsec > st.st_atim.tv_nsec);
+    }
+    return 0;
+}
+
+/* -1, 0 or 1 as a's mtime is older, equal or newer than b's */
+static int cmp_mtime(const struct stat *a, const struct stat *b) {
+    if (a->st_mtim.tv_sec != b->st_mtim.tv_sec) return a->st_mtim.tv_sec < b->st_mtim.tv_sec ? -1 : 1;
+    if (a->st_mtim.tv_nsec != b->st_mtim.tv_nsec) return a->st_mtim.tv_nsec < b->st_mtim.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+static int binary(struct texpr *t, const char *a, const char *op, const char *b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(a, b) > 0;
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        struct stat sa, sb;
+        int ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+        if (op[1] == 'e') return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (op[1] == 'n') return ha && (!hb || cmp_mtime(&sa, &sb) > 0);
+        return hb && (!ha || cmp_mtime(&sa, &sb) < 0);
+    }
+
+    long long x, y;
+    if (to_int(t, a, &x) != 0 || to_int(t, b, &y) != 0) return 0;
+    switch (op[1] << 8 | op[2]) {
+    case 'e' << 8 | 'q': return x == y;
+    case 'n' << 8 | 'e': return x != y;
+    case 'l' << 8 | 't': return x < y;
+    case 'l' << 8 | 'e': return x <= y;
+    case 'g' << 8 | 't': return x > y;
+    case 'g' << 8 | 'e': return x >= y;
+    }
+    return 0;
+}
+
+/* ---- general expressions ---- */
+
+static int parse_or(struct texpr *t);
+
+static const char *peek(struct texpr *t, int ahead) {
+    return t->pos + ahead < t->end ? t->argv[t->pos + ahead] : NULL;
+}
+
+static int parse_primary(struct texpr *t) {
+    const char *w = peek(t, 0);
+    if (!w) {
+        texpr_error(t, NULL, "argument expected");
+        return 0;
+    }
+    const char *op = peek(t, 1);
+    if (op && peek(t, 2) && is_binary_op(op)) {
+        t->pos += 3;
+        return binary(t, w, op, t->argv[t->pos - 1]);
+    }
+    if (strcmp(w, "(") == 0) {
+        t->pos++;
+        int v = parse_or(t);
+        const char *close = peek(t, 0);
+        if (!close || strcmp(close, ")") != 0) {
+            texpr_error(t, NULL, "`)' expected");
+            return 0;
+        }
+        t->pos++;
+        return v;
+    }
+    if (is_unary_op(w) && op) {
+        t->pos += 2;
+        return unary(w, op);
+    }
+    t->pos++;
+    return *w != 0;
+}
+
+static int parse_not(struct texpr *t) {
+    const char *w = peek(t, 0);
+    if (w && strcmp(w, "!") == 0) {
+        t->pos++;
+        return !parse_not(t);
+    }
+    return parse_primary(t);
+}
+
+static int parse_and(struct texpr *t) {
+    int v = parse_not(t);
+    const char *w;
+    while ((w = peek(t, 0)) && strcmp(w, "-a") == 0) {
+        t->pos++;
+        v = parse_not(t) && v;
+    }
+    return v;
+}
+
+static int parse_or(struct texpr *t) {
+    int v = parse_and(t);
+    const char *w;
+    while ((w = peek(t, 0)) && strcmp(w, "-o") == 0) {
+        t->pos++;
+        v = parse_and(t) || v;
+    }
+    return v;
+}
+
+/* ---- POSIX rules by argument count ---- */
+
+static int eval_args(struct texpr *t, int start, int n) {
+    char **a = t->argv + start;
+    switch (n) {
+    case 0:
+        return 0;
+    case 1:
+        return *a[0] != 0;
+    case 2:
+        if (strcmp(a[0], "!") == 0) return *a[1] == 0;
+        if (is_unary_op(a[0])) return unary(a[0], a[1]);
+        texpr_error(t, a[0], "unary operator expected");
+        return 0;
+    case 3:
+        if (is_binary_op(a[1])) return binary(t, a[0], a[1], a[2]);
+        if (strcmp(a[1], "-a") == 0) return *a[0] && *a[2];
+        if (strcmp(a[1], "-o") == 0) return *a[0] || *a[2];
+        if (strcmp(a[0], "!") == 0) return !eval_args(t, start + 1, 2);
+        if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0) return *a[1] != 0;
+        texpr_error(t, a[1], "binary operator expected");
+        return 0;
+    case 4:
+        if (strcmp(a[0], "!") == 0) return !eval_args(t, start + 1, 3);
+        if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0) return eval_args(t, start + 1, 2);
+        break;
+    }
+    t->pos = start;
+    int v = parse_or(t);
+    if (!t->err && t->pos < t->end) texpr_error(t, t->argv[t->pos], "syntax error");
+    return v;
+}
+
+int builtin_test(int argc, char **argv) {
+    struct texpr t = { .cmd = argv[0], .argv = argv, .pos = 1, .end = argc };
+    if (strcmp(argv[0], "[") == 0) {
+        if (argc < 2 || strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing `]'\n");
+            return 2;
+        }
+        t.end = --argc;
+    }
+    int v = eval_args(&t, 1, argc - 1);
+    if (t.err) return 2;
+    return !v;
+}
@@ -1,22 +1,16 @@
 #include "../include/utils.h"
+#include "../include/rcfile.h"
+#include "../include/var.h"
 #include <iostream>
-#include <fstream>
 #include <string>
 
 void print_banner(const std::string& version) {
     std::cout << "kzsh-" << version << std::endl;
 }
 
-bool load_kshrc() {
-    const char* home = getenv("HOME");
-    if (!home) return false;
+int load_kshrc(void) {
+    const char* home = var_get("HOME");
+    if (!home || !*home) return 0;
     std::string rcfile = std::string(home) + "/.kshrc";
-    std::ifstream rc(rcfile);
-    if (rc) {
-        std::cout << "Loading .kshrc..." << std::endl;
-        // TODO: parse and execute .kshrc
-        rc.close();
-        return true;
-    }
-    return false;
+    return rcfile_load(rcfile.c_str()) != -1;
 }
@@ -0,0 +1,431 @@
+/*
+ * Shell variable table: open-addressing (linear probing) hash table of
+ * name -> struct var, with backward-shift deletion like the alias store.
+ *
+ * Each variable is kept as a single "NAME=value" string, so the envp
+ * array handed to children is just pointers to those strings. The array
+ * is rebuilt lazily, only when an exported variable has changed since it
+ * was last handed out; setting shell-local variables in a loop and
+ * spawning commands never touches it.
+ */
+
+#include "../include/var.h"
+#include "../include/arith.h"
+#include "../include/cmdhash.h"
+#include "../include/history.h"
+#include "../include/out.h"
+#include "../include/pathglob.h"
+#include "../include/prompt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+struct var_slot {
+    struct var *var;        /* NULL marks an empty slot */
+    uint32_t hash;
+};
+
+static struct var_slot *table = NULL;
+static size_t table_cap = 0;    /* always a power of two */
+static size_t table_used = 0;
+
+static char **envp = NULL;
+static size_t envp_cap = 0;
+static int envp_dirty = 1;
+
+/* ---- table ---- */
+
+static uint32_t hash_mem(const char *s, size_t len) {
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct var_slot *find_slot(const char *name, size_t len, uint32_t h) {
+    size_t mask = table_cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        struct var_slot *e = &table[i];
+        if (!e->var) return e;
+        if (e->hash == h && e->var->name_len == len && memcmp(e->var->str, name, len) == 0) return e;
+    }
+}
+
+static int grow(void) {
+    size_t ncap = table_cap ? table_cap * 2 : 128;
+    struct var_slot *old = table;
+    size_t ocap = table_cap;
+    table = calloc(ncap, sizeof(*table));
+    if (!table) {
+        table = old;
+        return -1;
+    }
+    table_cap = ncap;
+    for (size_t i = 0; i < ocap; ++i) {
+        if (old[i].var) *find_slot(old[i].var->str, old[i].var->name_len, old[i].hash) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+static struct var *find(const char *name, size_t len) {
+    if (!table_used) return NULL;
+    return find_slot(name, len, hash_mem(name, len))->var;
+}
+
+static char *make_str(const char *name, size_t len, const char *value) {
+    size_t vlen = value ? strlen(value) : 0;
+    char *s = malloc(len + vlen + 2);
+    if (!s) return NULL;
+    memcpy(s, name, len);
+    s[len] = '=';
+    if (vlen) memcpy(s + len + 1, value, vlen);
+    s[len + 1 + vlen] = '\0';
+    return s;
+}
+
+/* Caches derived from particular variables */
+static void var_changed(const char *name, unsigned flags) {
+    if (flags & VAR_EXPORT) envp_dirty = 1;
+    if (strcmp(name, "PATH") == 0) cmdhash_clear();
+    else if (strcmp(name, "HISTSIZE") == 0) history_set_size(-1);
+    else if (strcmp(name, "HOME") == 0) prompt_invalidate(PROMPT_HOME);
+    else if (strcmp(name, "GLOB_THREADS") == 0) {
+        const char *v = var_get(name);
+        pathglob_set_threads(v ? atoi(v) : 0);
+    }
+    else if (strcmp(name, "PS1") == 0) prompt_invalidate(PROMPT_PS1);
+}
+
+/* Find or create name's entry; a new one is declared without a value */
+static struct var *intern(const char *name, size_t len) {
+    uint32_t h = hash_mem(name, len);
+    /* keep the load factor at or below 1/2 */
+    if ((table_used + 1) * 2 > table_cap && grow() != 0) return NULL;
+    struct var_slot *e = find_slot(name, len, h);
+    if (e->var) return e->var;
+    struct var *v = calloc(1, sizeof(*v));
+    if (!v) return NULL;
+    v->str = make_str(name, len, NULL);
+    if (!v->str) {
+        free(v);
+        return NULL;
+    }
+    v->name_len = len;
+    e->var = v;
+    e->hash = h;
+    table_used++;
+    return v;
+}
+
+static int replace_value(struct var *v, const char *value) {
+    if (v->set && value) {
+        /* a value no longer and not much shorter (a loop variable, a
+         * counter) is written over the old one */
+        char *old = VAR_VALUE(v);
+        size_t vlen = strlen(value), olen = strlen(old);
+        if (vlen <= olen && olen - vlen <= 16) {
+            memmove(old, value, vlen + 1);
+            v->flags &= ~VAR_ARRAY;
+            return 0;
+        }
+    }
+    char *s = make_str(v->str, v->name_len, value);
+    if (!s) return -1;
+    free(v->str);
+    v->str = s;
+    v->set = 1;
+    v->flags &= ~VAR_ARRAY;
+    return 0;
+}
+
+static void remove_var(const char *name, size_t len) {
+    struct var_slot *e = find_slot(name, len, hash_mem(name, len));
+    if (!e->var) return;
+    free(e->var->str);
+    free(e->var);
+    table_used--;
+
+    /* backward-shift: pull later members of the probe run into the hole */
+    size_t mask = table_cap - 1;
+    size_t hole = (size_t)(e - table);
+    for (size_t i = (hole + 1) & mask; table[i].var; i = (i + 1) & mask) {
+        size_t home = table[i].hash & mask;
+        /* move it unless its home lies cyclically in (hole, i] */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table[hole] = table[i];
+            hole = i;
+        }
+    }
+    table[hole].var = NULL;
+}
+
+/* Integer attribute: a value is evaluated as an arithmetic expression and
+ * stored in decimal. arith_eval has already reported a failure. */
+static int to_integer(const char *value, char *out, size_t outlen) {
+    long long n;
+    if (arith_eval(value, &n) != 0) return -1;
+    snprintf(out, outlen, "%lld", n);
+    return 0;
+}
+
+/* ---- public interface ---- */
+
+int var_valid_name(const char *name, size_t len) {
+    if (len == 0 || (name[0] >= '0' && name[0] <= '9')) return 0;
+    for (size_t i = 0; i < len; ++i) {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void var_init(void) {
+    extern char **environ;
+    for (char **e = environ; *e; ++e) {
+        const char *eq = strchr(*e, '=');
+        if (!eq || !var_valid_name(*e, (size_t)(eq - *e))) continue;
+        struct var *v = intern(*e, (size_t)(eq - *e));
+        if (!v || replace_value(v, eq + 1) != 0) continue;
+        v->flags |= VAR_EXPORT;
+    }
+    envp_dirty = 1;
+}
+
+const struct var *var_lookup(const char *name) {
+    return find(name, strlen(name));
+}
+
+const char *var_get(const char *name) {
+    const struct var *v = find(name, strlen(name));
+    return v && v->set ? VAR_VALUE(v) : NULL;
+}
+
+int var_set(const char *name, const char *value, unsigned flags) {
+    size_t len = strlen(name);
+    if (!var_valid_name(name, len)) {
+        fprintf(stderr, "kzsh: `%s': not a valid identifier\n", name);
+        return -1;
+    }
+    struct var *v = find(name, len);
+    if (v && (v->flags & VAR_READONLY)) {
+        fprintf(stderr, "kzsh: %s: readonly variable\n", name);
+        return -1;
+    }
+    char num[32];
+    if ((flags | (v ? v->flags : 0)) & VAR_INTEGER) {
+        if (to_integer(value, num, sizeof(num)) != 0) return -1;
+        value = num;
+    }
+    if (!v) v = intern(name, len);
+    if (!v || replace_value(v, value) != 0) {
+        fprintf(stderr, "kzsh: %s: %s\n", name, strerror(ENOMEM));
+        return -1;
+    }
+    v->flags |= flags;
+    var_changed(name, v->flags);
+    return 0;
+}
+
+int var_set_array(const char *name, const char *const *values, int n) {
+    size_t len = strlen(name);
+    struct var *v = find(name, len);
+    if (v && (v->flags & VAR_READONLY)) return -1;
+    size_t size = 0;
+    for (int i = 0; i < n; ++i) size += strlen(values[i]) + 1;
+    if (!v && !(v = intern(name, len))) return -1;
+    /* an old value at least as big is reused, as replace_value does; an
+     * identical one (PIPESTATUS after most commands) is left alone */
+    size_t have = 0;
+    if (v->set) {
+        const char *e = VAR_VALUE(v);
+        int same = (v->flags & VAR_ARRAY) && v->nelems == n;
+        for (int i = 0; i < ((v->flags & VAR_ARRAY) ? v->nelems : 1); ++i) {
+            size_t k = strlen(e + have) + 1;
+            if (same && (i >= n || memcmp(e + have, values[i], k) != 0)) same = 0;
+            have += k;
+        }
+        if (same) return 0;
+    }
+    if (!v->set || have < size || size == 0) {
+        char *s = malloc(len + 1 + (size ? size : 1));
+        if (!s) return -1;
+        memcpy(s, name, len + 1);
+        s[len] = '=';
+        free(v->str);
+        v->str = s;
+    }
+    char *p = VAR_VALUE(v);
+    *p = '\0';
+    for (int i = 0; i < n; ++i) {
+        size_t k = strlen(values[i]) + 1;
+        memcpy(p, values[i], k);
+        p += k;
+    }
+    v->set = 1;
+    v->nelems = n;
+    v->flags |= VAR_ARRAY;
+    var_changed(name, v->flags);
+    return 0;
+}
+
+const char *var_elem(const struct var *v, int i) {
+    if (!v || !v->set || i < 0) return NULL;
+    if (!(v->flags & VAR_ARRAY)) return i == 0 ? VAR_VALUE(v) : NULL;
+    if (i >= v->nelems) return NULL;
+    const char *e = VAR_VALUE(v);
+    while (i-- > 0) e += strlen(e) + 1;
+    return e;
+}
+
+int var_set_flags(const char *name, unsigned flags) {
+    size_t len = strlen(name);
+    if (!var_valid_name(name, len)) {
+        fprintf(stderr, "kzsh: `%s': not a valid identifier\n", name);
+        return -1;
+    }
+    struct var *v = intern(name, len);
+    if (!v) {
+        fprintf(stderr, "kzsh: %s: %s\n", name, strerror(ENOMEM));
+        return -1;
+    }
+    if ((flags & VAR_INTEGER) && !(v->flags & VAR_INTEGER) && v->set) {
+        char num[32];
+        if (to_integer(VAR_VALUE(v), num, sizeof(num)) != 0) snprintf(num, sizeof(num), "0");
+        replace_value(v, num);
+    }
+    if ((flags & ~v->flags) & VAR_EXPORT) envp_dirty = 1;
+    v->flags |= flags;
+    return 0;
+}
+
+void var_restore(const char *name, const char *value, unsigned flags) {
+    size_t len = strlen(name);
+    struct var *v = find(name, len);
+    unsigned old = v ? v->flags : 0;
+    if (!value && !flags) {
+        if (v) remove_var(name, len);
+    } else if (!value) {
+        /* declared with attributes but never given a value */
+        if (!v) v = intern(name, len);
+        if (!v || replace_value(v, NULL) != 0) return;
+        v->set = 0;
+        v->flags = flags;
+    } else {
+        if (!v) v = intern(name, len);
+        if (!v || replace_value(v, value) != 0) return;
+        v->flags = flags & ~VAR_ARRAY;
+    }
+    var_changed(name, old | flags);
+}
+
+int var_unset(const char *name) {
+    size_t len = strlen(name);
+    struct var *v = find(name, len);
+    if (!v) return 0;
+    if (v->flags & VAR_READONLY) {
+        fprintf(stderr, "kzsh: %s: cannot unset: readonly variable\n", name);
+        return -1;
+    }
+    unsigned flags = v->flags;
+    remove_var(name, len);
+    var_changed(name, flags);
+    return 0;
+}
+
+char **var_envp(void) {
+    if (!envp_dirty && envp) return envp;
+    size_t n = 0;
+    for (size_t i = 0; i < table_cap; ++i) {
+        const struct var *v = table[i].var;
+        if (v && v->set && (v->flags & VAR_EXPORT)) n++;
+    }
+    if (n + 1 > envp_cap) {
+        size_t ncap = envp_cap ? envp_cap : 64;
+        while (ncap < n + 1) ncap *= 2;
+        char **grown = realloc(envp, sizeof(*grown) * ncap);
+        if (!grown) {
+            /* the old array may point at freed values: hand out nothing */
+            static char *empty[1] = { NULL };
+            return empty;
+        }
+        envp = grown;
+        envp_cap = ncap;
+    }
+    n = 0;
+    for (size_t i = 0; i < table_cap; ++i) {
+        const struct var *v = table[i].var;
+        if (v && v->set && (v->flags & VAR_EXPORT)) envp[n++] = v->str;
+    }
+    envp[n] = NULL;
+    envp_dirty = 0;
+    return envp;
+}
+
+/* cmd [-flags] NAME='value', with embedded quotes written as '\'' so the
+ * output can be fed back to the shell */
+void var_print(struct out *o, const char *cmd, const struct var *v, int with_flags) {
+    out_str(o, cmd);
+    if (with_flags) {
+        out_write(o, " -", 2);
+        if (v->flags & VAR_ARRAY) out_putc(o, 'a');
+        if (v->flags & VAR_INTEGER) out_putc(o, 'i');
+        if (v->flags & VAR_READONLY) out_putc(o, 'r');
+        if (v->flags & VAR_EXPORT) out_putc(o, 'x');
+        if (!(v->flags & (VAR_ARRAY | VAR_INTEGER | VAR_READONLY | VAR_EXPORT))) out_putc(o, '-');
+    }
+    out_putc(o, ' ');
+    out_write(o, v->str, v->name_len);
+    if (v->set && (v->flags & VAR_ARRAY)) {
+        /* NAME=([0]='a' [1]='b') */
+        out_write(o, "=(", 2);
+        for (int i = 0; i < v->nelems; ++i) {
+            if (i > 0) out_putc(o, ' ');
+            out_putc(o, '[');
+            out_num(o, (unsigned long long)i, 0, 0);
+            out_write(o, "]=", 2);
+            out_quoted(o, var_elem(v, i));
+        }
+        out_putc(o, ')');
+    } else if (v->set) {
+        out_putc(o, '=');
+        out_quoted(o, VAR_VALUE(v));
+    }
+    out_putc(o, '\n');
+}
+
+static int by_name(const void *a, const void *b) {
+    const struct var *x = *(const struct var *const *)a;
+    const struct var *y = *(const struct var *const *)b;
+    size_t n = x->name_len < y->name_len ? x->name_len : y->name_len;
+    int c = memcmp(x->str, y->str, n);
+    return c ? c : (x->name_len > y->name_len) - (x->name_len < y->name_len);
+}
+
+void var_show(struct out *o, const char *cmd, unsigned mask, int with_flags) {
+    if (!table_used) return;
+    const struct var **list = malloc(sizeof(*list) * table_used);
+    if (!list) return;
+    size_t n = 0;
+    for (size_t i = 0; i < table_cap; ++i) {
+        const struct var *v = table[i].var;
+        if (v && (v->flags & mask) == mask) list[n++] = v;
+    }
+    qsort(list, n, sizeof(*list), by_name);
+    for (size_t i = 0; i < n; ++i) var_print(o, cmd, list[i], with_flags);
+    free(list);
+}
+
+const struct var *var_next(size_t *pos) {
+    while (*pos < table_cap) {
+        const struct var *v = table[(*pos)++].var;
+        if (v) return v;
+    }
+    return NULL;
+}
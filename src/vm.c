@@ -0,0 +1,974 @@
+/*
+ * Bytecode VM for compound commands.
+ *
+ * if, while, until, for, case and { } are compiled once into a flat array
+ * of instructions and run by a single switch over the opcode (a jump
+ * table). Conditions and && / || become conditional jumps, loops keep
+ * their state in per-run registers, and break / continue find their target
+ * in a loop table instead of unwinding a tree walk. A simple command made
+ * only of plain words whose name is a builtin is bound to the builtin's
+ * function at compile time, with its argv already built, so running it
+ * costs no expansion, lookup or allocation. Every other command goes back
+ * to eval_node one at a time.
+ *
+ * Each loop iteration starts by releasing whatever the previous one
+ * allocated in the arena, so a loop runs in constant memory however many
+ * times it goes round.
+ *
+ * Functions are compiled when they are defined. The body is copied out of
+ * the command line into an arena of its own, together with its code, and
+ * kept in an open-addressing table (FNV-1a, backward-shift deletion) like
+ * the alias table. A function redefined while it runs stays alive until
+ * its last call returns.
+ */
+
+#define _GNU_SOURCE
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fnmatch.h>
+
+#include "alias.h"
+#include "builtins.h"
+#include "eval.h"
+#include "expand.h"
+#include "shell.h"
+#include "var.h"
+
+#define VM_MAX_REGS 256         /* registers are numbered by an unsigned char */
+#define VM_MAX_LOOPS 65535      /* and loops by an unsigned short */
+#define CALL_MAX_DEPTH 1000
+#define CALL_ARGV_INLINE 16
+
+enum op {
+    OP_EVAL,        /* eval_node: simple commands, pipelines, subshells, & */
+    OP_BUILTIN,     /* call a builtin with the argv built at compile time */
+    OP_JUMP,
+    OP_JUMP_OK,     /* jump if the status is 0 */
+    OP_JUMP_FAIL,   /* jump if it is not */
+    OP_NOT,
+    OP_STATUS,      /* the status becomes target */
+    OP_SAVE,        /* reg.status = status */
+    OP_LOAD,        /* status = reg.status */
+    OP_LOOP,        /* enter a while / until loop */
+    OP_RELEASE,     /* top of a while / until loop */
+    OP_FOR_INIT,    /* expand the word list; jump to target on error */
+    OP_FOR_NEXT,    /* assign the next word, or jump to target when done */
+    OP_CASE_INIT,   /* expand the subject; jump to target on error */
+    OP_CASE_MATCH,  /* jump to target if one of the patterns matches */
+    OP_CASE_TABLE,  /* literal patterns only: one hash lookup for the arm */
+    OP_FUNCDEF,
+    OP_END
+};
+
+struct call;
+struct case_table;
+
+struct insn {
+    unsigned char op;
+    unsigned char reg;
+    unsigned short loop;    /* innermost enclosing loop + 1; 0 outside loops */
+    int target;
+    union {
+        struct node *node;
+        const struct call *call;
+        const struct case_table *table;
+        const struct word *words;
+        const char *name;
+    } u;
+};
+
+/* Where break and continue go for each loop */
+struct loop {
+    int brk, cont;
+    int parent;             /* enclosing loop + 1 */
+};
+
+/* A builtin bound at compile time */
+struct call {
+    const struct builtin *bi;
+    struct node *node;      /* run normally if a function or alias took the name */
+    int argc;
+    char **argv;
+};
+
+struct case_entry {
+    const char *key;        /* NULL marks an empty slot */
+    size_t len;
+    uint32_t hash;
+    int target;
+};
+
+struct case_table {
+    struct case_entry *slots;
+    size_t mask;
+};
+
+struct vm_code {
+    struct insn *insns;
+    struct loop *loops;
+    int nregs;
+};
+
+/* State of a loop or case while it runs */
+struct reg {
+    char **v;               /* for: the words; case: v[0] is the subject */
+    int n, i;
+    int status;             /* the loop's exit status so far */
+    struct arena_mark mark; /* where an iteration's storage starts */
+};
+
+struct function {
+    char *name;
+    struct arena arena;     /* the copied body and its code */
+    struct vm_code *code;
+    int refs;               /* one for the table, one per running call */
+};
+
+/* Code running now, innermost first, for break and continue to count the
+ * loops around them */
+struct frame {
+    const struct vm_code *code;
+    const struct insn *ip;  /* the command being run */
+    int function;           /* a function body: loops outside do not count */
+    struct frame *up;
+};
+
+/* Variables a function made local, put back when it returns */
+struct local_var {
+    char *name;
+    char *old;              /* NULL if unset */
+    unsigned flags;
+};
+
+struct call_frame {
+    struct local_var *locals;
+    int nlocals, cap;
+    struct call_frame *up;
+};
+
+enum { UNWIND_BREAK = 1, UNWIND_CONTINUE, UNWIND_RETURN, UNWIND_INTERRUPT };
+
+int vm_unwinding = 0;
+static int unwind_levels;
+static int unwind_status;
+
+static struct frame *frames = NULL;
+static struct call_frame *calls = NULL;
+static int call_depth = 0;
+
+static uint32_t hash_mem(const char *s, size_t len) {
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* ---- function table ---- */
+
+struct function_slot {
+    struct function *fn;    /* NULL marks an empty slot */
+    uint32_t hash;
+};
+
+static struct function_slot *ftable = NULL;
+static size_t ftable_cap = 0;   /* always a power of two */
+static size_t ftable_used = 0;
+
+static struct function_slot *find_slot(const char *name, size_t len, uint32_t h) {
+    size_t mask = ftable_cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        struct function_slot *e = &ftable[i];
+        if (!e->fn) return e;
+        if (e->hash == h && strncmp(e->fn->name, name, len) == 0 && e->fn->name[len] == '\0') return e;
+    }
+}
+
+static int grow(void) {
+    size_t ncap = ftable_cap ? ftable_cap * 2 : 16;
+    struct function_slot *old = ftable;
+    size_t ocap = ftable_cap;
+    ftable = calloc(ncap, sizeof(*ftable));
+    if (!ftable) {
+        ftable = old;
+        return -1;
+    }
+    ftable_cap = ncap;
+    for (size_t i = 0; i < ocap; ++i) {
+        if (old[i].fn) {
+            const char *name = old[i].fn->name;
+            *find_slot(name, strlen(name), old[i].hash) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static void function_release(struct function *fn) {
+    if (--fn->refs > 0) return;
+    arena_free(&fn->arena);
+    free(fn->name);
+    free(fn);
+}
+
+const struct function *vm_function(const char *name) {
+    if (!ftable_used) return NULL;
+    size_t len = strlen(name);
+    return find_slot(name, len, hash_mem(name, len))->fn;
+}
+
+int vm_function_unset(const char *name) {
+    if (!ftable_used) return -1;
+    size_t len = strlen(name);
+    struct function_slot *e = find_slot(name, len, hash_mem(name, len));
+    if (!e->fn) return -1;
+    function_release(e->fn);
+    ftable_used--;
+
+    /* backward-shift: pull later members of the probe run into the hole */
+    size_t mask = ftable_cap - 1;
+    size_t hole = (size_t)(e - ftable);
+    for (size_t i = (hole + 1) & mask; ftable[i].fn; i = (i + 1) & mask) {
+        size_t home = ftable[i].hash & mask;
+        /* move it unless its home lies cyclically in (hole, i] */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            ftable[hole] = ftable[i];
+            hole = i;
+        }
+    }
+    ftable[hole].fn = NULL;
+    return 0;
+}
+
+/* ---- compiler ---- */
+
+struct compiler {
+    struct arena *a;
+    struct insn *insns;     /* grown on the heap, copied into the arena at the end */
+    int n, cap;
+    struct loop *loops;
+    int nloops, loops_cap;
+    int loop;               /* loop being compiled + 1 */
+    int reg, nregs;
+    const char *error;
+};
+
+static void compile_node(struct compiler *c, struct node *n);
+
+/* Returns the new instruction's index. After a failed allocation the
+ * compiler only records the error, and writes go to instruction 0. */
+static int emit(struct compiler *c, enum op op, int reg, int target) {
+    if (c->error) return 0;
+    if (c->n == c->cap) {
+        struct insn *grown = realloc(c->insns, sizeof(*grown) * (size_t)c->cap * 2);
+        if (!grown) {
+            c->error = "out of memory";
+            return 0;
+        }
+        c->insns = grown;
+        c->cap *= 2;
+    }
+    struct insn *i = &c->insns[c->n];
+    i->op = (unsigned char)op;
+    i->reg = (unsigned char)reg;
+    i->loop = (unsigned short)c->loop;
+    i->target = target;
+    i->u.node = NULL;
+    return c->n++;
+}
+
+/* Point the jump at index j to the next instruction */
+static void patch(struct compiler *c, int j) {
+    c->insns[j].target = c->n;
+}
+
+static int new_loop(struct compiler *c) {
+    if (c->error) return 0;
+    if (c->nloops == VM_MAX_LOOPS) {
+        c->error = "too many loops";
+        return 0;
+    }
+    if (c->nloops == c->loops_cap) {
+        int cap = c->loops_cap ? c->loops_cap * 2 : 8;
+        struct loop *grown = realloc(c->loops, sizeof(*grown) * (size_t)cap);
+        if (!grown) {
+            c->error = "out of memory";
+            return 0;
+        }
+        c->loops = grown;
+        c->loops_cap = cap;
+    }
+    c->loops[c->nloops].parent = c->loop;
+    return c->nloops++;
+}
+
+static int new_reg(struct compiler *c) {
+    if (c->reg == VM_MAX_REGS) {
+        c->error = "loops and case statements nested too deeply";
+        return 0;
+    }
+    int r = c->reg++;
+    if (c->reg > c->nregs) c->nregs = c->reg;
+    return r;
+}
+
+/* The call for a command of plain words naming a builtin, else NULL */
+static struct call *bind_builtin(struct compiler *c, struct node *n) {
+    if (n->u.cmd.assigns || n->u.cmd.redirs || n->u.cmd.nwords == 0) return NULL;
+    for (const struct word *w = n->u.cmd.words; w; w = w->next) {
+        if (w->flags) return NULL;
+    }
+    const struct word *first = n->u.cmd.words;
+    char *name = arena_strndup(c->a, first->text, first->len);
+    const struct builtin *bi = builtin_lookup(name);
+    if (!bi) return NULL;
+    struct call *cl = arena_alloc(c->a, sizeof(*cl));
+    cl->bi = bi;
+    cl->node = n;
+    cl->argc = n->u.cmd.nwords;
+    cl->argv = arena_alloc(c->a, sizeof(char *) * (size_t)(cl->argc + 1));
+    cl->argv[0] = name;
+    int i = 1;
+    for (const struct word *w = first->next; w; w = w->next) {
+        cl->argv[i++] = arena_strndup(c->a, w->text, w->len);
+    }
+    cl->argv[i] = NULL;
+    return cl;
+}
+
+static void compile_loop_body(struct compiler *c, int loop, struct node *body) {
+    int saved = c->loop;
+    c->loop = loop + 1;
+    compile_node(c, body);
+    c->loop = saved;
+}
+
+/*   LOOP r
+ * top: RELEASE r           <- continue
+ *   cond
+ *   JUMP_FAIL end          (JUMP_OK for until)
+ *   body
+ *   SAVE r
+ *   JUMP top
+ * end: LOAD r
+ *                          <- break */
+static void compile_while(struct compiler *c, struct node *n) {
+    int r = new_reg(c);
+    emit(c, OP_LOOP, r, 0);
+    int loop = new_loop(c);
+    int top = emit(c, OP_RELEASE, r, 0);
+    compile_loop_body(c, loop, n->u.ctl.cond);
+    int leave = emit(c, n->type == NODE_WHILE ? OP_JUMP_FAIL : OP_JUMP_OK, 0, 0);
+    compile_loop_body(c, loop, n->u.ctl.body);
+    emit(c, OP_SAVE, r, 0);
+    emit(c, OP_JUMP, 0, top);
+    patch(c, leave);
+    emit(c, OP_LOAD, r, 0);
+    if (!c->error) {
+        c->loops[loop].cont = top;
+        c->loops[loop].brk = c->n;
+    }
+    c->reg--;
+}
+
+/*   FOR_INIT r, end
+ * next: FOR_NEXT r, done   <- continue
+ *   body
+ *   SAVE r
+ *   JUMP next
+ * done: LOAD r
+ * end:                     <- break */
+static void compile_for(struct compiler *c, struct node *n) {
+    int r = new_reg(c);
+    int init = emit(c, OP_FOR_INIT, r, 0);
+    c->insns[init].u.node = n;
+    int loop = new_loop(c);
+    int next = emit(c, OP_FOR_NEXT, r, 0);
+    const struct word *var = n->u.loop.var;
+    c->insns[next].u.name = arena_strndup(c->a, var->text, var->len);
+    compile_loop_body(c, loop, n->u.loop.body);
+    emit(c, OP_SAVE, r, 0);
+    emit(c, OP_JUMP, 0, next);
+    patch(c, next);
+    emit(c, OP_LOAD, r, 0);
+    patch(c, init);
+    if (!c->error) {
+        c->loops[loop].cont = next;
+        c->loops[loop].brk = c->n;
+    }
+    c->reg--;
+}
+
+static void table_add(struct case_table *t, const struct word *w, int target) {
+    uint32_t h = hash_mem(w->text, w->len);
+    for (size_t i = h & t->mask;; i = (i + 1) & t->mask) {
+        struct case_entry *e = &t->slots[i];
+        if (!e->key) {
+            e->key = w->text;
+            e->len = w->len;
+            e->hash = h;
+            e->target = target;
+            return;
+        }
+        /* the first arm to list a pattern is the one that matches */
+        if (e->hash == h && e->len == w->len && memcmp(e->key, w->text, w->len) == 0) return;
+    }
+}
+
+static int table_find(const struct case_table *t, const char *s, size_t len) {
+    uint32_t h = hash_mem(s, len);
+    for (size_t i = h & t->mask;; i = (i + 1) & t->mask) {
+        const struct case_entry *e = &t->slots[i];
+        if (!e->key) return -1;
+        if (e->hash == h && e->len == len && memcmp(e->key, s, len) == 0) return e->target;
+    }
+}
+
+/*   CASE_INIT r, end
+ *   CASE_MATCH r, arm1     (one per arm, or a single CASE_TABLE)
+ *   ...
+ *   STATUS 0
+ *   JUMP end
+ * arm1: body; JUMP end
+ *   ...
+ * end: */
+static void compile_case(struct compiler *c, struct node *n) {
+    int r = new_reg(c);
+    int init = emit(c, OP_CASE_INIT, r, 0);
+    c->insns[init].u.words = n->u.cas.subject;
+
+    int narms = 0, npatterns = 0, literal = 1;
+    for (const struct case_item *it = n->u.cas.items; it; it = it->next) {
+        narms++;
+        for (const struct word *w = it->patterns; w; w = w->next) {
+            npatterns++;
+            if (w->flags) literal = 0;
+        }
+    }
+    int *tests = arena_alloc(c->a, sizeof(int) * (size_t)(narms ? narms : 1));
+    int table = -1, i = 0;
+    if (literal && narms > 0) {
+        table = emit(c, OP_CASE_TABLE, r, 0);
+    } else {
+        for (const struct case_item *it = n->u.cas.items; it; it = it->next) {
+            tests[i] = emit(c, OP_CASE_MATCH, r, 0);
+            c->insns[tests[i++]].u.words = it->patterns;
+        }
+    }
+    emit(c, OP_STATUS, 0, 0);
+    int *ends = arena_alloc(c->a, sizeof(int) * (size_t)(narms + 1));
+    int nends = 0;
+    ends[nends++] = emit(c, OP_JUMP, 0, 0);
+
+    i = 0;
+    for (const struct case_item *it = n->u.cas.items; it; it = it->next, ++i) {
+        int start = c->n;
+        if (it->body) compile_node(c, it->body);
+        else emit(c, OP_STATUS, 0, 0);
+        ends[nends++] = emit(c, OP_JUMP, 0, 0);
+        if (table < 0) c->insns[tests[i]].target = start;
+        else tests[i] = start;
+    }
+    for (int k = 0; k < nends; ++k) patch(c, ends[k]);
+    patch(c, init);
+
+    if (table >= 0 && !c->error) {
+        struct case_table *t = arena_alloc(c->a, sizeof(*t));
+        size_t cap = 8;
+        while (cap < (size_t)npatterns * 2) cap *= 2;
+        t->slots = arena_calloc(c->a, sizeof(*t->slots) * cap);
+        t->mask = cap - 1;
+        i = 0;
+        for (const struct case_item *it = n->u.cas.items; it; it = it->next, ++i) {
+            for (const struct word *w = it->patterns; w; w = w->next) table_add(t, w, tests[i]);
+        }
+        c->insns[table].u.table = t;
+    }
+    c->reg--;
+}
+
+static void compile_node(struct compiler *c, struct node *n) {
+    if (c->error) return;
+    if (n->type != NODE_CMD && n->redirs) {
+        /* eval_node deals with the redirections */
+        c->insns[emit(c, OP_EVAL, 0, 0)].u.node = n;
+        return;
+    }
+    switch (n->type) {
+        case NODE_CMD: {
+            struct call *cl = bind_builtin(c, n);
+            int i = emit(c, cl ? OP_BUILTIN : OP_EVAL, 0, 0);
+            if (cl) c->insns[i].u.call = cl;
+            else c->insns[i].u.node = n;
+            break;
+        }
+        case NODE_PIPELINE:
+            if (n->u.pipe.ncmds > 1) {
+                c->insns[emit(c, OP_EVAL, 0, 0)].u.node = n;
+            } else {
+                compile_node(c, n->u.pipe.cmds[0]);
+                if (n->u.pipe.bang) emit(c, OP_NOT, 0, 0);
+            }
+            break;
+        case NODE_AND:
+        case NODE_OR: {
+            compile_node(c, n->u.bin.left);
+            int j = emit(c, n->type == NODE_AND ? OP_JUMP_FAIL : OP_JUMP_OK, 0, 0);
+            compile_node(c, n->u.bin.right);
+            patch(c, j);
+            break;
+        }
+        case NODE_SEQ:
+            compile_node(c, n->u.bin.left);
+            compile_node(c, n->u.bin.right);
+            break;
+        case NODE_BACKGROUND:
+        case NODE_SUBSHELL:
+            c->insns[emit(c, OP_EVAL, 0, 0)].u.node = n;
+            break;
+        case NODE_GROUP:
+            compile_node(c, n->u.group.body);
+            break;
+        case NODE_IF: {
+            compile_node(c, n->u.ctl.cond);
+            int j = emit(c, OP_JUMP_FAIL, 0, 0);
+            compile_node(c, n->u.ctl.body);
+            int end = emit(c, OP_JUMP, 0, 0);
+            patch(c, j);
+            if (n->u.ctl.else_part) compile_node(c, n->u.ctl.else_part);
+            else emit(c, OP_STATUS, 0, 0);
+            patch(c, end);
+            break;
+        }
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            compile_while(c, n);
+            break;
+        case NODE_FOR:
+            compile_for(c, n);
+            break;
+        case NODE_CASE:
+            compile_case(c, n);
+            break;
+        case NODE_FUNCDEF:
+            c->insns[emit(c, OP_FUNCDEF, 0, 0)].u.node = n;
+            break;
+    }
+}
+
+/* NULL after printing a message */
+static struct vm_code *compile(struct arena *a, struct node *n) {
+    struct compiler c = {0};
+    c.a = a;
+    c.cap = 64;
+    c.insns = malloc(sizeof(*c.insns) * (size_t)c.cap);
+    if (!c.insns) c.error = "out of memory";
+    compile_node(&c, n);
+    emit(&c, OP_END, 0, 0);
+    struct vm_code *code = NULL;
+    if (c.error) {
+        fprintf(stderr, "kzsh: %s\n", c.error);
+    } else {
+        code = arena_alloc(a, sizeof(*code));
+        code->insns = arena_alloc(a, sizeof(*code->insns) * (size_t)c.n);
+        memcpy(code->insns, c.insns, sizeof(*code->insns) * (size_t)c.n);
+        code->loops = arena_alloc(a, sizeof(*code->loops) * (size_t)(c.nloops ? c.nloops : 1));
+        if (c.nloops) memcpy(code->loops, c.loops, sizeof(*code->loops) * (size_t)c.nloops);
+        code->nregs = c.nregs;
+    }
+    free(c.insns);
+    free(c.loops);
+    return code;
+}
+
+/* ---- execution ---- */
+
+static int define_function(struct node *n) {
+    const struct word *w = n->u.func.name;
+    struct function *fn = calloc(1, sizeof(*fn));
+    if (!fn) return 1;
+    fn->name = strndup(w->text, w->len);
+    arena_init(&fn->arena, ARENA_DEFAULT_CHUNK);
+    fn->refs = 1;
+    if (fn->name) fn->code = compile(&fn->arena, node_copy(&fn->arena, n->u.func.body));
+    if (!fn->code || ((ftable_used + 1) * 2 > ftable_cap && grow() != 0)) {
+        function_release(fn);
+        return 1;
+    }
+    size_t len = w->len;
+    uint32_t h = hash_mem(fn->name, len);
+    struct function_slot *e = find_slot(fn->name, len, h);
+    if (e->fn) function_release(e->fn);
+    else ftable_used++;
+    e->fn = fn;
+    e->hash = h;
+    return 0;
+}
+
+static int call_builtin(struct arena *a, const struct call *cl) {
+    const char *name = cl->argv[0];
+    if ((ftable_used && vm_function(name)) || (alias_count() && alias_lookup(name))) {
+        return eval_node(a, cl->node);
+    }
+    /* builtins may permute argv (getopt), so they get a copy of the array */
+    char *inline_argv[CALL_ARGV_INLINE];
+    char **argv = inline_argv;
+    if (cl->argc >= CALL_ARGV_INLINE) argv = arena_alloc(a, sizeof(char *) * (size_t)(cl->argc + 1));
+    memcpy(argv, cl->argv, sizeof(char *) * (size_t)(cl->argc + 1));
+    return cl->bi->fn(cl->argc, argv);
+}
+
+static int for_init(struct arena *a, const struct node *n, struct reg *r) {
+    r->status = 0;
+    r->i = 0;
+    if (!n->u.loop.has_in) {
+        /* for name; do: over "$@", as it is now, even if the body shifts */
+        r->n = expand_params.n;
+        r->v = arena_alloc(a, sizeof(char *) * (size_t)(r->n + 1));
+        if (r->n) memcpy(r->v, expand_params.v, sizeof(char *) * (size_t)r->n);
+    } else {
+        struct field_list fields = {0};
+        for (const struct word *w = n->u.loop.words; w; w = w->next) {
+            if (expand_word(a, w, &fields) != 0) return -1;
+        }
+        r->v = fields.v;
+        r->n = fields.n;
+    }
+    r->mark = arena_mark(a);
+    return 0;
+}
+
+/* 1 if one of the patterns matches s[0, len), -1 on an expansion error */
+static int case_match(struct arena *a, const struct word *w, const char *s, size_t len) {
+    for (; w; w = w->next) {
+        if (!w->flags) {
+            if (w->len == len && memcmp(w->text, s, len) == 0) return 1;
+            continue;
+        }
+        char *pat = expand_pattern(a, w);
+        if (!pat) return -1;
+        if (fnmatch(pat, s, 0) == 0) return 1;
+    }
+    return 0;
+}
+
+static int run(struct arena *a, const struct vm_code *code, int function) {
+    struct reg *regs = code->nregs ? arena_alloc(a, sizeof(*regs) * (size_t)code->nregs) : NULL;
+    struct frame fr = {code, code->insns, function, frames};
+    frames = &fr;
+    int status = 0;
+    const struct insn *ip = code->insns;
+    struct reg *r;
+    for (;;) {
+        switch ((enum op)ip->op) {
+            case OP_EVAL: {
+                struct arena_mark mark = arena_mark(a);
+                fr.ip = ip;
+                status = eval_node(a, ip->u.node);
+                arena_release(a, mark);
+                break;
+            }
+            case OP_BUILTIN: {
+                struct arena_mark mark = arena_mark(a);
+                fr.ip = ip;
+                status = eval_last_status = call_builtin(a, ip->u.call);
+                arena_release(a, mark);
+                break;
+            }
+            case OP_JUMP:
+                ip = code->insns + ip->target;
+                continue;
+            case OP_JUMP_OK:
+                ip = status == 0 ? code->insns + ip->target : ip + 1;
+                continue;
+            case OP_JUMP_FAIL:
+                ip = status != 0 ? code->insns + ip->target : ip + 1;
+                continue;
+            case OP_NOT:
+                status = eval_last_status = !status;
+                ip++;
+                continue;
+            case OP_STATUS:
+                status = eval_last_status = ip->target;
+                ip++;
+                continue;
+            case OP_SAVE:
+                regs[ip->reg].status = status;
+                ip++;
+                continue;
+            case OP_LOAD:
+                status = eval_last_status = regs[ip->reg].status;
+                ip++;
+                continue;
+            case OP_LOOP:
+                r = &regs[ip->reg];
+                r->status = 0;
+                r->mark = arena_mark(a);
+                ip++;
+                continue;
+            case OP_RELEASE:
+                arena_release(a, regs[ip->reg].mark);
+                if (got_sigint) {
+                    vm_unwinding = UNWIND_INTERRUPT;
+                    status = eval_last_status = 130;
+                    break;
+                }
+                ip++;
+                continue;
+            case OP_FOR_INIT:
+                fr.ip = ip;
+                if (for_init(a, ip->u.node, &regs[ip->reg]) != 0) {
+                    status = eval_last_status = 1;
+                    ip = code->insns + ip->target;
+                    continue;
+                }
+                ip++;
+                continue;
+            case OP_FOR_NEXT:
+                r = &regs[ip->reg];
+                arena_release(a, r->mark);
+                if (got_sigint) {
+                    vm_unwinding = UNWIND_INTERRUPT;
+                    status = eval_last_status = 130;
+                    break;
+                }
+                if (r->i == r->n) {
+                    ip = code->insns + ip->target;
+                    continue;
+                }
+                if (var_set(ip->u.name, r->v[r->i++], 0) != 0) {
+                    /* e.g. a readonly loop variable: the loop stops */
+                    r->status = 1;
+                    ip = code->insns + ip->target;
+                    continue;
+                }
+                ip++;
+                continue;
+            case OP_CASE_INIT: {
+                r = &regs[ip->reg];
+                fr.ip = ip;
+                expand_subst_status = -1;
+                char *s = expand_string(a, ip->u.words, 0);
+                if (!s) {
+                    status = eval_last_status = 1;
+                    ip = code->insns + ip->target;
+                    continue;
+                }
+                r->v = arena_alloc(a, sizeof(char *));
+                r->v[0] = s;
+                r->n = (int)strlen(s);
+                ip++;
+                continue;
+            }
+            case OP_CASE_MATCH:
+                r = &regs[ip->reg];
+                fr.ip = ip;
+                ip = case_match(a, ip->u.words, r->v[0], (size_t)r->n) > 0 ? code->insns + ip->target
+                                                                          : ip + 1;
+                continue;
+            case OP_CASE_TABLE: {
+                r = &regs[ip->reg];
+                int t = table_find(ip->u.table, r->v[0], (size_t)r->n);
+                ip = t >= 0 ? code->insns + t : ip + 1;
+                continue;
+            }
+            case OP_FUNCDEF:
+                status = eval_last_status = define_function(ip->u.node);
+                ip++;
+                continue;
+            case OP_END:
+                break;
+        }
+        if (ip->op == OP_END) break;
+
+        /* a command ran: it may have asked to leave loops or the function */
+        if (vm_unwinding) {
+            if (vm_unwinding != UNWIND_BREAK && vm_unwinding != UNWIND_CONTINUE) break;
+            int l = ip->loop;
+            while (l && unwind_levels > 1) {
+                l = code->loops[l - 1].parent;
+                unwind_levels--;
+            }
+            if (!l) break;
+            ip = code->insns + (vm_unwinding == UNWIND_BREAK ? code->loops[l - 1].brk
+                                                             : code->loops[l - 1].cont);
+            vm_unwinding = 0;
+            continue;
+        }
+        ip++;
+    }
+    frames = fr.up;
+    if (!frames) vm_unwinding = 0;
+    return status;
+}
+
+int vm_eval(struct arena *a, struct node *n) {
+    struct vm_code *code = compile(a, n);
+    if (!code) return 1;
+    return run(a, code, 0);
+}
+
+int vm_call(struct arena *a, const struct function *f, int argc, char **argv) {
+    struct function *fn = (struct function *)f;
+    if (call_depth == CALL_MAX_DEPTH) {
+        fprintf(stderr, "kzsh: %s: maximum function nesting level exceeded (%d)\n", argv[0],
+                CALL_MAX_DEPTH);
+        return 1;
+    }
+    struct param_list saved = expand_params;
+    struct call_frame cf = {NULL, 0, 0, calls};
+    expand_params.v = argv + 1;
+    expand_params.n = argc - 1;
+    calls = &cf;
+    call_depth++;
+    fn->refs++;
+
+    struct arena_mark mark = arena_mark(a);
+    int status = run(a, fn->code, 1);
+    arena_release(a, mark);
+    if (vm_unwinding == UNWIND_RETURN) status = unwind_status;
+    if (vm_unwinding != UNWIND_INTERRUPT) vm_unwinding = 0;
+
+    while (cf.nlocals-- > 0) {
+        struct local_var *l = &cf.locals[cf.nlocals];
+        var_restore(l->name, l->old, l->flags);
+        free(l->name);
+        free(l->old);
+    }
+    free(cf.locals);
+    calls = cf.up;
+    call_depth--;
+    expand_params = saved;
+    function_release(fn);
+    return status;
+}
+
+/* ---- builtins ---- */
+
+/* Loops around the running command, up to the function it is in */
+static int loop_depth(void) {
+    int n = 0;
+    for (const struct frame *f = frames; f; f = f->up) {
+        for (int l = f->ip->loop; l; l = f->code->loops[l - 1].parent) n++;
+        if (f->function) break;
+    }
+    return n;
+}
+
+static int loop_control(int argc, char **argv, int kind) {
+    long n = 1;
+    if (argc > 1) {
+        char *end;
+        n = strtol(argv[1], &end, 10);
+        if (*end || end == argv[1] || n < 1) {
+            fprintf(stderr, "%s: %s: loop count out of range\n", argv[0], argv[1]);
+            return 1;
+        }
+    }
+    int depth = loop_depth();
+    if (depth == 0) {
+        fprintf(stderr, "%s: only meaningful in a `for', `while', or `until' loop\n", argv[0]);
+        return 0;
+    }
+    vm_unwinding = kind;
+    unwind_levels = n < depth ? (int)n : depth;
+    return 0;
+}
+
+int builtin_break(int argc, char **argv) {
+    return loop_control(argc, argv, UNWIND_BREAK);
+}
+
+int builtin_continue(int argc, char **argv) {
+    return loop_control(argc, argv, UNWIND_CONTINUE);
+}
+
+int builtin_return(int argc, char **argv) {
+    if (!calls) {
+        fprintf(stderr, "return: can only `return' from a function\n");
+        return 1;
+    }
+    int status = eval_last_status;
+    if (argc > 1) {
+        char *end;
+        long v = strtol(argv[1], &end, 10);
+        if (*end || end == argv[1]) {
+            fprintf(stderr, "return: %s: numeric argument required\n", argv[1]);
+            status = 2;
+        } else {
+            status = (int)(v & 0xff);
+        }
+    }
+    vm_unwinding = UNWIND_RETURN;
+    unwind_status = status;
+    return status;
+}
+
+int builtin_shift(int argc, char **argv) {
+    long n = 1;
+    if (argc > 1) {
+        char *end;
+        n = strtol(argv[1], &end, 10);
+        if (*end || end == argv[1] || n < 0) {
+            fprintf(stderr, "shift: %s: numeric argument required\n", argv[1]);
+            return 1;
+        }
+    }
+    if (n > expand_params.n) return 1;
+    expand_params.v += n;
+    expand_params.n -= (int)n;
+    return 0;
+}
+
+/* local name[=value]...: without a value the variable starts out unset */
+int builtin_local(int argc, char **argv) {
+    if (!calls) {
+        fprintf(stderr, "local: can only be used in a function\n");
+        return 1;
+    }
+    int status = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *eq = strchr(argv[i], '=');
+        size_t len = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+        if (!var_valid_name(argv[i], len)) {
+            fprintf(stderr, "local: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        char *name = strndup(argv[i], len);
+        if (!name) return 1;
+        int known = 0;
+        for (int k = 0; k < calls->nlocals && !known; ++k) known = strcmp(calls->locals[k].name, name) == 0;
+        const struct var *v = var_lookup(name);
+        if (!known) {
+            if (v && (v->flags & VAR_READONLY)) {
+                fprintf(stderr, "local: %s: readonly variable\n", name);
+                free(name);
+                status = 1;
+                continue;
+            }
+            if (calls->nlocals == calls->cap) {
+                int cap = calls->cap ? calls->cap * 2 : 4;
+                struct local_var *grown = realloc(calls->locals, sizeof(*grown) * (size_t)cap);
+                if (!grown) {
+                    free(name);
+                    return 1;
+                }
+                calls->locals = grown;
+                calls->cap = cap;
+            }
+            struct local_var *l = &calls->locals[calls->nlocals++];
+            l->name = name;     /* owned by the call frame from here on */
+            l->old = v && v->set ? strdup(VAR_VALUE(v)) : NULL;
+            l->flags = v ? v->flags : 0;
+            if (!eq) var_restore(name, NULL, 0);
+        }
+        if (eq && var_set(name, eq + 1, 0) != 0) status = 1;
+        if (known) free(name);
+    }
+    return status;
+}